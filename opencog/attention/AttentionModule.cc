@@ -23,6 +23,7 @@
  */
 
 #include "AttentionModule.h"
+#include "AttentionalFocusIndex.h"
 
 #include <opencog/cogserver/server/CogServer.h>
 
@@ -64,4 +65,6 @@ AttentionModule::~AttentionModule()
 
 void AttentionModule::init()
 {
+    // Index the atoms now, rather than on the first run of an agent
+    _afIndex = af_index(_cogserver.getAtomSpace());
 }
@@ -57,6 +57,9 @@ private:
     Factory<ImportanceUpdatingAgent, Agent>  updatingFactory;
     Factory<SimpleImportanceDiffusionAgent, Agent> simpleDiffusionFactory;
 
+    //! Keeps the attentional focus index while the module is loaded
+    std::shared_ptr<AttentionalFocusIndex> _afIndex;
+
 public:
 
     static inline const char* id();
@@ -0,0 +1,311 @@
+/*
+ * opencog/attention/AttentionalFocusIndex.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <climits>
+#include <map>
+#include <memory>
+
+#include <boost/bind.hpp>
+
+#include <opencog/attention/atom_types.h>
+
+#define DEPRECATED_ATOMSPACE_CALLS
+#include <opencog/atomspace/AtomSpace.h>
+
+#include "AttentionalFocusIndex.h"
+
+using namespace opencog;
+
+static const long MIN_STI = AttentionValue::MINSTI;
+static const long MAX_STI = AttentionValue::MAXSTI;
+
+AttentionalFocusIndex::STIBuckets::STIBuckets() :
+    buckets(STI_VALUES), tree(STI_VALUES + 1, 0), total(0),
+    focusBoundary(LONG_MIN), focusCount(0)
+{
+}
+
+void AttentionalFocusIndex::STIBuckets::add(long sti, int delta)
+{
+    for (size_t i = sti - MIN_STI + 1; i <= STI_VALUES; i += i & -i)
+        tree[i] += delta;
+}
+
+size_t AttentionalFocusIndex::STIBuckets::prefix(long sti) const
+{
+    if (sti < MIN_STI)
+        return 0;
+    if (sti > MAX_STI)
+        return total;
+
+    size_t sum = 0;
+    for (size_t i = sti - MIN_STI + 1; i > 0; i -= i & -i)
+        sum += tree[i];
+    return sum;
+}
+
+size_t AttentionalFocusIndex::STIBuckets::count(long lo, long hi) const
+{
+    if (lo > hi)
+        return 0;
+    return prefix(hi) - prefix(lo - 1);
+}
+
+const Handle& AttentionalFocusIndex::STIBuckets::select(size_t rank) const
+{
+    // Walk down the Fenwick tree to the bucket holding the atom of that
+    // rank, skipping whole ranges of buckets at each step
+    size_t pos = 0;
+    for (size_t step = STI_VALUES; step > 0; step >>= 1) {
+        if (pos + step <= STI_VALUES and tree[pos + step] <= rank) {
+            pos += step;
+            rank -= tree[pos];
+        }
+    }
+    return buckets[pos][rank];
+}
+
+uint32_t AttentionalFocusIndex::STIBuckets::insert(const Handle& h, long sti)
+{
+    HandleSeq& bucket = buckets[sti - MIN_STI];
+    bucket.push_back(h);
+    add(sti, 1);
+    total++;
+    if (sti >= focusBoundary)
+        focusCount++;
+    return bucket.size() - 1;
+}
+
+Handle AttentionalFocusIndex::STIBuckets::erase(long sti, uint32_t pos)
+{
+    HandleSeq& bucket = buckets[sti - MIN_STI];
+    add(sti, -1);
+    total--;
+    if (sti >= focusBoundary)
+        focusCount--;
+
+    bucket[pos] = bucket.back();
+    bucket.pop_back();
+    return pos < bucket.size() ? bucket[pos] : Handle::UNDEFINED;
+}
+
+void AttentionalFocusIndex::STIBuckets::updateFocusCount(long boundary)
+{
+    if (boundary == focusBoundary)
+        return;
+    focusCount = count(boundary, MAX_STI);
+    focusBoundary = boundary;
+}
+
+AttentionalFocusIndex::AttentionalFocusIndex(AtomSpace& as) : _as(as)
+{
+    // Follow the changes before indexing, so that none is missed; the
+    // updates are idempotent, so an atom seen twice does no harm
+    _addConnection = _as.addAtomSignal(
+            boost::bind(&AttentionalFocusIndex::atomAdded, this, _1));
+    _removeConnection = _as.removeAtomSignal(
+            boost::bind(&AttentionalFocusIndex::atomRemoved, this, _1));
+    _AVChangedConnection = _as.AVChangedSignal(
+            boost::bind(&AttentionalFocusIndex::AVChanged, this, _1, _2, _3));
+
+    _as.foreach_handle_of_type(ATOM, &AttentionalFocusIndex::addAtom, this,
+                               true);
+}
+
+AttentionalFocusIndex::~AttentionalFocusIndex()
+{
+    _addConnection.disconnect();
+    _removeConnection.disconnect();
+    _AVChangedConnection.disconnect();
+}
+
+bool AttentionalFocusIndex::connected() const
+{
+    return _AVChangedConnection.connected();
+}
+
+void AttentionalFocusIndex::place(const Handle& h, AttentionValue::sti_t sti)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    auto it = _slots.find(h);
+    if (it == _slots.end()) {
+        Type t = h->getType();
+        Slot slot;
+        slot.sti = sti;
+        slot.pos[ALL_ATOMS] = _views[ALL_ATOMS].insert(h, sti);
+        slot.pos[NON_HEBBIAN_ATOMS] = classserver().isA(t, HEBBIAN_LINK) ?
+            NONE : _views[NON_HEBBIAN_ATOMS].insert(h, sti);
+        slot.pos[NODES] = h->isNode() ? _views[NODES].insert(h, sti) : NONE;
+        _slots.insert({h, slot});
+        return;
+    }
+
+    Slot& slot = it->second;
+    if (slot.sti == sti)
+        return;
+    for (int v = 0; v < VIEWS; v++) {
+        if (slot.pos[v] == NONE)
+            continue;
+        Handle moved = _views[v].erase(slot.sti, slot.pos[v]);
+        if (moved != Handle::UNDEFINED)
+            _slots[moved].pos[v] = slot.pos[v];
+        slot.pos[v] = _views[v].insert(h, sti);
+    }
+    slot.sti = sti;
+}
+
+void AttentionalFocusIndex::remove(const Handle& h)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+
+    auto it = _slots.find(h);
+    if (it == _slots.end())
+        return;
+
+    Slot slot = it->second;
+    _slots.erase(it);
+    for (int v = 0; v < VIEWS; v++) {
+        if (slot.pos[v] == NONE)
+            continue;
+        Handle moved = _views[v].erase(slot.sti, slot.pos[v]);
+        if (moved != Handle::UNDEFINED)
+            _slots[moved].pos[v] = slot.pos[v];
+    }
+}
+
+bool AttentionalFocusIndex::addAtom(const Handle& h)
+{
+    place(h, h->getAttentionValue()->getSTI());
+    return false;
+}
+
+void AttentionalFocusIndex::atomAdded(const Handle& h)
+{
+    addAtom(h);
+}
+
+void AttentionalFocusIndex::atomRemoved(const AtomPtr& atom)
+{
+    remove(Handle(atom));
+}
+
+void AttentionalFocusIndex::AVChanged(const Handle& h,
+                                      const AttentionValuePtr& old_av,
+                                      const AttentionValuePtr& new_av)
+{
+    place(h, new_av->getSTI());
+}
+
+long AttentionalFocusIndex::boundary()
+{
+    return _as.get_attentional_focus_boundary();
+}
+
+size_t AttentionalFocusIndex::focusSize(View v)
+{
+    long b = boundary();
+    std::lock_guard<std::mutex> lock(_mtx);
+    _views[v].updateFocusCount(b);
+    return _views[v].focusCount;
+}
+
+size_t AttentionalFocusIndex::outOfFocusSize(View v)
+{
+    long b = boundary();
+    std::lock_guard<std::mutex> lock(_mtx);
+    _views[v].updateFocusCount(b);
+    return _views[v].total - _views[v].focusCount;
+}
+
+size_t AttentionalFocusIndex::count(View v, AttentionValue::sti_t lo,
+                                    AttentionValue::sti_t hi)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _views[v].count(lo, hi);
+}
+
+Handle AttentionalFocusIndex::randomAtom(View v, AttentionValue::sti_t lo,
+                                         AttentionValue::sti_t hi,
+                                         RandGen& rng)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    const STIBuckets& view = _views[v];
+    size_t n = view.count(lo, hi);
+    if (n == 0)
+        return Handle::UNDEFINED;
+    return view.select(view.prefix(lo - 1) + rng.randint((int) n));
+}
+
+Handle AttentionalFocusIndex::randomInFocus(View v, RandGen& rng)
+{
+    return randomAtom(v, boundary(), MAX_STI, rng);
+}
+
+Handle AttentionalFocusIndex::randomOutOfFocus(View v, RandGen& rng)
+{
+    long b = boundary();
+    if (b <= MIN_STI)
+        return Handle::UNDEFINED;
+    return randomAtom(v, MIN_STI, b - 1, rng);
+}
+
+HandleSeq AttentionalFocusIndex::atoms(View v, AttentionValue::sti_t lo,
+                                       AttentionValue::sti_t hi)
+{
+    HandleSeq result;
+    std::lock_guard<std::mutex> lock(_mtx);
+    const STIBuckets& view = _views[v];
+    result.reserve(view.count(lo, hi));
+    for (long sti = lo; sti <= hi; sti++) {
+        const HandleSeq& bucket = view.buckets[sti - MIN_STI];
+        result.insert(result.end(), bucket.begin(), bucket.end());
+    }
+    return result;
+}
+
+HandleSeq AttentionalFocusIndex::focus(View v)
+{
+    return atoms(v, boundary(), MAX_STI);
+}
+
+std::shared_ptr<AttentionalFocusIndex> opencog::af_index(AtomSpace& as)
+{
+    // The indexes are only owned by their users, so that none is left
+    // behind referring to a deleted AtomSpace
+    static std::mutex mtx;
+    static std::map<AtomSpace*, std::weak_ptr<AttentionalFocusIndex>> indexes;
+
+    std::lock_guard<std::mutex> lock(mtx);
+    for (auto it = indexes.begin(); it != indexes.end(); ) {
+        if (it->second.expired())
+            it = indexes.erase(it);
+        else
+            ++it;
+    }
+
+    // An index whose AtomSpace went away has lost its signals; a new
+    // AtomSpace at the same address needs an index of its own
+    std::shared_ptr<AttentionalFocusIndex> index = indexes[&as].lock();
+    if (!index or !index->connected()) {
+        index = std::make_shared<AttentionalFocusIndex>(as);
+        indexes[&as] = index;
+    }
+    return index;
+}
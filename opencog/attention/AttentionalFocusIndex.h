@@ -0,0 +1,155 @@
+/*
+ * opencog/attention/AttentionalFocusIndex.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_ATTENTIONAL_FOCUS_INDEX_H
+#define _OPENCOG_ATTENTIONAL_FOCUS_INDEX_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/signals2.hpp>
+
+#include <opencog/util/RandGen.h>
+#include <opencog/atoms/base/Handle.h>
+#include <opencog/truthvalue/AttentionValue.h>
+
+namespace opencog
+{
+/** \addtogroup grp_attention
+ *  @{
+ */
+
+class AtomSpace;
+
+/**
+ * An index of the atoms of an AtomSpace by STI, kept up to date from the
+ * AtomSpace signals, so that the attention agents need not rebuild the
+ * attentional focus, or its complement, at every run.
+ *
+ * The atoms are kept in one bucket per STI value, with a Fenwick tree of
+ * the bucket sizes: moving an atom, counting the atoms in an STI range and
+ * picking a random atom in an STI range are all O(log n) in the number of
+ * STI values. The number of atoms in and out of the attentional focus is
+ * kept up to date with every move, and only recounted, in O(log n), when
+ * the focus boundary changes.
+ *
+ * The index has three views of the atoms: all of them, those that are not
+ * hebbian links (the atoms that diffuse importance), and the nodes.
+ */
+class AttentionalFocusIndex
+{
+public:
+    enum View { ALL_ATOMS, NON_HEBBIAN_ATOMS, NODES, VIEWS };
+
+    /** Indexes the atoms of \a as, and follows its changes. */
+    AttentionalFocusIndex(AtomSpace& as);
+    ~AttentionalFocusIndex();
+
+    /** Whether the index still follows its AtomSpace */
+    bool connected() const;
+
+    /** Number of atoms in the attentional focus, that is with an STI of
+     *  at least the focus boundary. */
+    size_t focusSize(View v = ALL_ATOMS);
+
+    /** Number of atoms out of the attentional focus */
+    size_t outOfFocusSize(View v = ALL_ATOMS);
+
+    /** Number of atoms with an STI in [lo, hi] */
+    size_t count(View v, AttentionValue::sti_t lo, AttentionValue::sti_t hi);
+
+    /** A random atom with an STI in [lo, hi], chosen uniformly, or
+     *  Handle::UNDEFINED if there is none. */
+    Handle randomAtom(View v, AttentionValue::sti_t lo,
+                      AttentionValue::sti_t hi, RandGen& rng = randGen());
+    Handle randomInFocus(View v, RandGen& rng = randGen());
+    Handle randomOutOfFocus(View v, RandGen& rng = randGen());
+
+    /** The atoms with an STI in [lo, hi], by increasing STI */
+    HandleSeq atoms(View v, AttentionValue::sti_t lo, AttentionValue::sti_t hi);
+    HandleSeq focus(View v = ALL_ATOMS);
+
+private:
+    static const size_t STI_VALUES = 1 << 16;
+    static const uint32_t NONE = UINT32_MAX;
+
+    /** The atoms of one view, by STI. */
+    struct STIBuckets
+    {
+        STIBuckets();
+
+        std::vector<HandleSeq> buckets;
+        std::vector<uint32_t> tree; //!< Fenwick tree of the bucket sizes
+        size_t total;
+
+        //! Focus size for the boundary it was last counted at
+        long focusBoundary;
+        size_t focusCount;
+
+        uint32_t insert(const Handle&, long sti);
+        /** Removes the atom at pos in the bucket of sti, and returns the
+         *  atom moved to pos to fill the gap, if any */
+        Handle erase(long sti, uint32_t pos);
+        void add(long sti, int delta);
+        size_t prefix(long sti) const; //!< Atoms with an STI <= sti
+        size_t count(long lo, long hi) const;
+        const Handle& select(size_t rank) const;
+        void updateFocusCount(long boundary);
+    };
+
+    /** Where an atom is: its STI and its position in each view */
+    struct Slot
+    {
+        long sti;
+        uint32_t pos[VIEWS];
+    };
+
+    AtomSpace& _as;
+    std::mutex _mtx;
+    STIBuckets _views[VIEWS];
+    std::unordered_map<Handle, Slot, handle_hash> _slots;
+
+    boost::signals2::connection _addConnection;
+    boost::signals2::connection _removeConnection;
+    boost::signals2::connection _AVChangedConnection;
+
+    void place(const Handle&, AttentionValue::sti_t);
+    void remove(const Handle&);
+    bool addAtom(const Handle&);
+    void atomAdded(const Handle&);
+    void atomRemoved(const AtomPtr&);
+    void AVChanged(const Handle&, const AttentionValuePtr&,
+                   const AttentionValuePtr&);
+    long boundary();
+};
+
+/**
+ * The index of the attentional focus of an AtomSpace, created on first
+ * use and shared by all the attention agents. It lives as long as one of
+ * them holds on to it, and must not be used once its AtomSpace is gone.
+ */
+std::shared_ptr<AttentionalFocusIndex> af_index(AtomSpace& as);
+
+/** @}*/
+} // namespace
+
+#endif // _OPENCOG_ATTENTIONAL_FOCUS_INDEX_H
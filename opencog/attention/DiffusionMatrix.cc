@@ -0,0 +1,113 @@
+/*
+ * opencog/attention/DiffusionMatrix.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <math.h>
+
+#define DEPRECATED_ATOMSPACE_CALLS
+#include <opencog/atomspace/AtomSpace.h>
+
+#include "DiffusionMatrix.h"
+
+using namespace opencog;
+
+DiffusionMatrix::DiffusionMatrix()
+{
+    clear();
+}
+
+void DiffusionMatrix::clear()
+{
+    _index.clear();
+    _atoms.clear();
+    _rowStart.assign(1, 0);
+    _rowAtom.clear();
+    _rowAmount.clear();
+    _column.clear();
+    _share.clear();
+    _delta.clear();
+}
+
+size_t DiffusionMatrix::indexOf(const Handle& h)
+{
+    auto it = _index.find(h);
+    if (it != _index.end())
+        return it->second;
+    _index.insert({h, _atoms.size()});
+    _atoms.push_back(h);
+    return _atoms.size() - 1;
+}
+
+void DiffusionMatrix::addRow(const Handle& source,
+                             AttentionValue::sti_t amount,
+                             const HandleSeq& targets,
+                             const std::vector<double>& shares)
+{
+    _rowAtom.push_back(indexOf(source));
+    _rowAmount.push_back(amount);
+    for (size_t i = 0; i < targets.size(); i++) {
+        _column.push_back(indexOf(targets[i]));
+        _share.push_back(shares[i]);
+    }
+    _rowStart.push_back(_column.size());
+}
+
+void DiffusionMatrix::diffuse()
+{
+    _flow.resize(_share.size());
+    _delta.assign(_atoms.size(), 0);
+
+    // The amount moved by each entry. The inner loop runs over contiguous
+    // arrays without dependencies, so that the compiler vectorizes it.
+    const double* share = _share.data();
+    double* flow = _flow.data();
+    for (size_t r = 0; r < _rowAtom.size(); r++) {
+        const double amount = _rowAmount[r];
+        const size_t end = _rowStart[r + 1];
+        for (size_t k = _rowStart[r]; k < end; k++)
+            flow[k] = floor(amount * share[k]);
+    }
+
+    // Scatter the moves; truncating to sti_t as tradeSTI() does.
+    for (size_t r = 0; r < _rowAtom.size(); r++) {
+        long given = 0;
+        for (size_t k = _rowStart[r]; k < _rowStart[r + 1]; k++) {
+            AttentionValue::sti_t moved = (AttentionValue::sti_t) flow[k];
+            _delta[_column[k]] += moved;
+            given += moved;
+        }
+        _delta[_rowAtom[r]] -= given;
+    }
+}
+
+long DiffusionMatrix::delta(const Handle& h) const
+{
+    auto it = _index.find(h);
+    if (it == _index.end() or it->second >= _delta.size())
+        return 0;
+    return _delta[it->second];
+}
+
+void DiffusionMatrix::apply(AtomSpace& as) const
+{
+    for (size_t i = 0; i < _delta.size(); i++) {
+        if (_delta[i] == 0) continue;
+        as.set_STI(_atoms[i],
+                   (AttentionValue::sti_t) (as.get_STI(_atoms[i]) + _delta[i]));
+    }
+}
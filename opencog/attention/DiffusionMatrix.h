@@ -0,0 +1,98 @@
+/*
+ * opencog/attention/DiffusionMatrix.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_DIFFUSION_MATRIX_H
+#define _OPENCOG_DIFFUSION_MATRIX_H
+
+#include <unordered_map>
+#include <vector>
+
+#include <opencog/atoms/base/Handle.h>
+#include <opencog/truthvalue/AttentionValue.h>
+
+namespace opencog
+{
+/** \addtogroup grp_attention
+ *  @{
+ */
+
+class AtomSpace;
+
+/**
+ * A snapshot of one step of importance diffusion, as a sparse matrix in
+ * compressed row (CSR) form: one row per diffusing atom, holding the
+ * share of its diffusion amount that goes to each of its targets.
+ *
+ * diffuse() computes the STI change of every atom in one pass over the
+ * matrix, and apply() writes them back with a single update per atom,
+ * instead of one read-modify-write of two atoms per diffusion event.
+ *
+ * Like a sequence of tradeSTI() calls, a step conserves STI: each entry
+ * moves floor(amount * share) from the row's atom to the column's atom,
+ * so that the changes always add up to zero.
+ */
+class DiffusionMatrix
+{
+public:
+    DiffusionMatrix();
+
+    /** Empties the matrix, keeping its memory for the next step. */
+    void clear();
+
+    /** Adds the row of a diffusing atom. */
+    void addRow(const Handle& source, AttentionValue::sti_t amount,
+                const HandleSeq& targets, const std::vector<double>& shares);
+
+    size_t rows() const { return _rowAtom.size(); }
+    size_t entries() const { return _column.size(); }
+
+    /** Computes the STI change of every atom for one step. */
+    void diffuse();
+
+    /** The STI change of an atom, as computed by the last diffuse(). */
+    long delta(const Handle&) const;
+
+    /** Adds the STI changes to the atoms. */
+    void apply(AtomSpace&) const;
+
+private:
+    /** Dense index of every atom in the matrix */
+    std::unordered_map<Handle, size_t, handle_hash> _index;
+    HandleSeq _atoms;
+
+    /** CSR storage: the entries of row r are [_rowStart[r], _rowStart[r+1]) */
+    std::vector<size_t> _rowStart;
+    std::vector<size_t> _rowAtom;
+    std::vector<double> _rowAmount;
+    std::vector<size_t> _column;
+    std::vector<double> _share;
+
+    /** Scratch: the STI moved by each entry */
+    std::vector<double> _flow;
+
+    /** STI change of each atom, by dense index */
+    std::vector<long> _delta;
+
+    size_t indexOf(const Handle&);
+};
+
+/** @}*/
+} // namespace
+
+#endif // _OPENCOG_DIFFUSION_MATRIX_H
@@ -62,6 +62,13 @@ HebbianUpdatingAgent::HebbianUpdatingAgent(CogServer& cs) :
     convertLinks = config().get_bool("ECAN_CONVERT_LINKS");
     conversionThreshold = config().get_int("ECAN_CONVERSION_THRESHOLD");
 
+    // Reads the STI of the atoms and updates the Hebbian links; with
+    // ECAN_CONVERT_LINKS it also replaces links, removing atoms along with
+    // their attention values, so it only overlaps with agents that touch
+    // none of these.
+    setResources({"atoms", "sti", "hebbian-links"},
+                 {"atoms", "sti", "hebbian-links"});
+
     // Provide a logger, but disable it initially
     log = NULL;
     setLogger(new opencog::Logger("HebbianUpdatingAgent.log", Logger::FINE, true));
@@ -29,13 +29,20 @@
 #include <opencog/util/mt19937ar.h>
 
 #define DEPRECATED_ATOMSPACE_CALLS
+#include <opencog/atoms/base/ClassServer.h>
 #include <opencog/atomspace/AtomSpace.h>
+#include "AttentionalFocusIndex.h"
 #include "ImportanceUpdatingAgent.h"
 
-#define DEBUG
-
 using namespace opencog;
 
+ImportanceUpdatingAgent::UpdateShard::UpdateShard(unsigned long s) :
+    seed(s), stiFunds(0), ltiFunds(0),
+    maxSTISeen(AttentionValue::MINSTI), minSTISeen(AttentionValue::MAXSTI),
+    stimulated(0), paidWages(false)
+{
+}
+
 ImportanceUpdatingAgent::ImportanceUpdatingAgent(CogServer& cs) :
         Agent(cs)
 {
@@ -94,6 +101,12 @@ ImportanceUpdatingAgent::ImportanceUpdatingAgent(CogServer& cs) :
 
     initialEstimateMade = false;
 
+    updateThreads = config().has("ECAN_UPDATE_THREADS") ?
+        config().get_int("ECAN_UPDATE_THREADS") : 0;
+    shardSize = config().has("ECAN_UPDATE_SHARD_SIZE") ?
+        config().get_int("ECAN_UPDATE_SHARD_SIZE") : 4096;
+    shardsInFlight = 0;
+
     rng = NULL;
 
     // Provide a logger
@@ -131,12 +144,91 @@ Logger* ImportanceUpdatingAgent::getLogger()
     return log;
 }
 
-void ImportanceUpdatingAgent::getHandlesToUpdate(AtomSpace *a, HandleSeq &hs)
+std::deque<ImportanceUpdatingAgent::UpdateShard>&
+ImportanceUpdatingAgent::forEachShard(AtomSpace* a, ShardFunction f)
+{
+    if (updateThreads != 1 and !updatePool)
+        updatePool.reset(new WorkStealingPool(updateThreads));
+
+    shards.clear();
+    shardFunction = f;
+
+    // The shard boundaries are known from the number of atoms of each
+    // type; a type's atoms are only copied when its shards are submitted.
+    Type top = updateLinks ? ATOM : NODE;
+    size_t size = std::max<size_t>(1, shardSize);
+    Type numTypes = classserver().getNumberOfClasses();
+    for (Type t = 0; t < numTypes; t++) {
+        if (not classserver().isA(t, top) or
+            0 == a->get_num_atoms_of_type(t, false))
+            continue;
+
+        std::shared_ptr<HandleSeq> atoms(new HandleSeq());
+        a->get_handles_by_type(*atoms, t, false);
+        for (size_t begin = 0; begin < atoms->size(); begin += size) {
+            size_t end = std::min(begin + size, atoms->size());
+            submitShard(HandleRange{atoms, atoms->begin() + begin,
+                                    atoms->begin() + end});
+        }
+    }
+
+    if (updatePool)
+        updatePool->wait();
+    shardFunction = nullptr;
+
+    return shards;
+}
+
+void ImportanceUpdatingAgent::submitShard(const HandleRange& atoms)
+{
+    // Seeds are drawn in order, so that a pass is as reproducible as the
+    // agent's random number generator
+    shards.emplace_back((unsigned long) getRandGen()->randint());
+    UpdateShard& shard = shards.back();
+    shard.atoms = atoms;
+
+    if (!updatePool) {
+        runShard(shard);
+        return;
+    }
+
+    // Bound the number of shards waiting for a thread, so that copying
+    // the atoms does not get ahead of the updates
+    {
+        std::unique_lock<std::mutex> lock(shardMutex);
+        shardDone.wait(lock, [this] {
+            return shardsInFlight < 2 * updatePool->size(); });
+        shardsInFlight++;
+    }
+
+    updatePool->submit([this, &shard] {
+        auto done = [this] {
+            std::lock_guard<std::mutex> lock(shardMutex);
+            shardsInFlight--;
+            shardDone.notify_one();
+        };
+        try {
+            runShard(shard);
+        } catch (...) {
+            done();
+            throw;
+        }
+        done();
+    });
+}
+
+void ImportanceUpdatingAgent::runShard(UpdateShard& shard)
+{
+    shardFunction(shard);
+    shard.atoms = HandleRange();
+}
+
+size_t ImportanceUpdatingAgent::countHandlesToUpdate(AtomSpace *a)
 {
     if (updateLinks)
-        a->get_handles_by_type(back_inserter(hs), ATOM, true);
+        return a->get_num_nodes() + a->get_num_links();
     else
-        a->get_handles_by_type(back_inserter(hs), NODE, true);
+        return a->get_num_nodes();
 }
 
 void ImportanceUpdatingAgent::calculateAtomWages(AtomSpace *a,
@@ -170,7 +262,6 @@ void ImportanceUpdatingAgent::run()
 {
     AgentSeq agents = _cogserver.runningAgents();
     AtomSpace* a = &_cogserver.getAtomSpace();
-    HandleSeq hs;
     AttentionValue::sti_t maxSTISeen = AttentionValue::MINSTI;
     AttentionValue::sti_t minSTISeen = AttentionValue::MAXSTI;
 
@@ -196,24 +287,54 @@ void ImportanceUpdatingAgent::run()
     /* Update atoms: Collect rent, pay wages */
     log->info("Collecting rent and paying wages");
 
-    getHandlesToUpdate(a, hs);
-
     /* Calculate STI/LTI atom wages for each agent */
     calculateAtomWages(a, agents);
 
-    for (Handle handle : hs) {
-        updateAtomSTI(a, agents, handle);
-        updateAtomLTI(a, agents, handle);
+    /* Check for changes to the rent and wage parameters */
+    updateRentAndWages(a);
+
+    std::deque<UpdateShard>& updated = forEachShard(a, [&](UpdateShard& shard) {
+        shard.agentSTI.resize(agents.size());
+        shard.agentLTI.resize(agents.size());
+
+        for (const Handle& handle : shard.atoms) {
+            updateAtomSTI(a, agents, handle, shard);
+            updateAtomLTI(a, agents, handle, shard);
 
-        /* Enfore sti and lti caps */
-        enforceSTICap(a, handle);
-        enforceLTICap(a, handle);
+            /* Enfore sti and lti caps */
+            enforceSTICap(a, handle);
+            enforceLTICap(a, handle);
 
-        // Greater than max sti seen?
-        if (a->get_STI(handle) > maxSTISeen) {
-            maxSTISeen = a->get_STI(handle);
-        } else if (a->get_STI(handle) < minSTISeen) {
-            minSTISeen = a->get_STI(handle);
+            AttentionValue::sti_t sti = a->get_STI(handle);
+            shard.maxSTISeen = std::max(shard.maxSTISeen, sti);
+            shard.minSTISeen = std::min(shard.minSTISeen, sti);
+        }
+    });
+
+    /* Combine the totals of the shards */
+    long stiFunds = 0, ltiFunds = 0;
+    const UpdateShard* lastPaid = NULL;
+    for (const UpdateShard& shard : updated) {
+        stiFunds += shard.stiFunds;
+        ltiFunds += shard.ltiFunds;
+        maxSTISeen = std::max(maxSTISeen, shard.maxSTISeen);
+        minSTISeen = std::min(minSTISeen, shard.minSTISeen);
+        if (shard.paidWages)
+            lastPaid = &shard;
+    }
+    a->update_STI_funds(stiFunds);
+    a->update_LTI_funds(ltiFunds);
+
+    // Agents are left with the balance they had after paying the last atom,
+    // as when the atoms are updated one after the other
+    if (lastPaid) {
+        for (size_t n = 0; n < agents.size(); n++) {
+            if (agents[n]->getTotalStimulus() == 0)
+                continue;
+            AttentionValuePtr old_av = agents[n]->getAV();
+            agents[n]->setAV(createAV(lastPaid->agentSTI[n],
+                                      lastPaid->agentLTI[n],
+                                      old_av->getVLTI()));
         }
     }
 
@@ -302,26 +423,26 @@ opencog::RandGen* ImportanceUpdatingAgent::getRandGen()
 void ImportanceUpdatingAgent::randomStimulation(AtomSpace *a, AgentPtr agent)
 {
     int expectedNum, actualNum;
-    HandleSeq hs;
-    opencog::RandGen *rng;
-
-    rng = getRandGen();
 
     // TODO: use util::lazy_random_selector and a binomial dist
     // to get actualNum
     actualNum = 0;
 
-    getHandlesToUpdate(a, hs);
-    expectedNum = (int) (noiseOdds * hs.size());
-
-    for (Handle h : hs) {
-        double r;
-        r = rng->randdouble();
-        if (r < noiseOdds) {
-            agent->stimulateAtom(h, noiseUnit);
-            actualNum++;
+    expectedNum = (int) (noiseOdds * countHandlesToUpdate(a));
+
+    std::deque<UpdateShard>& stimulated = forEachShard(a, [&](UpdateShard& shard) {
+        opencog::MT19937RandGen rng(shard.seed);
+        for (const Handle& h : shard.atoms) {
+            double r;
+            r = rng.randdouble();
+            if (r < noiseOdds) {
+                agent->stimulateAtom(h, noiseUnit);
+                shard.stimulated++;
+            }
         }
-    }
+    });
+    for (const UpdateShard& shard : stimulated)
+        actualNum += shard.stimulated;
 
     log->info("Applied stimulation randomly to %d "
               "atoms, expected about %d.",
@@ -332,31 +453,32 @@ void ImportanceUpdatingAgent::randomStimulation(AtomSpace *a, AgentPtr agent)
 void ImportanceUpdatingAgent::adjustSTIFunds(AtomSpace* a)
 {
     long diff, oldTotal;
-    AttentionValue::sti_t afterTax, beforeTax;
     double taxAmount;
-    HandleSeq hs;
 
     oldTotal = a->get_STI_funds();
     diff = targetLobeSTI - oldTotal;
-    getHandlesToUpdate(a, hs);
-    taxAmount = (double) diff / (double) hs.size();
-
-    for (Handle handle : hs) {
-        int actualTax;
-        actualTax = getTaxAmount(taxAmount);
-        beforeTax = a->get_STI(handle);
-        afterTax = beforeTax - actualTax;
-
-        a->set_STI(handle, afterTax);
-        log->fine("sti %d. Actual tax %d. after tax %d.", beforeTax, actualTax,
-                  afterTax);
-
-#ifdef DEBUG        
-        std::cout << "Atom " << handle.value() << " STI " << beforeTax
-                  << ". Tax " << actualTax << ". After tax " << afterTax << "."
-                  << std::endl;
+    taxAmount = (double) diff / (double) countHandlesToUpdate(a);
+
+    forEachShard(a, [&](UpdateShard& shard) {
+        opencog::MT19937RandGen rng(shard.seed);
+        for (const Handle& handle : shard.atoms) {
+            AttentionValue::sti_t afterTax, beforeTax;
+            int actualTax;
+            actualTax = getTaxAmount(taxAmount, rng);
+            beforeTax = a->get_STI(handle);
+            afterTax = beforeTax - actualTax;
+
+            a->set_STI(handle, afterTax);
+            log->fine("sti %d. Actual tax %d. after tax %d.", beforeTax,
+                      actualTax, afterTax);
+
+#ifdef DEBUG
+            std::cout << "Atom " << handle.value() << " STI " << beforeTax
+                      << ". Tax " << actualTax << ". After tax " << afterTax
+                      << "." << std::endl;
 #endif
-    }
+        }
+    });
 
     log->info("AtomSpace STI Funds were %d, now %d. All atoms taxed %f.",
               oldTotal, a->get_STI_funds(), taxAmount);
@@ -371,26 +493,33 @@ void ImportanceUpdatingAgent::adjustSTIFunds(AtomSpace* a)
 void ImportanceUpdatingAgent::adjustLTIFunds(AtomSpace* a)
 {
     long diff, oldTotal;
-    AttentionValue::lti_t afterTax;
     double taxAmount;
-    HandleSeq hs;
 
     oldTotal = a->get_LTI_funds();
     diff = targetLobeLTI - oldTotal;
-    getHandlesToUpdate(a, hs);
 
-    taxAmount = (double) diff / (double) hs.size();
+    taxAmount = (double) diff / (double) countHandlesToUpdate(a);
 
-    for (Handle handle : hs) {
-        afterTax = handle->getAttentionValue()->getLTI() - getTaxAmount(taxAmount);
-        handle->setLTI(afterTax);
-    }
+    forEachShard(a, [&](UpdateShard& shard) {
+        opencog::MT19937RandGen rng(shard.seed);
+        for (const Handle& handle : shard.atoms) {
+            AttentionValue::lti_t afterTax;
+            afterTax = handle->getAttentionValue()->getLTI()
+                       - getTaxAmount(taxAmount, rng);
+            handle->setLTI(afterTax);
+        }
+    });
 
     log->info("AtomSpace LTI Funds were %d, now %d. All atoms taxed %.2f.",
               oldTotal, a->get_LTI_funds(), taxAmount);
 }
 
 int ImportanceUpdatingAgent::getTaxAmount(double mean)
+{
+    return getTaxAmount(mean, *getRandGen());
+}
+
+int ImportanceUpdatingAgent::getTaxAmount(double mean, opencog::RandGen& rng)
 {
     double sum, prob, p;
     int count = 0;
@@ -404,7 +533,7 @@ int ImportanceUpdatingAgent::getTaxAmount(double mean)
     base = (int) mean;
     mean = mean - base;
     // Calculates tax amount by sampling a Poisson distribution
-    p = getRandGen()->randdouble_one_excluded();
+    p = rng.randdouble_one_excluded();
     prob = sum = exp(-mean);
 
     while (p > sum) {
@@ -498,23 +627,22 @@ void ImportanceUpdatingAgent::updateLTIRent(AtomSpace* a)
 
 void ImportanceUpdatingAgent::updateAttentionalFocusSizes(AtomSpace* a)
 {
-    int n = 0;
-    HandleSeq inFocus;
-
+    if (!afIndex)
+        afIndex = af_index(*a);
+    AttentionalFocusIndex& index = *afIndex;
     AttentionValue::sti_t threshold = a->get_attentional_focus_boundary()
             + amnesty;
-    a->get_handles_by_AV(back_inserter(inFocus), threshold);
 
-    attentionalFocusSize.update(inFocus.size());
+    attentionalFocusSize.update(
+            index.count(AttentionalFocusIndex::ALL_ATOMS, threshold,
+                        AttentionValue::MAXSTI));
 
     log->fine("attentionalFocusSize = %d, recent = %f",
               attentionalFocusSize.val, attentionalFocusSize.recent);
 
-    for (Handle h : inFocus) {
-        if (a->is_node(h))
-            n += 1;
-    }
-    attentionalFocusNodesSize.update(n);
+    attentionalFocusNodesSize.update(
+            index.count(AttentionalFocusIndex::NODES, threshold,
+                        AttentionValue::MAXSTI));
 
     log->fine("attentionalFocusNodesSize = %d, recent = %f",
               attentionalFocusNodesSize.val, attentionalFocusNodesSize.recent);
@@ -568,11 +696,9 @@ void ImportanceUpdatingAgent::updateAgentLTI(AtomSpace* a, AgentPtr agent)
 }
 
 void ImportanceUpdatingAgent::updateAtomSTI(AtomSpace* a,
-                                            const AgentSeq &agents, Handle h)
+                                            const AgentSeq &agents, Handle h,
+                                            UpdateShard& shard)
 {
-    // Check for changes to the rent and wage parameters
-    updateRentAndWages(a);
-
     AttentionValue::sti_t current = a->get_STI(h);
     AttentionValue::sti_t stiRentCharged = calculateSTIRent(a, current);
 
@@ -590,12 +716,10 @@ void ImportanceUpdatingAgent::updateAtomSTI(AtomSpace* a,
             wage = (float) STIAtomWage;
         exchangeAmount += (AttentionValue::sti_t) wage * s;
 
-        a->update_STI_funds(exchangeAmount);
-
-        AttentionValuePtr old_av = agents[n]->getAV();
-        AttentionValuePtr new_av =
-        createAV(current - exchangeAmount, old_av->getLTI(), old_av->getVLTI());
-        agents[n]->setAV(new_av);
+        // The funds and the agent are updated once the whole pass is done
+        shard.stiFunds += exchangeAmount;
+        shard.agentSTI[n] = current - exchangeAmount;
+        shard.paidWages = true;
     }
     a->set_STI(h, current + exchangeAmount);
 
@@ -676,7 +800,8 @@ AttentionValue::sti_t ImportanceUpdatingAgent::calculateSTIRent(
 }
 
 void ImportanceUpdatingAgent::updateAtomLTI(AtomSpace* a,
-                                            const AgentSeq &agents, Handle h)
+                                            const AgentSeq &agents, Handle h,
+                                            UpdateShard& shard)
 {
     /* collect LTI */
     AttentionValue::lti_t current = h->getAttentionValue()->getLTI();
@@ -692,13 +817,10 @@ void ImportanceUpdatingAgent::updateAtomLTI(AtomSpace* a,
             wage = (float) LTIAtomWage;
         exchangeAmount += (AttentionValue::lti_t) (wage * s);
 
-        a->update_LTI_funds(exchangeAmount);
-
-        AttentionValuePtr old_av = agents[n]->getAV();
-        AttentionValuePtr new_av = createAV(old_av->getSTI(), current
-                - exchangeAmount, old_av->getVLTI());
-
-        agents[n]->setAV(new_av);
+        // The funds and the agent are updated once the whole pass is done
+        shard.ltiFunds += exchangeAmount;
+        shard.agentLTI[n] = current - exchangeAmount;
+        shard.paidWages = true;
     }
 
     h->setLTI(current + exchangeAmount);
@@ -755,6 +877,18 @@ bool ImportanceUpdatingAgent::getUpdateLinksFlag() const
     return updateLinks;
 }
 
+void ImportanceUpdatingAgent::setUpdateThreads(unsigned int n)
+{
+    if (n != updateThreads)
+        updatePool.reset();
+    updateThreads = n;
+}
+
+void ImportanceUpdatingAgent::setShardSize(size_t n)
+{
+    shardSize = n > 0 ? n : 1;
+}
+
 std::string ImportanceUpdatingAgent::toString()
 {
     std::ostringstream s;
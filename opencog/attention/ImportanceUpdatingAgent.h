@@ -24,9 +24,14 @@
 #ifndef _OPENCOG_IMPORTANCE_UPDATING_AGENT_H
 #define _OPENCOG_IMPORTANCE_UPDATING_AGENT_H
 
-#include <string>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <string>
 
 #include <opencog/util/Logger.h>
 #include <opencog/util/RandGen.h>
@@ -36,6 +41,7 @@
 #include <opencog/truthvalue/AttentionValue.h>
 #include <opencog/cogserver/server/CogServer.h>
 #include <opencog/cogserver/server/Agent.h>
+#include <opencog/concurrency/WorkStealingPool.h>
 
 class ImportanceUpdatingAgentUTest;
 
@@ -45,6 +51,7 @@ namespace opencog
  *  @{
  */
 
+class AttentionalFocusIndex;
 class CogServer;
 
 /** ImportantUpdatingAgent updates the AttentionValues of atoms.
@@ -104,6 +111,12 @@ class CogServer;
  * recalculates the optimal rent based on decaying measures of the AtomSpace
  * size and number of atoms in the attentional focus.
  *
+ * The passes over all the atoms (wages and rent, taxes, random stimulation)
+ * are sharded: the atoms of each type are split in shards of
+ * ECAN_UPDATE_SHARD_SIZE atoms, which are updated in parallel by
+ * ECAN_UPDATE_THREADS threads. Each shard keeps its own totals of the funds
+ * moved, and these are combined once the pass is done.
+ *
  * @todo Remove the conversion of stimulus to STI/LTI from
  * ImportanceUpdatingAgent. Create a opencog::MindAgent function that converts stimulus
  * into STI/LTI as well as resetting the stimulus map. This function should be
@@ -210,22 +223,101 @@ private:
      */
     void updateAgentLTI(AtomSpace* a, AgentPtr agent);
 
+    /** The atoms of one shard of an update pass, along with what the pass
+     * computed for them. Each shard is updated by a single thread.
+     */
+    /** A range of the atoms of one type, sharing their copy with the
+     * other ranges of that type.
+     */
+    struct HandleRange
+    {
+        std::shared_ptr<const HandleSeq> seq;
+        HandleSeq::const_iterator first, last;
+
+        HandleSeq::const_iterator begin() const { return first; }
+        HandleSeq::const_iterator end() const { return last; }
+    };
+
+    struct UpdateShard
+    {
+        UpdateShard(unsigned long seed);
+
+        HandleRange atoms;
+        unsigned long seed; //!< Seed for the random numbers of this shard
+
+        long stiFunds; //!< STI to add to the AtomSpace funds
+        long ltiFunds; //!< LTI to add to the AtomSpace funds
+        AttentionValue::sti_t maxSTISeen;
+        AttentionValue::sti_t minSTISeen;
+        int stimulated; //!< Atoms stimulated by randomStimulation
+
+        //! Whether agentSTI and agentLTI were set by this shard
+        bool paidWages;
+        //! Balance of each agent after paying the last atom of the shard
+        std::vector<AttentionValue::sti_t> agentSTI;
+        std::vector<AttentionValue::lti_t> agentLTI;
+    };
+    typedef std::function<void(UpdateShard&)> ShardFunction;
+
+    unsigned int updateThreads; //!< Threads of the update passes, 0 for one per core
+    size_t shardSize; //!< Number of atoms per shard
+    std::unique_ptr<WorkStealingPool> updatePool;
+
+    std::shared_ptr<AttentionalFocusIndex> afIndex;
+
+    //! Shards of the current pass. A deque, so that shards being updated
+    //! stay in place while new ones are added.
+    std::deque<UpdateShard> shards;
+    ShardFunction shardFunction;
+    std::mutex shardMutex;
+    std::condition_variable shardDone;
+    size_t shardsInFlight;
+
+    /** Runs \a f on every atom to update (all atoms or all nodes,
+     * depending on \a updateLinks), one shard at a time, in parallel.
+     *
+     * The shards are ranges of the atoms of a single type. The atoms are
+     * copied out of the AtomSpace one type at a time, with no callback
+     * running under its lock, and each copy is released as soon as the
+     * shards of its type are updated. Only a couple of shards per thread
+     * are queued at once, so that the copies don't get ahead of the
+     * updates.
+     *
+     * @param a The AtomSpace to work on.
+     * @param f The function to run on each shard.
+     * @return The shards, for their totals to be combined; their atoms
+     *         are released as soon as they are updated.
+     */
+    std::deque<UpdateShard>& forEachShard(AtomSpace* a, ShardFunction f);
+    void submitShard(const HandleRange& atoms);
+    void runShard(UpdateShard& shard);
+
+    /** Counts the atoms that forEachShard visits, without visiting them.
+     *
+     * @param a The AtomSpace to work on.
+     */
+    size_t countHandlesToUpdate(AtomSpace* a);
+
     /** Collect STI rent for atoms within attentional focus
      * and pay wages based on amount of stimulus.
      *
      * @param a The AtomSpace the Agent is working on.
      * @param agents The list of running agents.
      * @param h The Handle of the atom to update.
+     * @param shard The shard of \a h, which accumulates the funds moved.
      */
-    void updateAtomSTI(AtomSpace* a, const AgentSeq& agents, Handle h);
+    void updateAtomSTI(AtomSpace* a, const AgentSeq& agents, Handle h,
+                       UpdateShard& shard);
 
     /** Collect LTI rent for all atoms and pay wages based on stimulation
      *
      * @param a The AtomSpace the Agent is working on.
      * @param agents The list of running agents.
      * @param h The Handle of the atom to update.
+     * @param shard The shard of \a h, which accumulates the funds moved.
      */
-    void updateAtomLTI(AtomSpace* a, const AgentSeq &agents, Handle h);
+    void updateAtomLTI(AtomSpace* a, const AgentSeq &agents, Handle h,
+                       UpdateShard& shard);
 
     /** Cap STI values to the maximum to prevent atoms
      * becoming all important.
@@ -301,8 +393,10 @@ private:
      * from a Poisson distribution for the remainder.
      *
      * @param mean The mean tax that would be charged if STI/LTI were a float.
+     * @param rng The random number generator to sample with.
      * @return An integer amount of tax to charge
      */
+    int getTaxAmount(double mean, opencog::RandGen& rng);
     int getTaxAmount(double mean);
 
     /** Get Random number generator associated with Agent,
@@ -333,14 +427,6 @@ private:
      */
     void updateTotalStimulus(const AgentSeq &agents);
 
-    /** Gets either handles of all Atoms or all Nodes, depending on
-     * \a updateLinks.
-     *
-     * @param a The AtomSpace to work on.
-     * @param hs The HandleSeq to add handles to.
-     */
-    void getHandlesToUpdate(AtomSpace* a, HandleSeq& hs);
-
     void updateRentAndWages(AtomSpace*);
 
     /** Set the agent's logger object
@@ -402,6 +488,18 @@ public:
      */
     bool getUpdateLinksFlag() const;
 
+    /** Set the number of threads of the update passes.
+     *
+     * @param n number of threads, 0 for one per core.
+     */
+    void setUpdateThreads(unsigned int n);
+
+    /** Set the number of atoms in each shard of the update passes.
+     *
+     * @param n number of atoms.
+     */
+    void setShardSize(size_t n);
+
     inline AttentionValue::sti_t getSTIAtomWage() const
         { return STIAtomWage; }
     inline AttentionValue::lti_t getLTIAtomWage() const
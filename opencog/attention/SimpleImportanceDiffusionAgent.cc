@@ -25,6 +25,8 @@
 #include <time.h>
 #include <math.h>
 
+#include <algorithm>
+
 #include <opencog/util/algorithm.h>
 #include <opencog/util/Config.h>
 #include <opencog/util/mt19937ar.h>
@@ -39,6 +41,7 @@
 #include <opencog/atomspace/AtomSpace.h>
 #include <opencog/cogserver/server/CogServer.h>
 
+#include "AttentionalFocusIndex.h"
 #include "SimpleImportanceDiffusionAgent.h"
 #include "SpreadDecider.h"
 
@@ -58,6 +61,8 @@ SimpleImportanceDiffusionAgent::SimpleImportanceDiffusionAgent(CogServer& cs) :
     setSpreadHebbianOnly(config().get_bool("ECAN_SPREAD_HEBBIAN_ONLY"));
     setHebbianMaxAllocationPercentage(
                 config().get_double("HEBBIAN_MAX_ALLOCATION_PERCENTAGE"));
+    setUseDiffusionMatrix(config().has("ECAN_DIFFUSION_ENGINE") and
+                          config()["ECAN_DIFFUSION_ENGINE"] == "matrix");
 
     // Provide a logger
     log = NULL;
@@ -141,6 +146,16 @@ void SimpleImportanceDiffusionAgent::setSpreadHebbianOnly(bool option)
     spreadHebbianOnly = option;
 }
 
+/*
+ * Set whether the diffusion is computed as a sparse matrix and applied in
+ * bulk (when the parameter is True), or computed and traded one diffusion
+ * event at a time (when the parameter is False).
+ */
+void SimpleImportanceDiffusionAgent::setUseDiffusionMatrix(bool option)
+{
+    useDiffusionMatrix = option;
+}
+
 void SimpleImportanceDiffusionAgent::setSpreadDecider(int type, float shape)
 {
     if (spreadDecider) {
@@ -171,7 +186,10 @@ void SimpleImportanceDiffusionAgent::run()
 {
     as = &_cogserver.getAtomSpace();
     spreadDecider->setFocusBoundary(0);
-    spreadImportance();
+    if (useDiffusionMatrix)
+        spreadImportanceMatrix();
+    else
+        spreadImportance();
 }
 
 /*
@@ -207,6 +225,98 @@ void SimpleImportanceDiffusionAgent::spreadImportance()
     SimpleImportanceDiffusionAgent::processDiffusionStack();
 }
 
+/*
+ * Carries out the same importance diffusion as spreadImportance(), but
+ * snapshots all the diffusion events of the step into a sparse matrix,
+ * and then applies the resulting STI changes with one update per atom
+ */
+void SimpleImportanceDiffusionAgent::spreadImportanceMatrix()
+{
+    updateMaxSpreadPercentage();
+    diffusionMatrix.clear();
+
+    HandleSeq targets;
+    std::vector<double> shares;
+    for (Handle atomSource : diffusionSourceVector())
+    {
+        // Same decision and amount as diffuseAtom()
+        if (not spreadDecider->spreadDecision(as->get_STI(atomSource)))
+            continue;
+
+        AttentionValue::sti_t totalDiffusionAmount = (AttentionValue::sti_t)
+                round(as->get_STI(atomSource) * maxSpreadPercentage);
+        if (totalDiffusionAmount == 0)
+            continue;
+
+        diffusionRow(atomSource, targets, shares);
+        diffusionMatrix.addRow(atomSource, totalDiffusionAmount,
+                               targets, shares);
+    }
+
+    diffusionMatrix.diffuse();
+    diffusionMatrix.apply(*as);
+}
+
+/*
+ * Computes the combined probability vector of diffuseAtom() as two flat
+ * vectors, without building the intermediate maps.
+ *
+ * The arithmetic is kept exactly as in probabilityVectorIncident(),
+ * probabilityVectorHebbianAdjacent() and combineIncidentAdjacentVectors(),
+ * in the same order, so that both engines round the same way. In
+ * particular, the targets are visited in handle order, as the maps do, and
+ * a target that is both hebbian adjacent and incident keeps its hebbian
+ * share only.
+ */
+void SimpleImportanceDiffusionAgent::diffusionRow(Handle source,
+        HandleSeq& targets, std::vector<double>& shares)
+{
+    targets.clear();
+    shares.clear();
+
+    HandleSeq incident = incidentAtoms(source);
+    HandleSeq adjacent = hebbianAdjacentAtoms(source);
+
+    double incidentShare = 1.0f / incident.size();
+    double maxAllocation = 1.0 / adjacent.size();
+
+    std::sort(incident.begin(), incident.end());
+    incident.erase(std::unique(incident.begin(), incident.end()),
+                   incident.end());
+    std::sort(adjacent.begin(), adjacent.end());
+    adjacent.erase(std::unique(adjacent.begin(), adjacent.end()),
+                   adjacent.end());
+
+    double diffusionAvailable = 1.0;
+    double hebbianDiffusionAvailable =
+            hebbianMaxAllocationPercentage * diffusionAvailable;
+    double hebbianMaximumLinkAllocation =
+            hebbianDiffusionAvailable / adjacent.size();
+    double hebbianDiffusionUsed = 0.0;
+
+    for (const Handle& target : adjacent)
+    {
+        Handle link = as->get_handle(ASYMMETRIC_HEBBIAN_LINK, source, target);
+        double probability =
+                maxAllocation * calculateHebbianDiffusionPercentage(link);
+        double diffusionAmount = hebbianMaximumLinkAllocation * probability;
+
+        targets.push_back(target);
+        shares.push_back(diffusionAmount);
+        hebbianDiffusionUsed += diffusionAmount;
+    }
+
+    diffusionAvailable -= hebbianDiffusionUsed;
+
+    for (const Handle& target : incident)
+    {
+        if (std::binary_search(adjacent.begin(), adjacent.end(), target))
+            continue;
+        targets.push_back(target);
+        shares.push_back(diffusionAvailable * incidentShare);
+    }
+}
+
 /*
  * Diffuses importance from one atom to its non-hebbian incident atoms
  * and hebbian adjacent atoms
@@ -338,51 +448,16 @@ void SimpleImportanceDiffusionAgent::tradeSTI(DiffusionEventType event)
  */
 HandleSeq SimpleImportanceDiffusionAgent::diffusionSourceVector()
 {
-    // Retrieve the atoms in the AttentionalFocus
-    HandleSeq resultSet;
-    as->get_handle_set_in_attentional_focus(back_inserter(resultSet));
+    // Retrieve the atoms in the AttentionalFocus, without the hebbian
+    // links, from the index maintained for the attention agents
+    if (!afIndex)
+        afIndex = af_index(*as);
+    HandleSeq resultSet =
+            afIndex->focus(AttentionalFocusIndex::NON_HEBBIAN_ATOMS);
 
 #ifdef DEBUG
     std::cout << "Calculating diffusionSourceVector." << std::endl;
-    std::cout << "AF Size before removing hebbian links: " <<
-                 resultSet.size() << "\n";
-#endif
-
-    // Remove the hebbian links
-    auto it_end =
-        std::remove_if(resultSet.begin(), resultSet.end(),
-                       [=](const Handle& h)
-                       {
-                           Type type = as->get_type(h);
-
-#ifdef DEBUG
-                           std::cout << "Checking atom of type: " <<
-                                        classserver().getTypeName(type) << "\n";
-#endif
-
-                           if (type == ASYMMETRIC_HEBBIAN_LINK ||
-                               type == HEBBIAN_LINK ||
-                               type == SYMMETRIC_HEBBIAN_LINK ||
-                               type == INVERSE_HEBBIAN_LINK ||
-                               type == SYMMETRIC_INVERSE_HEBBIAN_LINK)
-                           {
-#ifdef DEBUG
-                               std::cout << "Atom is hebbian" << "\n";
-#endif
-                               return true;
-                           }
-                           else
-                           {
-#ifdef DEBUG
-                               std::cout << "Atom is not hebbian" << "\n";
-#endif
-                               return false;
-                           }
-                       });
-    resultSet.erase(it_end, resultSet.end());
-
-#ifdef DEBUG
-    std::cout << "AF Size after removing hebbian links: " <<
+    std::cout << "AF Size without hebbian links: " <<
     resultSet.size() << "\n";
 #endif
 
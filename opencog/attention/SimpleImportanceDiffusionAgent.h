@@ -33,6 +33,7 @@
 #include <opencog/cogserver/server/Agent.h>
 #include <opencog/util/Logger.h>
 #include <opencog/util/RandGen.h>
+#include "DiffusionMatrix.h"
 #include "SpreadDecider.h"
 
 namespace opencog
@@ -41,6 +42,7 @@ namespace opencog
  *  @{
  */
 
+class AttentionalFocusIndex;
 class CogServer;
 
 /** Diffuses short term importance between atoms in the attentional focus.
@@ -55,6 +57,11 @@ class CogServer;
  * (2) Diffusion to atoms that are adjacent to each atom, where the type of
  *     the connecting edge is a hebbian link
  * 
+ * The diffusion of a step is either computed one event at a time and
+ * traded through a stack (the default), or, when the configuration
+ * parameter ECAN_DIFFUSION_ENGINE is "matrix", snapshotted into a sparse
+ * DiffusionMatrix and applied in bulk. Both give the same STI values.
+ *
  * Please refer to the detailed description of this agent in the README file,
  * where an extensive explanation of the algorithm, features and pending
  * work is explained.
@@ -67,7 +74,10 @@ private:
     float maxSpreadPercentage;
     float hebbianMaxAllocationPercentage;
     bool spreadHebbianOnly;
+    bool useDiffusionMatrix;
+    DiffusionMatrix diffusionMatrix;
     SpreadDecider* spreadDecider;
+    std::shared_ptr<AttentionalFocusIndex> afIndex;
     void setLogger(Logger* l);
     Logger *log;
     
@@ -82,6 +92,8 @@ private:
     void processDiffusionStack();
     
     void spreadImportance();
+    void spreadImportanceMatrix();
+    void diffusionRow(Handle, HandleSeq&, std::vector<double>&);
     void diffuseAtom(Handle);
     HandleSeq diffusionSourceVector();
     HandleSeq incidentAtoms(Handle);
@@ -103,6 +115,7 @@ public:
     void setMaxSpreadPercentage(float);
     void setHebbianMaxAllocationPercentage(float);
     void setSpreadHebbianOnly(bool);
+    void setUseDiffusionMatrix(bool);
     SimpleImportanceDiffusionAgent(CogServer&);
     virtual ~SimpleImportanceDiffusionAgent();
     virtual void run();
@@ -25,6 +25,7 @@
 #include <opencog/atoms/base/Link.h>
 #include <opencog/truthvalue/IndefiniteTruthValue.h>
 #include <opencog/truthvalue/SimpleTruthValue.h>
+#include <opencog/attention/AttentionalFocusIndex.h>
 #include <opencog/attention/atom_types.h>
 #include <opencog/atomutils/Neighbors.h>
 
@@ -59,13 +60,15 @@ void HebbianCreationAgent::run()
     if (classserver().isA(source->getType(), HEBBIAN_LINK))
         return;
 
-    HandleSeq notAttentionalFocus;
+    if (!afIndex)
+        afIndex = af_index(*_as);
+    AttentionalFocusIndex& index = *afIndex;
     int afb = _as->get_attentional_focus_boundary();
-    _as->get_handles_by_AV(back_inserter(notAttentionalFocus),0,afb);
 
-   // Retrieve the atoms in the AttentionalFocus
-    OrderedHandleSet attentionalFocus;
-    _as->get_handle_set_in_attentional_focus(std::inserter(attentionalFocus,attentionalFocus.begin()));
+    // Retrieve the atoms in the AttentionalFocus, leaving out the
+    // HebbianLinks for the same reason as above
+    HandleSeq focus = index.focus(AttentionalFocusIndex::NON_HEBBIAN_ATOMS);
+    OrderedHandleSet attentionalFocus(focus.begin(), focus.end());
 
     // Exclude the source atom
     attentionalFocus.erase(source);
@@ -104,14 +107,18 @@ void HebbianCreationAgent::run()
     }
 
     std::default_random_engine generator;
-    std::uniform_int_distribution<int> distribution(0,notAttentionalFocus.size()-1);
 
     //How many links outside the AF should be created
     int farLinks = round(count / localToFarLinks);
 
-    //Pick a random target and create the link if it doesn't exist already
+    //Pick a random target and create the link if it doesn't exist already.
+    //The targets are sampled from the index, without listing the atoms
+    //outside of the AF.
     for (int i = 0; i < farLinks; i++) {
-        Handle target = notAttentionalFocus[distribution(generator)];
+        Handle target = index.randomAtom(AttentionalFocusIndex::NON_HEBBIAN_ATOMS,
+                                         0, afb);
+        if (target == Handle::UNDEFINED)
+            break;
         Handle link = _as->get_handle(ASYMMETRIC_HEBBIAN_LINK, source, target);
         if (link == Handle::UNDEFINED)
             addHebbian(source,target);
@@ -39,6 +39,7 @@ namespace opencog
 
 extern concurrent_queue<Handle> newAtomsInAV;
 
+class AttentionalFocusIndex;
 class CogServer;
 
 /**
@@ -71,6 +72,8 @@ protected:
     //should be created
     int localToFarLinks;
 
+    std::shared_ptr<AttentionalFocusIndex> afIndex;
+
 public:
 
     virtual const ClassInfo& classinfo() const { return info(); }
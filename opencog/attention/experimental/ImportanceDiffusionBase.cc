@@ -24,6 +24,7 @@
  */
 #include <time.h>
 #include <math.h>
+#include <unordered_map>
 
 #include <opencog/util/algorithm.h>
 #include <opencog/util/Config.h>
@@ -33,6 +34,7 @@
 #include <opencog/atomutils/FollowLink.h>
 #include <opencog/atomutils/Neighbors.h>
 #include <opencog/atoms/base/Link.h>
+#include <opencog/attention/AttentionalFocusIndex.h>
 #include <opencog/attention/atom_types.h>
 
 #define DEPRECATED_ATOMSPACE_CALLS
@@ -56,6 +58,8 @@ ImportanceDiffusionBase::ImportanceDiffusionBase(CogServer& cs) : Agent(cs)
     setSpreadHebbianOnly(config().get_bool("ECAN_SPREAD_HEBBIAN_ONLY"));
     setHebbianMaxAllocationPercentage(
                 config().get_double("HEBBIAN_MAX_ALLOCATION_PERCENTAGE"));
+    setUseDiffusionMatrix(config().has("ECAN_DIFFUSION_ENGINE") and
+                          config()["ECAN_DIFFUSION_ENGINE"] == "matrix");
 
     // TODO
     // Read diffusion rate from config file.
@@ -131,6 +135,16 @@ void ImportanceDiffusionBase::setSpreadHebbianOnly(bool option)
     spreadHebbianOnly = option;
 }
 
+/*
+ * Set whether the diffusion events are applied in bulk through a
+ * DiffusionMatrix (when the parameter is True), or traded one at a time
+ * (when the parameter is False).
+ */
+void ImportanceDiffusionBase::setUseDiffusionMatrix(bool option)
+{
+    useDiffusionMatrix = option;
+}
+
 void ImportanceDiffusionBase::setSpreadDecider(int type, float shape)
 {
     if (spreadDecider) {
@@ -290,59 +304,21 @@ void ImportanceDiffusionBase::tradeSTI(DiffusionEventType event)
  */
 HandleSeq ImportanceDiffusionBase::diffusionSourceVector(bool af_only)
 {
-
-    HandleSeq resultSet;
-
-    if(af_only)
-        _as->get_handle_set_in_attentional_focus(back_inserter(resultSet));
-    else
-        _as->get_all_atoms(resultSet);
+    // The atoms without the hebbian links, from the index maintained for
+    // the attention agents
+    if (!afIndex)
+        afIndex = af_index(*_as);
+    HandleSeq resultSet = af_only ?
+        afIndex->focus(AttentionalFocusIndex::NON_HEBBIAN_ATOMS) :
+        afIndex->atoms(AttentionalFocusIndex::NON_HEBBIAN_ATOMS,
+                    AttentionValue::MINSTI, AttentionValue::MAXSTI);
 
 #ifdef DEBUG
     std::cout << "Calculating diffusionSourceVector." << std::endl;
-    std::cout << "AF Size before removing hebbian links: " <<
-                 resultSet.size() << "\n";
-#endif
-
-    // Remove the hebbian links
-    auto it_end =
-        std::remove_if(resultSet.begin(), resultSet.end(),
-                       [=](const Handle& h)
-                       {
-                           Type type = _as->get_type(h);
-
-#ifdef DEBUG
-                           std::cout << "Checking atom of type: " <<
-                                        classserver().getTypeName(type) << "\n";
-#endif
-
-                           if (type == ASYMMETRIC_HEBBIAN_LINK ||
-                               type == HEBBIAN_LINK ||
-                               type == SYMMETRIC_HEBBIAN_LINK ||
-                               type == INVERSE_HEBBIAN_LINK ||
-                               type == SYMMETRIC_INVERSE_HEBBIAN_LINK)
-                           {
-#ifdef DEBUG
-                               std::cout << "Atom is hebbian" << "\n";
-#endif
-                               return true;
-                           }
-                           else
-                           {
-#ifdef DEBUG
-                               std::cout << "Atom is not hebbian" << "\n";
-#endif
-                               return false;
-                           }
-                       });
-    resultSet.erase(it_end, resultSet.end());
-
-#ifdef DEBUG
-    std::cout << "AF Size after removing hebbian links: " <<
+    std::cout << "Size without hebbian links: " <<
     resultSet.size() << "\n";
 #endif
 
-
     return resultSet;
 }
 
@@ -598,10 +574,30 @@ void ImportanceDiffusionBase::processDiffusionStack()
     AttentionValue::sti_t totalAmountTraded = 0;
 #endif
 
+    // The events of each source become one row of the matrix, with a row
+    // amount of 1 and each event's amount as the share of its target.
+    // The amounts are whole STI, so floor(1 * amount) moves exactly the
+    // amount of the event, as tradeSTI() would.
+    std::unordered_map<Handle, size_t, handle_hash> sourceRow;
+    HandleSeq rowSources;
+    std::vector<HandleSeq> rowTargets;
+    std::vector<std::vector<double>> rowShares;
+
     while (!diffusionStack.empty())
     {
         DiffusionEventType event = diffusionStack.top();
-        ImportanceDiffusionBase::tradeSTI(event);
+        if (useDiffusionMatrix) {
+            auto it = sourceRow.find(event.source);
+            if (it == sourceRow.end()) {
+                it = sourceRow.insert({event.source, rowSources.size()}).first;
+                rowSources.push_back(event.source);
+                rowTargets.emplace_back();
+                rowShares.emplace_back();
+            }
+            rowTargets[it->second].push_back(event.target);
+            rowShares[it->second].push_back(event.amount);
+        } else
+            ImportanceDiffusionBase::tradeSTI(event);
         diffusionStack.pop();
 
 #ifdef DEBUG
@@ -609,6 +605,14 @@ void ImportanceDiffusionBase::processDiffusionStack()
 #endif
     }
 
+    if (useDiffusionMatrix) {
+        diffusionMatrix.clear();
+        for (size_t r = 0; r < rowSources.size(); r++)
+            diffusionMatrix.addRow(rowSources[r], 1, rowTargets[r], rowShares[r]);
+        diffusionMatrix.diffuse();
+        diffusionMatrix.apply(*_as);
+    }
+
 #ifdef DEBUG
     // Each trade occurs bidirectionally. Therefore, if you add up all the
     // trades, it should be equal to twice the amount that was diffused
@@ -34,6 +34,7 @@
 #include <opencog/cogserver/server/Agent.h>
 #include <opencog/util/Logger.h>
 #include <opencog/util/RandGen.h>
+#include <opencog/attention/DiffusionMatrix.h>
 #include <opencog/attention/SpreadDecider.h>
 
 namespace opencog
@@ -42,6 +43,7 @@ namespace opencog
  *  @{
  */
 
+class AttentionalFocusIndex;
 class CogServer;
 
 /**
@@ -56,7 +58,10 @@ protected:
     float maxSpreadPercentage;
     float hebbianMaxAllocationPercentage;
     bool spreadHebbianOnly;
+    bool useDiffusionMatrix;
+    DiffusionMatrix diffusionMatrix;
     SpreadDecider* spreadDecider;
+    std::shared_ptr<AttentionalFocusIndex> afIndex;
 
     typedef struct DiffusionEventType
     {
@@ -92,6 +97,7 @@ public:
     void setMaxSpreadPercentage(float);
     void setHebbianMaxAllocationPercentage(float);
     void setSpreadHebbianOnly(bool);
+    void setUseDiffusionMatrix(bool);
 
     ImportanceDiffusionBase(CogServer&);
     virtual ~ImportanceDiffusionBase();
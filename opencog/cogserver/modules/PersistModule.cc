@@ -61,6 +61,7 @@ std::string PersistModule::do_close(Request *dummy, std::list<std::string> args)
 	if (!args.empty())
 		return "sql-close: Error: Unexpected argument\n";
 
+	std::lock_guard<std::mutex> lock(_api_mtx);
 	try
 	{
 		_api->do_close();
@@ -78,6 +79,7 @@ std::string PersistModule::do_load(Request *dummy, std::list<std::string> args)
 	if (!args.empty())
 		return "sql-load: Error: Unexpected argument\n";
 
+	std::lock_guard<std::mutex> lock(_api_mtx);
 	try
 	{
 		_api->do_load();
@@ -101,6 +103,7 @@ std::string PersistModule::do_open(Request *dummy, std::list<std::string> args)
 	std::string username = args.front(); args.pop_front();
 	std::string auth     = args.front(); args.pop_front();
 
+	std::lock_guard<std::mutex> lock(_api_mtx);
 	try
 	{
 		_api->do_open(dbname, username, auth);
@@ -119,6 +122,7 @@ std::string PersistModule::do_store(Request *dummy, std::list<std::string> args)
 	if (!args.empty())
 		return "sql-store: Error: Unexpected argument\n";
 
+	std::lock_guard<std::mutex> lock(_api_mtx);
 	try
 	{
 		_api->do_store();
@@ -24,6 +24,8 @@
 #ifndef _OPENCOG_PERSIST_MODULE_H
 #define _OPENCOG_PERSIST_MODULE_H
 
+#include <mutex>
+
 #include <opencog/persist/sql/odbc/SQLPersistSCM.h>
 #include <opencog/cogserver/server/CogServer.h>
 #include <opencog/cogserver/server/Module.h>
@@ -40,13 +42,18 @@ class PersistModule : public Module
 private:
     SQLPersistSCM *_api;
 
-    DECLARE_CMD_REQUEST(PersistModule, "sql-close", do_close, 
+    // The commands run off the server thread, concurrently with the
+    // agents and other requests, since a bulk load or store takes long;
+    // they only share the backend, which they take turns on.
+    std::mutex _api_mtx;
+
+    DECLARE_CMD_REQUEST_KIND(PersistModule, "sql-close", do_close, 
        "Close the SQL database", 
        "Usage: sql-close\n\n"
        "Close the currently open SQL database", 
-       false, false)
+       false, false, LONG_RUNNING_REQUEST)
 
-    DECLARE_CMD_REQUEST(PersistModule, "sql-load", do_load,
+    DECLARE_CMD_REQUEST_KIND(PersistModule, "sql-load", do_load,
        "Load contents of SQL database",
        "Usage: sql-load\n\n"
        "Load the contents of the currently open SQL database to the\n"
@@ -54,25 +61,25 @@ private:
        "is a bulk load -- *all* atoms in the database will be loaded.\n"
        "The loading ocurrs in a distinct thread; this command only initiates\n"
        "the loading.", 
-       false, false)
+       false, false, LONG_RUNNING_REQUEST)
 
 public:
-    DECLARE_CMD_REQUEST(PersistModule, "sql-open", do_open,
+    DECLARE_CMD_REQUEST_KIND(PersistModule, "sql-open", do_open,
        "Open connection to SQL storage",
        "Usage: sql-open <dbname> <username> <auth-passwd>\n\n"
        "Open a connection to an SQL database, for saving or restoring\n"
        "atomtable contents. If the tables needed to hold atomtable\n"
        "information do not yet exist, they will be created.",
-       false, false)
+       false, false, LONG_RUNNING_REQUEST)
 
 private:
-    DECLARE_CMD_REQUEST(PersistModule, "sql-store", do_store,
+    DECLARE_CMD_REQUEST_KIND(PersistModule, "sql-store", do_store,
        "Save the atomtable on the SQL database",
        "Usage: sql-store\n\n"
        "Save the contents of the atomtable into the currently open SQL\n"
        "database.  This is a bulk-save -- all atoms will be saved. They can\n"
        "be loaded at a later time with the sql-load command.",
-       false, false)
+       false, false, LONG_RUNNING_REQUEST)
 
 public:
     const char* id(void);
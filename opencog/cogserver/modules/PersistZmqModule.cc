@@ -60,6 +60,7 @@ std::string PersistZmqModule::do_close(Request *dummy, std::list<std::string> ar
 	if (!args.empty())
 		return "zmq-close: Error: Unexpected argument\n";
 
+	std::lock_guard<std::mutex> lock(_api_mtx);
 	try
 	{
 		_api->do_close();
@@ -77,6 +78,7 @@ std::string PersistZmqModule::do_load(Request *dummy, std::list<std::string> arg
 	if (!args.empty())
 		return "zmq-load: Error: Unexpected argument\n";
 
+	std::lock_guard<std::mutex> lock(_api_mtx);
 	try
 	{
 		_api->do_load();
@@ -101,6 +103,7 @@ std::string PersistZmqModule::do_open(Request *dummy, std::list<std::string> arg
 		networkAddress = "tcp://127.0.0.1:5555";
 	}
 
+	std::lock_guard<std::mutex> lock(_api_mtx);
 	try
 	{
 		_api->do_open(networkAddress);
@@ -119,6 +122,7 @@ std::string PersistZmqModule::do_store(Request *dummy, std::list<std::string> ar
 	if (!args.empty())
 		return "zmq-store: Error: Unexpected argument\n";
 
+	std::lock_guard<std::mutex> lock(_api_mtx);
 	try
 	{
 		_api->do_store();
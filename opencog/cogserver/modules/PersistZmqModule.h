@@ -25,6 +25,8 @@
 #ifndef _OPENCOG_PERSIST_ZMQ_MODULE_H
 #define _OPENCOG_PERSIST_ZMQ_MODULE_H
 
+#include <mutex>
+
 #include <opencog/persist/zmq/atomspace/ZMQPersistSCM.h>
 #include <opencog/cogserver/server/CogServer.h>
 #include <opencog/cogserver/server/Module.h>
@@ -41,13 +43,18 @@ class PersistZmqModule : public Module
 private:
     ZMQPersistSCM *_api;
 
-    DECLARE_CMD_REQUEST(PersistZmqModule, "zmq-close", do_close,
+    // The commands run off the server thread, concurrently with the
+    // agents and other requests, since a bulk load or store takes long;
+    // they only share the backend, which they take turns on.
+    std::mutex _api_mtx;
+
+    DECLARE_CMD_REQUEST_KIND(PersistZmqModule, "zmq-close", do_close,
        "Close the ZeroMQ persistence",
        "Usage: zmq-close\n\n"
        "Close the currently open ZeroMQ persistence",
-       false, false)
+       false, false, LONG_RUNNING_REQUEST)
 
-    DECLARE_CMD_REQUEST(PersistZmqModule, "zmq-load", do_load,
+    DECLARE_CMD_REQUEST_KIND(PersistZmqModule, "zmq-load", do_load,
        "Load contents of ZeroMQ persistence",
        "Usage: zmq-load\n\n"
        "Load the contents of the currently open ZeroMQ persistence to the\n"
@@ -55,25 +62,25 @@ private:
        "is a bulk load -- *all* atoms in the database will be loaded.\n"
        "The loading ocurrs in a distinct thread; this command only initiates\n"
        "the loading.", 
-       false, false)
+       false, false, LONG_RUNNING_REQUEST)
 
 public:
-    DECLARE_CMD_REQUEST(PersistZmqModule, "zmq-open", do_open,
+    DECLARE_CMD_REQUEST_KIND(PersistZmqModule, "zmq-open", do_open,
        "Open connection to ZeroMQ persistence",
        "Usage: zmq-open <dbname> <username> <auth-passwd>\n\n"
        "Open a connection to a ZeroMQ persistence, for saving or restoring\n"
        "atomtable contents. If the tables needed to hold atomtable\n"
        "information do not yet exist, they will be created.",
-       false, false)
+       false, false, LONG_RUNNING_REQUEST)
 
 private:
-    DECLARE_CMD_REQUEST(PersistZmqModule, "zmq-store", do_store,
+    DECLARE_CMD_REQUEST_KIND(PersistZmqModule, "zmq-store", do_store,
        "Save the atomtable on the ZeroMQ persistence",
        "Usage: zmq-store\n\n"
        "Save the contents of the atomtable into the currently open ZeroMQ persistence.\n"
        "This is a bulk-save -- all atoms will be saved. They can\n"
        "be loaded at a later time with the sql-load command.",
-       false, false)
+       false, false, LONG_RUNNING_REQUEST)
 
 public:
     const char* id(void);
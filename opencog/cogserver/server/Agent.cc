@@ -31,7 +31,8 @@
 
 using namespace opencog;
 
-Agent::Agent(CogServer& cs, const unsigned int f) : _cogserver(cs), _frequency(f)
+Agent::Agent(CogServer& cs, const unsigned int f) : _cogserver(cs),
+    _frequency(f), _period(0), _deadlineMisses(0), _resourcesDeclared(false)
 {
     STIAtomWage = config().get_int("ECAN_STARTING_ATOM_STI_WAGE");
     LTIAtomWage = config().get_int("ECAN_STARTING_ATOM_LTI_WAGE");
@@ -53,6 +54,7 @@ Agent::Agent(CogServer& cs, const unsigned int f) : _cogserver(cs), _frequency(f
 
     stimulatedAtoms = new AtomStimHashMap();
     totalStimulus = 0;
+    _profile = nullptr;
 
     conn = _cogserver.getAtomSpace().removeAtomSignal(
             boost::bind(&Agent::atomRemoved, this, _1));
@@ -99,6 +101,35 @@ void Agent::setParameters(const std::string* params)
     }
 }
 
+void Agent::setResources(const AgentResourceSet& reads,
+                         const AgentResourceSet& writes)
+{
+    _readSet = reads;
+    _writeSet = writes;
+    _resourcesDeclared = true;
+}
+
+static bool intersects(const AgentResourceSet& a, const AgentResourceSet& b)
+{
+    AgentResourceSet::const_iterator ia = a.begin(), ib = b.begin();
+    while (ia != a.end() and ib != b.end()) {
+        if (*ia < *ib) ++ia;
+        else if (*ib < *ia) ++ib;
+        else return true;
+    }
+    return false;
+}
+
+bool Agent::conflictsWith(const Agent& other) const
+{
+    if (this == &other) return true;
+    if (not _resourcesDeclared or not other._resourcesDeclared) return true;
+
+    return intersects(_writeSet, other._writeSet)
+        or intersects(_writeSet, other._readSet)
+        or intersects(_readSet, other._writeSet);
+}
+
 std::string Agent::to_string() const
 {
     std::ostringstream oss;
@@ -27,6 +27,9 @@
 
 #include <atomic>
 #include <mutex>
+#include <chrono>
+#include <memory>
+#include <set>
 #include <string>
 #include <unordered_map>
 
@@ -48,7 +51,17 @@ namespace opencog
 typedef short stim_t;
 typedef std::unordered_map<Handle, stim_t, handle_hash> AtomStimHashMap;
 
+/** Names of the shared resources an agent reads or writes, see
+ *  Agent::setResources(): "atoms" for the atoms in the AtomSpace (adding
+ *  or removing one writes it), "sti" for their attention values,
+ *  "hebbian-links" for the truth values of the Hebbian links. */
+typedef std::set<std::string> AgentResourceSet;
+
 class CogServer;
+class AgentActivityLog;
+struct AgentProfile;
+class Profiler;
+class SystemActivityTable;
 
 /** The MindAgent Class
  * This class defines the base abstract class that should be extended by all
@@ -133,6 +146,27 @@ protected:
      *  will be executed every 2 cycles; and so on. */
     int _frequency;
 
+    /** The agent's wall-clock period. If non-zero, it replaces the
+     *  frequency: the agent is run whenever this much time has passed
+     *  since its previous deadline, independently of the server cycles. */
+    std::chrono::milliseconds _period;
+
+    /** Number of periods that elapsed without the agent being run */
+    std::atomic<unsigned long> _deadlineMisses;
+
+    /** The shared resources this agent reads and writes during run(). Only
+     *  meaningful if _resourcesDeclared is true; an agent that declared
+     *  nothing is assumed to touch everything. */
+    AgentResourceSet _readSet;
+    AgentResourceSet _writeSet;
+    bool _resourcesDeclared;
+
+    /** Declares the resources this agent reads and writes, allowing the
+     *  parallel scheduler to run it concurrently with agents it does not
+     *  conflict with. Should be called from the derived constructor. */
+    void setResources(const AgentResourceSet& reads,
+                      const AgentResourceSet& writes);
+
     /** Sets the list of parameters for this agent and their default values.
      * If any parameter values are unspecified in the Config singleton, sets
      * them to the default values.
@@ -176,6 +210,18 @@ protected:
 
     Logger *log; //!< Logger object for Agent
 
+    /** Where the SystemActivityTable logs the runs of this agent. Set by
+     *  the thread running the agent, and reset by clearActivity() from
+     *  any thread, so it is only accessed with std::atomic_load and
+     *  std::atomic_store. */
+    friend class SystemActivityTable;
+    std::shared_ptr<AgentActivityLog> _activityLog;
+
+    /** The Profiler's record for this agent's class, cached on first
+     *  run. */
+    friend class Profiler;
+    AgentProfile* _profile;
+
 public:
 
     /** Return the agent's logger object
@@ -204,9 +250,34 @@ public:
     /** Sets the agent's frequency. */
     virtual void setFrequency(int frequency) { _frequency=frequency; }
 
+    /** Returns the agent's wall-clock period; zero if the agent is
+     *  scheduled by frequency. */
+    std::chrono::milliseconds period(void) const { return _period; }
+
+    /** Sets the agent's wall-clock period; zero reverts to frequency
+     *  based scheduling. */
+    void setPeriod(std::chrono::milliseconds period) { _period = period; }
+
+    /** Returns how many periods elapsed without the agent being run. */
+    unsigned long deadlineMisses(void) const { return _deadlineMisses; }
+
+    /** Called by the agent runner when the agent ran late. */
+    void addDeadlineMisses(unsigned long n) { _deadlineMisses += n; }
+
     /** Returns the agent's class info. */
     virtual const ClassInfo& classinfo() const = 0;
 
+    /** Returns true if the agent declared its read/write resources. */
+    bool resourcesDeclared() const { return _resourcesDeclared; }
+
+    const AgentResourceSet& readSet() const { return _readSet; }
+    const AgentResourceSet& writeSet() const { return _writeSet; }
+
+    /** Returns true if this agent may not run concurrently with 'other',
+     *  i.e. if either of them writes a resource the other one reads or
+     *  writes, or if either of them did not declare its resources. */
+    bool conflictsWith(const Agent& other) const;
+
     /** Dumps the agent's name and all its configuration parameters
      * to a string. */
     std::string to_string() const;
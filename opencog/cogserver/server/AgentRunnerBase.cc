@@ -18,7 +18,10 @@
  */
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <functional>
+#include <memory>
 #include <opencog/cogserver/server/AgentRunnerBase.h>
 #include <opencog/cogserver/server/CogServer.h>
 #include <opencog/util/Logger.h>
@@ -111,33 +114,40 @@ void AgentRunnerBase::remove_all_agents()
 
 void AgentRunnerBase::run_agent(AgentPtr a)
 {
-    size_t mem_start = getMemUsage();
-    int atoms_start = atomspace().get_size();
+    SystemActivityTable& sat = cogserver().systemActivityTable();
+
+    // Memory usage and atomspace size are too costly to be measured on
+    // every run of a fast agent; they are only sampled now and then.
+    bool probe = sat.probeDue(a);
+    size_t mem_start = 0;
+    size_t atoms_start = 0;
+    if (probe) {
+        mem_start = getMemUsage();
+        atoms_start = atomspace().get_size();
+    }
 
     logger().debug("[CogServer::%s] begin to run mind agent: %s, [cycle = %d]",
                    name.c_str(), a->classinfo().id.c_str(), cycle_count);
 
-    auto timer_start = system_clock::now();
+    // the run is timed with the steady clock, which a change of the
+    // system time can't make jump
+    auto timer_start = steady_clock::now();
 
     a->resetUtilizedHandleSets();
     a->run();
 
-    auto timer_end = system_clock::now();
-
-    size_t mem_end = getMemUsage();
-    int atoms_end = atomspace().get_size();
+    auto timer_end = steady_clock::now();
 
-    size_t mem_used;
-    if (mem_start > mem_end)
-        mem_used = 0;
-    else
-        mem_used = mem_end - mem_start;
-
-    int atoms_used;
-    if (atoms_start > atoms_end)
-        atoms_used = 0;
-    else
-        atoms_used = atoms_end - atoms_start;
+    size_t mem_used = 0;
+    size_t atoms_used = 0;
+    if (probe) {
+        size_t mem_end = getMemUsage();
+        size_t atoms_end = atomspace().get_size();
+        if (mem_end > mem_start)
+            mem_used = mem_end - mem_start;
+        if (atoms_end > atoms_start)
+            atoms_used = atoms_end - atoms_start;
+    }
 
     auto elapsed = timer_end - timer_start;
     auto elapsed_secs = duration_cast<duration<float>>(elapsed).count();
@@ -146,19 +156,146 @@ void AgentRunnerBase::run_agent(AgentPtr a)
             a->classinfo().id.c_str(), elapsed_secs, mem_used, atoms_used,
             cycle_count);
 
-    cogserver().systemActivityTable().logActivity(a, elapsed, mem_used,
-        atoms_used);
+    sat.logActivity(a, duration_cast<system_clock::duration>(elapsed),
+                    mem_used, atoms_used, probe);
+    cogserver().profiler().recordAgentRun(*a, elapsed, probe, atoms_used);
 }
 
 void SimpleRunner::process_agents()
 {
-    AgentSeq::const_iterator it;
-    for (it = agents.begin(); it != agents.end(); ++it) {
-        AgentPtr agent = *it;
-        if ((cycle_count % agent->frequency()) == 0)
-            run_agent(agent);
+    AgentSeq due;
+    for (const AgentPtr &agent : agents)
+        if (agent->period() == milliseconds::zero() and
+            (cycle_count % agent->frequency()) == 0)
+            due.push_back(agent);
+    select_timed_agents(clock::now(), due);
+
+    try {
+        run_agents(due);
+    } catch (...) {
+        ++cycle_count;
+        throw;
     }
     ++cycle_count;
 }
 
+void SimpleRunner::process_timed_agents()
+{
+    if (deadlines.empty()) return;
+
+    AgentSeq due;
+    select_timed_agents(clock::now(), due);
+    if (!due.empty())
+        run_agents(due);
+}
+
+SimpleRunner::clock::time_point SimpleRunner::next_deadline() const
+{
+    clock::time_point next = clock::time_point::max();
+    for (const auto &a : agents) {
+        if (a->period() == milliseconds::zero()) continue;
+        auto d = deadlines.find(a.get());
+        // a timed agent that never ran is due right away
+        if (d == deadlines.end()) return clock::now();
+        next = min(next, d->second);
+    }
+    return next;
+}
+
+void SimpleRunner::select_timed_agents(clock::time_point now, AgentSeq &due)
+{
+    for (const AgentPtr &agent : agents) {
+        milliseconds period = agent->period();
+        if (period == milliseconds::zero()) continue;
+
+        auto d = deadlines.find(agent.get());
+        if (d == deadlines.end()) {
+            deadlines[agent.get()] = now + period;
+            due.push_back(agent);
+            continue;
+        }
+        if (now < d->second) continue;
+
+        // every whole period we slept through is a missed deadline
+        unsigned long missed = (now - d->second) / period;
+        if (missed > 0) {
+            agent->addDeadlineMisses(missed);
+            logger().debug("[CogServer::%s] agent %s missed %lu deadline(s)",
+                name.c_str(), agent->classinfo().id.c_str(), missed);
+        }
+        d->second += period * (missed + 1);
+        due.push_back(agent);
+    }
+}
+
+void SimpleRunner::prune_deadlines()
+{
+    for (auto d = deadlines.begin(); d != deadlines.end();) {
+        bool found = std::any_of(agents.begin(), agents.end(),
+            [&d](const AgentPtr &a) { return a.get() == d->first; });
+        if (found) ++d;
+        else d = deadlines.erase(d);
+    }
+}
+
+void SimpleRunner::run_agents(const AgentSeq &due)
+{
+    for (const AgentPtr &agent : due)
+        run_agent(agent);
+}
+
+ParallelRunner::ParallelRunner(unsigned int num_threads,
+        const std::string &name): SimpleRunner(name), pool(num_threads)
+{
+    logger().info("[CogServer::%s] running agents on %u threads",
+        name.c_str(), pool.size());
+}
+
+void ParallelRunner::run_agents(const AgentSeq &due)
+{
+    size_t n = due.size();
+    if (n == 0) return;
+
+    // An agent waits for every earlier due agent it conflicts with, so
+    // conflicting agents keep the relative order SimpleRunner gives them.
+    vector<vector<size_t>> successors(n);
+    unique_ptr<atomic<unsigned int>[]> blockers(new atomic<unsigned int>[n]);
+    vector<size_t> roots;
+    for (size_t i = 0; i < n; ++i) {
+        unsigned int count = 0;
+        for (size_t j = 0; j < i; ++j) {
+            if (due[i]->conflictsWith(*due[j])) {
+                successors[j].push_back(i);
+                ++count;
+            }
+        }
+        blockers[i].store(count);
+        if (count == 0)
+            roots.push_back(i);
+    }
+
+    function<void(size_t)> launch;
+    auto release = [&](size_t i) {
+        for (size_t s : successors[i])
+            if (blockers[s].fetch_sub(1) == 1)
+                launch(s);
+    };
+    launch = [&](size_t i) {
+        pool.submit([&, i] {
+            try {
+                run_agent(due[i]);
+            } catch (...) {
+                release(i);
+                throw;
+            }
+            release(i);
+        });
+    };
+
+    for (size_t i : roots)
+        launch(i);
+
+    pool.wait();
+}
+
 } /* namespace opencog */
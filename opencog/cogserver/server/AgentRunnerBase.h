@@ -20,9 +20,12 @@
 #ifndef OPENCOG_SERVER_AGENTRUNNERBASE_H_
 #define OPENCOG_SERVER_AGENTRUNNERBASE_H_
 
+#include <chrono>
+#include <map>
 #include <string>
 #include <vector>
 #include <opencog/cogserver/server/Agent.h>
+#include <opencog/concurrency/WorkStealingPool.h>
 
 namespace opencog
 {
@@ -38,7 +41,7 @@ class AgentRunnerBase
     public:
         AgentRunnerBase(std::string runner_name = "unnamed");
         AgentRunnerBase(AgentRunnerBase &&tmp) = default;
-        ~AgentRunnerBase();
+        virtual ~AgentRunnerBase();
 
         void set_name(std::string new_name);
         const std::string &get_name() const;
@@ -76,10 +79,18 @@ class AgentRunnerBase
 /**
  * This class calls Agent::run() for its agents each time process_agents() is
  * called. This provides the classical behavior of CogServer.
+ *
+ * Agents with a non-zero \link Agent::period() period \endlink are not
+ * scheduled by cycle count but by wall-clock time: they run whenever their
+ * deadline has passed, either as part of a cycle or from
+ * process_timed_agents(). Each full period that elapses before such an
+ * agent gets to run is counted as a deadline miss.
  */
 class SimpleRunner: public AgentRunnerBase
 {
     public:
+        typedef std::chrono::steady_clock clock;
+
         SimpleRunner(const std::string &name = "simple"): AgentRunnerBase(name)
         {}
 
@@ -87,11 +98,18 @@ class SimpleRunner: public AgentRunnerBase
         void add_agent(AgentPtr a) { AgentRunnerBase::add_agent(a); }
 
         /** Removes agent 'a' from the list of scheduled agents. */
-        void remove_agent(AgentPtr a) { AgentRunnerBase::remove_agent(a); }
+        void remove_agent(AgentPtr a)
+        {
+            AgentRunnerBase::remove_agent(a);
+            prune_deadlines();
+        }
 
         /** Removes all agents from class 'id' */
         void remove_all_agents(const std::string &id)
-        { AgentRunnerBase::remove_all_agents(id); }
+        {
+            AgentRunnerBase::remove_all_agents(id);
+            prune_deadlines();
+        }
 
         const AgentSeq &get_agents() const { return agents; }
 
@@ -101,9 +119,67 @@ class SimpleRunner: public AgentRunnerBase
          *
          * Each call to process_agents() is a processing cycle, and it selects
          * agents to run in each cycle based on their \link Agent::_frequency
-         * frequency \endlink property.
+         * frequency \endlink property, plus the timed agents whose deadline
+         * has passed.
          */
         void process_agents();
+
+        /**
+         * Runs the timed agents whose deadline has passed, without starting
+         * a new cycle.
+         */
+        void process_timed_agents();
+
+        /**
+         * Returns the earliest deadline among the timed agents, or
+         * clock::time_point::max() if there are none.
+         */
+        clock::time_point next_deadline() const;
+
+    protected:
+        /** Next deadline of each timed agent */
+        std::map<const Agent*, clock::time_point> deadlines;
+
+        /** Appends the timed agents that are due at 'now' to 'due', and
+         * moves their deadline forward. */
+        void select_timed_agents(clock::time_point now, AgentSeq &due);
+
+        /** Forgets the deadlines of agents that are no longer scheduled. */
+        void prune_deadlines();
+
+        /** Runs the given agents; they are all due in the current step. */
+        virtual void run_agents(const AgentSeq &due);
+};
+
+
+/**
+ * This class runs the agents that are due in a cycle concurrently on a
+ * work-stealing thread pool, so that a cycle takes about as long as its
+ * longest agent rather than the sum of all of them.
+ *
+ * Agents are selected exactly as in SimpleRunner. Two agents that
+ * conflict (see Agent::conflictsWith()) never run at the same time; the
+ * one added first runs first. Agents that do not declare their
+ * resources conflict with everything, so they keep their classical
+ * serial behavior.
+ *
+ * If an agent throws, the agents that depend on it still run and the
+ * first exception is rethrown once all of them are finished.
+ */
+class ParallelRunner: public SimpleRunner
+{
+    public:
+        /** A thread count of 0 means one thread per hardware thread. */
+        ParallelRunner(unsigned int num_threads = 0,
+                       const std::string &name = "parallel");
+
+        unsigned int get_num_threads() const { return pool.size(); }
+
+    protected:
+        void run_agents(const AgentSeq &due);
+
+    private:
+        WorkStealingPool pool;
 };
 
 } /* namespace opencog */
@@ -73,6 +73,8 @@ void BuiltinRequestsModule::registerAgentRequests()
     do_stopAgentLoop_register();
     do_listAgents_register();
     do_activeAgents_register();
+
+    do_metrics_register();
 }
 
 void BuiltinRequestsModule::unregisterAgentRequests()
@@ -93,6 +95,8 @@ void BuiltinRequestsModule::unregisterAgentRequests()
     do_stopAgentLoop_unregister();
     do_listAgents_unregister();
     do_activeAgents_unregister();
+
+    do_metrics_unregister();
 }
 
 void BuiltinRequestsModule::init()
@@ -354,3 +358,23 @@ std::string BuiltinRequestsModule::do_activeAgents(Request *dummy, std::list<std
 
     return oss.str();
 }
+
+// ====================================================================
+// Profiling
+std::string BuiltinRequestsModule::do_metrics(Request *dummy, std::list<std::string> args)
+{
+    Profiler& profiler = _cogserver.profiler();
+
+    if (args.empty())
+        return profiler.summary();
+
+    if (args.size() == 1 and args.front() == "-p")
+        return profiler.exposition();
+
+    if (args.size() == 1 and args.front() == "-r") {
+        profiler.reset();
+        return "Reset all metrics\n";
+    }
+
+    return do_metricsRequest::info().help;
+}
@@ -85,19 +85,21 @@ DECLARE_CMD_REQUEST(BuiltinRequestsModule, ".", do_dot,
        "Close the shell TCP/IP connection.\n",
        false, true)
 
-DECLARE_CMD_REQUEST(BuiltinRequestsModule, "help", do_help,
+DECLARE_CMD_REQUEST_KIND(BuiltinRequestsModule, "help", do_help,
        "List the available commands or print the help for a specific command",
        "Usage: help [<command>]\n\n"
        "If no command is specified, then print a menu of commands.\n"
        "Otherwise, print verbose help for the indicated command.\n",
-       false, false)
+       false, false,
+       READ_ONLY_REQUEST)
 
-DECLARE_CMD_REQUEST(BuiltinRequestsModule, "h", do_h,
+DECLARE_CMD_REQUEST_KIND(BuiltinRequestsModule, "h", do_h,
        "List the available commands or print the help for a specific command",
        "Usage: h [<command>]\n\n"
        "If no command is specified, then print a menu of commands.\n"
        "Otherwise, print verbose help for the indicated command.\n",
-       false, true)
+       false, true,
+       READ_ONLY_REQUEST)
 
 // I'm adding the agent control commands via the macro syntax
 // (it's much more convenient than adding several new .cc/.h files). -- Jared Wigmore
@@ -138,11 +140,12 @@ DECLARE_CMD_REQUEST(BuiltinRequestsModule, "agents-start-loop", do_startAgentLoo
        "Start the agent loop (that is, start running agents during the CogServer loop).\n",
        false, false)
 
-DECLARE_CMD_REQUEST(BuiltinRequestsModule, "agents-list", do_listAgents,
+DECLARE_CMD_REQUEST_KIND(BuiltinRequestsModule, "agents-list", do_listAgents,
        "List available agents",
        "Usage: agents-list\n\n"
        "List all the available agents from loaded modules.\n",
-       false, false)
+       false, false,
+       READ_ONLY_REQUEST)
 
 DECLARE_CMD_REQUEST(BuiltinRequestsModule, "agents-active", do_activeAgents,
        "List running agents",
@@ -150,6 +153,15 @@ DECLARE_CMD_REQUEST(BuiltinRequestsModule, "agents-active", do_activeAgents,
        "List all the currently running agents, including their configuration parameters.\n",
        false, false)
 
+DECLARE_CMD_REQUEST(BuiltinRequestsModule, "metrics", do_metrics,
+       "Show agent and request timings",
+       "Usage: metrics [-p | -r]\n\n"
+       "Print the run time percentiles of every agent and request class,\n"
+       "the request queue depth and the number of cycle overruns.\n"
+       "   -p: print them in the Prometheus text exposition format\n"
+       "   -r: reset all the measurements\n",
+       false, false)
+
     void registerAgentRequests();
     void unregisterAgentRequests();
 
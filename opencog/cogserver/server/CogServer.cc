@@ -25,6 +25,7 @@
  */
 
 #include <time.h>
+#include <chrono>
 #ifdef WIN32
 #include <winsock2.h>
 #else
@@ -86,6 +87,14 @@ CogServer::~CogServer()
     logger().debug("[CogServer] enter destructor");
     disableNetworkServer();
 
+    // let the requests still running finish, and drop the ones that
+    // never got to run
+    readOnlyRequestPool.reset();
+    longRunningRequestPool.reset();
+    for (Request* request : pendingRequests)
+        delete request;
+    pendingRequests.clear();
+
     std::vector<std::string> moduleKeys;
 
     for (ModuleMap::iterator it = modules.begin(); it != modules.end(); ++it)
@@ -135,7 +144,8 @@ CogServer::~CogServer()
 }
 
 CogServer::CogServer(AtomSpace* as) :
-    cycleCount(1), running(false), _networkServer(nullptr)
+    cycleCount(1), running(false), requestsUnblocked(false),
+    cycleOverruns(0), _networkServer(nullptr)
 {
     // We shouldn't get called with a non-NULL atomSpace static global as
     // that's indicative of a missing call to CogServer::~CogServer.
@@ -164,6 +174,25 @@ CogServer::CogServer(AtomSpace* as) :
 #endif // HAVE_CYTHON
 
     _systemActivityTable.init(this);
+    _profiler.init(this);
+
+    readOnlyRequestPool.reset(new WorkStealingPool(
+        config().has("SERVER_REQUEST_THREADS") ?
+        config().get_int("SERVER_REQUEST_THREADS") : 2));
+    longRunningRequestPool.reset(new WorkStealingPool(
+        config().has("SERVER_LONG_REQUEST_THREADS") ?
+        config().get_int("SERVER_LONG_REQUEST_THREADS") : 2));
+
+    if (config().has("SERVER_AGENT_SCHEDULER") and
+        config()["SERVER_AGENT_SCHEDULER"] == "parallel")
+    {
+        unsigned int num_threads = 0;
+        if (config().has("SERVER_AGENT_THREADS"))
+            num_threads = config().get_int("SERVER_AGENT_THREADS");
+        agentScheduler.reset(new ParallelRunner(num_threads));
+    }
+    else
+        agentScheduler.reset(new SimpleRunner);
 
     agentsRunning = true;
 }
@@ -185,30 +214,81 @@ SystemActivityTable& CogServer::systemActivityTable()
     return _systemActivityTable;
 }
 
+Profiler& CogServer::profiler()
+{
+    return _profiler;
+}
+
 void CogServer::serverLoop()
 {
-    struct timeval timer_start, timer_end, elapsed_time;
-    time_t cycle_duration = config().get_int("SERVER_CYCLE_DURATION") * 1000;
+    using namespace std::chrono;
+
+    milliseconds cycle_duration(config().get_int("SERVER_CYCLE_DURATION"));
+    bool sleep_when_idle = config().has("SERVER_SLEEP_WHEN_IDLE") and
+        config().get_bool("SERVER_SLEEP_WHEN_IDLE");
 //    bool externalTickMode = config().get_bool("EXTERNAL_TICK_MODE");
 
     logger().info("Starting CogServer loop.");
 
-    gettimeofday(&timer_start, NULL);
+    steady_clock::time_point next_cycle = steady_clock::now();
     for (running = true; running;)
     {
-        runLoopStep();
+        steady_clock::time_point now = steady_clock::now();
+        if (now >= next_cycle and
+            (not sleep_when_idle or hasScheduledAgents()))
+        {
+            runLoopStep();
+
+            // the next cycle starts config["SERVER_CYCLE_DURATION"]
+            // milliseconds after the start of this one, or right away
+            // if this one took longer than that
+            next_cycle = now + cycle_duration;
+            now = steady_clock::now();
+            if (next_cycle < now) {
+                cycleOverruns++;
+                next_cycle = now;
+            }
+        }
+        else
+        {
+            // woken up between cycles: serve the requests and the timed
+            // agents without waiting for the next cycle
+            if (hasPendingRequests())
+                processRequests();
+            if (agentsRunning)
+                agentScheduler->process_timed_agents();
+        }
 
-        gettimeofday(&timer_end, NULL);
-        timersub(&timer_end, &timer_start, &elapsed_time);
+        steady_clock::time_point wake_up = next_cycle;
+        if (sleep_when_idle and not hasScheduledAgents())
+            wake_up = steady_clock::time_point::max();
+        if (agentsRunning)
+            wake_up = std::min(wake_up, agentScheduler->next_deadline());
+
+        std::unique_lock<std::mutex> lock(loopMutex);
+        auto has_work = [this] {
+            return not running or hasPendingRequests();
+        };
+        if (wake_up == steady_clock::time_point::max())
+            loopCond.wait(lock, has_work);
+        else
+            loopCond.wait_until(lock, wake_up, has_work);
+    }
+}
 
-        // sleep long enough so that the next cycle will only start
-        // after config["SERVER_CYCLE_DURATION"] milliseconds
-        long delta = cycle_duration;
-        delta -= 1000.0*elapsed_time.tv_sec + elapsed_time.tv_usec/1000.0;
-        if (delta > 0)
-            usleep((unsigned int) delta);
-        timer_start = timer_end;
+void CogServer::wakeUpLoop(void)
+{
+    {
+        // locking is required, so that the wake-up cannot be lost between
+        // the loop testing its condition and going to sleep
+        std::lock_guard<std::mutex> lock(loopMutex);
     }
+    loopCond.notify_all();
+}
+
+bool CogServer::hasScheduledAgents(void)
+{
+    return agentsRunning and 0 < agentScheduler->get_agents().size();
 }
 
 void CogServer::runLoopStep(void)
@@ -219,7 +299,7 @@ void CogServer::runLoopStep(void)
     long currentCycle = this->cycleCount;
 
     // Process requests
-    if (0 < getRequestQueueSize())
+    if (hasPendingRequests())
     {
         gettimeofday(&timer_start, NULL);
         processRequests();
@@ -233,9 +313,9 @@ void CogServer::runLoopStep(void)
     }
 
     // Process mind agents
-    if (customLoopRun() and agentsRunning and 0 < agentScheduler.get_agents().size())
+    if (customLoopRun() and agentsRunning and 0 < agentScheduler->get_agents().size())
     {
-        agentScheduler.process_agents();
+        agentScheduler->process_agents();
 
         gettimeofday(&timer_end, NULL);
         timersub(&timer_end, &timer_start, &elapsed_time);
@@ -254,13 +334,89 @@ bool CogServer::customLoopRun(void)
     return true;
 }
 
+void CogServer::executeRequest(Request* request)
+{
+    auto start = std::chrono::steady_clock::now();
+    request->execute();
+    _profiler.recordRequest(request->get_name(),
+                            start - request->get_queued_time(),
+                            std::chrono::steady_clock::now() - start);
+    delete request;
+}
+
+bool CogServer::isBusyClient(ConsoleSocket* con)
+{
+    std::lock_guard<std::mutex> lock(busyClientsMutex);
+    return busyClients.count(con) > 0;
+}
+
+void CogServer::startAsyncRequest(Request* request, WorkStealingPool& pool)
+{
+    ConsoleSocket* con = request->get_console();
+    {
+        std::lock_guard<std::mutex> lock(busyClientsMutex);
+        busyClients.insert(con);
+    }
+
+    bool read_only = (&pool == readOnlyRequestPool.get());
+    pool.submit([this, request, con, read_only] {
+        if (read_only) {
+            boost::shared_lock<boost::shared_mutex> lock(requestStateMutex);
+            executeRequest(request);
+        } else {
+            executeRequest(request);
+        }
+
+        // The client may have been deleted along with the request; it is
+        // only used as a key from here on.
+        {
+            std::lock_guard<std::mutex> lock(busyClientsMutex);
+            busyClients.erase(con);
+        }
+        requestsUnblocked = true;
+        wakeUpLoop();
+    });
+}
+
 void CogServer::processRequests(void)
 {
     std::unique_lock<std::mutex> lock(processRequestsMutex);
-    while (0 < getRequestQueueSize()) {
-        Request* request = popRequest();
-        request->execute();
-        delete request;
+    requestsUnblocked = false;
+
+    while (0 < getRequestQueueSize())
+        pendingRequests.push_back(popRequest());
+
+    // A request waits while an earlier request of its client is still
+    // running or waiting; all others are started in the order they came.
+    std::deque<Request*> pending;
+    pending.swap(pendingRequests);
+    std::set<ConsoleSocket*> blocked;
+    boost::unique_lock<boost::shared_mutex>
+        state_lock(requestStateMutex, boost::defer_lock);
+
+    for (Request* request : pending) {
+        ConsoleSocket* con = request->get_console();
+        if (blocked.count(con) or isBusyClient(con)) {
+            blocked.insert(con);
+            pendingRequests.push_back(request);
+            continue;
+        }
+
+        RequestKind kind = requestInfo(request->get_name()).kind;
+        if (kind == MUTATING_REQUEST) {
+            // run consecutive mutating requests under a single lock
+            if (not state_lock.owns_lock())
+                state_lock.lock();
+            executeRequest(request);
+            continue;
+        }
+
+        if (state_lock.owns_lock())
+            state_lock.unlock();
+        if (kind == READ_ONLY_REQUEST)
+            startAsyncRequest(request, *readOnlyRequestPool);
+        else
+            startAsyncRequest(request, *longRunningRequestPool);
     }
 }
 
@@ -283,7 +439,7 @@ std::list<const char*> CogServer::agentIds() const
 
 AgentSeq CogServer::runningAgents(void)
 {
-    AgentSeq agents = agentScheduler.get_agents();
+    AgentSeq agents = agentScheduler->get_agents();
     for (auto &runner: agentThreads) {
         auto t = runner->get_agents();
         agents.insert(agents.end(), t.begin(), t.end());
@@ -319,13 +475,15 @@ void CogServer::startAgent(AgentPtr agent, bool dedicated_thread,
         if (agentsRunning)
             runner->start();
     }
-    else
-        agentScheduler.add_agent(agent);
+    else {
+        agentScheduler->add_agent(agent);
+        wakeUpLoop();
+    }
 }
 
 void CogServer::stopAgent(AgentPtr agent)
 {
-    agentScheduler.remove_agent(agent);
+    agentScheduler->remove_agent(agent);
     for (auto &runner: agentThreads)
         runner->remove_agent(agent);
     logger().debug("[CogServer] stopped agent \"%s\"", agent->to_string().c_str());
@@ -333,7 +491,7 @@ void CogServer::stopAgent(AgentPtr agent)
 
 void CogServer::stopAllAgents(const std::string& id)
 {
-    agentScheduler.remove_all_agents(id);
+    agentScheduler->remove_all_agents(id);
     for (auto &runner: agentThreads)
         runner->remove_all_agents(id);
 //    // remove statistical record of their activities
@@ -346,6 +504,7 @@ void CogServer::startAgentLoop(void)
     agentsRunning = true;
     for (auto &runner: agentThreads)
         runner->start();
+    wakeUpLoop();
 }
 
 void CogServer::stopAgentLoop(void)
@@ -367,7 +526,10 @@ bool CogServer::unregisterRequest(const std::string& name)
 
 Request* CogServer::createRequest(const std::string& name)
 {
-    return Registry<Request>::create(*this, name);
+    Request* request = Registry<Request>::create(*this, name);
+    if (request)
+        request->set_name(name);
+    return request;
 }
 
 const RequestClassInfo& CogServer::requestInfo(const std::string& name) const
@@ -387,7 +549,11 @@ long CogServer::getCycleCount()
 
 void CogServer::stop()
 {
-    running = false;
+    {
+        std::lock_guard<std::mutex> lock(loopMutex);
+        running = false;
+    }
+    loopCond.notify_all();
 }
 
 bool CogServer::loadModule(const std::string& filename)
@@ -541,6 +707,11 @@ bool CogServer::unloadModule(const std::string& moduleId)
     }
     ModuleData mdata = it->second;
 
+    // The requests running off the server thread may be in the code of
+    // the module.
+    if (readOnlyRequestPool) readOnlyRequestPool->wait();
+    if (longRunningRequestPool) longRunningRequestPool->wait();
+
     // cache filename, id and handle
     std::string filename = mdata.filename;
     std::string id       = mdata.id;
@@ -27,12 +27,18 @@
 #ifndef _OPENCOG_COGSERVER_H
 #define _OPENCOG_COGSERVER_H
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <set>
 #include <vector>
 #include <thread>
 
+#include <boost/thread/shared_mutex.hpp>
+
 #include <opencog/util/concurrent_queue.h>
 #include <opencog/cogserver/server/Agent.h>
 #include <opencog/cogserver/server/AgentRunnerBase.h>
@@ -40,9 +46,11 @@
 #include <opencog/cogserver/server/BaseServer.h>
 #include <opencog/cogserver/server/Module.h>
 #include <opencog/cogserver/server/NetworkServer.h>
+#include <opencog/cogserver/server/Profiler.h>
 #include <opencog/cogserver/server/SystemActivityTable.h>
 #include <opencog/cogserver/server/Request.h>
 #include <opencog/cogserver/server/Registry.h>
+#include <opencog/concurrency/WorkStealingPool.h>
 
 namespace opencog
 {
@@ -81,9 +89,10 @@ namespace opencog
  * the last user disconnects; the server will stay running in this
  * dettached state, until user reconnect, or until it is shut down.
  *
- * The network server is implemented by devoting one thread to listening
- * for tcp/ip socket connections. Upon connection, a new thread is
- * forked to handle user requests and the run the python/scheme shells.
+ * The network server accepts tcp/ip socket connections and serves all of
+ * them asynchronously from a small, fixed pool of "SERVER_IO_THREADS"
+ * threads; no thread is created per connection. Shell evaluations
+ * (python/scheme) run on a bounded pool of "SERVER_EVAL_SLOTS" slots.
  * Command-line commands are implemented as "Requests", described below.
  * The atomspace is thread-safe, as well as the Request queue, and the
  * python/scheme REPL shells, so there should be no issues with
@@ -108,10 +117,20 @@ namespace opencog
  *
  * Cycles are handled by the server's main loop (method 'serverLoop').
  * Each cycle has a minimum duration controlled by the parameter
- * "SERVER_CYCLE_DURATION" (in seconds). At the start of every cycle,
+ * "SERVER_CYCLE_DURATION" (in milliseconds). At the start of every cycle,
  * the server processes the queued requests and then executes an
- * interaction of each scheduled agent. When all the agents are finished,
- * the server sleeps for the remaining time until the end of the cycle.
+ * interaction of each scheduled agent. Between cycles the server sleeps
+ * on a condition variable, and is woken up as soon as a request is
+ * queued or a timed agent (see Agent::setPeriod()) becomes due, so that
+ * requests do not wait for the end of the cycle. Cycles that take longer
+ * than "SERVER_CYCLE_DURATION" are counted as overruns. If
+ * "SERVER_SLEEP_WHEN_IDLE" is true, the server does not run empty cycles
+ * at all while no agent is scheduled.
+ * By default the agents of a cycle run one after another on the server
+ * thread. Setting "SERVER_AGENT_SCHEDULER" to "parallel" runs them on a
+ * work-stealing pool of "SERVER_AGENT_THREADS" threads (0 meaning one
+ * per core) instead; see ParallelRunner for the rules that decide which
+ * agents may overlap.
  *
  * Agent management is done through inheritance from the Registry<Agent>
  * class.  The agent registry API provides several methods to:
@@ -160,16 +179,59 @@ protected:
     // Used to start and stop the Agents loop via shell commands
     bool agentsRunning;
 
-    SimpleRunner agentScheduler;
+    std::unique_ptr<SimpleRunner> agentScheduler;
     std::vector<AgentRunnerThreadPtr> agentThreads;
     std::map<std::string, AgentRunnerThread*> threadNameMap;
 
     std::mutex processRequestsMutex;
     concurrent_queue<Request*> requestQueue;
 
+    /** Requests taken from the queue but not started yet, in the order
+     *  they were pushed. Only touched by processRequests(). */
+    std::deque<Request*> pendingRequests;
+
+    /** The clients that have a request running on a worker pool; their
+     *  next requests wait for it, so that each client sees its requests
+     *  executed in order. */
+    std::mutex busyClientsMutex;
+    std::set<ConsoleSocket*> busyClients;
+
+    /** Set when a client is no longer busy and has pending requests */
+    std::atomic<bool> requestsUnblocked;
+
+    /** Taken shared by the read-only requests, and exclusively by each
+     *  batch of mutating requests. */
+    boost::shared_mutex requestStateMutex;
+
+    std::unique_ptr<WorkStealingPool> readOnlyRequestPool;
+    std::unique_ptr<WorkStealingPool> longRunningRequestPool;
+
+    /** Executes a request and deletes it. */
+    void executeRequest(Request*);
+
+    /** Runs a request on a worker pool; the client is busy until it is
+     *  done. */
+    void startAsyncRequest(Request*, WorkStealingPool&);
+
+    bool isBusyClient(ConsoleSocket*);
+
+    /** Used to wake up the server loop when there is something to do */
+    std::mutex loopMutex;
+    std::condition_variable loopCond;
+
+    /** Number of cycles that took longer than SERVER_CYCLE_DURATION */
+    std::atomic<unsigned long> cycleOverruns;
+
+    /** Wakes up the server loop, if it is sleeping. */
+    void wakeUpLoop(void);
+
+    /** Returns true if there are agents to run as part of the cycles. */
+    bool hasScheduledAgents(void);
+
     NetworkServer* _networkServer;
 
     SystemActivityTable _systemActivityTable;
+    Profiler _profiler;
 
 public:
 
@@ -187,8 +249,9 @@ public:
 
     /** Server's main loop. Executed while the 'running' flag is set
      *  to true. It processes the request queue, then the scheduled
-     *  agents and finally sleeps for the remaining time until the end
-     * of the cycle (if any). */
+     *  agents and finally sleeps until the end of the cycle, the next
+     *  timed agent deadline or the next queued request, whichever comes
+     *  first. */
     virtual void serverLoop(void);
 
     /** Runs a single server loop step. Quasi-private method, made
@@ -213,6 +276,9 @@ public:
     /** Returns the number of executed cycles so far */
     virtual long getCycleCount(void);
 
+    /** Returns the number of cycles that exceeded SERVER_CYCLE_DURATION */
+    unsigned long getCycleOverruns(void) const { return cycleOverruns; }
+
     /** Interrupts the main loop. Note that the loop will only exit
      *  after the current interaction is finished. */
     virtual void stop(void);
@@ -228,6 +294,9 @@ public:
     /** Returns a reference to the system activity table instance */
     virtual SystemActivityTable& systemActivityTable(void);
 
+    /** Returns a reference to the agent and request profiler */
+    virtual Profiler& profiler(void);
+
     /**** Module API ****/
     /** Loads a dynamic library/module. Takes the filename of the
      *  library (.so or .dylib or .dll). On Linux/Unix, the filename may
@@ -329,8 +398,15 @@ public:
     /** Returns the class metadata from request class 'id'. */
     virtual const RequestClassInfo& requestInfo(const std::string& id) const;
 
-    /** Adds request to the end of the requests queue. */
-    void pushRequest(Request* request) { requestQueue.push(request); }
+    /** Adds request to the end of the requests queue, and wakes up the
+     *  server loop to process it. */
+    void pushRequest(Request* request)
+    {
+        request->set_queued_time(std::chrono::steady_clock::now());
+        requestQueue.push(request);
+        _profiler.recordQueueDepth(requestQueue.size());
+        wakeUpLoop();
+    }
 
     /** Removes and returns the first request from the requests queue. */
     Request* popRequest(void) { return requestQueue.pop(); }
@@ -338,7 +414,20 @@ public:
     /** Returns the requests queue size. */
     int getRequestQueueSize(void) { return requestQueue.size(); }
 
-    /** Force drain of all outstanding requests */
+    /** Returns true if there are requests that can be processed. */
+    bool hasPendingRequests(void)
+    {
+        return 0 < getRequestQueueSize() or requestsUnblocked;
+    }
+
+    /** Drain the request queue, in the order the requests were pushed,
+     *  across all clients. Mutating requests are executed right away,
+     *  batching the consecutive ones under a single lock; read-only and
+     *  long-running requests are started on their worker pools
+     *  ("SERVER_REQUEST_THREADS" and "SERVER_LONG_REQUEST_THREADS"
+     *  threads), and may still be running when this returns. The
+     *  requests of a client are always executed one after the other, in
+     *  the order they were pushed. */
     void processRequests(void);
 
     /** Return the logger */
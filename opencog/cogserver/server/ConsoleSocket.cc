@@ -37,36 +37,71 @@ using namespace opencog;
 ConsoleSocket::ConsoleSocket(void)
 {
     _use_count = 0;
-    _shell = nullptr;
+    _disconnected = false;
+    _awaiting_shell = false;
+
+    _max_in_flight = 16;
+    if (config().has("SERVER_MAX_REQUESTS_IN_FLIGHT"))
+        _max_in_flight = config().get_int("SERVER_MAX_REQUESTS_IN_FLIGHT");
 }
 
 ConsoleSocket::~ConsoleSocket()
 {
     logger().debug("[ConsoleSocket] destructor");
 
-    // We need the use-count and the condition variables because
-    // somehow the design of either this subsystem, or boost:asio
-    // is broken. Basically, the boost::asio code calls this destructor
-    // for ConsoleSocket while there are still requests outstanding
-    // in another thread.  We have to stall the destructor until all
-    // the in-flight requests are complete; we use the condition
-    // variable to do this. But really, something somewhere is broken
-    // or mis-designed. Not sure what/where; this code is too complicated.
-    //
-    // Some details: basically, the remote end of the socket "fires and
-    // forgets" a bunch of commands, and then closes the socket before
-    // these requests have completed.  boost:asio notices that the
-    // remote socket has closed, and so decides its a good day to call
-    // destructors. But of course, its not ...
-    std::unique_lock<std::mutex> lck(_mtx);
-    while (_use_count) _cv.wait(lck);
-
-    // If there's a shell, kill it.
-    if (_shell) delete _shell;
+    // If there's a shell, let go of it. Its evaluations still in
+    // progress keep it alive until they are done.
+    if (_shell) _shell->socket_closed();
+    _shell.reset();
 
     logger().debug("[ConsoleSocket] destructor finished");
 }
 
+void ConsoleSocket::put()
+{
+    bool last;
+    {
+        std::unique_lock<std::mutex> lck(_mtx);
+        _use_count--;
+        last = _disconnected and 0 == _use_count;
+
+        // No input was read after the shell request, so once nothing is
+        // in flight, it has run.
+        if (0 == _use_count) _awaiting_shell = false;
+    }
+    if (last) {
+        delete this;
+        return;
+    }
+
+    // Reading may have been held off because of us.
+    ResumeInput();
+}
+
+bool ConsoleSocket::AcceptingInput(void)
+{
+    {
+        std::unique_lock<std::mutex> lck(_mtx);
+        if (_awaiting_shell) return false;
+        if (_max_in_flight <= _use_count) return false;
+    }
+    return ServerSocket::AcceptingInput();
+}
+
+void ConsoleSocket::OnDisconnect(void)
+{
+    // Some details: the remote end of the socket may "fire and forget"
+    // a bunch of commands, and then close the socket before these
+    // requests have completed. The last request to finish deletes us.
+    bool last;
+    {
+        std::unique_lock<std::mutex> lck(_mtx);
+        _disconnected = true;
+        last = 0 == _use_count;
+    }
+    if (last) delete this;
+}
+
 // Some random RFC 854 characters
 #define IAC 0xff  // Telnet Interpret As Command
 #define IP 0xf4   // Telnet IP Interrupt Process
@@ -141,8 +176,12 @@ void ConsoleSocket::OnLine(const std::string& line)
     // as possible, since the shell needs to be able to handle a
     // high-speed data feed with as little getting in the way as
     // possible.
-    if (_shell) {
-        _shell->eval(line);
+    //
+    // The shell may let go of this socket while evaluating (when the
+    // user exits it), so hold on to it until the call returns.
+    std::shared_ptr<GenericShell> shell(_shell);
+    if (shell) {
+        shell->eval(line);
         return;
     }
 
@@ -170,6 +209,16 @@ void ConsoleSocket::OnLine(const std::string& line)
     {
         OnLine("scm");
 
+        // If the shell request has to wait for the earlier requests of
+        // this client, the command is read again once it has run.
+        {
+            std::unique_lock<std::mutex> lck(_mtx);
+            if (_awaiting_shell) {
+                UnreadLine(line);
+                return;
+            }
+        }
+
         // Re-issue the command, but only if we sucessfully got a shell.
         // (We might not get a shell if scheme is not installed.)
         if (_shell) {
@@ -199,6 +248,12 @@ void ConsoleSocket::OnLine(const std::string& line)
     request->set_console(this);
     request->setParameters(params);
 
+    if (request->isShell())
+    {
+        std::unique_lock<std::mutex> lck(_mtx);
+        _awaiting_shell = true;
+    }
+
     // We only add the command to the processing queue
     // if it hasn't disabled the line protocol
     cogserver.pushRequest(request);
@@ -211,7 +266,9 @@ void ConsoleSocket::OnLine(const std::string& line)
         // Force a drain of this request, because we *must* enter
         // shell mode before handling any additional input from the
         // socket (since the next input is almost surely intended for
-        // the new shell, not for the cogserver one).
+        // the new shell, not for the cogserver one). If an earlier
+        // request of this client is still running, it stays queued,
+        // and no more input is read until it has run.
         //
         // NOTE: Calling this method for non-shell requests may
         // cause cogserver to crash due to concurrency issues, since
@@ -240,7 +297,7 @@ void ConsoleSocket::SendResult(const std::string& res)
     Send(res);
 }
 
-void ConsoleSocket::SetShell(GenericShell *g)
+void ConsoleSocket::SetShell(const std::shared_ptr<GenericShell>& g)
 {
     _shell = g;
 }
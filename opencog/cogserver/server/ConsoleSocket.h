@@ -25,7 +25,7 @@
 #ifndef _OPENCOG_CONSOLE_SOCKET_H
 #define _OPENCOG_CONSOLE_SOCKET_H
 
-#include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <string>
 
@@ -43,39 +43,48 @@ namespace opencog
  * interface of the cogserver: the plain text command line.
  *
  * There may be multiple instances of ConsoleSocket to support multiple
- * simultaneous clients. This is done by creating a separate thread and
- * dispatching a client socket for each client that connects to the
- * server socket.
+ * simultaneous clients. All of them share the network server's i/o
+ * threads; see ServerSocket.
  *
  * We provide a callback method: 'OnRequestCompleted()'. This callback
  * tells the server socket that request processing has finished (so that
  * the command prompt can be sent to the client immediately, while the
  * request itself is processed 'asynchronously'.
+ *
+ * Backpressure: no more input is read from the client while it has more
+ * than "SERVER_MAX_REQUESTS_IN_FLIGHT" requests queued or running, while
+ * a request entering a shell has not run yet, or while too much output
+ * is waiting to be written to it.
  */
 class ConsoleSocket : public ServerSocket
 {
 private:
-    GenericShell *_shell;
-
-    // We need the use-count and the condition variables to avoid races
-    // between asynchronous socket closures and unsent replies. So, for
-    // example, the user may send a command, but then close the socket
-    // before the reply is sent.  The boost::asio code notices the
-    // closed socket, and ServerSocket::handle_connection() exits it's
-    // loop, and then tries to destruct this class and exit the thread
-    // that has been handling the socket i/o. We have to hold off this
-    // destruction, until all of the users of this class have completed
-    // thier work. We accomplish this with a use-count: each in-flight
-    // request increments the use-count, and then decrements it when done.
-    // The destructor can run only when the use-count has dropped to zero.
+    std::shared_ptr<GenericShell> _shell;
+
+    // We need the use-count to avoid races between asynchronous socket
+    // closures and unsent replies. So, for example, the user may send a
+    // command, but then close the socket before the reply is sent. The
+    // boost::asio code notices the closed socket, and the ServerSocket
+    // calls OnDisconnect(). We have to hold off the destruction of this
+    // class until all of the users of this class have completed thier
+    // work. We accomplish this with a use-count: each in-flight request
+    // increments the use-count, and then decrements it when done. The
+    // socket is deleted by whoever comes last: OnDisconnect() or the
+    // put() that drops the use-count to zero.
     //
     // Sockets with a shell on them will typically have a use-count of
-    // zero already; these use a different method of holding off the dtor.
-    // Basically, the shell dtor has to run first, before the
-    // ServerSocket::handle_connection() invokes this dtor.
+    // zero already. The shell is shared with its evaluations in
+    // progress, which let go of it when they finish; they no longer
+    // send output once this socket is gone (GenericShell::socket_closed).
     unsigned int _use_count;
+    unsigned int _max_in_flight;
+    bool _disconnected;
+
+    // A shell request is queued or running: the lines that follow it
+    // are meant for the shell, so none is read until it has run, along
+    // with the requests before it.
+    bool _awaiting_shell;
     std::mutex _mtx;
-    std::condition_variable _cv;
 
 protected:
 
@@ -101,6 +110,18 @@ protected:
      */
     void OnLine(const std::string&);
 
+    /**
+     * Backpressure: refuses input while too many requests are in flight,
+     * or while a shell is being entered.
+     */
+    bool AcceptingInput(void);
+
+    /**
+     * Called when the connection is gone; deletes the socket unless
+     * requests are still using it.
+     */
+    void OnDisconnect(void);
+
 public:
     /**
      * Ctor. Defines the socket's mime-type as 'text/plain' and then
@@ -110,7 +131,7 @@ public:
     ~ConsoleSocket();
 
     void get() { std::unique_lock<std::mutex> lck(_mtx); _use_count++; }
-    void put() { std::unique_lock<std::mutex> lck(_mtx); _use_count--; _cv.notify_all(); }
+    void put();
 
     /**
      * OnRequestComplete: called when a request has finished. It
@@ -133,9 +154,10 @@ public:
 
     /**
      * SetShell: Declare an alternate shell, that will perform all
-     * command line processing.
+     * command line processing. nullptr returns to the cogserver
+     * command line.
      */
-    void SetShell(GenericShell *);
+    void SetShell(const std::shared_ptr<GenericShell>&);
 
 }; // class
 
@@ -0,0 +1,122 @@
+/*
+ * opencog/cogserver/server/EvalPool.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <exception>
+
+#include <opencog/util/Config.h>
+#include <opencog/util/Logger.h>
+#include <opencog/cogserver/server/EvalPool.h>
+
+using namespace opencog;
+
+EvalPool::EvalPool(unsigned int slots) :
+    _slots(std::max(1u, slots)), _active(0), _stopping(false)
+{
+    for (unsigned int i = 0; i < 2 * _slots; i++)
+        _threads.emplace_back(&EvalPool::worker, this);
+}
+
+EvalPool::~EvalPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _stopping = true;
+    }
+    _cv.notify_all();
+    for (std::thread& t : _threads)
+        t.join();
+}
+
+void EvalPool::submit(Task eval, Task poll, Task done)
+{
+    JobPtr job(new Job{eval, poll, done, 2});
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _waiting.push_back(job);
+        admit();
+    }
+    _cv.notify_all();
+}
+
+size_t EvalPool::backlog()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    return _waiting.size();
+}
+
+// Must be called with _mtx held.
+void EvalPool::admit()
+{
+    while (_active < _slots and not _waiting.empty())
+    {
+        JobPtr job = _waiting.front();
+        _waiting.pop_front();
+        _active++;
+        _runnable.push_back(std::make_pair(job, &job->eval));
+        _runnable.push_back(std::make_pair(job, &job->poll));
+    }
+}
+
+void EvalPool::worker()
+{
+    while (true)
+    {
+        std::pair<JobPtr, Task*> task;
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _cv.wait(lock, [this] {
+                return _stopping or not _runnable.empty(); });
+            if (_runnable.empty()) return;
+            task = _runnable.front();
+            _runnable.pop_front();
+        }
+
+        try {
+            (*task.second)();
+        } catch (const std::exception& e) {
+            logger().error("[EvalPool] evaluation failed: %s", e.what());
+        }
+
+        bool finished;
+        {
+            std::lock_guard<std::mutex> lock(_mtx);
+            finished = (0 == --task.first->remaining);
+            if (finished) {
+                _active--;
+                admit();
+            }
+        }
+        if (finished) {
+            _cv.notify_all();
+            try {
+                task.first->done();
+            } catch (const std::exception& e) {
+                logger().error("[EvalPool] evaluation failed: %s", e.what());
+            }
+        }
+    }
+}
+
+EvalPool& opencog::eval_pool()
+{
+    static EvalPool pool(config().has("SERVER_EVAL_SLOTS") ?
+                         config().get_int("SERVER_EVAL_SLOTS") : 8);
+    return pool;
+}
@@ -0,0 +1,97 @@
+/*
+ * opencog/cogserver/server/EvalPool.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_EVAL_POOL_H
+#define _OPENCOG_EVAL_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace opencog
+{
+/** \addtogroup grp_server
+ *  @{
+ */
+
+/**
+ * A bounded pool of threads running the shell evaluations of all the
+ * network clients.
+ *
+ * A shell evaluation is a job made of two tasks that must run at the
+ * same time: the evaluation itself, and a poller that relays its output
+ * to the client while it is still running. The pool has two threads per
+ * job slot and runs at most one job per slot, so that a job that has
+ * been started never waits for a thread. Jobs beyond the number of
+ * slots wait in FIFO order.
+ */
+class EvalPool
+{
+public:
+    typedef std::function<void()> Task;
+
+    EvalPool(unsigned int slots);
+    ~EvalPool();
+
+    /**
+     * Queues a job. 'done' is called, in a pool thread, after both
+     * 'eval' and 'poll' have returned.
+     */
+    void submit(Task eval, Task poll, Task done);
+
+    /** Number of jobs waiting for a free slot */
+    size_t backlog();
+
+private:
+    struct Job
+    {
+        Task eval;
+        Task poll;
+        Task done;
+        int remaining;
+    };
+    typedef std::shared_ptr<Job> JobPtr;
+
+    std::mutex _mtx;
+    std::condition_variable _cv;
+    std::deque<JobPtr> _waiting;
+    std::deque<std::pair<JobPtr, Task*>> _runnable;
+    unsigned int _slots;
+    unsigned int _active;
+    bool _stopping;
+    std::vector<std::thread> _threads;
+
+    void admit();
+    void worker();
+};
+
+/**
+ * The pool shared by all shells. Its number of slots is given by the
+ * "SERVER_EVAL_SLOTS" configuration parameter.
+ */
+EvalPool& eval_pool();
+
+/** @}*/
+}  // namespace
+
+#endif // _OPENCOG_EVAL_POOL_H
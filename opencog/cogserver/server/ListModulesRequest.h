@@ -24,7 +24,8 @@ public:
             "listmodules",
             "List the currently loaded modules",
             "Usage: listmodules\n\n"
-            "List modules currently loaded into the cogserver. "
+            "List modules currently loaded into the cogserver. ",
+            false, false, READ_ONLY_REQUEST
         );
         return _cci;
     }
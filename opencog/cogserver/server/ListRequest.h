@@ -63,7 +63,8 @@ public:
             "   -n <name>:   list the nodes identified by the specified name\n"
             "   -t <name>:   list the atoms of the specified type\n"
             "   -T <name>:   list the atoms of the specified type (including subtypes)\n"
-            "   -m <num>:    list the nodes up to the specified size"
+            "   -m <num>:    list the nodes up to the specified size",
+            false, false, READ_ONLY_REQUEST
         );
         return _cci;
     }
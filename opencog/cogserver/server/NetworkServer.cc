@@ -26,6 +26,10 @@
 
 #include "NetworkServer.h"
 
+#include <algorithm>
+#include <boost/bind.hpp>
+
+#include <opencog/util/Config.h>
 #include <opencog/util/Logger.h>
 
 using namespace opencog;
@@ -38,7 +42,15 @@ NetworkServer::NetworkServer(unsigned short port) :
 {
     logger().debug("[NetworkServer] constructor");
 
-    _service_thread = new std::thread(&NetworkServer::run, this);
+    int num_threads = 2;
+    if (config().has("SERVER_IO_THREADS"))
+        num_threads = std::max(1, config().get_int("SERVER_IO_THREADS"));
+
+    printf("Listening on port %d\n", _port);
+    start_accept();
+
+    for (int i = 0; i < num_threads; i++)
+        _io_threads.emplace_back(&NetworkServer::run, this);
 }
 
 NetworkServer::~NetworkServer()
@@ -55,39 +67,41 @@ void NetworkServer::stop()
     _running = false;
     _io_service.stop();
 
-    _listener_thread->join();
-    _service_thread->join();
-    // delete _service_thread;
+    for (std::thread& t : _io_threads)
+        t.join();
 }
 
-void NetworkServer::listen()
+void NetworkServer::start_accept()
 {
-    printf("Listening on port %d\n", _port);
-    while (_running)
-    {
-        // The call to _acceptor.accept() will block this thread until
-        // a network connection is made. Thus, we defer the creation
-        // of the connection handler thread until after accept()
-        // returns.  However, the boost design violates RAII principles,
-        // so instead, what we do is to hand off the socket created here,
-        // to the ServerSocket class, which will delete it, when the
-        // connection socket closes (just before the connection handler
-        // thread exits).  That is why there is no delete of the *ss
-        // below, and that is why there is the weird self-delete at the
-        // end of ServerSocket::handle_connection().
-        boost::asio::ip::tcp::socket* sock = new boost::asio::ip::tcp::socket(_io_service);
-        _acceptor.accept(*sock);
+    // The socket is handed off to the ConsoleSocket, which will delete
+    // it when the connection closes.
+    boost::asio::ip::tcp::socket* sock =
+        new boost::asio::ip::tcp::socket(_io_service);
+    _acceptor.async_accept(*sock,
+        boost::bind(&NetworkServer::handle_accept, this, sock,
+                    boost::asio::placeholders::error));
+}
 
+void NetworkServer::handle_accept(boost::asio::ip::tcp::socket* sock,
+                                  const boost::system::error_code& error)
+{
+    if (error) {
+        delete sock;
+        if (error != boost::asio::error::operation_aborted)
+            logger().error("[NetworkServer] accept failed: %s",
+                           error.message().c_str());
+    } else {
         ConsoleSocket* ss = new ConsoleSocket();
         ss->set_connection(sock);
-        std::thread(&ConsoleSocket::handle_connection, ss).detach();
+        ss->start(_io_service);
     }
+
+    if (_running)
+        start_accept();
 }
 
 void NetworkServer::run()
 {
-    _listener_thread = new std::thread(&NetworkServer::listen, this);
-
     while (_running)
     {
         try {
@@ -26,8 +26,8 @@
 #define _OPENCOG_SIMPLE_NETWORK_SERVER_H
 
 #include <string>
-#include <queue>
 #include <thread>
+#include <vector>
 
 #include <boost/asio.hpp>
 
@@ -44,9 +44,15 @@ namespace opencog
  * This class implements the entity responsible for managing the
  * cogserver's network server.
  *
- * The network server runs on its own thread (thus freeing the cogserver's main
- * loop to deal with requests and agents only). It may be enabled/disabled
- * at will so that a cogserver may run in networkless mode if desired.
+ * The network server runs on its own pool of i/o threads (thus freeing the
+ * cogserver's main loop to deal with requests and agents only). It may be
+ * enabled/disabled at will so that a cogserver may run in networkless mode
+ * if desired.
+ *
+ * Connections are accepted asynchronously, and every connection is served
+ * by asynchronous reads and writes on the same fixed set of threads, whose
+ * size is given by the "SERVER_IO_THREADS" configuration parameter. Thus,
+ * the number of threads does not grow with the number of clients.
  *
  * The network server supports only one server socket. Client applications
  * should use the 'start' methodr to start listening to a port.
@@ -62,21 +68,24 @@ protected:
     short _port;
     boost::asio::io_service _io_service;
     boost::asio::ip::tcp::acceptor _acceptor;
-    std::thread* _service_thread;
-    std::thread* _listener_thread;
+    std::vector<std::thread> _io_threads;
 
     /** Stops the server */
     void stop();
 
-    /** The network server's thread main method.  */
-    void listen();
+    /** Queues the accept of the next connection */
+    void start_accept();
+    void handle_accept(boost::asio::ip::tcp::socket*,
+                       const boost::system::error_code&);
+
+    /** The i/o threads' main method */
     void run();
 
 public:
 
     /**
-     * Starts the NetworkServer in a new thread.
-     * The socket listen happens in the new thread.
+     * Starts the NetworkServer on a pool of new threads.
+     * The socket listen happens in those threads.
      */
     NetworkServer(unsigned short port);
     ~NetworkServer();
@@ -0,0 +1,348 @@
+/*
+ * opencog/cogserver/server/Profiler.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include <opencog/cogserver/server/Agent.h>
+#include <opencog/cogserver/server/CogServer.h>
+#include <opencog/cogserver/server/Profiler.h>
+
+using namespace opencog;
+using namespace std::chrono;
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+unsigned int LatencyHistogram::bucket(uint64_t usec)
+{
+    if (usec < 2 * SUB_BUCKETS)
+        return usec;
+    unsigned int msb = 63 - __builtin_clzll(usec);
+    unsigned int shift = msb - SUB_BUCKET_BITS;
+    unsigned int b = (shift + 1) * SUB_BUCKETS +
+                     (usec >> shift) - SUB_BUCKETS;
+    return b < BUCKETS ? b : BUCKETS - 1;
+}
+
+uint64_t LatencyHistogram::highest_value(unsigned int b)
+{
+    if (b < 2 * SUB_BUCKETS)
+        return b;
+    unsigned int shift = b / SUB_BUCKETS - 1;
+    uint64_t lowest = uint64_t(SUB_BUCKETS + b % SUB_BUCKETS) << shift;
+    return lowest + (uint64_t(1) << shift) - 1;
+}
+
+void LatencyHistogram::record(steady_clock::duration d)
+{
+    record(duration_cast<microseconds>(d).count());
+}
+
+void LatencyHistogram::record(uint64_t usec)
+{
+    _buckets[bucket(usec)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _sum.fetch_add(usec, std::memory_order_relaxed);
+
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while (usec > max and
+           not _max.compare_exchange_weak(max, usec,
+                                          std::memory_order_relaxed))
+        ;
+}
+
+uint64_t LatencyHistogram::percentile(double q) const
+{
+    uint64_t total = 0;
+    for (unsigned int b = 0; b < BUCKETS; b++)
+        total += _buckets[b].load(std::memory_order_relaxed);
+    if (total == 0)
+        return 0;
+
+    uint64_t rank = std::max<uint64_t>(1, std::ceil(q * total));
+    uint64_t seen = 0;
+    for (unsigned int b = 0; b < BUCKETS; b++) {
+        seen += _buckets[b].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return std::min(highest_value(b), max());
+    }
+    return max();
+}
+
+void LatencyHistogram::reset()
+{
+    for (unsigned int b = 0; b < BUCKETS; b++)
+        _buckets[b].store(0, std::memory_order_relaxed);
+    _count.store(0, std::memory_order_relaxed);
+    _sum.store(0, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
+
+AgentProfile::AgentProfile() : atomsCreated(0), firstRun(0), lastRun(0)
+{
+}
+
+double AgentProfile::runsPerSecond() const
+{
+    steady_clock::duration span(lastRun.load() - firstRun.load());
+    double secs = duration_cast<duration<double>>(span).count();
+    if (secs <= 0)
+        return 0;
+    // the first run opens the span, it is not part of the rate
+    return (runtime.count() - 1) / secs;
+}
+
+Profiler::Profiler() : _cogServer(nullptr), _maxQueueDepth(0)
+{
+}
+
+void Profiler::init(CogServer* cogServer)
+{
+    _cogServer = cogServer;
+}
+
+void Profiler::recordAgentRun(Agent& agent, steady_clock::duration elapsed,
+                              bool probed, size_t atomsCreated)
+{
+    AgentProfile* profile = agent._profile;
+    if (profile == nullptr) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        std::unique_ptr<AgentProfile>& p = _agents[agent.classinfo().id];
+        if (not p)
+            p.reset(new AgentProfile());
+        profile = agent._profile = p.get();
+    }
+
+    steady_clock::rep now = steady_clock::now().time_since_epoch().count();
+    steady_clock::rep never = 0;
+    profile->firstRun.compare_exchange_strong(never, now);
+    profile->lastRun.store(now, std::memory_order_relaxed);
+
+    profile->runtime.record(elapsed);
+    if (probed)
+        profile->atomsCreated.fetch_add(atomsCreated,
+                                        std::memory_order_relaxed);
+}
+
+void Profiler::recordRequest(const std::string& id,
+                             steady_clock::duration wait,
+                             steady_clock::duration elapsed)
+{
+    RequestProfile* profile;
+    {
+        std::lock_guard<std::mutex> lock(_mtx);
+        std::unique_ptr<RequestProfile>& p = _requests[id];
+        if (not p)
+            p.reset(new RequestProfile());
+        profile = p.get();
+    }
+    profile->queueWait.record(wait);
+    profile->runtime.record(elapsed);
+}
+
+void Profiler::recordQueueDepth(size_t depth)
+{
+    size_t max = _maxQueueDepth.load(std::memory_order_relaxed);
+    while (depth > max and
+           not _maxQueueDepth.compare_exchange_weak(max, depth))
+        ;
+}
+
+const AgentProfile* Profiler::agentProfile(const std::string& id)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto it = _agents.find(id);
+    return it == _agents.end() ? nullptr : it->second.get();
+}
+
+const RequestProfile* Profiler::requestProfile(const std::string& id)
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    auto it = _requests.find(id);
+    return it == _requests.end() ? nullptr : it->second.get();
+}
+
+void Profiler::reset()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    for (auto& entry : _agents) {
+        AgentProfile& p = *entry.second;
+        p.runtime.reset();
+        p.atomsCreated = 0;
+        p.firstRun = 0;
+        p.lastRun = 0;
+    }
+    for (auto& entry : _requests) {
+        entry.second->runtime.reset();
+        entry.second->queueWait.reset();
+    }
+    _maxQueueDepth = 0;
+}
+
+static double millis(uint64_t usec)
+{
+    return usec / 1000.0;
+}
+
+static double seconds(uint64_t usec)
+{
+    return usec / 1000000.0;
+}
+
+std::string Profiler::summary()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(3);
+
+    oss << std::left << std::setw(40) << "agent" << std::right
+        << std::setw(10) << "runs" << std::setw(10) << "runs/s"
+        << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms"
+        << std::setw(10) << "max ms" << std::setw(10) << "atoms"
+        << std::endl;
+    for (const auto& entry : _agents) {
+        const AgentProfile& p = *entry.second;
+        oss << std::left << std::setw(40) << entry.first << std::right
+            << std::setw(10) << p.runtime.count()
+            << std::setw(10) << p.runsPerSecond()
+            << std::setw(10) << millis(p.runtime.percentile(0.5))
+            << std::setw(10) << millis(p.runtime.percentile(0.99))
+            << std::setw(10) << millis(p.runtime.max())
+            << std::setw(10) << p.atomsCreated.load()
+            << std::endl;
+    }
+
+    oss << std::endl << std::left << std::setw(40) << "request" << std::right
+        << std::setw(10) << "count" << std::setw(10) << "p50 ms"
+        << std::setw(10) << "p99 ms" << std::setw(10) << "max ms"
+        << std::setw(10) << "wait p50" << std::setw(10) << "wait p99"
+        << std::endl;
+    for (const auto& entry : _requests) {
+        const RequestProfile& p = *entry.second;
+        oss << std::left << std::setw(40) << entry.first << std::right
+            << std::setw(10) << p.runtime.count()
+            << std::setw(10) << millis(p.runtime.percentile(0.5))
+            << std::setw(10) << millis(p.runtime.percentile(0.99))
+            << std::setw(10) << millis(p.runtime.max())
+            << std::setw(10) << millis(p.queueWait.percentile(0.5))
+            << std::setw(10) << millis(p.queueWait.percentile(0.99))
+            << std::endl;
+    }
+
+    oss << std::endl;
+    if (_cogServer) {
+        oss << "request queue depth: " << _cogServer->getRequestQueueSize()
+            << " (max " << _maxQueueDepth << ")" << std::endl;
+        oss << "cycles: " << _cogServer->getCycleCount()
+            << ", overruns: " << _cogServer->getCycleOverruns() << std::endl;
+    }
+    return oss.str();
+}
+
+static std::string label(const std::string& value)
+{
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' or c == '"') escaped += '\\';
+        if (c == '\n') { escaped += "\\n"; continue; }
+        escaped += c;
+    }
+    return escaped;
+}
+
+static void summary_metric(std::ostringstream& oss, const std::string& name,
+                           const std::string& labels,
+                           const LatencyHistogram& h)
+{
+    oss << name << "{" << labels << ",quantile=\"0.5\"} "
+        << seconds(h.percentile(0.5)) << "\n";
+    oss << name << "{" << labels << ",quantile=\"0.99\"} "
+        << seconds(h.percentile(0.99)) << "\n";
+    oss << name << "{" << labels << ",quantile=\"1\"} "
+        << seconds(h.max()) << "\n";
+    oss << name << "_sum{" << labels << "} " << seconds(h.sum()) << "\n";
+    oss << name << "_count{" << labels << "} " << h.count() << "\n";
+}
+
+std::string Profiler::exposition()
+{
+    std::lock_guard<std::mutex> lock(_mtx);
+    std::ostringstream oss;
+    oss << std::setprecision(9);
+
+    oss << "# HELP opencog_agent_run_seconds Run time of the agents.\n"
+        << "# TYPE opencog_agent_run_seconds summary\n";
+    for (const auto& entry : _agents)
+        summary_metric(oss, "opencog_agent_run_seconds",
+                       "agent=\"" + label(entry.first) + "\"",
+                       entry.second->runtime);
+
+    oss << "# HELP opencog_agent_runs_per_second Average run rate of the agents.\n"
+        << "# TYPE opencog_agent_runs_per_second gauge\n";
+    for (const auto& entry : _agents)
+        oss << "opencog_agent_runs_per_second{agent=\"" << label(entry.first)
+            << "\"} " << entry.second->runsPerSecond() << "\n";
+
+    oss << "# HELP opencog_agent_atoms_created_total Atoms created by the "
+           "agents, on probed runs.\n"
+        << "# TYPE opencog_agent_atoms_created_total counter\n";
+    for (const auto& entry : _agents)
+        oss << "opencog_agent_atoms_created_total{agent=\""
+            << label(entry.first) << "\"} "
+            << entry.second->atomsCreated.load() << "\n";
+
+    oss << "# HELP opencog_request_run_seconds Execution time of the requests.\n"
+        << "# TYPE opencog_request_run_seconds summary\n";
+    for (const auto& entry : _requests)
+        summary_metric(oss, "opencog_request_run_seconds",
+                       "request=\"" + label(entry.first) + "\"",
+                       entry.second->runtime);
+
+    oss << "# HELP opencog_request_queue_wait_seconds Time spent by the "
+           "requests in the queue.\n"
+        << "# TYPE opencog_request_queue_wait_seconds summary\n";
+    for (const auto& entry : _requests)
+        summary_metric(oss, "opencog_request_queue_wait_seconds",
+                       "request=\"" + label(entry.first) + "\"",
+                       entry.second->queueWait);
+
+    oss << "# HELP opencog_request_queue_depth_max Deepest request queue seen.\n"
+        << "# TYPE opencog_request_queue_depth_max gauge\n"
+        << "opencog_request_queue_depth_max " << _maxQueueDepth << "\n";
+
+    if (_cogServer) {
+        oss << "# HELP opencog_request_queue_depth Requests waiting in the queue.\n"
+            << "# TYPE opencog_request_queue_depth gauge\n"
+            << "opencog_request_queue_depth "
+            << _cogServer->getRequestQueueSize() << "\n";
+        oss << "# HELP opencog_cycles_total Server cycles run.\n"
+            << "# TYPE opencog_cycles_total counter\n"
+            << "opencog_cycles_total " << _cogServer->getCycleCount() << "\n";
+        oss << "# HELP opencog_cycle_overruns_total Server cycles that took "
+               "longer than SERVER_CYCLE_DURATION.\n"
+            << "# TYPE opencog_cycle_overruns_total counter\n"
+            << "opencog_cycle_overruns_total "
+            << _cogServer->getCycleOverruns() << "\n";
+    }
+    return oss.str();
+}
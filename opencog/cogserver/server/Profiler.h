@@ -0,0 +1,173 @@
+/*
+ * opencog/cogserver/server/Profiler.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_PROFILER_H
+#define _OPENCOG_PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace opencog
+{
+/** \addtogroup grp_server
+ *  @{
+ */
+
+class Agent;
+class CogServer;
+
+/**
+ * A latency histogram in the style of HdrHistogram: values (in
+ * microseconds) are counted in buckets whose width doubles every 16
+ * buckets, so that any recorded value is known within about 6%, from a
+ * microsecond up to several days, in a few kilobytes.
+ *
+ * Recording is wait-free; reading while recording gives a slightly
+ * blurred but usable picture.
+ */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(std::chrono::steady_clock::duration);
+    void record(uint64_t usec);
+
+    uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+    uint64_t sum() const { return _sum.load(std::memory_order_relaxed); }
+    uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+
+    /** The value, in microseconds, below which the fraction q of the
+     *  recorded values fall. */
+    uint64_t percentile(double q) const;
+
+    void reset();
+
+private:
+    static const unsigned int SUB_BUCKET_BITS = 4;
+    static const unsigned int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const unsigned int BUCKETS = 40 * SUB_BUCKETS;
+
+    static unsigned int bucket(uint64_t usec);
+    static uint64_t highest_value(unsigned int bucket);
+
+    std::atomic<uint64_t> _buckets[BUCKETS];
+    std::atomic<uint64_t> _count;
+    std::atomic<uint64_t> _sum;
+    std::atomic<uint64_t> _max;
+};
+
+/** What the Profiler knows about the agents of one class. */
+struct AgentProfile
+{
+    AgentProfile();
+
+    LatencyHistogram runtime;
+
+    /** Atoms created, as measured on the probed runs only, see
+     *  SystemActivityTable::probeInterval() */
+    std::atomic<uint64_t> atomsCreated;
+
+    /** Time of the first and last runs, in steady_clock ticks */
+    std::atomic<std::chrono::steady_clock::rep> firstRun;
+    std::atomic<std::chrono::steady_clock::rep> lastRun;
+
+    /** Average number of runs per second since the first run */
+    double runsPerSecond() const;
+};
+
+/** What the Profiler knows about the requests of one class. */
+struct RequestProfile
+{
+    /** Time spent in Request::execute() */
+    LatencyHistogram runtime;
+
+    /** Time spent in the request queue, before being executed */
+    LatencyHistogram queueWait;
+};
+
+/**
+ * Always-on instrumentation of the cogserver: keeps latency histograms of
+ * every agent class and request class, along with the request queue
+ * depth and the cycle overruns. It can be read with the "metrics" shell
+ * request, either as a table or in the Prometheus text exposition format
+ * ("metrics -p") so that a local scraper can poll it.
+ *
+ * Recording an agent run costs a few relaxed atomic increments: the
+ * profile of an agent is looked up once and then cached in the agent.
+ */
+class Profiler
+{
+public:
+    Profiler();
+
+    void init(CogServer*);
+
+    /** Records a run of an agent; atomsCreated is only meaningful if
+     *  probed is true. Must be called from the thread running the agent. */
+    void recordAgentRun(Agent&, std::chrono::steady_clock::duration elapsed,
+                        bool probed, size_t atomsCreated);
+
+    /** Records the execution of a request. */
+    void recordRequest(const std::string& id,
+                       std::chrono::steady_clock::duration wait,
+                       std::chrono::steady_clock::duration elapsed);
+
+    /** Records the depth of the request queue after a push. */
+    void recordQueueDepth(size_t);
+
+    size_t maxQueueDepth() const { return _maxQueueDepth; }
+
+    /** Returns the profile of an agent class, or nullptr if none of its
+     *  agents has run yet. */
+    const AgentProfile* agentProfile(const std::string& id);
+
+    /** Returns the profile of a request class, or nullptr if no request
+     *  of that class has been executed yet. */
+    const RequestProfile* requestProfile(const std::string& id);
+
+    /** A human readable table of all profiles */
+    std::string summary();
+
+    /** All profiles, in the Prometheus text exposition format */
+    std::string exposition();
+
+    /** Forgets everything measured so far. */
+    void reset();
+
+private:
+    CogServer* _cogServer;
+
+    /** Profiles are never deleted, so that agents may cache them. */
+    std::mutex _mtx;
+    std::map<std::string, std::unique_ptr<AgentProfile>> _agents;
+    std::map<std::string, std::unique_ptr<RequestProfile>> _requests;
+
+    std::atomic<size_t> _maxQueueDepth;
+};
+
+/** @}*/
+}  // namespace
+
+#endif // _OPENCOG_PROFILER_H
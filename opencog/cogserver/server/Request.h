@@ -27,6 +27,7 @@
 #ifndef _OPENCOG_REQUEST_H
 #define _OPENCOG_REQUEST_H
 
+#include <chrono>
 #include <list>
 #include <string>
 
@@ -136,6 +137,22 @@ class CogServer;
  */
 #define DECLARE_CMD_REQUEST(mod_type,cmd_str,do_cmd,                  \
                             cmd_sum,cmd_desc,shell_cmd,hidden)        \
+    DECLARE_CMD_REQUEST_KIND(mod_type,cmd_str,do_cmd,                 \
+                             cmd_sum,cmd_desc,shell_cmd,hidden,       \
+                             MUTATING_REQUEST)
+
+/**
+ * DECLARE_CMD_REQUEST_KIND -- Same as DECLARE_CMD_REQUEST, for a command
+ * that is not a MUTATING_REQUEST.
+ *
+ * - kind:    The RequestKind of the command: READ_ONLY_REQUEST for a
+ *            command that only looks at the server state, and may thus
+ *            run concurrently with other such commands, or
+ *            LONG_RUNNING_REQUEST for a slow command that only uses
+ *            thread-safe interfaces.
+ */
+#define DECLARE_CMD_REQUEST_KIND(mod_type,cmd_str,do_cmd,             \
+                            cmd_sum,cmd_desc,shell_cmd,hidden,kind)   \
                                                                       \
    class do_cmd##Request : public Request {                           \
       public:                                                         \
@@ -144,7 +161,8 @@ class CogServer;
                                                  cmd_sum,             \
                                                  cmd_desc,            \
                                                  shell_cmd,           \
-                                                 hidden);             \
+                                                 hidden,              \
+                                                 kind);               \
               return _cci;                                            \
           }                                                           \
           do_cmd##Request(CogServer& cs) : Request(cs) {};            \
@@ -247,6 +265,8 @@ class Request
 {
 private:
     ConsoleSocket*         _console;
+    std::string            _name;
+    std::chrono::steady_clock::time_point _queued_time;
 
 protected:
     CogServer&             _cogserver;
@@ -274,6 +294,18 @@ public:
     void set_console(ConsoleSocket*);
     ConsoleSocket *get_console(void) const { return _console; }
 
+    /** The id the request was created with, see CogServer::createRequest */
+    void set_name(const std::string& name) { _name = name; }
+    const std::string& get_name(void) const { return _name; }
+
+    /** When the request was put in the request queue, for profiling */
+    void set_queued_time(std::chrono::steady_clock::time_point t) {
+        _queued_time = t;
+    }
+    std::chrono::steady_clock::time_point get_queued_time(void) const {
+        return _queued_time;
+    }
+
     /** sets the command's parameter list. */
     virtual void setParameters(const std::list<std::string>&);
 
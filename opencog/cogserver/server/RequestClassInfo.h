@@ -32,6 +32,22 @@
 namespace opencog
 {
 
+/** How the requests of a class may be executed, see
+ *  CogServer::processRequests() */
+enum RequestKind
+{
+    /** Only reads the server state. Runs on a worker pool, concurrently
+     *  with the other read-only requests. */
+    READ_ONLY_REQUEST,
+    /** Changes the server state. Runs on the server thread, in order,
+     *  excluding the read-only requests. */
+    MUTATING_REQUEST,
+    /** Takes a long time. Runs on its own worker pool so that it doesn't
+     *  hold up the other requests; it must only use thread-safe
+     *  interfaces, like the atomspace. */
+    LONG_RUNNING_REQUEST
+};
+
 /**
  * This struct defines the extended set of attributes used by opencog requests.
  * The current set of attributes are:
@@ -39,6 +55,8 @@ namespace opencog
  *     description: a short description of what the request does
  *     help:        an extended description of the request, listing multiple
  *                  usage patterns and parameters
+ *     kind:        how the request may be executed (MUTATING_REQUEST by
+ *                  default)
  */
 struct RequestClassInfo : public ClassInfo
 {
@@ -47,17 +65,23 @@ struct RequestClassInfo : public ClassInfo
     bool is_shell;
     /** Whether default shell should be hidden from help */
     bool hidden;
+    RequestKind kind;
 
-    RequestClassInfo() : is_shell(false), hidden(false) {};
+    RequestClassInfo() : is_shell(false), hidden(false),
+        kind(MUTATING_REQUEST) {};
     RequestClassInfo(const char* i, const char *d, const char* h,
-            bool s = false, bool hide = false)
-        : ClassInfo(i), description(d), help(h), is_shell(s), hidden(hide) {};
+            bool s = false, bool hide = false,
+            RequestKind k = MUTATING_REQUEST)
+        : ClassInfo(i), description(d), help(h), is_shell(s), hidden(hide),
+          kind(k) {};
     RequestClassInfo(const std::string& i, 
                      const std::string& d,
                      const std::string& h, 
                      bool s = false,
-                     bool hide = false)
-        : ClassInfo(i), description(d), help(h), is_shell(s), hidden(hide) {};
+                     bool hide = false,
+                     RequestKind k = MUTATING_REQUEST)
+        : ClassInfo(i), description(d), help(h), is_shell(s), hidden(hide),
+          kind(k) {};
 };
 
 
@@ -23,8 +23,9 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include <mutex>
+#include <boost/bind.hpp>
 
+#include <opencog/util/Config.h>
 #include <opencog/util/Logger.h>
 #include <opencog/util/oc_assert.h>
 #include <opencog/cogserver/server/ServerSocket.h>
@@ -32,8 +33,19 @@
 using namespace opencog;
 
 ServerSocket::ServerSocket(void) :
-    _socket(nullptr)
+    _socket(nullptr),
+    _out_bytes(0),
+    _writing(false),
+    _max_pending_output(1 << 20),
+    _read_paused(false),
+    _read_done(false),
+    _close_requested(false),
+    _closed(false),
+    _disconnected(false),
+    _pending_posts(0)
 {
+    if (config().has("SERVER_MAX_PENDING_OUTPUT"))
+        _max_pending_output = config().get_int("SERVER_MAX_PENDING_OUTPUT");
 }
 
 ServerSocket::~ServerSocket()
@@ -44,49 +56,167 @@ ServerSocket::~ServerSocket()
     _socket = nullptr;
 }
 
+// Runs a handler on the strand, on behalf of another thread. The
+// connection is not torn down while posted handlers are outstanding.
+void ServerSocket::post(std::function<void()> handler)
+{
+    // _out_mtx must be held by the caller
+    _pending_posts++;
+    _strand->post([this, handler]
+    {
+        handler();
+        {
+            std::lock_guard<std::mutex> lock(_out_mtx);
+            _pending_posts--;
+        }
+        maybe_disconnect();
+    });
+}
+
 void ServerSocket::Send(const std::string& cmd)
 {
-    OC_ASSERT(_socket, "Use of socket after it's been closed!\n");
+    OC_ASSERT(_strand, "Use of socket before it's been started!\n");
 
-    boost::system::error_code error;
-    boost::asio::write(*_socket, boost::asio::buffer(cmd),
-                       boost::asio::transfer_all(), error);
-
-    // The most likely cause of an error is that the remote side has
-    // closed the socket, even though we still had stuff to send.
-    // I beleive this is a ENOTCON errno, maybe its another one as well.
-    // Don't log these harmless errors.
-    if (error.value() != boost::system::errc::success and
-        error.value() != boost::system::errc::not_connected)
-        logger().warn("ServerSocket::Send(): %s", error.message().c_str());
-}
-
-// As far as I can tell, boost::asio is not actually thread-safe,
-// in particular, when closing and destroying sockets.  This strikes
-// me as incredibly stupid -- a first-class reason to not use boost.
-// But whatever.  Hack around this for now.
-static std::mutex _asio_crash;
-
-// This is called in a different thread than the thread that is running
-// the handle_connection() method. It's purpose in life is to terminate
-// the connection -- it does so by closing the socket. Sometime later,
-// the handle_connection() method notices that it's closed, and exits
-// it's loop, thus ending the thread that its running in.
-void ServerSocket::SetCloseAndDelete()
+    if (cmd.empty()) return;
+
+    std::lock_guard<std::mutex> lock(_out_mtx);
+
+    // The most likely cause is that the remote side has closed the
+    // socket, even though we still had stuff to send. Just drop it.
+    if (_closed) return;
+
+    _out_queue.push_back(cmd);
+    _out_bytes += cmd.size();
+    if (_writing) return;
+
+    _writing = true;
+    post([this] { start_write(); });
+}
+
+size_t ServerSocket::PendingOutput(void)
 {
-    std::lock_guard<std::mutex> lock(_asio_crash);
-    logger().debug("ServerSocket::SetCloseAndDelete()");
-    try
+    std::lock_guard<std::mutex> lock(_out_mtx);
+    return _out_bytes;
+}
+
+bool ServerSocket::AcceptingInput(void)
+{
+    return PendingOutput() < _max_pending_output;
+}
+
+// Runs on the strand, from OnLine().
+void ServerSocket::UnreadLine(const std::string& line)
+{
+    _unread_lines.push_back(line);
+}
+
+void ServerSocket::OnDisconnect(void)
+{
+    delete this;
+}
+
+void ServerSocket::start_write(void)
+{
+    std::lock_guard<std::mutex> lock(_out_mtx);
+    if (_out_queue.empty() or _closed) {
+        _writing = false;
+        return;
+    }
+
+    // References to deque elements stay valid while more output is
+    // appended, so the buffer lives until handle_write() pops it.
+    boost::asio::async_write(*_socket, boost::asio::buffer(_out_queue.front()),
+        _strand->wrap(boost::bind(&ServerSocket::handle_write, this,
+                                  boost::asio::placeholders::error)));
+}
+
+void ServerSocket::handle_write(const boost::system::error_code& error)
+{
+    bool close_now;
     {
-        _socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both);
-        _socket->close();
+        std::lock_guard<std::mutex> lock(_out_mtx);
+        _out_bytes -= _out_queue.front().size();
+        _out_queue.pop_front();
+
+        if (error) {
+            // Don't log the harmless errors caused by the remote side
+            // going away while we still had stuff to send.
+            if (error != boost::asio::error::not_connected and
+                error != boost::asio::error::broken_pipe and
+                error != boost::asio::error::connection_reset and
+                error != boost::asio::error::operation_aborted and
+                error != boost::asio::error::bad_descriptor)
+                logger().warn("ServerSocket::Send(): %s",
+                              error.message().c_str());
+            _out_queue.clear();
+            _out_bytes = 0;
+        }
+        else if (not _out_queue.empty() and not _closed) {
+            boost::asio::async_write(*_socket,
+                boost::asio::buffer(_out_queue.front()),
+                _strand->wrap(boost::bind(&ServerSocket::handle_write, this,
+                                          boost::asio::placeholders::error)));
+            return;
+        }
+        _writing = false;
+        close_now = error or _close_requested;
+    }
+
+    if (close_now)
+        shutdown();
+    else if (_read_paused and AcceptingInput()) {
+        _read_paused = false;
+        start_read();
     }
-    catch (const boost::system::system_error& e)
+    maybe_disconnect();
+}
+
+void ServerSocket::ResumeInput(void)
+{
+    std::lock_guard<std::mutex> lock(_out_mtx);
+    if (_disconnected) return;
+    post([this]
     {
-        if (e.code() != boost::asio::error::not_connected)
-        {
-            logger().error("ServerSocket::handle_connection(): Error closing socket: %s", e.what());
+        if (_read_paused and AcceptingInput()) {
+            _read_paused = false;
+            start_read();
         }
+    });
+}
+
+// This is usually called in a different thread than the i/o threads.
+// It's purpose in life is to terminate the connection, once the reply
+// to the last request has been sent. Closing the socket makes the
+// pending read fail, which ends the connection.
+void ServerSocket::SetCloseAndDelete()
+{
+    logger().debug("ServerSocket::SetCloseAndDelete()");
+    std::lock_guard<std::mutex> lock(_out_mtx);
+    if (_close_requested or _disconnected) return;
+    _close_requested = true;
+
+    // handle_write() will shut down once the output is drained.
+    if (_writing) return;
+    post([this] { shutdown(); });
+}
+
+// Must run on the strand.
+void ServerSocket::shutdown(void)
+{
+    {
+        std::lock_guard<std::mutex> lock(_out_mtx);
+        if (_closed and _read_done) return;
+        _closed = true;
+    }
+
+    boost::system::error_code error;
+    _socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+    _socket->close(error);
+
+    // Nobody is reading, so nobody would notice the closed socket.
+    if (_read_paused) {
+        _read_paused = false;
+        finish_read();
     }
 }
 
@@ -138,54 +268,99 @@ void ServerSocket::set_connection(boost::asio::ip::tcp::socket* sock)
     _socket = sock;
 }
 
-void ServerSocket::handle_connection(void)
+void ServerSocket::start(boost::asio::io_service& io_service)
 {
-    logger().debug("ServerSocket::handle_connection()");
-    OnConnection();
-    boost::asio::streambuf b;
-    while (true)
+    logger().debug("ServerSocket::start()");
+    _strand.reset(new boost::asio::io_service::strand(io_service));
+
+    std::lock_guard<std::mutex> lock(_out_mtx);
+    post([this]
     {
-        try
-        {
-            boost::asio::read_until(*_socket, b, match_eol_or_escape);
-            std::istream is(&b);
-            std::string line;
-            std::getline(is, line);
-            if (!line.empty() && line[line.length()-1] == '\r') {
-                line.erase(line.end()-1);
-            }
-            OnLine(line);
+        OnConnection();
+        start_read();
+    });
+}
+
+// Must run on the strand.
+void ServerSocket::start_read(void)
+{
+    if (not AcceptingInput()) {
+        // ResumeInput() or handle_write() will pick it up from here.
+        _read_paused = true;
+        return;
+    }
+
+    while (not _unread_lines.empty()) {
+        std::string line;
+        line.swap(_unread_lines.front());
+        _unread_lines.pop_front();
+        OnLine(line);
+
+        if (not AcceptingInput()) {
+            _read_paused = true;
+            return;
         }
-        catch (const boost::system::system_error& e)
+    }
+
+    boost::asio::async_read_until(*_socket, _inbuf, match_eol_or_escape,
+        _strand->wrap(boost::bind(&ServerSocket::handle_read, this,
+                                  boost::asio::placeholders::error)));
+}
+
+void ServerSocket::handle_read(const boost::system::error_code& error)
+{
+    if (error) {
+        if (error != boost::asio::error::eof and
+            error != boost::asio::error::connection_reset and
+            error != boost::asio::error::not_connected and
+            error != boost::asio::error::operation_aborted and
+            error != boost::asio::error::bad_descriptor)
         {
-            if (e.code() == boost::asio::error::eof) {
-                break;
-            } else if (e.code() == boost::asio::error::connection_reset) {
-                break;
-            } else if (e.code() == boost::asio::error::not_connected) {
-                break;
-            } else {
-                logger().error("ServerSocket::handle_connection(): Error reading data. Message: %s", e.what());
-            }
+            logger().error("ServerSocket::handle_read(): Error reading data. "
+                           "Message: %s", error.message().c_str());
         }
+        finish_read();
+        return;
     }
 
-    logger().debug("ServerSocket::exiting handle_connection()");
+    std::istream is(&_inbuf);
+    std::string line;
+    std::getline(is, line);
+    if (!line.empty() && line[line.length()-1] == '\r') {
+        line.erase(line.end()-1);
+    }
+    OnLine(line);
 
-    std::lock_guard<std::mutex> lock(_asio_crash);
-    try
+    start_read();
+}
+
+// Must run on the strand. No more input will be read.
+void ServerSocket::finish_read(void)
+{
+    logger().debug("ServerSocket::finish_read()");
     {
-        _socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both);
-        _socket->close();
+        std::lock_guard<std::mutex> lock(_out_mtx);
+        _read_done = true;
+        _closed = true;
     }
-    catch (const boost::system::system_error& e)
+
+    boost::system::error_code error;
+    _socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+    _socket->close(error);
+
+    maybe_disconnect();
+}
+
+// The connection is over once reading has stopped, and no write or
+// posted handler is outstanding; after that, nothing refers to us.
+void ServerSocket::maybe_disconnect(void)
+{
     {
-        if (e.code() != boost::asio::error::not_connected and
-            e.code() != boost::asio::error::bad_descriptor)
-        {
-            logger().error("ServerSocket::handle_connection(): Error closing socket: %s", e.what());
-        }
+        std::lock_guard<std::mutex> lock(_out_mtx);
+        if (_disconnected or not _read_done or _writing or _pending_posts)
+            return;
+        _disconnected = true;
     }
-
-    delete this;
+    logger().debug("ServerSocket::exiting connection");
+    OnDisconnect();
 }
@@ -25,6 +25,12 @@
 #ifndef _OPENCOG_SERVER_SOCKET_H
 #define _OPENCOG_SERVER_SOCKET_H
 
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
 #include <boost/asio.hpp>
 
 namespace opencog
@@ -38,11 +44,60 @@ namespace opencog
  * have to handle the primary interface of the cogserver.
  *
  * Each ServerSocket supports a client that connects to the cog server.
+ *
+ * All socket i/o is asynchronous, and runs on the network server's pool
+ * of i/o threads; no thread is tied to a connection. Input is read one
+ * line at a time and handed to OnLine(). Output passed to Send() is
+ * queued and written in order, by a single write in flight at a time.
+ * All the callbacks of one connection are serialized through a strand,
+ * so OnLine() is never called concurrently for the same client.
+ *
+ * Backpressure: before reading the next line, the socket asks
+ * AcceptingInput(). If it says no (by default: because too much output
+ * is still waiting to be written to a slow client), reading stops until
+ * ResumeInput() is called, or the pending output has been written.
+ *
+ * When the connection goes away, OnDisconnect() is called exactly once,
+ * after which no other callback will run. The default implementation
+ * deletes the socket.
  */
 class ServerSocket
 {
 private:
     boost::asio::ip::tcp::socket* _socket;
+    std::unique_ptr<boost::asio::io_service::strand> _strand;
+    boost::asio::streambuf _inbuf;
+
+    /** Lines handed back by UnreadLine(), read before any new input */
+    std::deque<std::string> _unread_lines;
+
+    /** Protects the output queue and the connection state */
+    std::mutex _out_mtx;
+    std::deque<std::string> _out_queue;
+    size_t _out_bytes;
+    bool _writing;
+
+    /** Output bytes above which input from the client is held off */
+    size_t _max_pending_output;
+
+    bool _read_paused;
+    bool _read_done;
+    bool _close_requested;
+    bool _closed;
+    bool _disconnected;
+
+    /** Handlers posted from other threads, that have not run yet */
+    unsigned int _pending_posts;
+
+    void post(std::function<void()>);
+
+    void start_read(void);
+    void handle_read(const boost::system::error_code&);
+    void start_write(void);
+    void handle_write(const boost::system::error_code&);
+    void shutdown(void);
+    void finish_read(void);
+    void maybe_disconnect(void);
 
 protected:
     /**
@@ -55,20 +110,55 @@ protected:
      */
     virtual void OnLine (const std::string&) = 0;
 
+    /**
+     * Backpressure callback: called before reading more input from
+     * the client. Return false to stop reading, until ResumeInput()
+     * is called.
+     */
+    virtual bool AcceptingInput(void);
+
+    /**
+     * Called once the connection is closed and all of its i/o has
+     * completed. Deletes this object by default.
+     */
+    virtual void OnDisconnect(void);
+
+    /**
+     * Hands a line back, to be passed to OnLine() again before any new
+     * input, once AcceptingInput() agrees. Only to be called from
+     * OnLine().
+     */
+    void UnreadLine(const std::string&);
+
+    /** Number of bytes queued by Send() and not yet written */
+    size_t PendingOutput(void);
+
 public:
     ServerSocket(void);
     virtual ~ServerSocket();
 
     void set_connection(boost::asio::ip::tcp::socket*);
-    void handle_connection(void);
 
     /**
-     * Sends data to the client
+     * Starts serving the connection on the given io_service. Returns
+     * immediately; all further processing happens in the handlers.
+     */
+    void start(boost::asio::io_service&);
+
+    /**
+     * Sends data to the client. Never blocks: the data is queued, and
+     * written as fast as the client reads it.
      */
     void Send(const std::string&);
 
     /**
-     * Close this socket
+     * Resumes reading input, if it was held off by AcceptingInput().
+     * May be called from any thread.
+     */
+    void ResumeInput(void);
+
+    /**
+     * Close this socket, once the queued output has been written.
      */
     void SetCloseAndDelete(void);
 }; // class
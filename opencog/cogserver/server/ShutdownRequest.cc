@@ -46,10 +46,12 @@ bool ShutdownRequest::execute()
 
     _cogserver.stop();
 
+    // Exit before dropping our use-count on the console, as the
+    // latter may delete it.
     ConsoleSocket* con = get_console();
     OC_ASSERT(con, "Bad request state");
-    set_console(nullptr);
     con->Exit();
+    set_console(nullptr);
 
     return true;
 }
@@ -47,7 +47,8 @@ public:
             "sleep",
             "Sleep for the number of given seconds (default: 5 seconds)",
             "Usage: sleep [<num seconds>]\n\n"
-            "Busy-sleep for the number of given seconds (default: 5 seconds)"
+            "Busy-sleep for the number of given seconds (default: 5 seconds)",
+            false, false, LONG_RUNNING_REQUEST
         );
         return _cci;
     }
@@ -23,6 +23,9 @@
 
 #include "SystemActivityTable.h"
 
+#include <algorithm>
+
+#include <opencog/util/Config.h>
 #include <opencog/util/Logger.h>
 #include <opencog/util/exceptions.h>
 #include <opencog/util/platform.h>
@@ -31,8 +34,83 @@
 
 using namespace opencog;
 
+AgentActivityLog::AgentActivityLog(size_t capacity) :
+        utilizedCycle(-1), _capacity(std::max<size_t>(1, capacity)),
+        _slots(new Slot[_capacity]), _head(0)
+{
+    for (size_t n = 0; n < _capacity; n++) {
+        _slots[n].seq.store(0, std::memory_order_relaxed);
+        _slots[n].run.store(0, std::memory_order_relaxed);
+    }
+}
+
+void AgentActivityLog::append(const Activity& a)
+{
+    unsigned long run = _head.load(std::memory_order_relaxed);
+    Slot& slot = _slots[run % _capacity];
+
+    // An odd sequence number tells readers the slot is being written.
+    unsigned long seq = slot.seq.load(std::memory_order_relaxed);
+    slot.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.run.store(run, std::memory_order_relaxed);
+    slot.cycleCount.store(a.cycleCount, std::memory_order_relaxed);
+    slot.elapsed.store(a.elapsedTime.count(), std::memory_order_relaxed);
+    slot.memUsed.store(a.memUsed, std::memory_order_relaxed);
+    slot.atomsUsed.store(a.atomsUsed, std::memory_order_relaxed);
+    slot.probed.store(a.probed, std::memory_order_relaxed);
+
+    slot.seq.store(seq + 2, std::memory_order_release);
+    _head.store(run + 1, std::memory_order_release);
+}
+
+ActivitySeq AgentActivityLog::read(size_t max) const
+{
+    unsigned long head = _head.load(std::memory_order_acquire);
+    size_t n = std::min<size_t>(std::min<size_t>(max, _capacity), head);
+
+    ActivitySeq result;
+    result.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        unsigned long run = head - 1 - i;
+        const Slot& slot = _slots[run % _capacity];
+        Activity a;
+        unsigned long seq, recycled;
+        do {
+            seq = slot.seq.load(std::memory_order_acquire);
+            recycled = slot.run.load(std::memory_order_relaxed);
+            a.cycleCount = slot.cycleCount.load(std::memory_order_relaxed);
+            a.elapsedTime = std::chrono::system_clock::duration(
+                slot.elapsed.load(std::memory_order_relaxed));
+            a.memUsed = slot.memUsed.load(std::memory_order_relaxed);
+            a.atomsUsed = slot.atomsUsed.load(std::memory_order_relaxed);
+            a.probed = slot.probed.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) or seq != slot.seq.load(std::memory_order_relaxed));
+
+        // The writer went round the ring while we were reading: this slot,
+        // and all the older ones, now hold more recent runs.
+        if (recycled != run)
+            break;
+        result.push_back(a);
+    }
+    return result;
+}
+
+void AgentActivityLog::copyFrom(const AgentActivityLog& other)
+{
+    ActivitySeq recent = other.read(_capacity);
+    for (auto it = recent.rbegin(); it != recent.rend(); ++it)
+        append(*it);
+
+    std::lock_guard<std::mutex> lock(other.utilizedMutex);
+    utilizedHandleSets = other.utilizedHandleSets;
+    utilizedCycle = other.utilizedCycle;
+}
+
 SystemActivityTable::SystemActivityTable() : _maxAgentActivityTableSeqSize(100),
-        _cogServer(nullptr)
+        _probeInterval(10), _cogServer(nullptr)
 {
     logger().debug("[SystemActivityTable] constructor");
 }
@@ -49,81 +127,130 @@ void SystemActivityTable::init(CogServer *cogServer)
 {
     logger().debug("[SystemActivityTable] init");
     _cogServer = cogServer;
+    if (config().has("SERVER_ACTIVITY_PROBE_INTERVAL"))
+        _probeInterval = config().get_int("SERVER_ACTIVITY_PROBE_INTERVAL");
     _conn = cogServer->getAtomSpace().removeAtomSignal(
             boost::bind(&SystemActivityTable::atomRemoved, this, _1));
 }
 
 void SystemActivityTable::setMaxAgentActivityTableSeqSize(size_t n)
 {
-    std::lock_guard<std::mutex> lock(_activityTableMutex);
     _maxAgentActivityTableSeqSize = n;
-
-    for (AgentActivityTable::iterator it  = _agentActivityTable.begin();
-                                      it != _agentActivityTable.end(); ++it) {
-        ActivitySeq &seq = it->second;
-        trimActivitySeq(seq, _maxAgentActivityTableSeqSize);
-    }
 }
 
-void SystemActivityTable::trimActivitySeq(ActivitySeq &seq, size_t max)
+std::shared_ptr<AgentActivityLog> SystemActivityTable::log(const AgentPtr& agent)
 {
-    if (seq.size() <= max)
-        return;
-    for (size_t n = max; n < seq.size(); n++)
-        delete seq[n];
-    seq.resize(max);
+    size_t max = _maxAgentActivityTableSeqSize;
+    std::shared_ptr<AgentActivityLog> current =
+        std::atomic_load(&agent->_activityLog);
+    if (current and current->capacity() == std::max<size_t>(1, max))
+        return current;
+
+    // First run of the agent, or its ring has to be resized: this is the
+    // only place where logging allocates or locks.
+    std::shared_ptr<AgentActivityLog> fresh(new AgentActivityLog(max));
+    if (current)
+        fresh->copyFrom(*current);
+
+    std::lock_guard<std::mutex> lock(_activityTableMutex);
+    _logs[agent] = fresh;
+    std::atomic_store(&agent->_activityLog, fresh);
+    return fresh;
 }
 
 void SystemActivityTable::atomRemoved(AtomPtr atom)
 {
     Handle h = atom->getHandle();
     std::lock_guard<std::mutex> lock(_activityTableMutex);
-    for (AgentActivityTable::iterator it  = _agentActivityTable.begin();
-                                      it != _agentActivityTable.end(); ++it) {
-        ActivitySeq &seq = it->second;
-        for (size_t n = 0; n < seq.size(); n++) {
-            Activity *a = seq[n];
-            for (size_t i = 0; i < a->utilizedHandleSets.size(); i++) {
-                a->utilizedHandleSets[i].erase(h);
-            }
-        }
+    for (auto& entry : _logs) {
+        AgentActivityLog& log = *entry.second;
+        std::lock_guard<std::mutex> utilizedLock(log.utilizedMutex);
+        for (size_t i = 0; i < log.utilizedHandleSets.size(); i++)
+            log.utilizedHandleSets[i].erase(h);
     }
 }
 
+bool SystemActivityTable::probeDue(const AgentPtr& agent)
+{
+    unsigned int interval = _probeInterval;
+    if (interval == 0)
+        return false;
+    return log(agent)->runs() % interval == 0;
+}
+
 void SystemActivityTable::logActivity(AgentPtr agent,
     std::chrono::system_clock::duration elapsedTime, size_t memUsed,
-    size_t atomsUsed)
+    size_t atomsUsed, bool probed)
 {
-    std::lock_guard<std::mutex> lock(_activityTableMutex);
-    ActivitySeq& as = _agentActivityTable[agent];
-    as.insert(as.begin(),
-        new Activity(_cogServer->getCycleCount(), elapsedTime, memUsed,
-                 atomsUsed,
-                 agent->getUtilizedHandleSets()));
-    trimActivitySeq(as, _maxAgentActivityTableSeqSize);
+    // Hold on to the log: the agent may be cleared meanwhile.
+    std::shared_ptr<AgentActivityLog> log = this->log(agent);
+    long cycle = _cogServer->getCycleCount();
+
+    if (probed) {
+        std::vector<UnorderedHandleSet> utilized =
+            agent->getUtilizedHandleSets();
+        std::lock_guard<std::mutex> lock(log->utilizedMutex);
+        log->utilizedHandleSets.swap(utilized);
+        log->utilizedCycle = cycle;
+    }
+
+    log->append(Activity{cycle, elapsedTime, memUsed, atomsUsed, probed});
+}
+
+static AgentActivity snapshot(const AgentActivityLog& log, size_t max)
+{
+    AgentActivity result;
+    result.runs = log.runs();
+    result.activities = log.read(max);
+    std::lock_guard<std::mutex> lock(log.utilizedMutex);
+    result.utilizedHandleSets = log.utilizedHandleSets;
+    result.utilizedCycle = log.utilizedCycle;
+    return result;
+}
+
+AgentActivityTable SystemActivityTable::agentActivityTable()
+{
+    std::map<AgentPtr, std::shared_ptr<AgentActivityLog>> logs;
+    {
+        std::lock_guard<std::mutex> lock(_activityTableMutex);
+        logs = _logs;
+    }
+
+    size_t max = _maxAgentActivityTableSeqSize;
+    AgentActivityTable table;
+    for (const auto& entry : logs)
+        table[entry.first] = snapshot(*entry.second, max);
+    return table;
+}
+
+AgentActivity SystemActivityTable::agentActivity(const AgentPtr& agent)
+{
+    std::shared_ptr<AgentActivityLog> log;
+    {
+        std::lock_guard<std::mutex> lock(_activityTableMutex);
+        auto it = _logs.find(agent);
+        if (it != _logs.end())
+            log = it->second;
+    }
+    if (not log)
+        return AgentActivity{ActivitySeq(), 0,
+                             std::vector<UnorderedHandleSet>(), -1};
+    return snapshot(*log, _maxAgentActivityTableSeqSize);
 }
 
 void SystemActivityTable::clearActivity(AgentPtr agent)
 {
     std::lock_guard<std::mutex> lock(_activityTableMutex);
-    AgentActivityTable::iterator it = _agentActivityTable.find(agent);
-    if (it == _agentActivityTable.end())
-        return;
-    ActivitySeq &seq = it->second;
-    for (size_t n = 0; n < seq.size(); n++)
-        delete seq[n];
-    _agentActivityTable.erase(it);
+    _logs.erase(agent);
+    std::atomic_store(&agent->_activityLog,
+                      std::shared_ptr<AgentActivityLog>());
 }
 
 void SystemActivityTable::clearActivity()
 {
     std::lock_guard<std::mutex> lock(_activityTableMutex);
-    for (AgentActivityTable::iterator it  = _agentActivityTable.begin();
-                                      it != _agentActivityTable.end(); ++it) {
-        ActivitySeq& seq = it->second;
-        for (size_t n = 0; n < seq.size(); n++)
-            delete seq[n];
-    }
-    _agentActivityTable.clear();
+    for (auto& entry : _logs)
+        std::atomic_store(&entry.first->_activityLog,
+                          std::shared_ptr<AgentActivityLog>());
+    _logs.clear();
 }
-
@@ -25,14 +25,15 @@
 #ifndef _OPENCOG_SYSTEM_ACTIVITY_TABLE_H
 #define _OPENCOG_SYSTEM_ACTIVITY_TABLE_H
 
-#include <string>
-#include <queue>
+#include <atomic>
+#include <chrono>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <vector>
 
 #include <opencog/cogserver/server/Agent.h>
-#include <opencog/cogserver/server/SystemActivityTable.h>
 #include <opencog/util/Logger.h>
 
 namespace opencog
@@ -42,29 +43,89 @@ namespace opencog
  */
 
 /**
- * This class implements storage for activity data.
+ * One run of an agent, as recorded in the SystemActivityTable.
+ *
+ * memUsed and atomsUsed are only measured on probed runs, see
+ * SystemActivityTable::setProbeInterval(); they are 0 otherwise.
  */
-class Activity
+struct Activity
 {
-public:
-    Activity(long cycleCount, std::chrono::system_clock::duration elapsedTime,
-                              size_t memUsed, size_t atomsUsed,
-                              const std::vector<UnorderedHandleSet>& utilized) :
-            cycleCount(cycleCount),
-            elapsedTime(elapsedTime),
-            memUsed(memUsed),
-            atomsUsed(atomsUsed) {
-        for (size_t n = 0; n < utilized.size(); n++)
-            utilizedHandleSets.push_back(utilized[n]);
-    }
     long cycleCount;
     std::chrono::system_clock::duration elapsedTime;
     size_t memUsed;
     size_t atomsUsed;
+    bool probed;
+};
+typedef std::vector<Activity> ActivitySeq;
+
+/**
+ * A snapshot of the activity of one agent.
+ */
+struct AgentActivity
+{
+    /** The most recent runs, most recent first */
+    ActivitySeq activities;
+
+    /** Total number of runs logged, including the ones no longer kept */
+    unsigned long runs;
+
+    /** The handle sets the agent reported on its last probed run, and the
+     *  cycle of that run (-1 if it has not been probed yet). */
+    std::vector<UnorderedHandleSet> utilizedHandleSets;
+    long utilizedCycle;
+};
+typedef std::map<AgentPtr, AgentActivity> AgentActivityTable;
+
+/**
+ * The activity log of one agent: a fixed size ring of samples.
+ *
+ * The ring has a single writer, the thread running the agent, which never
+ * blocks and never allocates. Readers copy it out without locking: each
+ * slot is guarded by a sequence number, and a reader retries a slot that
+ * is being written and stops at slots that have already been recycled.
+ */
+class AgentActivityLog
+{
+public:
+    AgentActivityLog(size_t capacity);
+
+    size_t capacity() const { return _capacity; }
+    unsigned long runs() const {
+        return _head.load(std::memory_order_acquire);
+    }
+
+    /** Appends a sample. Must only be called from the writer thread. */
+    void append(const Activity&);
+
+    /** Copies out up to max samples, most recent first */
+    ActivitySeq read(size_t max) const;
+
+    /** Copies the samples of another log, when resizing. Must be called
+     *  before this log is published. */
+    void copyFrom(const AgentActivityLog&);
+
+    /** The handle sets of the last probed run. Only touched on probed
+     *  runs, so a plain lock is good enough. */
     std::vector<UnorderedHandleSet> utilizedHandleSets;
+    long utilizedCycle;
+    mutable std::mutex utilizedMutex;
+
+private:
+    struct Slot
+    {
+        std::atomic<unsigned long> seq;
+        std::atomic<unsigned long> run;
+        std::atomic<long> cycleCount;
+        std::atomic<std::chrono::system_clock::rep> elapsed;
+        std::atomic<size_t> memUsed;
+        std::atomic<size_t> atomsUsed;
+        std::atomic<bool> probed;
+    };
+
+    size_t _capacity;
+    std::unique_ptr<Slot[]> _slots;
+    std::atomic<unsigned long> _head;
 };
-typedef std::vector<Activity*> ActivitySeq;
-typedef std::map<AgentPtr, ActivitySeq> AgentActivityTable;
 
 class CogServer;
 
@@ -72,25 +133,36 @@ class CogServer;
  * This class implements the entity responsible for logging of all system
  * activity.
  *
+ * Logging is cheap enough to be done on every agent run: each agent gets
+ * its own lock-free ring of samples (see AgentActivityLog) the first time
+ * it runs. The expensive probes (memory usage, atomspace size and the
+ * utilized handle sets) are only taken every probeInterval() runs of an
+ * agent, as configured by "SERVER_ACTIVITY_PROBE_INTERVAL".
+ *
  * See http://opencog.org/wiki/OpenCogPrime:AttentionalDataMining
  */
 class SystemActivityTable
 {
 protected:
-    AgentActivityTable _agentActivityTable;
-    size_t _maxAgentActivityTableSeqSize;
+    /** The logs of all agents, for readers. Writers find their log
+     *  through the agent itself and don't touch this. */
+    std::map<AgentPtr, std::shared_ptr<AgentActivityLog>> _logs;
+    std::atomic<size_t> _maxAgentActivityTableSeqSize;
+    std::atomic<unsigned int> _probeInterval;
     CogServer* _cogServer;
     boost::signals2::connection _conn;
 
-    /** Protects _agentActivityTable from concurrent access. It is possible to
-     * implement fine grained locking per agent. */
+    /** Protects _logs; never taken on the logging fast path. */
     std::mutex _activityTableMutex;
 
     /** called by AtomSpace via a boost::signals2::signal when an atom is removed. */
     void atomRemoved(AtomPtr);
 
-    /** trim Activity sequence to a maximum size */
-    void trimActivitySeq(ActivitySeq&, size_t max);
+    /** Returns the log of an agent, creating it, or replacing it if its
+     *  size is no longer the configured one. The caller must keep the
+     *  returned pointer while using the log, since clearActivity() may
+     *  drop it from another thread. */
+    std::shared_ptr<AgentActivityLog> log(const AgentPtr&);
 
 public:
 
@@ -103,28 +175,44 @@ public:
     /** initialize the SystemActivityTable */
     virtual void init(CogServer*);
 
-    /** Returns the agent activity table
-     *  Activities will be listed with the most recent first. */
-    AgentActivityTable agentActivityTable() {
-        std::lock_guard<std::mutex> lock(_activityTableMutex);
-        return _agentActivityTable;
-    }
+    /** Returns a snapshot of the agent activity table.
+     *  Activities will be listed with the most recent first. This never
+     *  blocks the agents that are logging. */
+    AgentActivityTable agentActivityTable();
+
+    /** Returns a snapshot of the activity of a single agent */
+    AgentActivity agentActivity(const AgentPtr&);
 
     /** Get the maximum size of a sequence in the AgentActivityTable */
     size_t maxAgentActivityTableSeqSize() const {
         return _maxAgentActivityTableSeqSize;
     }
 
-    /** Set the maximum size of a sequence in the AgentActivityTable */
+    /** Set the maximum size of a sequence in the AgentActivityTable.
+     *  Snapshots are trimmed right away; the ring of each agent is
+     *  resized on its next run. */
     void setMaxAgentActivityTableSeqSize(size_t);
 
-    /** Logs activity of an Agent.
+    /** Get the number of runs between two probes of an agent. 0 means the
+     *  expensive probes are disabled. */
+    unsigned int probeInterval() const { return _probeInterval; }
+
+    /** Set the number of runs between two probes of an agent. */
+    void setProbeInterval(unsigned int n) { _probeInterval = n; }
+
+    /** Tells whether the next run of the agent should be probed. Must be
+     *  called from the thread running the agent. */
+    bool probeDue(const AgentPtr&);
+
+    /** Logs activity of an Agent. Must be called from the thread running
+     *  the agent.
      *
-     *  This will call agent->getUtilizedHandleSets() to get a list of handle
-     *  sets utilized in the activity that has just been completed.
+     *  On probed runs, this will call agent->getUtilizedHandleSets() to get
+     *  a list of handle sets utilized in the activity that has just been
+     *  completed.
      */
     void logActivity(AgentPtr, std::chrono::system_clock::duration,
-        size_t memUsed, size_t atomsUsed);
+        size_t memUsed, size_t atomsUsed, bool probed = true);
 
     /** Clear activity of a specified Agent. */
     void clearActivity(AgentPtr);
@@ -27,6 +27,7 @@
 #include <opencog/util/oc_assert.h>
 
 #include <opencog/cogserver/server/ConsoleSocket.h>
+#include <opencog/cogserver/server/EvalPool.h>
 #include <opencog/eval/GenericEval.h>
 #include "GenericShell.h"
 
@@ -61,29 +62,14 @@ GenericShell::GenericShell(void)
 
 	evaluator = nullptr;
 	socket = nullptr;
-	evalthr = nullptr;
-	pollthr = nullptr;
 	self_destruct = false;
+	_eval_busy = false;
 }
 
 GenericShell::~GenericShell()
 {
-	if (evalthr)
-	{
-		logger().debug("[GenericShell] dtor, wait for eval threads.");
-		evalthr->join();
-		delete evalthr;
-		evalthr = nullptr;
-	}
-
-	if (pollthr)
-	{
-		logger().debug("[GenericShell] dtor, wait for writer threads.");
-		pollthr->join();
-		delete pollthr;
-		pollthr = nullptr;
-	}
-	logger().debug("[GenericShell] dtor finsihed.");
+	// No evaluation can be running: each of them holds a reference.
+	logger().debug("[GenericShell] dtor");
 }
 
 /* ============================================================== */
@@ -124,7 +110,19 @@ void GenericShell::set_socket(ConsoleSocket *s)
 	OC_ASSERT(socket==nullptr, "Shell already associated with socket!");
 
 	socket = s;
-	socket->SetShell(this);
+	socket->SetShell(std::shared_ptr<GenericShell>(this));
+}
+
+void GenericShell::socket_closed(void)
+{
+	std::lock_guard<std::mutex> lock(_socket_mtx);
+	socket = nullptr;
+}
+
+void GenericShell::send_output(const std::string& s)
+{
+	std::lock_guard<std::mutex> lock(_socket_mtx);
+	if (socket) socket->Send(s);
 }
 
 /* ============================================================== */
@@ -149,14 +147,16 @@ static GenericShell* _redirector = nullptr;
 //    output is generated, instead of waiting for the evaluation
 //    to terminate first, before relaying output.
 //
-// The above requirements force us to create not just one, but two
-// threads for each evaluation: one thread for the evaluation, and
-// another thread to listen for results, and pass them on.
+// The above requirements force us to run not just one, but two
+// tasks for each evaluation: one for the evaluation, and another one
+// to listen for results, and pass them on. Both run on the EvalPool
+// shared by all shells, which bounds the number of threads no matter
+// how many clients are connected. Expressions that arrive while an
+// evaluation is in progress are queued, and started when it finishes.
 //
-// Side-note: the constructor for this class runs in a different thead
-// than the caller for this method. That's because the socket listen
-// and socket accept runs in a different thread, than the socket
-// receive.  The receiver thread calls us.
+// Side-note: this method is called from one of the network server's
+// i/o threads, which serve many other clients as well; so it must
+// never block.
 //
 void GenericShell::eval(const std::string &expr)
 {
@@ -202,38 +202,13 @@ void GenericShell::eval(const std::string &expr)
 	poll_needed = false;
 	line_discipline(expr);
 
-	// Avoid polling, if an evaluation thread was not created. This is
-	// used to handle interrupts (control-c's).
+	// If no evaluation was queued, there's no evaluator output to wait
+	// for. This is used to handle interrupts (control-c's).
 	if (not poll_needed)
 	{
-		std::string retstr = poll_output();
-		socket->Send(retstr);
-	}
-	else
-	{
-		// Poll for output from the evaluator, and send back results.
-		auto poll_wrapper = [&](void)
-		{
-			std::string retstr = poll_output();
-			while (0 < retstr.size())
-			{
-				socket->Send(retstr);
-				retstr = poll_output();
-			}
-		};
-
-		// Always wait for the previous poll of results to complete, before
-		// starting the next one.  The goal here is to keep results
-		// serialized on the socket, so that chronologically-earlier
-		// results are written to the socket in order, before the newer
-		// results.
-		if (pollthr)
-		{
-			pollthr->join();
-			delete pollthr;
-		}
-		sched_yield();
-		pollthr = new std::thread(poll_wrapper);
+		std::string retstr = take_pending_output();
+		if (0 < retstr.size())
+			socket->Send(retstr);
 	}
 
 #ifdef PERFORM_STDOUT_DUPLICATION
@@ -282,13 +257,12 @@ void GenericShell::eval(const std::string &expr)
 #endif // PERFORM_STDOUT_DUPLICATION
 
 	// The user is exiting the shell. No one will ever call a method on
-	// this instance ever again. So stop hogging space, and self-destruct.
-	// We have to do this here; there is no other opportunity to call dtor.
+	// this instance ever again. The socket lets go of it; it is freed
+	// by the caller, or by the last evaluation still in progress.
 	if (self_destruct)
 	{
 		socket->sendPrompt();
 		socket->SetShell(nullptr);
-		delete this;
 	}
 }
 
@@ -328,6 +302,7 @@ void GenericShell::line_discipline(const std::string &expr)
 			c = expr[i+1];
 			if ((IP == c) || (AO == c))
 			{
+				discard_queued_evals();
 				evaluator->interrupt();
 				evaluator->clear_pending();
 				put_output(abort_prompt);
@@ -350,6 +325,7 @@ void GenericShell::line_discipline(const std::string &expr)
 	unsigned char c = expr[len-1];
 	if ((SYN == c) || (CAN == c) || (ESC == c))
 	{
+		discard_queued_evals();
 		evaluator->interrupt();
 		evaluator->clear_pending();
 		put_output("\n");
@@ -387,42 +363,74 @@ void GenericShell::line_discipline(const std::string &expr)
  */
 void GenericShell::do_eval(const std::string &input)
 {
-	// Always wait for the previous evaluation to complete, before
-	// starting the next one.  That is, evaluations are always
-	// explicitly serialized.
-	//
-	// ... and even if they were not, we cannot use the same evaluator
-	// in two different threads at the same time; a single evaluator is
-	// not thread-safe against itself. So always wait for the previous
-	// evaluation thread to finish, before we go at it again.
-	if (evalthr)
-	{
-		evalthr->join();
-		delete evalthr;
-		evalthr = nullptr;
-	}
+	// Evaluations are always explicitly serialized: a single evaluator
+	// is not thread-safe against itself. So if one is in progress, just
+	// queue the input; it is started when the previous one is done.
+	std::unique_lock<std::mutex> lock(_eval_mtx);
+	poll_needed = true;
+	_eval_queue.push_back(input);
+	if (_eval_busy) return;
+	_eval_busy = true;
+	lock.unlock();
+
+	start_next_eval();
+}
 
-	// Wait for the polling thread to finish also, as otherwise a new
-	// evaluation might be started before polling for the last one has
-	// finished.  The new evaluation might clobber previous results.
-	if (pollthr)
+void GenericShell::start_next_eval(void)
+{
+	std::string input;
 	{
-		pollthr->join();
-		delete pollthr;
-		pollthr = nullptr;
+		std::lock_guard<std::mutex> lock(_eval_mtx);
+		input = _eval_queue.front();
+		_eval_queue.pop_front();
 	}
 
 	eval_done = false;
-	poll_needed = true;
-	evaluator->begin_eval(); // must be called in same thread as poll_result
+	evaluator->begin_eval();
 
-	auto eval_wrapper = [&](const std::string& in)
+	// The tasks keep the shell alive until they are done, even if the
+	// socket has let go of it in the meantime.
+	std::shared_ptr<GenericShell> self(shared_from_this());
+
+	auto eval_task = [self, input](void)
 	{
-		thread_init();
-		evaluator->eval_expr(in);
+		self->thread_init();
+		self->evaluator->eval_expr(input);
 	};
 
-	evalthr = new std::thread(eval_wrapper, input);
+	// Poll for output from the evaluator, and send back results.
+	auto poll_task = [self](void)
+	{
+		std::string retstr = self->poll_output();
+		while (0 < retstr.size())
+		{
+			self->send_output(retstr);
+			retstr = self->poll_output();
+		}
+	};
+
+	// Results of the next expression are polled only after the ones
+	// of this expression are all written, to keep them in order.
+	auto done = [self](void)
+	{
+		{
+			std::lock_guard<std::mutex> lock(self->_eval_mtx);
+			if (self->_eval_queue.empty())
+			{
+				self->_eval_busy = false;
+				return;
+			}
+		}
+		self->start_next_eval();
+	};
+
+	eval_pool().submit(eval_task, poll_task, done);
+}
+
+void GenericShell::discard_queued_evals(void)
+{
+	std::lock_guard<std::mutex> lock(_eval_mtx);
+	_eval_queue.clear();
 }
 
 void GenericShell::thread_init(void)
@@ -434,22 +442,28 @@ void GenericShell::thread_init(void)
 
 void GenericShell::put_output(const std::string& s)
 {
-	pending_output += s;	
+	std::lock_guard<std::mutex> lock(_output_mtx);
+	pending_output += s;
+}
+
+std::string GenericShell::take_pending_output(void)
+{
+	std::lock_guard<std::mutex> lock(_output_mtx);
+	std::string result = pending_output;
+	pending_output.clear();
+	return result;
 }
 
 std::string GenericShell::poll_output()
 {
 	// If there's pending output, return that.
-	if (0 < pending_output.size())
-	{
-		std::string result = pending_output;
-		pending_output.clear();
+	std::string result = take_pending_output();
+	if (0 < result.size())
 		return result;
-	}
 
 	// If we are here, there's no pending output. Does the
 	// evaluator have anything for us?
-	std::string result = evaluator->poll_result();
+	result = evaluator->poll_result();
 	if (0 < result.size())
 		return result;
 
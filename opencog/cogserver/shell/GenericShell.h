@@ -23,8 +23,10 @@
 #ifndef _OPENCOG_GENERIC_SHELL_H
 #define _OPENCOG_GENERIC_SHELL_H
 
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <thread>
 
 /**
  * The GenericShell class implements an "escape" from the default cogserver
@@ -35,6 +37,11 @@
  * in this class. The eval method is then free to parse the input in
  * any way desired.
  *
+ * The shell is owned through a shared_ptr: by the ConsoleSocket it is
+ * attached to, and by its evaluations in progress. Whichever lets go last
+ * frees it, so that neither a disconnecting client nor an exiting shell
+ * ever waits for an evaluation to finish.
+ *
  * If instead a module has only a small number of simple commands that
  * need to be implemented, then the DECLARE_CMD_REQUEST function, defined
  * in Request.h, provides a simpler and easier way implementing comands.
@@ -48,10 +55,26 @@ namespace opencog {
 class ConsoleSocket;
 class GenericEval;
 
-class GenericShell
+class GenericShell : public std::enable_shared_from_this<GenericShell>
 {
 	private:
 		std::string pending_output;
+		std::mutex _output_mtx;
+
+		// Expressions waiting to be evaluated, oldest first. They are
+		// evaluated one at a time, on the shared EvalPool.
+		std::deque<std::string> _eval_queue;
+		bool _eval_busy;
+		std::mutex _eval_mtx;
+
+		// Guards socket against socket_closed(), for the evaluations
+		// that send their output from the EvalPool.
+		std::mutex _socket_mtx;
+
+		void start_next_eval(void);
+		void discard_queued_evals(void);
+		std::string take_pending_output(void);
+		void send_output(const std::string&);
 
 	protected:
 		std::string abort_prompt;
@@ -63,8 +86,6 @@ class GenericShell
 
 		ConsoleSocket* socket;
 		GenericEval* evaluator;
-		std::thread* evalthr;
-		std::thread* pollthr;
 
 		virtual void thread_init(void);
 		virtual void line_discipline(const std::string &expr);
@@ -80,7 +101,17 @@ class GenericShell
 		GenericShell(void);
 		virtual ~GenericShell();
 
+		/**
+		 * Attaches the shell to the socket, which takes ownership of it.
+		 * The shell must have been allocated with new, and not be owned
+		 * by a shared_ptr yet.
+		 */
 		virtual void set_socket(ConsoleSocket *);
+		/**
+		 * Called by the socket when it goes away. Evaluations still in
+		 * progress run to completion, but their output is dropped.
+		 */
+		virtual void socket_closed(void);
 		virtual void eval(const std::string &);
 
 		virtual const std::string& get_prompt(void);
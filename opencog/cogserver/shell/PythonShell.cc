@@ -47,12 +47,6 @@ PythonShell::PythonShell()
 
 PythonShell::~PythonShell()
 {
-    // Eval an empty string as a end-of-file marker. This is needed
-    // to flush pending input in the python shell, as otherwise,
-    // there is no way to know that no more python input will
-    // arrive!
-    GenericShell::do_eval("");
-
     // Don't delete, its currently set to a singleton instance.
     //	if (evaluator) delete evaluator;
 }
@@ -71,6 +65,17 @@ void PythonShell::set_socket(ConsoleSocket *s)
     if (!evaluator) evaluator = &PythonEval::instance();
 }
 
+void PythonShell::socket_closed(void)
+{
+    GenericShell::socket_closed();
+
+    // Eval an empty string as a end-of-file marker. This is needed
+    // to flush pending input in the python shell, as otherwise,
+    // there is no way to know that no more python input will
+    // arrive!
+    if (evaluator) GenericShell::do_eval("");
+}
+
 void PythonShell::eval(const std::string &expr)
 {
     bool selfie = self_destruct;
@@ -48,6 +48,7 @@ public:
     PythonShell(void);
     virtual ~PythonShell();
     virtual void set_socket(ConsoleSocket *);
+    virtual void socket_closed(void);
     virtual void eval(const std::string &);
 };
 
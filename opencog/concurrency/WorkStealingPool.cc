@@ -0,0 +1,145 @@
+/*
+ * opencog/concurrency/WorkStealingPool.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/concurrency/WorkStealingPool.h>
+
+using namespace std;
+
+
+namespace opencog
+{
+
+thread_local int WorkStealingPool::current_index = -1;
+thread_local const WorkStealingPool *WorkStealingPool::current_pool = nullptr;
+
+WorkStealingPool::WorkStealingPool(unsigned int num_workers) :
+        queued(0), pending(0), next_worker(0), stopping(false)
+{
+    if (num_workers == 0)
+        num_workers = max(1u, thread::hardware_concurrency());
+
+    for (unsigned int i = 0; i < num_workers; ++i)
+        workers.emplace_back(new Worker);
+    for (unsigned int i = 0; i < num_workers; ++i)
+        threads.emplace_back(&WorkStealingPool::worker_loop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        lock_guard<mutex> lock(state_mutex);
+        stopping = true;
+    }
+    work_cond.notify_all();
+    for (auto &t : threads)
+        t.join();
+}
+
+void WorkStealingPool::submit(Task task)
+{
+    unsigned int index;
+    if (current_pool == this)
+        index = current_index;
+    else
+        index = next_worker.fetch_add(1, memory_order_relaxed) % workers.size();
+
+    pending.fetch_add(1);
+    queued.fetch_add(1);
+    {
+        lock_guard<mutex> lock(workers[index]->deque_mutex);
+        workers[index]->tasks.push_back(move(task));
+    }
+    {
+        // locking is required, to prevent a lost wake-up in worker_loop()
+        lock_guard<mutex> lock(state_mutex);
+    }
+    work_cond.notify_one();
+}
+
+void WorkStealingPool::wait()
+{
+    unique_lock<mutex> lock(state_mutex);
+    done_cond.wait(lock, [this] { return pending.load() == 0; });
+
+    if (first_error) {
+        exception_ptr e = first_error;
+        first_error = nullptr;
+        rethrow_exception(e);
+    }
+}
+
+bool WorkStealingPool::pop_task(unsigned int index, Task &task)
+{
+    // own deque first, newest task
+    {
+        Worker &w = *workers[index];
+        lock_guard<mutex> lock(w.deque_mutex);
+        if (!w.tasks.empty()) {
+            task = move(w.tasks.back());
+            w.tasks.pop_back();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // then steal the oldest task of somebody else
+    for (size_t i = 1; i < workers.size(); ++i) {
+        Worker &victim = *workers[(index + i) % workers.size()];
+        lock_guard<mutex> lock(victim.deque_mutex);
+        if (!victim.tasks.empty()) {
+            task = move(victim.tasks.front());
+            victim.tasks.pop_front();
+            queued.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::worker_loop(unsigned int index)
+{
+    current_pool = this;
+    current_index = index;
+
+    while (true) {
+        Task task;
+        if (pop_task(index, task)) {
+            try {
+                task();
+            } catch (...) {
+                lock_guard<mutex> lock(state_mutex);
+                if (!first_error)
+                    first_error = current_exception();
+            }
+            if (pending.fetch_sub(1) == 1) {
+                lock_guard<mutex> lock(state_mutex);
+                done_cond.notify_all();
+            }
+            continue;
+        }
+
+        unique_lock<mutex> lock(state_mutex);
+        work_cond.wait(lock,
+            [this] { return stopping or queued.load() > 0; });
+        if (stopping and queued.load() == 0)
+            break;
+    }
+}
+
+} /* namespace opencog */
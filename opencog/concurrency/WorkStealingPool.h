@@ -0,0 +1,112 @@
+/*
+ * opencog/concurrency/WorkStealingPool.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef OPENCOG_CONCURRENCY_WORKSTEALINGPOOL_H_
+#define OPENCOG_CONCURRENCY_WORKSTEALINGPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace opencog
+{
+
+/**
+ * A fixed-size pool of worker threads, each owning a task deque.
+ *
+ * A worker pops tasks from the back of its own deque (LIFO, good for
+ * locality) and, when it runs dry, steals from the front of the other
+ * workers' deques (FIFO, takes the oldest and usually biggest chunk of
+ * pending work). Tasks submitted from inside a worker go to that
+ * worker's own deque; tasks submitted from outside the pool are spread
+ * round-robin.
+ *
+ * wait() blocks until every submitted task (including tasks submitted
+ * by tasks) has finished. If a task throws, the first exception is kept
+ * and rethrown by wait().
+ */
+class WorkStealingPool
+{
+    public:
+        typedef std::function<void()> Task;
+
+        /** Creates the pool. A size of 0 means one worker per hardware
+         * thread. */
+        WorkStealingPool(unsigned int num_workers = 0);
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+        ~WorkStealingPool();
+
+        /** Queues a task for execution. */
+        void submit(Task task);
+
+        /** Blocks until all queued tasks have run. */
+        void wait();
+
+        unsigned int size() const { return workers.size(); }
+
+        /** The index of the worker running the calling thread, or -1 if
+         * it is not one of the workers of this pool. */
+        int worker_index() const
+        {
+            return current_pool == this ? current_index : -1;
+        }
+
+    private:
+        struct Worker
+        {
+            std::mutex deque_mutex;
+            std::deque<Task> tasks;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::vector<std::thread> threads;
+
+        /** Protects the sleep/wake-up and completion handshake */
+        std::mutex state_mutex;
+        std::condition_variable work_cond;
+        std::condition_variable done_cond;
+
+        /** Tasks queued but not yet picked up by a worker */
+        std::atomic<size_t> queued;
+
+        /** Tasks submitted but not yet finished */
+        std::atomic<size_t> pending;
+
+        std::atomic<unsigned int> next_worker;
+        bool stopping;
+
+        std::exception_ptr first_error;
+
+        void worker_loop(unsigned int index);
+        bool pop_task(unsigned int index, Task &task);
+
+        static thread_local int current_index;
+        static thread_local const WorkStealingPool *current_pool;
+};
+
+} /* namespace opencog */
+
+#endif /* OPENCOG_CONCURRENCY_WORKSTEALINGPOOL_H_ */
@@ -24,8 +24,151 @@
 
 #include "HTree.h"
 #include <iterator>
+#include <new>
 
 
 using namespace opencog::PatternMining;
 using namespace opencog;
 
+
+bool InstanceUidSet::insert(uint64_t uid)
+{
+    if (uid == 0)
+    {
+        if (hasZero)
+            return false;
+        hasZero = true;
+        num ++;
+        return true;
+    }
+
+    // keep the table at most 3/4 full
+    if ((num + 1) * 4 > slots.size() * 3)
+        grow();
+
+    // the uids are hashes, their low bits are the bucket
+    size_t mask = slots.size() - 1;
+    for (size_t i = uid & mask; ; i = (i + 1) & mask)
+    {
+        if (slots[i] == uid)
+            return false;
+
+        if (slots[i] == 0)
+        {
+            slots[i] = uid;
+            num ++;
+            return true;
+        }
+    }
+}
+
+void InstanceUidSet::grow()
+{
+    vector<uint64_t> oldSlots;
+    oldSlots.swap(slots);
+    slots.assign(oldSlots.empty() ? 8 : oldSlots.size() * 2, 0);
+
+    size_t mask = slots.size() - 1;
+    for (uint64_t uid : oldSlots)
+    {
+        if (uid == 0)
+            continue;
+
+        size_t i = uid & mask;
+        while (slots[i] != 0)
+            i = (i + 1) & mask;
+        slots[i] = uid;
+    }
+}
+
+size_t HTreeNode::memoryUsage() const
+{
+    size_t bytes = pattern.capacity() * sizeof(Handle);
+
+    bytes += instances.capacity() * sizeof(HandleSeq);
+    for (const HandleSeq& instance : instances)
+        bytes += instance.capacity() * sizeof(Handle);
+
+    bytes += (parentLinks.capacity() + childLinks.capacity()) * sizeof(HTreeNodeId);
+    bytes += instancesUids.memoryUsage();
+    bytes += superPatternRelations.capacity() * sizeof(ExtendRelation);
+    bytes += sharedVarNodeList.capacity() * sizeof(Handle);
+
+    return bytes;
+}
+
+void HTreeNode::spill()
+{
+    HandleSeq().swap(pattern);
+    vector<HandleSeq>().swap(instances);
+    vector<HTreeNodeId>().swap(parentLinks);
+    vector<HTreeNodeId>().swap(childLinks);
+    instancesUids.clear();
+    vector<ExtendRelation>().swap(superPatternRelations);
+    HandleSeq().swap(sharedVarNodeList);
+
+    spilled = true;
+}
+
+HTreeNodePool::HTreeNodePool() : nextId(0)
+{
+    chunks.reserve(MAX_CHUNK_NUM);
+}
+
+HTreeNodePool::~HTreeNodePool()
+{
+    for (HTreeNode* chunk : chunks)
+        delete [] chunk;
+}
+
+HTreeNode* HTreeNodePool::create()
+{
+    std::lock_guard<std::mutex> lock(poolLock);
+
+    if (! freeIds.empty())
+    {
+        HTreeNodeId id = freeIds.back();
+        freeIds.pop_back();
+        return get(id);
+    }
+
+    if (nextId % CHUNK_SIZE == 0)
+    {
+        if (chunks.size() == MAX_CHUNK_NUM)
+            throw std::bad_alloc();
+
+        HTreeNode* chunk = new HTreeNode[CHUNK_SIZE];
+        for (unsigned int i = 0; i < CHUNK_SIZE; ++ i)
+            chunk[i].id = nextId + i;
+        chunks.push_back(chunk);
+    }
+
+    return get(nextId ++);
+}
+
+void HTreeNodePool::release(HTreeNode* node)
+{
+    HTreeNodeId id = node->id;
+    *node = HTreeNode();
+    node->id = id;
+
+    std::lock_guard<std::mutex> lock(poolLock);
+    freeIds.push_back(id);
+}
+
+size_t HTreeNodePool::size()
+{
+    std::lock_guard<std::mutex> lock(poolLock);
+    return nextId - freeIds.size();
+}
+
+size_t HTreeNodePool::memoryUsage()
+{
+    std::lock_guard<std::mutex> lock(poolLock);
+
+    size_t bytes = chunks.size() * CHUNK_SIZE * sizeof(HTreeNode) + freeIds.capacity() * sizeof(HTreeNodeId);
+    for (HTreeNodeId id = 0; id < nextId; ++ id)
+        bytes += get(id)->memoryUsage();
+
+    return bytes;
+}
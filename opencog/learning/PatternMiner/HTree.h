@@ -24,7 +24,9 @@
 
 #ifndef _OPENCOG_PATTERNMINER_HTREE_H
 #define _OPENCOG_PATTERNMINER_HTREE_H
+#include <cstdint>
 #include <map>
+#include <mutex>
 #include <vector>
 
 #define DEPRECATED_ATOMSPACE_CALLS
@@ -41,6 +43,9 @@ namespace opencog
 
      class  HTreeNode;
 
+     // the index of an HTreeNode in the HTreeNodePool
+     typedef uint32_t HTreeNodeId;
+
      struct ExtendRelation // to store a super pattern of a pattern, only store when it's extended from a const
      {
          HTreeNode* extendedHTreeNode; // the super pattern HTreeNode
@@ -50,14 +55,51 @@ namespace opencog
      //    bool isExtendedFromVar; // if it's
      };
 
+     // The uids of the instances of a pattern, see instanceUid(). The uids are
+     // hashes already, so they are kept in a flat open addressing table, one
+     // uint64_t per slot, rather than in a node per uid.
+     class InstanceUidSet
+     {
+     public:
+         InstanceUidSet() : num(0), hasZero(false) {}
+
+         // returns false if uid was already in the set
+         bool insert(uint64_t uid);
+
+         size_t size() const
+         {
+             return num;
+         }
+
+         void clear()
+         {
+             vector<uint64_t>().swap(slots);
+             num = 0;
+             hasZero = false;
+         }
+
+         size_t memoryUsage() const
+         {
+             return slots.capacity() * sizeof(uint64_t);
+         }
+
+     private:
+         vector<uint64_t> slots; // 0 is an empty slot
+         size_t num;
+         bool hasZero;
+
+         void grow();
+     };
+
      class HTreeNode
          {
          public:
+            HTreeNodeId id; // in the HTreeNodePool
             HandleSeq pattern;
             vector<HandleSeq> instances; // the corresponding instances of this pattern in the original AtomSpace, only be used by breadth first mining
-            set<HTreeNode*> parentLinks;
-            set<HTreeNode*> childLinks;
-            set<string> instancesUidStrings;// all uid in each instance HandleSeq in all instances, in the form of 5152_815_201584. to prevent the same instance being count multiple times
+            vector<HTreeNodeId> parentLinks;
+            vector<HTreeNodeId> childLinks;
+            InstanceUidSet instancesUids;// to prevent the same instance being count multiple times, only used while mining
 
             vector<ExtendRelation> superPatternRelations; // store all the connections to its super patterns
 
@@ -67,34 +109,80 @@ namespace opencog
             float nI_Surprisingness;
             float nII_Surprisingness;
 
+            // the pattern has been written to the spill file and released, only its count is kept, for the
+            // super pattern relations and the sub pattern lookups that lead to it
+            bool spilled;
+
             HandleSeq sharedVarNodeList; // all the shared nodes in these links in the original AtomSpace, each handle is a shared node
 
             HTreeNode()
             {
-                parentLinks.clear();
-                childLinks.clear();
-                instances.clear();
-                instancesUidStrings.clear();
-                superPatternRelations.clear();
+                id = 0;
                 count = 0;
                 var_num = 0;
                 interactionInformation = 0.0;
                 nI_Surprisingness = 0.0f;
                 nII_Surprisingness = 0.0f;
+                spilled = false;
 
             }
 
+            // the heap memory held by this node, besides the node itself
+            size_t memoryUsage() const;
+
+            // release everything but the count, after the pattern has been spilled
+            void spill();
+
          };
+
+     // The arena of all the HTreeNodes. The nodes are allocated by chunks,
+     // never move, and are addressed by their id, so that the tree edges are
+     // 4 byte indexes rather than pointers in sets.
+     class HTreeNodePool
+     {
+     public:
+         HTreeNodePool();
+         ~HTreeNodePool();
+
+         // thread safe
+         HTreeNode* create();
+
+         // gives back a node that was never shared with other threads
+         void release(HTreeNode* node);
+
+         HTreeNode* get(HTreeNodeId id) const
+         {
+             return chunks[id / CHUNK_SIZE] + (id % CHUNK_SIZE);
+         }
+
+         // number of nodes in use
+         size_t size();
+
+         // the memory held by all the nodes, only while no mining thread runs
+         size_t memoryUsage();
+
+     private:
+         static const unsigned int CHUNK_SIZE = 4096;
+         static const unsigned int MAX_CHUNK_NUM = 1 << 16;
+
+         std::mutex poolLock;
+         vector<HTreeNode*> chunks; // reserved once, so get() needs no lock
+         HTreeNodeId nextId;
+         vector<HTreeNodeId> freeIds;
+     };
+
      class HTree
      {
 
      public:
 
+         HTreeNodePool nodePool;
+
          HTreeNode* rootNode;
 
          HTree()
          {
-             rootNode = new HTreeNode(); // the rootNode with no parents
+             rootNode = nodePool.create(); // the rootNode with no parents
          }
 
      };
@@ -0,0 +1,65 @@
+/*
+ * opencog/learning/PatternMiner/InstanceCountCB.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <set>
+
+#include "InstanceCountCB.h"
+
+using namespace opencog::PatternMining;
+using namespace opencog;
+
+InstanceCountCB::InstanceCountCB(AtomSpace* as, const HandleSeq& _pattern, bool _skipDuplicateLinks) :
+    InitiateSearchCB(as),
+    DefaultPatternMatchCB(as),
+    count(0),
+    pattern(_pattern),
+    skipDuplicateLinks(_skipDuplicateLinks)
+{
+}
+
+bool InstanceCountCB::grounding(const std::map<Handle, Handle> &var_soln,
+                                const std::map<Handle, Handle> &term_soln)
+{
+    // FNV-1a of the uuids of the grounded links, in the order of the pattern
+    uint64_t hash = 14695981039346656037ULL;
+    std::set<Handle> instanceLinks;
+
+    for (const Handle& link : pattern)
+    {
+        std::map<Handle, Handle>::const_iterator it = term_soln.find(link);
+        if (it == term_soln.end())
+            return false;
+
+        if (skipDuplicateLinks && (! instanceLinks.insert(it->second).second))
+            return false;
+
+        uint64_t uuid = it->second.value();
+        for (unsigned int i = 0; i < sizeof(uuid); ++ i)
+        {
+            hash ^= (uuid >> (i * 8)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    }
+
+    if (instanceHashes.insert(hash).second)
+        count ++;
+
+    // keep searching for more groundings
+    return false;
+}
@@ -0,0 +1,73 @@
+/*
+ * opencog/learning/PatternMiner/InstanceCountCB.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_PATTERNMINER_INSTANCECOUNTCB_H
+#define _OPENCOG_PATTERNMINER_INSTANCECOUNTCB_H
+#include <cstdint>
+#include <map>
+#include <unordered_set>
+
+#include <opencog/query/DefaultPatternMatchCB.h>
+#include <opencog/query/InitiateSearchCB.h>
+#include <opencog/atoms/base/Handle.h>
+
+using namespace std;
+
+namespace opencog
+{
+ namespace PatternMining
+{
+
+ // A pattern matcher callback that only counts the instances of a pattern.
+ // Unlike bindlink, it does not add a result link per instance to the
+ // AtomSpace, nor the BindLink itself: the groundings are counted as they
+ // are found, and then forgotten.
+ // The instances are the groundings of the links of the pattern, in order.
+ // Each one is counted once, and, if skipDuplicateLinks is true, not at all
+ // if it grounds two links of the pattern to the same link.
+ class InstanceCountCB :
+     public InitiateSearchCB,
+     public DefaultPatternMatchCB
+ {
+ public:
+     InstanceCountCB(AtomSpace* as, const HandleSeq& pattern, bool skipDuplicateLinks);
+
+     virtual void set_pattern(const Variables& vars, const Pattern& pat)
+     {
+         InitiateSearchCB::set_pattern(vars, pat);
+         DefaultPatternMatchCB::set_pattern(vars, pat);
+     }
+
+     virtual bool grounding(const std::map<Handle, Handle> &var_soln,
+                            const std::map<Handle, Handle> &term_soln);
+
+     unsigned int count;
+
+ private:
+     const HandleSeq& pattern;
+     bool skipDuplicateLinks;
+
+     // hashes of the instances found, the same one can be grounded again
+     unordered_set<uint64_t> instanceHashes;
+ };
+
+}
+}
+
+#endif //_OPENCOG_PATTERNMINER_INSTANCECOUNTCB_H
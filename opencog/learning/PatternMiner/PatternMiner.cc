@@ -39,10 +39,14 @@
 #include <opencog/spacetime/atom_types.h>
 #include <opencog/embodiment/atom_types.h>
 //#include <opencog/atoms/bind/BindLink.h>
+#include <opencog/atoms/pattern/PatternLink.h>
+#include <opencog/concurrency/WorkStealingPool.h>
 #include <opencog/query/BindLinkAPI.h>
 #include <opencog/util/Config.h>
+#include <opencog/util/Logger.h>
 #include <opencog/util/StringManipulator.h>
 
+#include "InstanceCountCB.h"
 #include "PatternMiner.h"
 
 using namespace opencog::PatternMining;
@@ -289,9 +293,24 @@ string PatternMiner::unifiedPatternToKeyString(HandleSeq& inputPattern, const At
     return keyStr;
 }
 
-bool PatternMiner::checkPatternExist(const string& patternKeyStr)
+PatternKey PatternMiner::unifiedPatternToKey(HandleSeq& inputPattern, const AtomSpace *atomspace)
 {
-    if (keyStrToHTreeNodeMap.find(patternKeyStr) == keyStrToHTreeNodeMap.end())
+    if (atomspace == 0)
+        atomspace = this->atomSpace;
+
+    // reuse the buffer, the keys are built for every pattern extracted
+    static thread_local string bytes;
+    bytes.clear();
+
+    for (Handle h : inputPattern)
+        Link2keyBytes(h, bytes, atomspace);
+
+    return PatternKey::fromBytes(bytes);
+}
+
+bool PatternMiner::checkPatternExist(const PatternKey& patternKey)
+{
+    if (patternTable.find(patternKey) == 0)
         return false;
     else
         return true;
@@ -735,6 +754,132 @@ void PatternMiner::findAllInstancesForGivenPatternInNestedAtomSpace(HTreeNode* H
     HNode->count = HNode->instances.size();
 }
 
+unsigned int PatternMiner::countAllInstancesForGivenPattern(HandleSeq& pattern)
+{
+    // the variables to be bound
+    OrderedHandleSet allVariableNodesInPattern;
+    for (unsigned int i = 0; i < pattern.size(); ++i)
+    {
+        extractAllVariableNodesInLink(pattern[i],allVariableNodesInPattern, atomSpace);
+    }
+
+    // instance that contains duplicate links will not be counted, as in findAllInstancesForGivenPatternInNestedAtomSpace
+    InstanceCountCB countCB(atomSpace, pattern, cur_gram != 1);
+    PatternLinkPtr patternLink(createPatternLink(allVariableNodesInPattern, pattern));
+    patternLink->satisfy(countCB);
+
+    return countCB.count;
+}
+
+HTreeNode* PatternMiner::countAndMemoizePattern(const PatternKey& key, HandleSeq& unifiedPattern)
+{
+    // count before adding the node, so that the other threads never find it with a count of 0
+    unsigned int count = countAllInstancesForGivenPattern(unifiedPattern);
+
+    // another thread may have added it meanwhile, the node is only created if it's not there
+    return patternTable.findOrInsert(key, [&]()
+    {
+        HTreeNode* newHTreeNode = htree->nodePool.create();
+        newHTreeNode->pattern = unifiedPattern;
+        newHTreeNode->count = count;
+        return newHTreeNode;
+    },
+    [](HTreeNode*, bool) {});
+}
+
+void PatternMiner::countPatternsInBatch(vector<HandleSeq>& unifiedPatterns)
+{
+    // only count the patterns that are not in patternTable yet, once each
+    vector<PatternKey> keys;
+    vector<HandleSeq*> patterns;
+    set<pair<uint64_t, uint64_t> > seenKeys;
+    for (HandleSeq& pattern : unifiedPatterns)
+    {
+        PatternKey key = unifiedPatternToKey(pattern);
+        if (checkPatternExist(key) || (! seenKeys.insert(make_pair(key.hi, key.lo)).second))
+            continue;
+
+        keys.push_back(key);
+        patterns.push_back(&pattern);
+    }
+
+    if (keys.empty())
+        return;
+
+    WorkStealingPool pool(THREAD_NUM);
+    for (unsigned int i = 0; i < keys.size(); ++ i)
+    {
+        pool.submit([this, i, &keys, &patterns] { countAndMemoizePattern(keys[i], *patterns[i]); });
+    }
+    pool.wait();
+}
+
+void PatternMiner::collectSubPatternsForSurprisingness(HTreeNode* HNode, vector<HandleSeq>& subPatterns)
+{
+    // the same sub patterns as calculateSurprisingness() counts
+    if (HNode->count < 2)
+        return;
+
+    unsigned int gram = HNode->pattern.size();
+
+    for (vector<vector<unsigned int>>&  oneCombin : components_ngram[gram-2])
+    {
+        vector<HandleSeq> unifiedComponents;
+        bool containsComponentDisconnected = false;
+
+        for (vector<unsigned int>& oneComponent : oneCombin)
+        {
+            HandleSeq subPattern;
+            for (unsigned int index : oneComponent)
+            {
+                subPattern.push_back(HNode->pattern[index]);
+            }
+
+            unsigned int unifiedLastLinkIndex;
+            HandleSeq unifiedSubPattern = UnifyPatternOrder(subPattern, unifiedLastLinkIndex);
+
+            HandleSeqSeq splittedSubPattern;
+            if (splitDisconnectedLinksIntoConnectedGroups(unifiedSubPattern, splittedSubPattern))
+            {
+                containsComponentDisconnected = true;
+                break;
+            }
+
+            unifiedComponents.push_back(unifiedSubPattern);
+        }
+
+        if (! containsComponentDisconnected)
+            subPatterns.insert(subPatterns.end(), unifiedComponents.begin(), unifiedComponents.end());
+    }
+
+    if (gram == MAX_GRAM)
+        return;
+
+    for (ExtendRelation& curSuperRelation : HNode->superPatternRelations)
+    {
+        HandleSeq patternE;
+        patternE.push_back(curSuperRelation.newExtendedLink);
+        unsigned int unifiedLastLinkIndex;
+        subPatterns.push_back(UnifyPatternOrder(patternE, unifiedLastLinkIndex));
+    }
+}
+
+void PatternMiner::countSubPatternsForGram(unsigned int gram)
+{
+    vector<HandleSeq> subPatterns;
+    for (HTreeNode* htreeNode : patternsForGram[gram - 1])
+    {
+        collectSubPatternsForSurprisingness(htreeNode, subPatterns);
+    }
+
+    std::cout << "Counting " << subPatterns.size() << " sub patterns of the " << gram << " gram patterns ... ";
+    std::cout.flush();
+
+    countPatternsInBatch(subPatterns);
+
+    std::cout << "done!" << std::endl;
+}
+
 
 void PatternMiner::removeLinkAndItsAllSubLinks(AtomSpace* _atomspace, Handle link)
 {
@@ -923,30 +1068,48 @@ void PatternMiner::OutPutFrequentPatternsToFile(unsigned int n_gram)
     resultFile.open(fileName.c_str());
     vector<HTreeNode*> &patternsForThisGram = patternsForGram[n_gram-1];
 
-    resultFile << "Frequent Pattern Mining results for " + toString(n_gram) + " gram patterns. Total pattern number: " + toString(patternsForThisGram.size()) << endl;
+    resultFile << "Frequent Pattern Mining results for " + toString(n_gram) + " gram patterns. Total pattern number: " + toString(patternsForThisGram.size() + spilledPatternNum[n_gram-1]) << endl;
 
     for (HTreeNode* htreeNode : patternsForThisGram)
     {
         if (htreeNode->count < 2)
             continue;
 
-        resultFile << endl << "Pattern: Frequency = " << toString(htreeNode->count);
-
-        resultFile << endl;
-
-        resultFile << unifiedPatternToKeyString(htreeNode->pattern)<< endl;
+        writeFrequentPattern(resultFile, htreeNode);
+    }
 
-//        for (Handle link : htreeNode->pattern)
-//        {
-//            resultFile << atomSpace->atom_as_string(link);
-//        }
+    // the patterns released by boundHTreeMemory are all less frequent than the ones kept, they follow them
+    if (spilledPatternNum[n_gram-1] != 0)
+    {
+        string spilledFileName = gramFileName("lowfrequency", n_gram);
+        ifstream spilledFile(spilledFileName.c_str());
+        if (spilledFile.peek() != EOF)
+            resultFile << spilledFile.rdbuf();
+        spilledFile.close();
+        remove(spilledFileName.c_str());
     }
 
+    frequentPatternsOutput[n_gram-1] = true;
+
     resultFile.close();
 
 
 }
 
+void PatternMiner::writeFrequentPattern(ostream& resultFile, HTreeNode* htreeNode)
+{
+    resultFile << endl << "Pattern: Frequency = " << toString(htreeNode->count);
+
+    resultFile << endl;
+
+    resultFile << unifiedPatternToKeyString(htreeNode->pattern)<< endl;
+
+//    for (Handle link : htreeNode->pattern)
+//    {
+//        resultFile << atomSpace->atom_as_string(link);
+//    }
+}
+
 void PatternMiner::OutPutInterestingPatternsToFile(vector<HTreeNode*> &patternsForThisGram, unsigned int n_gram, int surprisingness) // surprisingness 1 or 2, it is default 0 which means Interaction_Information
 {
 
@@ -1526,33 +1689,23 @@ bool PatternMiner::splitDisconnectedLinksIntoConnectedGroups(HandleSeq& inputLin
 
 }
 
-double PatternMiner::calculateEntropyOfASubConnectedPattern(string& connectedSubPatternKey, HandleSeq& connectedSubPattern)
+double PatternMiner::calculateEntropyOfASubConnectedPattern(const PatternKey& connectedSubPatternKey, HandleSeq& connectedSubPattern)
 {
     // try to find if it has a correponding HtreeNode
-    map<string, HTreeNode*>::iterator subPatternNodeIter = keyStrToHTreeNodeMap.find(connectedSubPatternKey);
-    if (subPatternNodeIter != keyStrToHTreeNodeMap.end())
+    HTreeNode* subPatternNode = patternTable.find(connectedSubPatternKey);
+    if (subPatternNode)
     {
         // it's in the H-Tree, add its entropy
-        HTreeNode* subPatternNode = (HTreeNode*)subPatternNodeIter->second;
         // cout << "CalculateEntropy: Found in H-tree! h = log" << subPatternNode->count << " ";
         return log2(subPatternNode->count);
     }
     else
     {
         // can't find its HtreeNode, have to calculate its frequency again by calling pattern matcher
-        // Todo: need to decide if add this missing HtreeNode into H-Tree or not
-
-        HTreeNode* newHTreeNode = new HTreeNode();
-        keyStrToHTreeNodeMap.insert(std::pair<string, HTreeNode*>(connectedSubPatternKey, newHTreeNode));
-        newHTreeNode->pattern = connectedSubPattern;
+        subPatternNode = countAndMemoizePattern(connectedSubPatternKey, connectedSubPattern);
+        // cout << "CalculateEntropy: Not found in H-tree! call pattern matcher again! h = log" << subPatternNode->count << " ";
 
-        // Find All Instances in the original AtomSpace For this Pattern
-        findAllInstancesForGivenPatternInNestedAtomSpace(newHTreeNode);
-        // cout << "CalculateEntropy: Not found in H-tree! call pattern matcher again! h = log" << newHTreeNode->count << " ";
-
-        int count = newHTreeNode->count;
-
-        return log2(count);
+        return log2(subPatternNode->count);
 
     }
 }
@@ -1617,9 +1770,9 @@ void PatternMiner::calculateInteractionInformation(HTreeNode* HNode)
 
              unsigned int unifiedLastLinkIndex;
              HandleSeq unifiedSubPattern = UnifyPatternOrder(subPattern, unifiedLastLinkIndex);
-             string subPatternKey = unifiedPatternToKeyString(unifiedSubPattern);
+             PatternKey subPatternKey = unifiedPatternToKey(unifiedSubPattern);
 
-//             std::cout<< "Subpattern: " << subPatternKey;
+//             std::cout<< "Subpattern: " << unifiedPatternToKeyString(unifiedSubPattern);
 
              // First check if this subpattern is disconnected. If it is disconnected, it won't exist in the H-Tree anyway.
              HandleSeqSeq splittedSubPattern;
@@ -1634,8 +1787,8 @@ void PatternMiner::calculateInteractionInformation(HTreeNode* HNode)
                      // Unify it again
                      unsigned int _unifiedLastLinkIndex;
                      HandleSeq unifiedConnectedSubPattern = UnifyPatternOrder(aConnectedSubPart, _unifiedLastLinkIndex);
-                     string connectedSubPatternKey = unifiedPatternToKeyString(unifiedConnectedSubPattern);
-//                     cout << "a splitted part: " << connectedSubPatternKey;
+                     PatternKey connectedSubPatternKey = unifiedPatternToKey(unifiedConnectedSubPattern);
+//                     cout << "a splitted part: " << unifiedPatternToKeyString(unifiedConnectedSubPattern);
                      double h = calculateEntropyOfASubConnectedPattern(connectedSubPatternKey, unifiedConnectedSubPattern);
                      II += sign*h;
 //                     cout << "sign="<<sign << " h =" << h << std::endl << std::endl;
@@ -1817,18 +1970,13 @@ void PatternMiner::calculateInteractionInformation(HTreeNode* HNode)
 
 //}
 
-unsigned int PatternMiner::getCountOfAConnectedPattern(string& connectedPatternKey, HandleSeq& connectedPattern)
+unsigned int PatternMiner::getCountOfAConnectedPattern(const PatternKey& connectedPatternKey, HandleSeq& connectedPattern)
 {
-    uniqueKeyLock.lock();
     // try to find if it has a correponding HtreeNode
-    map<string, HTreeNode*>::iterator patternNodeIter = keyStrToHTreeNodeMap.find(connectedPatternKey);
+    HTreeNode* patternNode = patternTable.find(connectedPatternKey);
 
-    if (patternNodeIter != keyStrToHTreeNodeMap.end())
+    if (patternNode)
     {
-        uniqueKeyLock.unlock();
-
-        HTreeNode* patternNode = (HTreeNode*)patternNodeIter->second;
-
         return patternNode->count;
     }
     else
@@ -1839,23 +1987,13 @@ unsigned int PatternMiner::getCountOfAConnectedPattern(string& connectedPatternK
         // cout << "Exception: can't find a subpattern: \n" << connectedPatternKey << std::endl;
         if (run_as_central_server)
         {
-            uniqueKeyLock.unlock();
-
             return 0;
         }
         else
         {
-
-            HTreeNode* newHTreeNode = new HTreeNode();
-            keyStrToHTreeNodeMap.insert(std::pair<string, HTreeNode*>(connectedPatternKey, newHTreeNode));
-            uniqueKeyLock.unlock();
-
-            newHTreeNode->pattern = connectedPattern;
-
-            // Find All Instances in the original AtomSpace For this Pattern
-            findAllInstancesForGivenPatternInNestedAtomSpace(newHTreeNode);
-    //        cout << "Not found in H-tree! call pattern matcher again! count = " << newHTreeNode->count << std::endl;
-            return newHTreeNode->count;
+            patternNode = countAndMemoizePattern(connectedPatternKey, connectedPattern);
+    //        cout << "Not found in H-tree! call pattern matcher again! count = " << patternNode->count << std::endl;
+            return patternNode->count;
         }
 
     }
@@ -2035,9 +2173,8 @@ void PatternMiner::calculateSurprisingness( HTreeNode* HNode, AtomSpace *_fromAt
 
             unsigned int unifiedLastLinkIndex;
             HandleSeq unifiedSubPattern = UnifyPatternOrder(subPattern, unifiedLastLinkIndex);
-            string subPatternKey = unifiedPatternToKeyString(unifiedSubPattern);
 
-            // std::cout<< "Subpattern: " << subPatternKey;
+            // std::cout<< "Subpattern: " << unifiedPatternToKeyString(unifiedSubPattern);
 
             // First check if this subpattern is disconnected. If it is disconnected, it won't exist in the H-Tree anyway.
             HandleSeqSeq splittedSubPattern;
@@ -2050,6 +2187,7 @@ void PatternMiner::calculateSurprisingness( HTreeNode* HNode, AtomSpace *_fromAt
             else
             {
                 // std::cout<< " is connected!" ;
+                PatternKey subPatternKey = unifiedPatternToKey(unifiedSubPattern);
                 unsigned int component_count = getCountOfAConnectedPattern(subPatternKey, unifiedSubPattern);
 
                 if (component_count == 0)
@@ -2158,7 +2296,7 @@ void PatternMiner::calculateSurprisingness( HTreeNode* HNode, AtomSpace *_fromAt
             // unify patternE
             unsigned int unifiedLastLinkIndex;
             HandleSeq unifiedPatternE = UnifyPatternOrder(patternE, unifiedLastLinkIndex);
-            string patternEKey = unifiedPatternToKeyString(unifiedPatternE, atomSpace);
+            PatternKey patternEKey = unifiedPatternToKey(unifiedPatternE, atomSpace);
 
             unsigned int patternE_count = getCountOfAConnectedPattern(patternEKey, unifiedPatternE);
             float p_ApDivByCountE = p_Ap / ( (float)(patternE_count) );
@@ -2177,7 +2315,7 @@ void PatternMiner::calculateSurprisingness( HTreeNode* HNode, AtomSpace *_fromAt
 //                cout << unifiedPatternToKeyString(curSuperRelation.extendedHTreeNode->pattern, atomSpace);
 //                cout << "P(Ap) = " << p_Ap << std::endl;
 //                cout << "The extended link pattern:  " << std::endl;
-//                cout << patternEKey;
+//                cout << unifiedPatternToKeyString(unifiedPatternE, atomSpace);
 //                cout << "Count(E) = " << patternE_count << std::endl;
 //                cout << "Surprisingness_II = |P(A) -P(Ap)/Count(E)| = " << Surprisingness_II << std::endl;
 
@@ -2253,7 +2391,18 @@ PatternMiner::PatternMiner(AtomSpace* _originalAtomSpace): originalAtomSpace(_or
 //     // use all the threads in this machine
 //     THREAD_NUM = system_thread_num;
 
-    THREAD_NUM = 1;
+    int thread_num = config().has("Pattern_Mining_Thread_Num") ? config().get_int("Pattern_Mining_Thread_Num") : 1;
+    if (thread_num < 0)
+    {
+        logger().warn("PatternMiner: Pattern_Mining_Thread_Num = %d is negative, using 1 thread.", thread_num);
+        thread_num = 1;
+    }
+    if (thread_num == 0)
+        THREAD_NUM = std::max(1u, std::thread::hardware_concurrency());
+    else
+        THREAD_NUM = (unsigned int)thread_num;
+
+    miningPool = 0;
 
     run_as_distributed_worker = false;
     run_as_central_server = false;
@@ -2261,7 +2410,16 @@ PatternMiner::PatternMiner(AtomSpace* _originalAtomSpace): originalAtomSpace(_or
 
     threads = new thread[THREAD_NUM];
 
-    patternJsonArrays = new web::json::value[THREAD_NUM];
+    patternFrameWriters = new PatternFrameWriter[THREAD_NUM];
+
+    patternStreamClient = 0;
+    patternStreamServer = 0;
+
+    // 0 means no limit, the patterns are only spilled to disk over this
+    maxHTreeMemory = (size_t)(config().has("Pattern_Max_HTree_Memory_MB") ? config().get_int("Pattern_Max_HTree_Memory_MB") : 0) * 1024 * 1024;
+    memoryCheckLinkNum = DF_MEMORY_CHECK_LINK_NUM;
+    checkpointDir = config().has("Pattern_Checkpoint_Dir") ? config().get("Pattern_Checkpoint_Dir") : "";
+    resumeFromCheckpoint = config().has("Pattern_Resume_From_Checkpoint") ? config().get_bool("Pattern_Resume_From_Checkpoint") : false;
 
     int max_gram = config().get_int("Pattern_Max_Gram");
     MAX_GRAM = (unsigned int)max_gram;
@@ -2306,6 +2464,9 @@ PatternMiner::PatternMiner(AtomSpace* _originalAtomSpace): originalAtomSpace(_or
 
     }
 
+    spilledPatternNum.assign(MAX_GRAM, 0);
+    frequentPatternsOutput.assign(MAX_GRAM, false);
+
     // define (hard coding) all the possible subcomponent combinations for 2~4 gram patterns
     string gramNcomponents[3];
     // for 2 gram patterns [01], the only possible combination is [0][1]
@@ -2358,7 +2519,26 @@ void PatternMiner::runPatternMiner(unsigned int _thresholdFrequency)
         runPatternMinerBreadthFirst();
     else
     {
-        runPatternMinerDepthFirst();
+        // the depth first mining can only resume when all its grams are checkpointed
+        if (resumeFromCheckpoint && (checkpointedGramNum() == MAX_GRAM))
+        {
+            resumeGramsFromCheckpoint(MAX_GRAM);
+
+            allLinks.clear();
+            (HandleSeq()).swap(allLinks);
+        }
+        else
+        {
+            runPatternMinerDepthFirst();
+
+            // the counts are all done, the instance uids are not needed anymore
+            releaseInstanceUids();
+
+            for (unsigned int gram = 1; gram <= MAX_GRAM; ++ gram)
+                checkpointGram(gram);
+
+            boundHTreeMemory(MAX_GRAM);
+        }
 
         if (enable_Frequent_Pattern)
         {
@@ -2385,6 +2565,11 @@ void PatternMiner::runPatternMiner(unsigned int _thresholdFrequency)
             {
 
                 cout << "\nCalculating interestingness for " << cur_gram << " gram patterns by evaluating " << interestingness_Evaluation_method << std::endl;
+
+                // count all the missing sub patterns at once, then the evaluation threads only look them up
+                if (interestingness_Evaluation_method == "surprisingness")
+                    countSubPatternsForGram(cur_gram);
+
                 cur_index = -1;
                 threads = new thread[THREAD_NUM];
                 num_of_patterns_without_superpattern_cur_gram = 0;
@@ -2573,6 +2758,32 @@ std::string PatternMiner::Link2keyString(Handle& h, std::string indent, const At
     return answer.str();
 }
 
+// The same as Link2keyString, without the text: the type, then the name
+// of a node, prefixed by its length, or the arity of a link, then its
+// outgoings. The lengths keep two different patterns from having the
+// same encoding.
+void PatternMiner::Link2keyBytes(Handle& h, string& bytes, const AtomSpace *atomspace)
+{
+    Type type = atomspace->get_type(h);
+    bytes.append((const char*) &type, sizeof(type));
+
+    if (atomspace->is_node(h))
+    {
+        const string& name = atomspace->get_name(h);
+        uint32_t len = name.size();
+        bytes.append((const char*) &len, sizeof(len));
+        bytes.append(name);
+    }
+    else
+    {
+        const HandleSeq& outgoings = h->getOutgoingSet();
+        uint32_t arity = outgoings.size();
+        bytes.append((const char*) &arity, sizeof(arity));
+        for (Handle outgoing : outgoings)
+            Link2keyBytes(outgoing, bytes, atomspace);
+    }
+}
+
 void PatternMiner::testPatternMatcher1()
 {
     originalAtomSpace->get_handles_by_type(back_inserter(allLinks), (Type) LINK, true );
@@ -24,9 +24,11 @@
 
 #ifndef _OPENCOG_PATTERNMINER_PATTERNMINER_H
 #define _OPENCOG_PATTERNMINER_PATTERNMINER_H
+#include <atomic>
 #include <cstdio>
 #include <map>
 #include <mutex>
+#include <ostream>
 #include <thread>
 #include <vector>
 #include <cpprest/http_client.h>
@@ -37,6 +39,8 @@
 
 #include "Pattern.h"
 #include "HTree.h"
+#include "PatternTable.h"
+#include "PatternStream.h"
 
 using namespace std;
 using namespace web;
@@ -44,8 +48,12 @@ using namespace web::http;
 using namespace web::http::client;
 using namespace web::http::experimental::listener;
 
+class PatternMinerUTest;
+
 namespace opencog
 {
+class WorkStealingPool;
+
 namespace PatternMining
 {
 #define FLOAT_MIN_DIFF 0.00001
@@ -54,7 +62,17 @@ namespace PatternMining
 
 #define LINE_INDENTATION "  "
 
-#define JSON_BUF_MAX_NUM 30
+#define PATTERN_FRAME_MAX_NUM 200
+
+#define DF_MEMORY_CHECK_LINK_NUM 10000
+
+ // a super pattern relation read from a checkpoint, resolved once all the grams are loaded
+ struct CheckpointRelation
+ {
+     HTreeNode* node;
+     PatternKey superPatternKey;
+     unsigned int extendedLinkIndex; // of newExtendedLink in the super pattern
+ };
 
  struct _non_ordered_pattern
  {
@@ -89,6 +107,8 @@ namespace PatternMining
 
  class PatternMiner
  {
+     friend class ::PatternMinerUTest;
+
  private:
 
      HTree* htree;
@@ -98,8 +118,8 @@ namespace PatternMining
 
      HandleSeq allLinks;// all links in the orginal atomspace
 
-     // Every pattern is reprented as a unique string as the key in this map, mapping to its cooresponding HTreeNode
-     map<string, HTreeNode*> keyStrToHTreeNodeMap;
+     // Every pattern is reprented as a unique key in this table, mapping to its cooresponding HTreeNode
+     PatternTable patternTable;
 
      vector < vector<HTreeNode*> > patternsForGram;
      vector < vector<HTreeNode*> > finalPatternsForGram;
@@ -108,6 +128,13 @@ namespace PatternMining
 
      unsigned int THREAD_NUM;
 
+     // runs the depth first mining tasks, the start links are stolen by the idle threads
+     WorkStealingPool* miningPool;
+
+     // the utilisation of each thread of miningPool, in the last depth first mining
+     vector<double> threadBusySeconds;
+     vector<unsigned int> threadMinedLinkNum;
+
      unsigned int MAX_GRAM;
 
      string Pattern_mining_mode;
@@ -118,8 +145,6 @@ namespace PatternMining
 
      int allLinkNumber;
 
-     unsigned int linksPerThread;
-
      float last_gram_total_float;
 
      bool enable_filter_leaves_should_not_be_vars;
@@ -135,7 +160,27 @@ namespace PatternMining
 
      unsigned int thresholdFrequency; // patterns with a frequency lower than thresholdFrequency will be neglected, not grow next gram pattern from them
 
-     std::mutex uniqueKeyLock, patternForLastGramLock, removeAtomLock, patternMatcherLock, addNewPatternLock, calculateIILock,
+     // When the HTree takes more memory than this at the end of a gram, the patterns with a frequency lower than
+     // thresholdFrequency are released, except their counts. While mining depth first, their super pattern
+     // relations are spilled to a file instead, and merged back at the end of the mining. 0 for no limit.
+     // The released patterns still go to the frequent pattern output, with their exact counts, but their
+     // interestingness is not evaluated.
+     size_t maxHTreeMemory;
+
+     // for each gram, the number of patterns released by the memory bound, and whether its frequent
+     // patterns have been output already
+     vector<unsigned int> spilledPatternNum;
+     vector<bool> frequentPatternsOutput;
+
+     // the number of start links mined depth first between two checks of maxHTreeMemory
+     unsigned int memoryCheckLinkNum;
+
+     // Every gram of patterns mined is written to a file in this directory, and can be reloaded instead of
+     // mined again if resumeFromCheckpoint is true. Empty for no checkpoint.
+     string checkpointDir;
+     bool resumeFromCheckpoint;
+
+     std::mutex patternForLastGramLock, removeAtomLock, patternMatcherLock, addNewPatternLock, calculateIILock,
                 readNextLinkLock,actualProcessedLinkLock, curDFExtractedLinksLock, readNextPatternLock;
 
      Type ignoredTypes[1];
@@ -188,6 +233,9 @@ namespace PatternMining
 
      string unifiedPatternToKeyString(HandleSeq& inputPattern , const AtomSpace *atomspace = 0);
 
+     // the key of a unified pattern in patternTable, the same for the same key string
+     PatternKey unifiedPatternToKey(HandleSeq& inputPattern , const AtomSpace *atomspace = 0);
+
      // this function is called by RebindVariableNames
      void findAndRenameVariablesForOneLink(Handle link, map<Handle,Handle>& varNameMap, HandleSeq& renameOutgoingLinks);
 
@@ -239,7 +287,7 @@ namespace PatternMining
 
      void extendAPatternForOneMoreGramRecursively(const Handle &extendedLink, AtomSpace* _fromAtomSpace, const Handle &extendedNode, const HandleSeq &lastGramLinks,
                                      HTreeNode* parentNode, const map<Handle,Handle> &lastGramValueToVarMap, const map<Handle,Handle> &lastGramPatternVarMap,
-                                     bool isExtendedFromVar, vector<HTreeNode*> &allHTreeNodesCurTask, web::json::value &patternJsonArray);
+                                     bool isExtendedFromVar, vector<HTreeNode*> &allHTreeNodesCurTask, PatternFrameWriter &patternFrameWriter);
 
      bool containsLoopVariable(HandleSeq& inputPattern);
 
@@ -248,6 +296,19 @@ namespace PatternMining
 
      void findAllInstancesForGivenPatternInNestedAtomSpace(HTreeNode* HNode);
 
+     // the number of instances of a pattern, without adding them to the AtomSpace
+     unsigned int countAllInstancesForGivenPattern(HandleSeq& pattern);
+
+     // count the instances of a unified pattern, and add it with its count to patternTable, where it's kept across grams
+     HTreeNode* countAndMemoizePattern(const PatternKey& key, HandleSeq& unifiedPattern);
+
+     // count many unified connected patterns at once on THREAD_NUM threads, skipping those already in patternTable
+     void countPatternsInBatch(vector<HandleSeq>& unifiedPatterns);
+
+     void collectSubPatternsForSurprisingness(HTreeNode* HNode, vector<HandleSeq>& subPatterns);
+
+     void countSubPatternsForGram(unsigned int gram);
+
      void findAllInstancesForGivenPatternBF(HTreeNode* HNode);
 
      void growTheFirstGramPatternsTaskBF();
@@ -256,14 +317,61 @@ namespace PatternMining
 
      void growPatternsTaskBF();
 
-     void GrowAllPatternsBF();
+     void GrowAllPatternsBF(unsigned int startGram = 2);
 
      void growPatternsDepthFirstTask_old();
 
-     void growPatternsDepthFirstTask(unsigned int thread_index);
+     void growPatternsDepthFirstTask(unsigned int begin, unsigned int end);
+
+     void growPatternsDepthFirstFromLink(unsigned int link_index);
 
      void evaluateInterestingnessTask();
 
+     // ---------------- memory bound and checkpoints, in PatternMinerCheckpoint.cc ----------------
+
+     string gramFileName(const string& kind, unsigned int gram);
+
+     void writePatternsToFile(const string& fileName, vector<HTreeNode*>& nodes, bool append);
+
+     bool loadPatternsFromFile(const string& fileName, unsigned int gram, vector<CheckpointRelation>& relations);
+
+     void checkpointGram(unsigned int gram);
+
+     // number of grams from 1 on that have a checkpoint file
+     unsigned int checkpointedGramNum();
+
+     // loads grams 1 to gram_num from their checkpoint files, returns gram_num
+     unsigned int resumeGramsFromCheckpoint(unsigned int gram_num);
+
+     // the instance uids are only needed to count the instances while mining
+     void releaseInstanceUids();
+
+     void spillLowFrequencyPatterns(unsigned int gram);
+
+     // writes the released patterns seen more than once, in the order of frequency, to a file the frequent
+     // pattern output of their gram appends
+     void writeSpilledFrequentPatterns(unsigned int gram, vector<HTreeNode*>& spilledNodes);
+
+     // spills the patterns of grams lastGram down to 1 until the HTree fits in maxHTreeMemory
+     void boundHTreeMemory(unsigned int lastGram);
+
+     // while mining depth first, the low frequency patterns are still counted, only their super
+     // pattern relations are written to the spill file of their gram and released
+     void spillSuperPatternRelations(unsigned int gram);
+
+     // the same as boundHTreeMemory, between two batches of depth first mining, while no thread runs
+     void boundHTreeMemoryWhileMining();
+
+     // once the depth first mining is done, gives the patterns that reached thresholdFrequency their
+     // spilled super pattern relations back, and drops the others. The spill files are removed.
+     void mergeSpilledRelations();
+
+     // the spill files left by a mining that did not finish
+     void removeSpillFiles();
+
+     // adds the relations read from a checkpoint or spill file, once all their super patterns are loaded
+     void addCheckpointRelations(vector<CheckpointRelation>& relations);
+
      void generateNextCombinationGroup(bool* &indexes, int n_max);
 
      bool isLastNElementsAllTrue(bool* array, int size, int n);
@@ -281,6 +389,9 @@ namespace PatternMining
      // if atomspace = 0, it will use the pattern mining Atomspace
      std::string Link2keyString(Handle& link, string indent = "", const AtomSpace *atomspace = 0);
 
+     // append the canonical binary encoding of a link to bytes
+     void Link2keyBytes(Handle& link, string& bytes, const AtomSpace *atomspace);
+
      void removeLinkAndItsAllSubLinks(AtomSpace *_atomspace, Handle link);
 
      OrderedHandleSet _getAllNonIgnoredLinksForGivenNode(Handle keywordNode, OrderedHandleSet& allSubsetLinks);
@@ -298,13 +409,13 @@ namespace PatternMining
 
      bool splitDisconnectedLinksIntoConnectedGroups(HandleSeq& inputLinks, HandleSeqSeq& outputConnectedGroups);
 
-     double calculateEntropyOfASubConnectedPattern(string& connectedSubPatternKey, HandleSeq& connectedSubPattern);
+     double calculateEntropyOfASubConnectedPattern(const PatternKey& connectedSubPatternKey, HandleSeq& connectedSubPattern);
 
      void calculateInteractionInformation(HTreeNode* HNode);
 
      void generateComponentCombinations(string componentsStr, vector<vector<vector<unsigned int>>> &componentCombinations);
 
-     unsigned int getCountOfAConnectedPattern(string& connectedPatternKey, HandleSeq& connectedPattern);
+     unsigned int getCountOfAConnectedPattern(const PatternKey& connectedPatternKey, HandleSeq& connectedPattern);
 
      void calculateSurprisingness( HTreeNode* HNode, AtomSpace *_fromAtomSpace);
 
@@ -325,10 +436,12 @@ namespace PatternMining
      PatternMiner(AtomSpace* _originalAtomSpace);
      ~PatternMiner();
 
-     bool checkPatternExist(const string& patternKeyStr);
+     bool checkPatternExist(const PatternKey& patternKey);
 
      void OutPutFrequentPatternsToFile(unsigned int n_gram);
 
+     void writeFrequentPattern(ostream& resultFile, HTreeNode* htreeNode);
+
      void OutPutStaticsToCsvFile(unsigned int n_gram);
 
      void OutPutLowFrequencyHighSurprisingnessPatternsToFile(vector<HTreeNode*> &patternsForThisGram, unsigned int n_gram);
@@ -359,19 +472,23 @@ private:
      string centralServerPort;
      string centralServerBaseURL;
 
-     web::json::value *patternJsonArrays;
+     string centralServerStreamPort;
+
+     // one per mining thread, the patterns found but not sent yet
+     PatternFrameWriter *patternFrameWriters;
+
+     PatternStreamClient* patternStreamClient; // in a worker
+     PatternStreamServer* patternStreamServer; // in the central server
 
      unsigned int pattern_parse_thread_num; // for the central server
      std::thread centralServerListeningThread;
      std::thread *parsePatternTaskThreads;
-     std::mutex patternQueueLock, addRelationLock, updatePatternCountLock, modifyWorkerLock;
+     std::mutex addRelationLock, modifyWorkerLock;
 
      // map < uid, <is_still_working, processedFactsNum> >
      map<string, std::pair<bool, unsigned int> > allWorkers;
      bool allWorkersStop;
 
-     list<json::value> waitForParsePatternQueue;
-
      string clientWorkerUID;
 
      bool run_as_distributed_worker;
@@ -381,7 +498,7 @@ private:
      http_listener* serverListener;
 
      int cur_worker_mined_pattern_num;
-     int total_pattern_received; // in the server
+     std::atomic<int> total_pattern_received; // in the server, counted by all the parse threads
 
      bool waitingForNewClients;
 
@@ -389,10 +506,10 @@ private:
      void handlePost(http_request request);
      void handleRegisterNewWorker(http_request request);
      void handleReportWorkerStop(http_request request);
-     void handleFindNewPatterns(http_request request);
 
      void runParsePatternTaskThread();
-     void parseAPatternTask(json::value jval);
+     void parseAPatternFrame(const PatternFrame& frame);
+     void parseAPatternRecord(const PatternFrameReader& reader, const PatternRecord& record);
 
      bool checkIfAllWorkersStopWorking();
 
@@ -401,8 +518,9 @@ private:
      void startMiningWork();
      void centralServerEvaluateInterestingness();
 
-     void addPatternsToJsonArrayBuf(string curPatternKeyStr, string parentKeyString,  unsigned int extendedLinkIndex, json::value &patternJsonArray);
-     void sendPatternsToCentralServer(json::value &patternJsonArray);
+     void addPatternToFrameBuf(HTreeNode* htreeNode, const PatternKey& curPatternKey, const PatternKey& parentKey,
+                               unsigned int extendedLinkIndex, PatternFrameWriter &patternFrameWriter);
+     void sendPatternsToCentralServer(PatternFrameWriter &patternFrameWriter);
      HandleSeq loadPatternIntoAtomSpaceFromString(string patternStr, AtomSpace* _atomSpace);
      bool loadOutgoingsIntoAtomSpaceFromString(stringstream &outgoingStream, AtomSpace *_atomSpace, HandleSeq &outgoings, string parentIndent = "");
 
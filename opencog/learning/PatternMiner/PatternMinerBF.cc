@@ -25,6 +25,7 @@
 #include <math.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <iterator>
@@ -251,55 +252,52 @@ void PatternMiner::extractAllPossiblePatternsFromInputLinksBF(HandleSeq& inputLi
                     unsigned int unifiedLastLinkIndex;
                     unifiedPattern = UnifyPatternOrder(pattern, unifiedLastLinkIndex);
 
-                    string keyString = unifiedPatternToKeyString(unifiedPattern);
+                    PatternKey key = unifiedPatternToKey(unifiedPattern);
 
-                    // next, check if this pattern already exist (need lock)
+                    // next, check if this pattern already exist
                     HTreeNode* newHTreeNode = 0;
-                    uniqueKeyLock.lock();
 
-                    map<string, HTreeNode*>::iterator htreeNodeIter = keyStrToHTreeNodeMap.find(keyString);
-
-                    if (htreeNodeIter == keyStrToHTreeNodeMap.end())
+                    HTreeNode* htreeNode = patternTable.findOrInsert(key, [&]()
                     {
-                        newHTreeNode = new HTreeNode();
-                        keyStrToHTreeNodeMap.insert(std::pair<string, HTreeNode*>(keyString, newHTreeNode));
-                    }
-                    else
+                        newHTreeNode = htree->nodePool.create();
+                        newHTreeNode->pattern = unifiedPattern;
+                        newHTreeNode->var_num = var_num;
+                        return newHTreeNode;
+                    },
+                    [](HTreeNode*, bool) {});
+
+                    if ((! newHTreeNode) && parentNode)
                     {
                         // which means the parent node is also a parent node of the found HTreeNode
-                        if (parentNode)
+                        addRelationLock.lock();
+                        vector<HTreeNodeId>& parentLinks= htreeNode->parentLinks;
+                        if (std::find(parentLinks.begin(), parentLinks.end(), parentNode->id) == parentLinks.end())
                         {
-                            set<HTreeNode*>& parentLinks= ((HTreeNode*)(htreeNodeIter->second))->parentLinks;
-                            if (parentLinks.find(parentNode) == parentLinks.end())
-                            {
-                                parentLinks.insert(parentNode);
-                                parentNode->childLinks.insert(((HTreeNode*)(htreeNodeIter->second)));
-                            }
+                            parentLinks.push_back(parentNode->id);
+                            parentNode->childLinks.push_back(htreeNode->id);
                         }
+                        addRelationLock.unlock();
     //                    // debug
-    //                    cout << "Unique Key already exists: \n" << keyString << "Skip this pattern!\n\n";
+    //                    cout << "Unique Key already exists: \n" << unifiedPatternToKeyString(unifiedPattern) << "Skip this pattern!\n\n";
                     }
 
-                    uniqueKeyLock.unlock();
-
                     if (newHTreeNode)
                     {
-                        newHTreeNode->pattern = unifiedPattern;
-                        newHTreeNode->var_num = var_num;
-
                         // Find All Instances in the original AtomSpace For this Pattern
                         findAllInstancesForGivenPatternInNestedAtomSpace(newHTreeNode);
 
+                        addRelationLock.lock();
                         if (parentNode)
                         {
-                            newHTreeNode->parentLinks.insert(parentNode);
-                            parentNode->childLinks.insert(newHTreeNode);
+                            newHTreeNode->parentLinks.push_back(parentNode->id);
+                            parentNode->childLinks.push_back(newHTreeNode->id);
                         }
                         else
                         {
-                            newHTreeNode->parentLinks.insert(this->htree->rootNode);
-                            this->htree->rootNode->childLinks.insert(newHTreeNode);
+                            newHTreeNode->parentLinks.push_back(this->htree->rootNode->id);
+                            this->htree->rootNode->childLinks.push_back(newHTreeNode->id);
                         }
+                        addRelationLock.unlock();
 
                         addNewPatternLock.lock();
                         (patternsForGram[gram-1]).push_back(newHTreeNode);
@@ -470,9 +468,9 @@ void PatternMiner::ConstructTheFirstGramPatternsBF()
 
 }
 
-void PatternMiner::GrowAllPatternsBF()
+void PatternMiner::GrowAllPatternsBF(unsigned int startGram)
 {
-    for ( cur_gram = 2; cur_gram <= MAX_GRAM; ++ cur_gram)
+    for ( cur_gram = startGram; cur_gram <= MAX_GRAM; ++ cur_gram)
     {
         cur_index = -1;
         std::cout<<"Debug: PatternMiner:  start (gram = " + toString(cur_gram) + ") pattern mining..." << std::endl;
@@ -491,6 +489,9 @@ void PatternMiner::GrowAllPatternsBF()
 
         cout << "\nFinished mining " << cur_gram << "gram patterns.\n";
 
+        checkpointGram(cur_gram);
+        boundHTreeMemory(cur_gram);
+
         if (enable_Frequent_Pattern)
         {
             // sort by frequency
@@ -731,10 +732,33 @@ void PatternMiner::findAllInstancesForGivenPatternBF(HTreeNode* HNode)
 
 void PatternMiner::runPatternMinerBreadthFirst()
 {
+    unsigned int resumedGramNum = resumeFromCheckpoint ? checkpointedGramNum() : 0;
+
+    if (resumedGramNum == 0)
+    {
+        ConstructTheFirstGramPatternsBF();
+
+        checkpointGram(1);
+        boundHTreeMemory(1);
+        resumedGramNum = 1;
+    }
+    else
+    {
+        resumeGramsFromCheckpoint(resumedGramNum);
+
+        allLinks.clear();
+        (HandleSeq()).swap(allLinks);
 
-    ConstructTheFirstGramPatternsBF();
+        // the instances of the last gram are not checkpointed, they are found again to grow the next gram
+        cur_gram = resumedGramNum;
+        for (HTreeNode* htreeNode : patternsForGram[resumedGramNum-1])
+        {
+            if (htreeNode->count >= thresholdFrequency)
+                findAllInstancesForGivenPatternBF(htreeNode);
+        }
+    }
 
     // and then generate all patterns
-    GrowAllPatternsBF();
+    GrowAllPatternsBF(resumedGramNum + 1);
 
 }
@@ -31,6 +31,7 @@
 #include <vector>
 #include <sstream>
 #include <thread>
+#include <atomic>
 #include <set>
 #include <string>
 #include <functional>
@@ -85,12 +86,29 @@ void PatternMiner::launchCentralServer()
 
     pattern_parse_thread_num = (unsigned int)(config().get_int("pattern_parse_thread_num"));
 
+    centralServerStreamPort = config().has("PMCentralServerStreamPort") ? config().get("PMCentralServerStreamPort") : "19010";
+
+    // the number of pattern frames each worker can have sent but not parsed yet
+    unsigned int streamCredits = config().has("PMStreamCredits") ? config().get_int("PMStreamCredits") : 16;
+
     serverListener = new http_listener( utility::string_t("http://" + centralServerIP + ":" + centralServerPort +"/PatternMinerServer") );
 
     serverListener->support(methods::POST, std::bind(&PatternMiner::handlePost, this,  std::placeholders::_1));
 
     allWorkersStop = false;
 
+    total_pattern_received = 0;
+
+    try
+    {
+        patternStreamServer = new PatternStreamServer(centralServerIP, centralServerStreamPort, streamCredits);
+    }
+    catch (exception const & e)
+    {
+        cout << "Cannot listen for pattern streams on port " << centralServerStreamPort << ": " << e.what() << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
     centralServerListeningThread = std::thread([this]{this->centralServerStartListening();});
 
 
@@ -135,9 +153,14 @@ void PatternMiner::launchCentralServer()
 
             cout <<"\n Pattern mining finished in the central server! \n"
                  << "Totally " << totalProcessedFactsNum << " facts processed! "
-                 << keyStrToHTreeNodeMap.size() << " pattern found!\n"
+                 << patternTable.size() << " pattern found!\n"
                  << "Now start to evaluate interestingness." << std::endl;
 
+            for (unsigned int gram = 1; gram <= MAX_GRAM; ++ gram)
+                checkpointGram(gram);
+
+            boundHTreeMemory(MAX_GRAM);
+
             centralServerEvaluateInterestingness();
 
             break;
@@ -158,7 +181,6 @@ void PatternMiner::centralServerStartListening()
 {
     try
     {
-       total_pattern_received = 0;
        serverListener->open().wait();
 
     }
@@ -174,6 +196,7 @@ void PatternMiner::centralServerStopListening()
     {
        cout << "\nCentral Server Stop Listening! total_pattern_received = " << total_pattern_received << std::endl;
        serverListener->close().wait();
+       patternStreamServer->stop();
 
     }
     catch (exception const & e)
@@ -210,10 +233,6 @@ void PatternMiner::handlePost(http_request request)
         {
             handleRegisterNewWorker(request);
         }
-        else if (path == "/FindNewPatterns")
-        {
-            handleFindNewPatterns(request);
-        }
         else if (path == "/ReportWorkerStop")
         {
             handleReportWorkerStop(request);
@@ -306,230 +325,141 @@ void PatternMiner::handleReportWorkerStop(http_request request)
 
 
 
-//long startTime;
-//long endTime;
-void PatternMiner::handleFindNewPatterns(http_request request)
-{
-
-//    // check server load
-//    static int msgReceivedNum = 0;
-//    msgReceivedNum ++;
-
-//    if (msgReceivedNum == 100)
-//    {
-//        timeval t1;
-//        gettimeofday(&t1, NULL);
-
-//        startTime = t1.tv_sec*1000 + t1.tv_usec/1000;
-//    }
-
-//    if (msgReceivedNum == 2100)
-//    {
-//        timeval t2;
-//        gettimeofday(&t2, NULL);
-
-//        endTime = t2.tv_sec*1000 + t2.tv_usec/1000;
-//        long costSeconds = (endTime - startTime) / 1000;
-//        std::cout<<std::endl<<"Server recieved 2000 requests in " << costSeconds << " seconds" << std::endl;
-//        std::cout<< (int)(2000.0f / (float)costSeconds) << " requests per second in average! " << std::endl;
-//    }
-
-    request.reply(status_codes::OK);
-
-    patternQueueLock.lock();
-
-    try
-    {
-        // should get an array of patterns
-        json::value jarray = request.extract_json().get();
-
-        for (json::array::iterator iter = jarray.as_array().begin(); iter != jarray.as_array().end(); ++iter)
-        {
-            json::value jval = (json::value)(*iter);
-            waitForParsePatternQueue.push_back(jval);
-            total_pattern_received ++;
-
-            //  cout << "Received pattern : \n" << jval.serialize() << std::endl;
-        }
-
-        // cout << "Received pattern num = " << total_pattern_received << std::endl;
-
-
-    }
-    catch (exception const & e)
-    {
-       cout << e.what() << "handleFindANewPattern error: " << request.to_string() << endl;
-
-    }
-
-    patternQueueLock.unlock();
-}
-
 void PatternMiner::runParsePatternTaskThread()
 {
-    static int tryToParsePatternNum = 0;
+    static std::atomic<int> tryToParsePatternNum(0);
 
     while(true)
     {
-
-        patternQueueLock.lock();
-        if (waitForParsePatternQueue.size() > 0)
+        PatternFrame frame;
+        if (patternStreamServer->popFrame(frame, 100))
         {
-            json::value jval = waitForParsePatternQueue.front();
-            waitForParsePatternQueue.pop_front();
-
-            tryToParsePatternNum ++;
-            cout<< "\r" << tryToParsePatternNum << + " received patterns parsed." ;
-            std::cout.flush();
+            parseAPatternFrame(frame);
 
-            patternQueueLock.unlock();
-
-            parseAPatternTask(jval);
+            // the worker can send one more frame
+            patternStreamServer->frameDone(frame);
 
+            cout<< "\r" << ++ tryToParsePatternNum << + " received pattern frames parsed." ;
+            std::cout.flush();
         }
         else
         {
-            patternQueueLock.unlock();
-
+            // a worker only reports it stopped once all its frames have been parsed
             if (allWorkersStop && (! waitingForNewClients))
                 return;
         }
-
-
     }
 }
 
-void PatternMiner::parseAPatternTask(json::value jval)
+void PatternMiner::parseAPatternFrame(const PatternFrame& frame)
 {
+    PatternRecord record;
 
-    try
+    // a malformed frame is rejected as a whole, before any of its patterns is added
+    PatternFrameReader checker(frame.payload);
+    while (checker.next(record));
+    if (! checker.isValid())
     {
-        string PatternStr =  jval[U("Pattern")].as_string();
-        // cout << "PatternStr = " << PatternStr << std::endl;
-        string ParentPatternStr = jval[U("ParentPattern")].as_string();
-        // cout << "ParentPatternStr = " << ParentPatternStr << std::endl;
-        int ExtendedLinkIndex = jval[U("ExtendedLinkIndex")].as_integer();
-        // cout << "ExtendedLinkIndex = " << ExtendedLinkIndex << std::endl;
-        string clientIDStr = jval[U("ClientUID")].as_string();
-        unsigned int processedFactsNum = (unsigned int)(jval[U("ProcessedFactsNum")].as_integer());
+        cout << "Warning: Invalid pattern frame from worker " << frame.connection->clientUID << ", frame rejected." << std::endl;
+        return;
+    }
 
-        modifyWorkerLock.lock();
-        allWorkers[clientIDStr].second = processedFactsNum;
-        modifyWorkerLock.unlock();
+    PatternFrameReader reader(frame.payload);
 
-        HTreeNode* newHTreeNode;
-        // check if the pattern key already exist
-        uniqueKeyLock.lock();
-        map<string, HTreeNode*>::iterator htreeNodeIter = keyStrToHTreeNodeMap.find(PatternStr);
-        uniqueKeyLock.unlock();
+    modifyWorkerLock.lock();
+    allWorkers[frame.connection->clientUID].second = reader.getProcessedFactsNum();
+    modifyWorkerLock.unlock();
 
-        static int duplicatePatternNum = 0;
+    while (reader.next(record))
+    {
+        parseAPatternRecord(reader, record);
+        total_pattern_received ++;
+    }
+}
 
-        if (htreeNodeIter != keyStrToHTreeNodeMap.end())
-        {
-            newHTreeNode = htreeNodeIter->second;
+void PatternMiner::parseAPatternRecord(const PatternFrameReader& reader, const PatternRecord& record)
+{
+    if ((record.gram == 0) || (record.gram > MAX_GRAM))
+    {
+        cout << "Warning: Invalid gram " << record.gram << " of pattern " << record.key.toString() << std::endl;
+        return;
+    }
 
-            updatePatternCountLock.lock();
-            newHTreeNode->count ++;
-            duplicatePatternNum ++;
-            // cout << "\nduplicatePatternNum = " << duplicatePatternNum << std::endl;
-            updatePatternCountLock.unlock();
-        }
-        else
+    try
+    {
+        // Count the pattern. Its node may have been added without a pattern, as the parent of a pattern
+        // that was parsed first, then the pattern is loaded into the AtomSpace now.
+        HandleSeq patternHandleSeq;
+        HTreeNode* newHTreeNode = patternTable.findOrInsert(record.key, [this]()
+        {
+            return htree->nodePool.create();
+        },
+        [&](HTreeNode* node, bool)
         {
-            // add this new found pattern into the Atomspace
-            HandleSeq patternHandleSeq = loadPatternIntoAtomSpaceFromString(PatternStr, atomSpace);
+            node->count ++;
+            patternHandleSeq = node->pattern;
+        });
 
+        if (patternHandleSeq.size() == 0)
+        {
+            // only the new patterns are loaded into the Atomspace
+            patternHandleSeq = reader.loadPattern(record, atomSpace);
 
             if (patternHandleSeq.size() == 0)
             {
-
-                // cout << "Warning: Invalid pattern string: " << PatternStr << std::endl;
+                cout << "Warning: Invalid pattern encoding of key " << record.key.toString() << std::endl;
                 return;
-
             }
 
-            // create a new HTreeNode
-            newHTreeNode = new HTreeNode();
-            newHTreeNode->pattern = patternHandleSeq;
-            newHTreeNode->count = 1;
-            uniqueKeyLock.lock();
-            keyStrToHTreeNodeMap.insert(std::pair<string, HTreeNode*>(PatternStr, newHTreeNode));
-            uniqueKeyLock.unlock();
-
-
-            addNewPatternLock.lock();
-            (patternsForGram[patternHandleSeq.size()-1]).push_back(newHTreeNode);
-            addNewPatternLock.unlock();
+            // another thread may have loaded the same pattern meanwhile, then it's already listed
+            bool loaded = false;
+            patternTable.findOrInsert(record.key, [newHTreeNode]()
+            {
+                return newHTreeNode;
+            },
+            [&](HTreeNode* node, bool)
+            {
+                if (node->pattern.size() == 0)
+                {
+                    node->pattern = patternHandleSeq;
+                    loaded = true;
+                }
+            });
 
+            if (loaded)
+            {
+                addNewPatternLock.lock();
+                (patternsForGram[patternHandleSeq.size()-1]).push_back(newHTreeNode);
+                addNewPatternLock.unlock();
+            }
         }
 
-        if (newHTreeNode->pattern.size() > 1) // this pattern is more than 1 gram, it should have a parent pattern
+        // a pattern more than 1 gram has a parent pattern
+        if ((patternHandleSeq.size() > 1) && (record.parentKey != PatternKey()))
         {
-            if (ParentPatternStr == "none")
+            if (record.extendedLinkIndex >= patternHandleSeq.size())
             {
-
-                // cout << "Warning: Pattern missing parent pattern string:" << PatternStr;
+                cout << "Warning: Invalid extended link index of pattern " << record.key.toString() << std::endl;
                 return;
-
             }
-            else
-            {
-                uniqueKeyLock.lock();
-                map<string, HTreeNode*>::iterator parentNodeIter = keyStrToHTreeNodeMap.find(ParentPatternStr);
-                uniqueKeyLock.unlock();
-
-                HTreeNode* parentNode;
-
-                if (parentNodeIter == keyStrToHTreeNodeMap.end())
-                {
-
-                    // cout << "Warning: Cannot find parent pattern in server: " << ParentPatternStr << std::endl;
-                    // The parent pattern should have been added, but it is not.
-                    // It's possibly sent by another thread, and added to the queue later than the current pattern.
-                    // So we add this parent pattern here first, but set its count = 0
-                    // add this new found pattern into the Atomspace
-                    HandleSeq parentPatternHandleSeq = loadPatternIntoAtomSpaceFromString(ParentPatternStr, atomSpace);
-                    if (parentPatternHandleSeq.size() == 0)
-                    {
-
-                        cout << "Warning: Invalid pattern string: " << ParentPatternStr << std::endl;
-                        return;
-
-                    }
-
-                    // create a new HTreeNode
-                    parentNode = new HTreeNode();
-                    parentNode->pattern = parentPatternHandleSeq;
-                    parentNode->count = 0;
 
-                    uniqueKeyLock.lock();
-                    keyStrToHTreeNodeMap.insert(std::pair<string, HTreeNode*>(ParentPatternStr, parentNode));
-                    uniqueKeyLock.unlock();
-
-                    addNewPatternLock.lock();
-                    (patternsForGram[parentPatternHandleSeq.size()-1]).push_back(parentNode);
-                    addNewPatternLock.unlock();
-
-
-                }
-                else
-                    parentNode = parentNodeIter->second;
-
-
-                // add super pattern relation
-
-
-
-                ExtendRelation relation;
-                relation.extendedHTreeNode = newHTreeNode;
-                relation.newExtendedLink = (newHTreeNode->pattern)[ExtendedLinkIndex];
-
-                addRelationLock.lock();
-                parentNode->superPatternRelations.push_back(relation);
-                addRelationLock.unlock();
-
-            }
+            // The parent pattern should have been added, but it is possibly sent by another thread
+            // and parsed later than the current pattern. So we add its node here first, with count = 0
+            // and no pattern, the pattern will be loaded when it arrives.
+            HTreeNode* parentNode = patternTable.findOrInsert(record.parentKey, [this]()
+            {
+                return htree->nodePool.create();
+            },
+            [](HTreeNode*, bool) {});
+
+            // add super pattern relation
+            ExtendRelation relation;
+            relation.extendedHTreeNode = newHTreeNode;
+            relation.newExtendedLink = patternHandleSeq[record.extendedLinkIndex];
+
+            addRelationLock.lock();
+            parentNode->superPatternRelations.push_back(relation);
+            addRelationLock.unlock();
         }
     }
     catch (exception const & e)
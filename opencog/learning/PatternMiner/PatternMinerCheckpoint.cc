@@ -0,0 +1,453 @@
+/*
+ * opencog/learning/PatternMiner/PatternMinerCheckpoint.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+
+#include <opencog/util/StringManipulator.h>
+
+#include "HTree.h"
+#include "PatternMiner.h"
+
+using namespace opencog::PatternMining;
+using namespace opencog;
+
+bool compareHTreeNodeByFrequency(HTreeNode* node1, HTreeNode* node2);
+
+// A checkpoint or spill file is a sequence of PATTERNS frames, as streamed by the distributed workers.
+// The extra bytes of each pattern are its count, its var_num, and its super pattern relations, each as the
+// key of the super pattern and the index of the extended link in it.
+// A spill file only lives while a depth first mining runs: it takes the super pattern relations of the low
+// frequency patterns out of memory, and is merged back and removed once the mining is done.
+
+string PatternMiner::gramFileName(const string& kind, unsigned int gram)
+{
+    string fileName = "PatternMiner_" + kind + "_gram" + toString(gram) + ".dat";
+    if (checkpointDir.empty())
+        return fileName;
+    return checkpointDir + "/" + fileName;
+}
+
+void PatternMiner::writePatternsToFile(const string& fileName, vector<HTreeNode*>& nodes, bool append)
+{
+    // a checkpoint is written under another name first, so that it's either complete or missing
+    string writeFileName = append ? fileName : fileName + ".tmp";
+    ofstream file(writeFileName.c_str(), append ? (ios::binary | ios::app) : (ios::binary | ios::trunc));
+    if (! file)
+    {
+        cout << "Warning: Cannot write patterns to file " << writeFileName << std::endl;
+        return;
+    }
+
+    PatternFrameWriter writer;
+    unordered_map<HTreeNode*, PatternKey> superPatternKeys;
+
+    for (HTreeNode* htreeNode : nodes)
+    {
+        if (htreeNode->spilled || htreeNode->pattern.empty())
+            continue;
+
+        // a spilled super pattern has no pattern left to key it, its relation is not kept
+        string relations;
+        unsigned int relationNum = 0;
+        for (ExtendRelation& relation : htreeNode->superPatternRelations)
+        {
+            HTreeNode* superNode = relation.extendedHTreeNode;
+            if (superNode->spilled || superNode->pattern.empty())
+                continue;
+
+            unordered_map<HTreeNode*, PatternKey>::iterator keyIt = superPatternKeys.find(superNode);
+            if (keyIt == superPatternKeys.end())
+                keyIt = superPatternKeys.insert(std::make_pair(superNode, unifiedPatternToKey(superNode->pattern))).first;
+
+            unsigned int extendedLinkIndex = std::find(superNode->pattern.begin(), superNode->pattern.end(), relation.newExtendedLink)
+                                             - superNode->pattern.begin();
+
+            writeKey(relations, keyIt->second);
+            writeVarint(relations, extendedLinkIndex);
+            relationNum ++;
+        }
+
+        string extra;
+        writeVarint(extra, htreeNode->count);
+        writeVarint(extra, htreeNode->var_num);
+        writeVarint(extra, relationNum);
+        extra.append(relations);
+
+        writer.addPattern(htreeNode->pattern, unifiedPatternToKey(htreeNode->pattern), PatternKey(), 0, atomSpace, extra);
+
+        if (writer.size() >= PATTERN_FRAME_MAX_NUM)
+        {
+            string frame = writer.finish(0);
+            file.write(frame.data(), frame.size());
+        }
+    }
+
+    if (writer.size() > 0)
+    {
+        string frame = writer.finish(0);
+        file.write(frame.data(), frame.size());
+    }
+
+    file.close();
+
+    if (! file)
+    {
+        cout << "Warning: Failed to write patterns to file " << writeFileName << std::endl;
+        return;
+    }
+
+    if ((! append) && (rename(writeFileName.c_str(), fileName.c_str()) != 0))
+        cout << "Warning: Cannot rename " << writeFileName << " to " << fileName << std::endl;
+}
+
+bool PatternMiner::loadPatternsFromFile(const string& fileName, unsigned int gram, vector<CheckpointRelation>& relations)
+{
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    // an empty gram
+    if (fileStat.st_size == 0)
+    {
+        close(fd);
+        return true;
+    }
+
+    // the file is mapped rather than read, the frames are parsed where they are
+    void* data = mmap(0, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    const char* cur = (const char*) data;
+    const char* end = cur + fileStat.st_size;
+    bool valid = true;
+
+    while (valid && (cur < end))
+    {
+        unsigned char type;
+        const char* payload;
+        size_t payloadSize;
+        if ((! nextPatternFrame(cur, end, type, payload, payloadSize)) || (type != PATTERN_FRAME_PATTERNS))
+        {
+            valid = false;
+            break;
+        }
+
+        PatternFrameReader reader(payload, payloadSize);
+        PatternRecord record;
+        while (reader.next(record))
+        {
+            const char* p = record.extra;
+            const char* pEnd = record.extra + record.extraSize;
+            uint64_t count, var_num, relationNum;
+            if ((! readVarint(p, pEnd, count)) || (! readVarint(p, pEnd, var_num)) || (! readVarint(p, pEnd, relationNum)))
+            {
+                valid = false;
+                break;
+            }
+
+            HandleSeq pattern = reader.loadPattern(record, atomSpace);
+            if (pattern.size() != gram)
+            {
+                valid = false;
+                break;
+            }
+
+            HTreeNode* newHTreeNode = 0;
+            HTreeNode* htreeNode = patternTable.findOrInsert(record.key, [&]()
+            {
+                newHTreeNode = htree->nodePool.create();
+                newHTreeNode->pattern = pattern;
+                newHTreeNode->count = (unsigned int) count;
+                newHTreeNode->var_num = (unsigned int) var_num;
+                return newHTreeNode;
+            },
+            [](HTreeNode*, bool) {});
+
+            if (newHTreeNode)
+                (patternsForGram[gram-1]).push_back(newHTreeNode);
+
+            for (uint64_t i = 0; i < relationNum; ++ i)
+            {
+                CheckpointRelation relation;
+                uint64_t extendedLinkIndex;
+                if ((! readKey(p, pEnd, relation.superPatternKey)) || (! readVarint(p, pEnd, extendedLinkIndex)))
+                {
+                    valid = false;
+                    break;
+                }
+
+                relation.node = htreeNode;
+                relation.extendedLinkIndex = (unsigned int) extendedLinkIndex;
+                relations.push_back(relation);
+            }
+
+            if (! valid)
+                break;
+        }
+
+        if (! reader.isValid())
+            valid = false;
+    }
+
+    munmap(data, fileStat.st_size);
+    return valid;
+}
+
+void PatternMiner::checkpointGram(unsigned int gram)
+{
+    if (checkpointDir.empty())
+        return;
+
+    writePatternsToFile(gramFileName("checkpoint", gram), patternsForGram[gram-1], false);
+}
+
+unsigned int PatternMiner::checkpointedGramNum()
+{
+    if (checkpointDir.empty())
+        return 0;
+
+    unsigned int gram = 0;
+    while (gram < MAX_GRAM)
+    {
+        struct stat fileStat;
+        if (stat(gramFileName("checkpoint", gram + 1).c_str(), &fileStat) != 0)
+            break;
+        gram ++;
+    }
+
+    return gram;
+}
+
+unsigned int PatternMiner::resumeGramsFromCheckpoint(unsigned int gram_num)
+{
+    vector<CheckpointRelation> relations;
+
+    for (unsigned int gram = 1; gram <= gram_num; ++ gram)
+    {
+        string fileName = gramFileName("checkpoint", gram);
+        if (! loadPatternsFromFile(fileName, gram, relations))
+        {
+            // part of the gram may have been loaded, mining it again would count its patterns twice
+            cout << "Error: Invalid checkpoint file " << fileName << "! Remove the checkpoints in "
+                 << checkpointDir << " to mine again from the start." << std::endl;
+            std::exit(EXIT_FAILURE);
+        }
+
+        cout << "Resumed " << (patternsForGram[gram-1]).size() << " gram " << gram << " patterns from " << fileName << std::endl;
+    }
+
+    // the super patterns are all loaded now
+    addCheckpointRelations(relations);
+
+    return gram_num;
+}
+
+void PatternMiner::addCheckpointRelations(vector<CheckpointRelation>& relations)
+{
+    for (CheckpointRelation& checkpointRelation : relations)
+    {
+        HTreeNode* superNode = patternTable.find(checkpointRelation.superPatternKey);
+        if ((superNode == 0) || (checkpointRelation.extendedLinkIndex >= superNode->pattern.size()))
+            continue;
+
+        ExtendRelation relation;
+        relation.extendedHTreeNode = superNode;
+        relation.newExtendedLink = (superNode->pattern)[checkpointRelation.extendedLinkIndex];
+        checkpointRelation.node->superPatternRelations.push_back(relation);
+    }
+}
+
+void PatternMiner::releaseInstanceUids()
+{
+    for (vector<HTreeNode*>& patternsForThisGram : patternsForGram)
+    {
+        for (HTreeNode* htreeNode : patternsForThisGram)
+            htreeNode->instancesUids.clear();
+    }
+}
+
+void PatternMiner::spillLowFrequencyPatterns(unsigned int gram)
+{
+    vector<HTreeNode*>& patternsForThisGram = patternsForGram[gram-1];
+    vector<HTreeNode*> keptNodes, spilledNodes;
+
+    for (HTreeNode* htreeNode : patternsForThisGram)
+    {
+        if (htreeNode->count < thresholdFrequency)
+            spilledNodes.push_back(htreeNode);
+        else
+            keptNodes.push_back(htreeNode);
+    }
+
+    if (spilledNodes.empty())
+        return;
+
+    // The frequent pattern output of their gram, if not written yet, needs their patterns
+    if (enable_Frequent_Pattern && (! frequentPatternsOutput[gram-1]))
+        writeSpilledFrequentPatterns(gram, spilledNodes);
+    spilledPatternNum[gram-1] += spilledNodes.size();
+
+    // They are done counting, and not extended any more. They stay in patternTable with their counts, for the
+    // sub pattern and super pattern lookups; the checkpoint of their gram, if any, has the rest of them.
+    for (HTreeNode* htreeNode : spilledNodes)
+        htreeNode->spill();
+
+    patternsForThisGram.swap(keptNodes);
+
+    cout << spilledNodes.size() << " gram " << gram << " patterns with a frequency lower than "
+         << thresholdFrequency << " spilled." << std::endl;
+}
+
+void PatternMiner::writeSpilledFrequentPatterns(unsigned int gram, vector<HTreeNode*>& spilledNodes)
+{
+    // a gram is only spilled once, a file left by a mining that did not finish is overwritten
+    string fileName = gramFileName("lowfrequency", gram);
+    ofstream file(fileName.c_str(), ios::trunc);
+    if (! file.is_open())
+    {
+        cout << "Warning: Cannot write patterns to file " << fileName << ", they are left out of the frequent patterns." << std::endl;
+        return;
+    }
+
+    std::sort(spilledNodes.begin(), spilledNodes.end(), compareHTreeNodeByFrequency);
+
+    for (HTreeNode* htreeNode : spilledNodes)
+    {
+        if (htreeNode->count < 2)
+            break;
+
+        writeFrequentPattern(file, htreeNode);
+    }
+}
+
+void PatternMiner::boundHTreeMemory(unsigned int lastGram)
+{
+    if (maxHTreeMemory == 0)
+        return;
+
+    size_t usage = htree->nodePool.memoryUsage();
+
+    // the highest grams have the most patterns under the threshold
+    for (unsigned int gram = lastGram; (gram >= 1) && (usage > maxHTreeMemory); -- gram)
+    {
+        cout << "H-tree memory " << usage / (1024 * 1024) << "MB is over the limit of "
+             << maxHTreeMemory / (1024 * 1024) << "MB, spilling gram " << gram << " patterns..." << std::endl;
+
+        spillLowFrequencyPatterns(gram);
+        usage = htree->nodePool.memoryUsage();
+    }
+
+    if (usage > maxHTreeMemory)
+        cout << "Warning: H-tree memory " << usage / (1024 * 1024) << "MB is still over the limit, "
+             << "raise Pattern_Max_HTree_Memory_MB or the threshold frequency." << std::endl;
+}
+
+void PatternMiner::spillSuperPatternRelations(unsigned int gram)
+{
+    vector<HTreeNode*> spilledNodes;
+
+    for (HTreeNode* htreeNode : patternsForGram[gram-1])
+    {
+        if ((htreeNode->count < thresholdFrequency) && (! htreeNode->superPatternRelations.empty()))
+            spilledNodes.push_back(htreeNode);
+    }
+
+    if (spilledNodes.empty())
+        return;
+
+    // a pattern can be spilled again later, with the relations found since, the file is appended to
+    writePatternsToFile(gramFileName("spill", gram), spilledNodes, true);
+
+    for (HTreeNode* htreeNode : spilledNodes)
+        vector<ExtendRelation>().swap(htreeNode->superPatternRelations);
+
+    cout << "\nThe super pattern relations of " << spilledNodes.size() << " gram " << gram
+         << " patterns with a frequency lower than " << thresholdFrequency << " spilled." << std::endl;
+}
+
+void PatternMiner::boundHTreeMemoryWhileMining()
+{
+    if (maxHTreeMemory == 0)
+        return;
+
+    size_t usage = htree->nodePool.memoryUsage();
+
+    // the MAX_GRAM patterns have no super pattern
+    for (unsigned int gram = MAX_GRAM - 1; (gram >= 1) && (usage > maxHTreeMemory); -- gram)
+    {
+        spillSuperPatternRelations(gram);
+        usage = htree->nodePool.memoryUsage();
+    }
+}
+
+void PatternMiner::removeSpillFiles()
+{
+    for (unsigned int gram = 1; gram <= MAX_GRAM; ++ gram)
+        remove(gramFileName("spill", gram).c_str());
+}
+
+void PatternMiner::mergeSpilledRelations()
+{
+    for (unsigned int gram = 1; gram < MAX_GRAM; ++ gram)
+    {
+        string fileName = gramFileName("spill", gram);
+        struct stat fileStat;
+        if (stat(fileName.c_str(), &fileStat) != 0)
+            continue;
+
+        // the patterns are all in patternTable, only their relations are read
+        vector<CheckpointRelation> relations;
+        if (! loadPatternsFromFile(fileName, gram, relations))
+            cout << "Warning: Invalid spill file " << fileName << ", some super pattern relations are lost." << std::endl;
+
+        remove(fileName.c_str());
+
+        // the relations of the patterns still under thresholdFrequency are dropped, those patterns are not
+        // extended; boundHTreeMemory releases them once they are checkpointed
+        vector<CheckpointRelation> keptRelations;
+        for (CheckpointRelation& relation : relations)
+        {
+            if (relation.node->count >= thresholdFrequency)
+                keptRelations.push_back(relation);
+        }
+
+        addCheckpointRelations(keptRelations);
+
+        cout << keptRelations.size() << " spilled super pattern relations of gram " << gram << " merged back." << std::endl;
+    }
+}
@@ -25,8 +25,10 @@
 #include <math.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <chrono>
 #include <iterator>
 #include <map>
 #include <vector>
@@ -38,8 +40,10 @@
 #include <opencog/atoms/base/atom_types.h>
 #include <opencog/spacetime/atom_types.h>
 #include <opencog/embodiment/atom_types.h>
+#include <opencog/concurrency/WorkStealingPool.h>
 #include <opencog/query/BindLinkAPI.h>
 #include <opencog/util/Config.h>
+#include <opencog/util/Logger.h>
 #include <opencog/util/StringManipulator.h>
 
 #include "HTree.h"
@@ -129,86 +133,86 @@ void PatternMiner::growPatternsDepthFirstTask_old()
 }
 
 
-void PatternMiner::growPatternsDepthFirstTask(unsigned int thread_index)
+// Mines from the start links in [begin, end). As long as there is more than
+// one link, the upper half of the range is queued as a task of its own, to
+// be stolen by the first idle thread: the threads share out the work however
+// skewed the link degrees are, while each one goes through adjacent links.
+void PatternMiner::growPatternsDepthFirstTask(unsigned int begin, unsigned int end)
 {
+    while (end - begin > 1)
+    {
+        unsigned int middle = begin + (end - begin) / 2;
+        miningPool->submit([this, middle, end] { growPatternsDepthFirstTask(middle, end); });
+        end = middle;
+    }
 
-    unsigned int start_index = linksPerThread * thread_index; // the start index in allLinks for current thread
+    if (begin < end)
+        growPatternsDepthFirstFromLink(begin);
+}
 
-    unsigned int end_index; // the last index for current thread ,excluded
-    if (thread_index == THREAD_NUM - 1) // if this the last thread, it need to finish all the rest of the links
-        end_index = allLinkNumber;
-    else
-        end_index = linksPerThread * (thread_index + 1);
+void PatternMiner::growPatternsDepthFirstFromLink(unsigned int link_index)
+{
+    unsigned int thread_index = (unsigned int) miningPool->worker_index();
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
 
+    readNextLinkLock.lock();
+    processedLinkNum ++;
+    cout<< "\r" << ((float)(processedLinkNum))/((float)(allLinkNumber))*100.0f << "% completed."; // it's not liner
+    std::cout.flush();
 
-    cout<< "Start thread " << thread_index << " from " << start_index << " to " << end_index-1 << std::endl;
+    Handle& cur_link = allLinks[link_index];
 
-    patternJsonArrays[thread_index] = json::value::array();
+    readNextLinkLock.unlock();
 
-    float allLinkNumberfloat = ((float)(end_index - start_index));
-    for(unsigned int t_cur_index = start_index; t_cur_index < end_index; ++ t_cur_index)
+    // if this link is listlink, ignore it
+    if (originalAtomSpace->get_type(cur_link) == opencog::LIST_LINK)
     {
-        readNextLinkLock.lock();
-        cout<< "\r" << ((float)(t_cur_index - start_index))/allLinkNumberfloat*100.0f << "% completed in Thread " + toString(thread_index) + "."; // it's not liner
-        std::cout.flush();
+        return;
+    }
 
-        processedLinkNum ++;
-        Handle& cur_link = allLinks[t_cur_index];
+    // Add this link into observingAtomSpace
+    HandleSeq outgoingLinks,outVariableNodes;
 
-        readNextLinkLock.unlock();
+    swapOneLinkBetweenTwoAtomSpace(originalAtomSpace, observingAtomSpace, cur_link, outgoingLinks, outVariableNodes);
+    Handle newLink = observingAtomSpace->add_link(originalAtomSpace->get_type(cur_link), outgoingLinks);
+    newLink->merge(originalAtomSpace->get_TV(cur_link));
 
-        // if this link is listlink, ignore it
-        if (originalAtomSpace->get_type(cur_link) == opencog::LIST_LINK)
-        {
-            continue;
-        }
-
-        // Add this link into observingAtomSpace
-        HandleSeq outgoingLinks,outVariableNodes;
-
-        swapOneLinkBetweenTwoAtomSpace(originalAtomSpace, observingAtomSpace, cur_link, outgoingLinks, outVariableNodes);
-        Handle newLink = observingAtomSpace->add_link(originalAtomSpace->get_type(cur_link), outgoingLinks);
-        newLink->merge(originalAtomSpace->get_TV(cur_link));
 
+    // Extract all the possible patterns from this originalLink, and extend till the max_gram links, not duplicating the already existing patterns
+    HandleSeq lastGramLinks;
+    map<Handle,Handle> lastGramValueToVarMap;
+    map<Handle,Handle> patternVarMap;
 
-        // Extract all the possible patterns from this originalLink, and extend till the max_gram links, not duplicating the already existing patterns
-        HandleSeq lastGramLinks;
-        map<Handle,Handle> lastGramValueToVarMap;
-        map<Handle,Handle> patternVarMap;
+    // vector<HTreeNode*> &allHTreeNodesCurTask is only used in distributed version
+    // is to store all the HTreeNode* mined in this current task, and release them after the task is finished.
+    vector<HTreeNode*> allHTreeNodesCurTask;
 
-        // vector<HTreeNode*> &allHTreeNodesCurTask is only used in distributed version
-        // is to store all the HTreeNode* mined in this current task, and release them after the task is finished.
-        vector<HTreeNode*> allHTreeNodesCurTask;
 
+    actualProcessedLinkLock.lock();
+    actualProcessedLinkNum ++;
+    actualProcessedLinkLock.unlock();
 
-        actualProcessedLinkLock.lock();
-        actualProcessedLinkNum ++;
-        actualProcessedLinkLock.unlock();
+    extendAPatternForOneMoreGramRecursively(newLink, observingAtomSpace, Handle::UNDEFINED, lastGramLinks, 0, lastGramValueToVarMap,
+                                            patternVarMap, false, allHTreeNodesCurTask, patternFrameWriters[thread_index]);
 
-        extendAPatternForOneMoreGramRecursively(newLink, observingAtomSpace, Handle::UNDEFINED, lastGramLinks, 0, lastGramValueToVarMap,
-                                                patternVarMap, false, allHTreeNodesCurTask, patternJsonArrays[thread_index]);
+    // release all the HTreeNodes created in this task if it's running as a distributed worker. A worker
+    // never adds its nodes to patternTable, they are only known to this task, see
+    // extractAPatternFromGivenVarCombination, so no other thread can hold one.
+    if (run_as_distributed_worker)
+    {
+        // clean up the pattern atomspace, do not need to keep patterns in atomspace when run as a distributed worker
+        if (THREAD_NUM == 1)
+            atomSpace->clear(); // can only clear the atomspace when only 1 thread is used
 
-        // release all the HTreeNodes created in this task if it's running as a distributed worker
-        if (run_as_distributed_worker)
+        for(unsigned int hNodeNum = 0; hNodeNum < allHTreeNodesCurTask.size(); hNodeNum ++)
         {
-            // clean up the pattern atomspace, do not need to keep patterns in atomspace when run as a distributed worker
-            if (THREAD_NUM == 1)
-                atomSpace->clear(); // can only clear the atomspace when only 1 thread is used
-
-            for(unsigned int hNodeNum = 0; hNodeNum < allHTreeNodesCurTask.size(); hNodeNum ++)
-            {
-                delete (allHTreeNodesCurTask[hNodeNum]);
-            }
+            htree->nodePool.release(allHTreeNodesCurTask[hNodeNum]);
         }
-
-
     }
 
-    if (patternJsonArrays[thread_index].size() > 0)
-        sendPatternsToCentralServer(patternJsonArrays[thread_index]);
-
-    cout<< "\r100% completed in Thread " + toString(thread_index) + ".";
-    std::cout.flush();
+    // only this thread writes its own utilisation
+    threadBusySeconds[thread_index] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    threadMinedLinkNum[thread_index] ++;
 }
 
 
@@ -275,21 +279,50 @@ void PatternMiner::runPatternMinerDepthFirst()
 
 //    cur_DF_ExtractedLinks = new set<string>[MAX_GRAM];
 
-    linksPerThread = allLinkNumber/THREAD_NUM;
-
     processedLinkNum = 0;
     actualProcessedLinkNum = 0;
 
-    for (unsigned int i = 0; i < THREAD_NUM; ++ i)
+    miningPool = new WorkStealingPool(THREAD_NUM);
+    threadBusySeconds.assign(THREAD_NUM, 0.0);
+    threadMinedLinkNum.assign(THREAD_NUM, 0);
+
+    std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+    // the start links are split into tasks on demand, as the threads steal them. With a memory limit, they are
+    // mined by batches, and the HTree is bounded between two batches, while no thread runs.
+    unsigned int linkNum = (unsigned int) allLinkNumber;
+    unsigned int batchLinkNum = ((maxHTreeMemory == 0) || run_as_distributed_worker) ? linkNum : memoryCheckLinkNum;
+    if (batchLinkNum < linkNum)
+        removeSpillFiles();
+
+    for (unsigned int begin = 0; begin < linkNum; begin += batchLinkNum)
     {
+        unsigned int end = std::min(begin + batchLinkNum, linkNum);
+        miningPool->submit([this, begin, end] { growPatternsDepthFirstTask(begin, end); });
+        miningPool->wait();
 
-        threads[i] = std::thread(&PatternMiner::growPatternsDepthFirstTask,this,i);
-        // threads[i] = std::thread([this]{this->growPatternsDepthFirstTask(i);}); // using C++11 lambda-expression
+        if (end < linkNum)
+            boundHTreeMemoryWhileMining();
     }
 
+    if (batchLinkNum < linkNum)
+        mergeSpilledRelations();
+
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+
+    delete miningPool;
+    miningPool = 0;
+
+    cout<< "\r100% completed." << std::endl;
+
     for (unsigned int i = 0; i < THREAD_NUM; ++ i)
     {
-        threads[i].join();
+        if (patternFrameWriters[i].size() > 0)
+            sendPatternsToCentralServer(patternFrameWriters[i]);
+
+        cout << "Thread " << i << ": " << threadMinedLinkNum[i] << " links mined, busy "
+             << threadBusySeconds[i] << "s, utilisation "
+             << (wallSeconds > 0.0 ? threadBusySeconds[i] / wallSeconds * 100.0 : 0.0) << "%" << std::endl;
     }
 
     // release allLinks
@@ -298,7 +331,7 @@ void PatternMiner::runPatternMinerDepthFirst()
 
 //    delete [] cur_DF_ExtractedLinks;
     delete [] threads;
-    delete [] patternJsonArrays;
+    delete [] patternFrameWriters;
 
     cout << "\nFinished mining 1~" << MAX_GRAM << " gram patterns.\n";
     cout << "\nprocessedLinkNum = " << processedLinkNum << std::endl;
@@ -422,7 +455,7 @@ HTreeNode* PatternMiner::extractAPatternFromGivenVarCombination(HandleSeq &input
 
         if (run_as_distributed_worker)
         {
-            newHTreeNode = new HTreeNode();
+            newHTreeNode = htree->nodePool.create();
             returnHTreeNode = newHTreeNode;
             newHTreeNode->count = 1;
             newHTreeNode->pattern = unifiedPattern;
@@ -432,82 +465,43 @@ HTreeNode* PatternMiner::extractAPatternFromGivenVarCombination(HandleSeq &input
         }
         else
         {
-            string keyString = unifiedPatternToKeyString(unifiedPattern);
+            PatternKey key = unifiedPatternToKey(unifiedPattern);
 
-            string instancekeyString = "";
-            if ( (gram > 1) && (THREAD_NUM > 1) )
+            uint64_t instanceUidValue = 0;
+            bool checkInstance = (gram > 1) && (THREAD_NUM > 1);
+            if (checkInstance)
             {
                 // check if these fact links already been processed before or by other thread
 
                 OrderedHandleSet originalLinksSet(inputLinks.begin(), inputLinks.end());
-
-                for (Handle h  : originalLinksSet)
-                {
-                    instancekeyString +=  toString(h.value());
-                    instancekeyString += "_";
-                }
+                instanceUidValue = instanceUid(originalLinksSet);
             }
 
-            if (THREAD_NUM > 1)
-                uniqueKeyLock.lock();
-
-            map<string, HTreeNode*>::iterator htreeNodeIter = keyStrToHTreeNodeMap.find(keyString);
-
-            if (htreeNodeIter == keyStrToHTreeNodeMap.end())
+            returnHTreeNode = patternTable.findOrInsert(key, [&]()
             {
-                newHTreeNode = new HTreeNode();
-                returnHTreeNode = newHTreeNode;
+                // fill in the node before adding it, the other threads can find it as soon as it's in the table
+                newHTreeNode = htree->nodePool.create();
                 newHTreeNode->count = 1;
-
-                if (gram > 1  && (THREAD_NUM > 1) )
-                {
-                    newHTreeNode->instancesUidStrings.insert(instancekeyString);
-                }
-
-                keyStrToHTreeNodeMap.insert(std::pair<string, HTreeNode*>(keyString, newHTreeNode));
-
-    //            cout << "A new pattern Found:\n"<< keyString << std::endl;
-
-
-
-            }
-            else
+                newHTreeNode->pattern = unifiedPattern;
+                newHTreeNode->var_num = patternVarMap.size();
+                if (checkInstance)
+                    newHTreeNode->instancesUids.insert(instanceUidValue);
+                return newHTreeNode;
+            },
+            [&](HTreeNode* node, bool added)
             {
-                returnHTreeNode = ((HTreeNode*)(htreeNodeIter->second));
+                if (added)
+                    return;
 
-                bool alreadyExtracted = false;
-                if (gram > 1  && (THREAD_NUM > 1))
-                {
-                    // check if these fact links already been processed before or by other thread
-                    if (returnHTreeNode->instancesUidStrings.find(instancekeyString) == returnHTreeNode->instancesUidStrings.end())
-                    {
-                        returnHTreeNode->instancesUidStrings.insert(instancekeyString);
-                    }
-                    else
-                    {
-                        alreadyExtracted = true;
-                        // debug
-                        // cout << "already extracted!" << std::endl;
-                    }
-
-                }
+                // check if these fact links already been processed before or by other thread
+                bool alreadyExtracted = checkInstance && (! node->instancesUids.insert(instanceUidValue));
 
                 if (! alreadyExtracted)
-                    returnHTreeNode->count ++;
-
-    //            cout << "Unique Key already exists:" << keyString << std::endl;
-
-            }
-
-            if (THREAD_NUM > 1)
-                uniqueKeyLock.unlock();
-
+                    node->count ++;
+            });
 
             if (newHTreeNode)
             {
-                newHTreeNode->pattern = unifiedPattern;
-                newHTreeNode->var_num = patternVarMap.size();
-
                 if (THREAD_NUM > 1)
                     addNewPatternLock.lock();
 
@@ -530,10 +524,10 @@ HTreeNode* PatternMiner::extractAPatternFromGivenVarCombination(HandleSeq &input
 // when it's the first gram pattern: parentNode = 0, extendedNode = undefined, lastGramLinks is empty, lastGramValueToVarMap and lastGramPatternVarMap are empty
 // extendedNode is the value node in original AtomSpace
 // lastGramLinks is the original links the parentLink is extracted from
-// patternJsonArray is only used in distributed mode, to buffer the pattern jsons to send to server
+// patternFrameWriter is only used in distributed mode, to buffer the patterns to send to server
 void PatternMiner::extendAPatternForOneMoreGramRecursively(const Handle &extendedLink, AtomSpace* _fromAtomSpace, const Handle &extendedNode, const HandleSeq &lastGramLinks,
                  HTreeNode* parentNode, const map<Handle,Handle> &lastGramValueToVarMap, const map<Handle,Handle> &lastGramPatternVarMap,
-                 bool isExtendedFromVar, vector<HTreeNode*> &allHTreeNodesCurTask, json::value &patternJsonArray)
+                 bool isExtendedFromVar, vector<HTreeNode*> &allHTreeNodesCurTask, PatternFrameWriter &patternFrameWriter)
 {
 
     // the ground value node in the _fromAtomSpace to the variable handle in pattenmining Atomspace
@@ -687,21 +681,14 @@ void PatternMiner::extendAPatternForOneMoreGramRecursively(const Handle &extende
                 if (run_as_distributed_worker)
                 {
                     allHTreeNodesCurTask.push_back(thisGramHTreeNode);
-                    string curPatternKeyStr = unifiedPatternToKeyString(thisGramHTreeNode->pattern);
-
-                    string parentKeyStr = "";
+                    PatternKey curPatternKey = unifiedPatternToKey(thisGramHTreeNode->pattern);
 
+                    // the parent is sent as its key only, a null key for none
+                    PatternKey parentKey;
                     if (parentNode)
-                    {
-                        parentKeyStr = unifiedPatternToKeyString(parentNode->pattern);
+                        parentKey = unifiedPatternToKey(parentNode->pattern);
 
-                    }
-                    else
-                    {
-                        parentKeyStr = "none";
-                    }
-
-                    addPatternsToJsonArrayBuf(curPatternKeyStr, parentKeyStr, extendedLinkIndex, patternJsonArray);
+                    addPatternToFrameBuf(thisGramHTreeNode, curPatternKey, parentKey, extendedLinkIndex, patternFrameWriter);
                 }
                 else
                 {
@@ -805,7 +792,7 @@ void PatternMiner::extendAPatternForOneMoreGramRecursively(const Handle &extende
 
                         // extract patterns from these child
                         extendAPatternForOneMoreGramRecursively(extendedHandle,  _fromAtomSpace, extendNode, inputLinks, thisGramHTreeNode,
-                                                                valueToVarMap,patternVarMap,isNewExtendedFromVar, allHTreeNodesCurTask, patternJsonArray);
+                                                                valueToVarMap,patternVarMap,isNewExtendedFromVar, allHTreeNodesCurTask, patternFrameWriter);
                     }
 
                     nodeIndex ++;
@@ -1147,46 +1134,44 @@ void PatternMiner::extractAllPossiblePatternsFromInputLinksDF(HandleSeq& inputLi
                 unsigned int unifiedLastLinkIndex;
                 unifiedPattern = UnifyPatternOrder(pattern, unifiedLastLinkIndex);
 
-                string keyString = unifiedPatternToKeyString(unifiedPattern);
+                PatternKey key = unifiedPatternToKey(unifiedPattern);
 
-                // next, check if this pattern already exist (need lock)
+                // next, check if this pattern already exist
                 HTreeNode* newHTreeNode = 0;
-                uniqueKeyLock.lock();
-
-                map<string, HTreeNode*>::iterator htreeNodeIter = keyStrToHTreeNodeMap.find(keyString);
+                bool newPattern = false;
 
-                if (htreeNodeIter == keyStrToHTreeNodeMap.end())
+                HTreeNode* superPatternNode = patternTable.findOrInsert(key, [&]()
                 {
-                    newHTreeNode = new HTreeNode();
-                    keyStrToHTreeNodeMap.insert(std::pair<string, HTreeNode*>(keyString, newHTreeNode));
-
-
-                    cout << "A new pattern Found:\n"<< keyString << std::endl;
-
-                    newHTreeNode->count = 1;
-                    allHTreeNodes.push_back(newHTreeNode);
-
-                }
-                else
+                    newHTreeNode = htree->nodePool.create();
+                    newHTreeNode->pattern = unifiedPattern;
+                    newHTreeNode->var_num = var_num;
+                    return newHTreeNode;
+                },
+                [&](HTreeNode* node, bool added)
                 {
+                    newPattern = added;
+                    if (added)
+                        node->count = 1;
+                    else
+                        node->count ++;
+                });
 
-                    ((HTreeNode*)(htreeNodeIter->second))->count ++;
-                    allHTreeNodes.push_back((HTreeNode*)(htreeNodeIter->second));
-                    cout << "Unique Key already exists. count ++ !\n\n";
-
+                // logged once the shard of the pattern table is unlocked
+                if (logger().is_debug_enabled())
+                {
+                    if (newPattern)
+                        logger().debug("[PatternMiner] A new pattern found:\n%s",
+                                       unifiedPatternToKeyString(unifiedPattern).c_str());
+                    else
+                        logger().debug("[PatternMiner] Unique key already exists, count ++");
                 }
 
-                uniqueKeyLock.unlock();
+                allHTreeNodes.push_back(superPatternNode);
 
                 // if gram > 1, this pattern is the super pattern of al the lastGramHTreeNodes
                 // add ExtendRelations
                 if (gram > 1)
                 {
-                    HTreeNode* superPatternNode;
-                    if (newHTreeNode)
-                        superPatternNode = newHTreeNode;
-                    else
-                        superPatternNode = (HTreeNode*)(htreeNodeIter->second);
 
                     for (HTreeNode* lastGramHTreeNode : allLastGramHTreeNodes)
                     {
@@ -1201,9 +1186,6 @@ void PatternMiner::extractAllPossiblePatternsFromInputLinksDF(HandleSeq& inputLi
 
                 if (newHTreeNode)
                 {
-                    newHTreeNode->pattern = unifiedPattern;
-                    newHTreeNode->var_num = var_num;
-
                     addNewPatternLock.lock();
                     (patternsForGram[gram-1]).push_back(newHTreeNode);
                     addNewPatternLock.unlock();
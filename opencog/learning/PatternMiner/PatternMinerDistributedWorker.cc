@@ -41,6 +41,7 @@
 #include <opencog/embodiment/atom_types.h>
 #include <opencog/query/BindLinkAPI.h>
 #include <opencog/util/Config.h>
+#include <opencog/util/Logger.h>
 #include <opencog/util/StringManipulator.h>
 
 #include <cpprest/http_client.h>
@@ -71,6 +72,7 @@ void PatternMiner::launchADistributedWorker()
     centralServerIP = config().get("PMCentralServerIP");
     centralServerPort = config().get("PMCentralServerPort");
     centralServerBaseURL = "http://" +  centralServerIP + ":" + centralServerPort + "/PatternMinerServer";
+    centralServerStreamPort = config().has("PMCentralServerStreamPort") ? config().get("PMCentralServerStreamPort") : "19010";
 
     boost::uuids::random_generator uuidGen;
     boost::uuids::uuid uid = uuidGen();
@@ -96,6 +98,15 @@ void PatternMiner::launchADistributedWorker()
         if (response.status_code() == status_codes::OK)
         {
             std::cout << "Registered to the central server successfully! " << std::endl;
+
+            // the patterns are streamed to the central server, the http requests are only for registering and stopping
+            patternStreamClient = new PatternStreamClient();
+            if (! patternStreamClient->connect(centralServerIP, centralServerStreamPort, clientWorkerUID))
+            {
+                std::cout << "Network problem. Cannot open the pattern stream to the central server! Client application quited!" << std::endl;
+                std::exit(EXIT_SUCCESS);
+            }
+
             startMiningWork();
         }
         else
@@ -204,6 +215,10 @@ void PatternMiner::startMiningWork()
         int end_time = time(NULL);
         printf("Current pattern mining worker finished working! Total time: %d seconds. \n", end_time - start_time);
 
+        // make sure the server has parsed all the patterns of this worker before it is told this worker stopped
+        patternStreamClient->flush();
+        patternStreamClient->close();
+
         notifyServerThisWorkerStop();
 
         std::cout << THREAD_NUM << " threads used. "
@@ -214,75 +229,30 @@ void PatternMiner::startMiningWork()
 
 }
 
-void PatternMiner::addPatternsToJsonArrayBuf(string curPatternKeyStr, string parentKeyString,  unsigned int extendedLinkIndex, json::value &patternJsonArray)
+void PatternMiner::addPatternToFrameBuf(HTreeNode* htreeNode, const PatternKey& curPatternKey, const PatternKey& parentKey,
+                                        unsigned int extendedLinkIndex, PatternFrameWriter &patternFrameWriter)
 {
-    try
-    {
-
-        json::value patternInfo = json::value::object();
-        patternInfo[U("Pattern")] = json::value(U(curPatternKeyStr));
-        patternInfo[U("ParentPattern")] = json::value(U(parentKeyString));
-        patternInfo[U("ExtendedLinkIndex")] = json::value(U(extendedLinkIndex));
-        patternInfo[U("ClientUID")] = json::value(U(clientWorkerUID));
-        patternInfo[U("ProcessedFactsNum")] = json::value(U(actualProcessedLinkNum));
-
-        patternJsonArray[patternJsonArray.size()] = patternInfo;
-
-        if(patternJsonArray.size() >= JSON_BUF_MAX_NUM)
-            sendPatternsToCentralServer(patternJsonArray);
+    patternFrameWriter.addPattern(htreeNode->pattern, curPatternKey, parentKey, extendedLinkIndex, atomSpace);
 
-    }
-    catch (exception const & e)
-    {
-       cout << e.what() << "addPatternsToJsonArrayBuf exception!: " << endl;
-
-    }
+    if (patternFrameWriter.size() >= PATTERN_FRAME_MAX_NUM)
+        sendPatternsToCentralServer(patternFrameWriter);
 
     cur_worker_mined_pattern_num ++;
     // cout << "\nWorker added cur_worker_mined_pattern_num = " << cur_worker_mined_pattern_num << std::endl;
 }
 
-// this function will empty patternJsonArray after sent
-void PatternMiner::sendPatternsToCentralServer(json::value &patternJsonArray)
+// this function will empty patternFrameWriter after sent.
+// It waits for a credit from the server, so the workers never send faster than the server parses
+void PatternMiner::sendPatternsToCentralServer(PatternFrameWriter &patternFrameWriter)
 {
-
-    uri_builder builder(U("/FindNewPatterns"));
-
-    while (true)
+    if (! patternStreamClient->send(patternFrameWriter.finish(actualProcessedLinkNum)))
     {
-        http_request request(methods::POST);
-        request.set_request_uri(builder.to_uri());
-        request.headers().add(header_names::accept, U("application/json"));
-        request.set_body(patternJsonArray);
-
-        http_response response;
-
-        if (sendRequest(request, response))
-        {
-//            std::cout << response.to_string() << std::endl;
-            if (response.status_code() == status_codes::OK)
-            {
-                break;
-            }
-            else
-            {
-                std::cout << "Network problem: Failed to send new found patterns! Retrying ... " << std::endl;
-            }
-        }
-        else
-        {
-            std::cout << "Network problem: Failed to send new found patterns! Retrying ... " << std::endl;
-        }
-
+        // the patterns found from now on could not reach the central
+        // server either, and it would count this worker's links as done
+        logger().error("PatternMiner: Failed to send new found patterns, the central server %s:%s is unreachable. The worker stops.",
+                       centralServerIP.c_str(), centralServerStreamPort.c_str());
+        std::exit(EXIT_FAILURE);
     }
-
-
-    // empty the array
-    patternJsonArray = json::value::array();
-
-    usleep(20000);
-
-
 }
 
 // send request, get response back
@@ -0,0 +1,758 @@
+/*
+ * opencog/learning/PatternMiner/PatternStream.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include <opencog/atoms/base/ClassServer.h>
+#include <opencog/util/Logger.h>
+
+#include "PatternStream.h"
+
+using namespace opencog::PatternMining;
+using namespace opencog;
+
+using boost::asio::ip::tcp;
+
+// a bigger frame can only come from a broken or foreign peer
+#define PATTERN_FRAME_MAX_SIZE (64 * 1024 * 1024)
+
+// the patterns are a few links deep, a deeper encoding is rejected before
+// it can exhaust the stack of the parse thread
+#define PATTERN_ATOM_MAX_DEPTH 64
+
+// a worker waits this many seconds between its tries to reopen a lost
+// stream, and gives up after PATTERN_STREAM_MAX_RECONNECTS tries
+#define PATTERN_STREAM_RECONNECT_DELAY 5
+#define PATTERN_STREAM_MAX_RECONNECTS 12
+
+void opencog::PatternMining::writeVarint(string& buf, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buf.push_back((char) ((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    buf.push_back((char) value);
+}
+
+bool opencog::PatternMining::readVarint(const char*& p, const char* end, uint64_t& value)
+{
+    value = 0;
+    for (unsigned int shift = 0; (p < end) && (shift < 64); shift += 7)
+    {
+        unsigned char byte = (unsigned char) *p ++;
+        value |= ((uint64_t) (byte & 0x7f)) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void writeUInt64(string& buf, uint64_t value)
+{
+    for (unsigned int i = 0; i < 8; ++ i)
+        buf.push_back((char) ((value >> (i * 8)) & 0xff));
+}
+
+static uint64_t readUInt64(const char* p)
+{
+    uint64_t value = 0;
+    for (unsigned int i = 0; i < 8; ++ i)
+        value |= ((uint64_t) (unsigned char) p[i]) << (i * 8);
+    return value;
+}
+
+void opencog::PatternMining::writeKey(string& buf, const PatternKey& key)
+{
+    writeUInt64(buf, key.hi);
+    writeUInt64(buf, key.lo);
+}
+
+bool opencog::PatternMining::readKey(const char*& p, const char* end, PatternKey& key)
+{
+    if (end - p < 16)
+        return false;
+
+    key.hi = readUInt64(p);
+    key.lo = readUInt64(p + 8);
+    p += 16;
+    return true;
+}
+
+static void writeFrameHeader(char* header, uint32_t length, unsigned char type)
+{
+    for (unsigned int i = 0; i < 4; ++ i)
+        header[i] = (char) ((length >> (i * 8)) & 0xff);
+    header[4] = (char) type;
+}
+
+static uint32_t readFrameLength(const char* header)
+{
+    uint32_t length = 0;
+    for (unsigned int i = 0; i < 4; ++ i)
+        length |= ((uint32_t) (unsigned char) header[i]) << (i * 8);
+    return length;
+}
+
+static string makeFrame(unsigned char type, const string& payload)
+{
+    string frame(5, '\0');
+    writeFrameHeader(&frame[0], (uint32_t) (payload.size() + 1), type);
+    frame.append(payload);
+    return frame;
+}
+
+// ---------------- PatternFrameWriter ----------------
+
+PatternFrameWriter::PatternFrameWriter() : patternNum(0)
+{
+}
+
+unsigned int PatternFrameWriter::stringId(const string& str)
+{
+    unordered_map<string, unsigned int>::iterator it = stringIds.find(str);
+    if (it != stringIds.end())
+        return it->second;
+
+    unsigned int id = stringIds.size();
+    stringIds.insert(std::pair<string, unsigned int>(str, id));
+    writeVarint(strings, str.size());
+    strings.append(str);
+    return id;
+}
+
+void PatternFrameWriter::encodeAtom(const Handle& h, const AtomSpace* atomspace)
+{
+    writeVarint(encoding, stringId(classserver().getTypeName(atomspace->get_type(h))));
+
+    if (atomspace->is_node(h))
+    {
+        writeVarint(encoding, stringId(atomspace->get_name(h)));
+    }
+    else
+    {
+        const HandleSeq& outgoings = h->getOutgoingSet();
+        writeVarint(encoding, outgoings.size());
+        for (const Handle& outgoing : outgoings)
+            encodeAtom(outgoing, atomspace);
+    }
+}
+
+void PatternFrameWriter::addPattern(const HandleSeq& pattern, const PatternKey& key, const PatternKey& parentKey,
+                                    unsigned int extendedLinkIndex, const AtomSpace* atomspace, const string& extra)
+{
+    encoding.clear();
+    for (const Handle& h : pattern)
+        encodeAtom(h, atomspace);
+
+    writeKey(patterns, key);
+    writeKey(patterns, parentKey);
+    writeVarint(patterns, extendedLinkIndex);
+    writeVarint(patterns, pattern.size());
+    writeVarint(patterns, encoding.size());
+    patterns.append(encoding);
+    writeVarint(patterns, extra.size());
+    patterns.append(extra);
+
+    patternNum ++;
+}
+
+string PatternFrameWriter::finish(unsigned int processedFactsNum)
+{
+    string payload;
+    payload.reserve(strings.size() + patterns.size() + 16);
+    writeVarint(payload, processedFactsNum);
+    writeVarint(payload, stringIds.size());
+    payload.append(strings);
+    writeVarint(payload, patternNum);
+    payload.append(patterns);
+
+    stringIds.clear();
+    strings.clear();
+    patterns.clear();
+    patternNum = 0;
+
+    return makeFrame(PATTERN_FRAME_PATTERNS, payload);
+}
+
+// ---------------- PatternFrameReader ----------------
+
+bool opencog::PatternMining::nextPatternFrame(const char*& cur, const char* end, unsigned char& type,
+                                              const char*& payload, size_t& payloadSize)
+{
+    if (end - cur < 5)
+        return false;
+
+    uint32_t length = readFrameLength(cur);
+    if ((length == 0) || ((size_t) (end - cur - 4) < length))
+        return false;
+
+    type = (unsigned char) cur[4];
+    payload = cur + 5;
+    payloadSize = length - 1;
+    cur += 4 + length;
+    return true;
+}
+
+PatternFrameReader::PatternFrameReader(const string& payload) :
+    cur(payload.data()),
+    end(payload.data() + payload.size()),
+    valid(false),
+    processedFactsNum(0),
+    remainingPatternNum(0)
+{
+    readHeader();
+}
+
+PatternFrameReader::PatternFrameReader(const char* payload, size_t size) :
+    cur(payload),
+    end(payload + size),
+    valid(false),
+    processedFactsNum(0),
+    remainingPatternNum(0)
+{
+    readHeader();
+}
+
+void PatternFrameReader::readHeader()
+{
+    uint64_t factsNum, stringNum, patternNum;
+    if ((! readVarint(cur, end, factsNum)) || (! readVarint(cur, end, stringNum)))
+        return;
+
+    // every string takes at least one byte
+    if (stringNum > (uint64_t) (end - cur))
+        return;
+
+    strings.reserve(stringNum);
+    for (uint64_t i = 0; i < stringNum; ++ i)
+    {
+        uint64_t length;
+        if ((! readVarint(cur, end, length)) || (length > (uint64_t) (end - cur)))
+            return;
+
+        strings.push_back(string(cur, length));
+        cur += length;
+    }
+
+    if (! readVarint(cur, end, patternNum))
+        return;
+
+    processedFactsNum = (unsigned int) factsNum;
+    remainingPatternNum = (unsigned int) patternNum;
+    valid = true;
+}
+
+bool PatternFrameReader::next(PatternRecord& record)
+{
+    if ((! valid) || (remainingPatternNum == 0))
+        return false;
+
+    uint64_t extendedLinkIndex, gram, encodingSize, extraSize;
+    if ((! readKey(cur, end, record.key)) || (! readKey(cur, end, record.parentKey)) ||
+        (! readVarint(cur, end, extendedLinkIndex)) || (! readVarint(cur, end, gram)) ||
+        (! readVarint(cur, end, encodingSize)) || (encodingSize > (uint64_t) (end - cur)))
+    {
+        valid = false;
+        return false;
+    }
+
+    record.extendedLinkIndex = (unsigned int) extendedLinkIndex;
+    record.gram = (unsigned int) gram;
+    record.encoding = cur;
+    record.encodingSize = (size_t) encodingSize;
+    cur += encodingSize;
+
+    // check the encoding before anything of it is added to an AtomSpace
+    const char* p = record.encoding;
+    Handle h;
+    for (uint64_t i = 0; i < gram; ++ i)
+    {
+        if (! loadAtom(p, cur, nullptr, h, 0))
+        {
+            valid = false;
+            return false;
+        }
+    }
+    if (p != cur)
+    {
+        valid = false;
+        return false;
+    }
+
+    if ((! readVarint(cur, end, extraSize)) || (extraSize > (uint64_t) (end - cur)))
+    {
+        valid = false;
+        return false;
+    }
+
+    record.extra = cur;
+    record.extraSize = (size_t) extraSize;
+    cur += extraSize;
+
+    remainingPatternNum --;
+    return true;
+}
+
+bool PatternFrameReader::loadAtom(const char*& p, const char* pEnd, AtomSpace* atomspace, Handle& h,
+                                  unsigned int depth) const
+{
+    if (depth >= PATTERN_ATOM_MAX_DEPTH)
+        return false;
+
+    uint64_t typeId;
+    if ((! readVarint(p, pEnd, typeId)) || (typeId >= strings.size()))
+        return false;
+
+    Type atomType = classserver().getType(strings[typeId]);
+
+    if (classserver().isNode(atomType))
+    {
+        uint64_t nameId;
+        if ((! readVarint(p, pEnd, nameId)) || (nameId >= strings.size()))
+            return false;
+
+        if (atomspace)
+            h = atomspace->add_node(atomType, strings[nameId]);
+        return true;
+    }
+    else if (classserver().isLink(atomType))
+    {
+        uint64_t arity;
+        // every outgoing takes at least two bytes
+        if ((! readVarint(p, pEnd, arity)) || (arity > (uint64_t) (pEnd - p)))
+            return false;
+
+        HandleSeq outgoings;
+        if (atomspace)
+            outgoings.reserve(arity);
+        for (uint64_t i = 0; i < arity; ++ i)
+        {
+            Handle outgoing;
+            if (! loadAtom(p, pEnd, atomspace, outgoing, depth + 1))
+                return false;
+            if (atomspace)
+                outgoings.push_back(outgoing);
+        }
+
+        if (atomspace)
+            h = atomspace->add_link(atomType, outgoings);
+        return true;
+    }
+
+    cout << "Warning: PatternFrameReader: Not a valid typename: " << strings[typeId] << std::endl;
+    return false;
+}
+
+HandleSeq PatternFrameReader::loadPattern(const PatternRecord& record, AtomSpace* atomspace) const
+{
+    HandleSeq pattern;
+    const char* p = record.encoding;
+    const char* pEnd = record.encoding + record.encodingSize;
+
+    for (unsigned int i = 0; i < record.gram; ++ i)
+    {
+        Handle link;
+        if (! loadAtom(p, pEnd, atomspace, link, 0))
+            return HandleSeq();
+        pattern.push_back(link);
+    }
+
+    if (p != pEnd)
+        return HandleSeq();
+
+    return pattern;
+}
+
+// ---------------- PatternStreamServer ----------------
+
+PatternStreamServer::PatternStreamServer(const string& ip, const string& port, unsigned int _credits) :
+    acceptor(ioService),
+    credits(_credits)
+{
+    tcp::endpoint endpoint(boost::asio::ip::address::from_string(ip), (unsigned short) atoi(port.c_str()));
+    acceptor.open(endpoint.protocol());
+    acceptor.set_option(tcp::acceptor::reuse_address(true));
+    acceptor.bind(endpoint);
+    acceptor.listen();
+
+    startAccept();
+
+    ioThread = std::thread([this] { ioService.run(); });
+}
+
+PatternStreamServer::~PatternStreamServer()
+{
+    stop();
+}
+
+void PatternStreamServer::stop()
+{
+    ioService.stop();
+    if (ioThread.joinable())
+        ioThread.join();
+
+    boost::system::error_code error;
+    acceptor.close(error);
+}
+
+void PatternStreamServer::startAccept()
+{
+    PatternStreamConnectionPtr connection = std::make_shared<PatternStreamConnection>(ioService);
+
+    acceptor.async_accept(connection->socket, [this, connection](const boost::system::error_code& error)
+    {
+        if (error == boost::asio::error::operation_aborted)
+            return;
+
+        if (! error)
+        {
+            boost::system::error_code optionError;
+            connection->socket.set_option(tcp::no_delay(true), optionError);
+            startRead(connection);
+        }
+
+        startAccept();
+    });
+}
+
+void PatternStreamServer::startRead(PatternStreamConnectionPtr connection)
+{
+    boost::asio::async_read(connection->socket, boost::asio::buffer(connection->header, sizeof(connection->header)),
+                            [this, connection](const boost::system::error_code& error, size_t)
+    {
+        // the worker has closed the connection
+        if (error)
+            return;
+
+        uint32_t length = readFrameLength(connection->header);
+        if ((length == 0) || (length > PATTERN_FRAME_MAX_SIZE))
+        {
+            cout << "Warning: PatternStreamServer: Invalid frame length " << length
+                 << " from worker " << connection->clientUID << ", connection closed." << std::endl;
+            boost::system::error_code closeError;
+            connection->socket.close(closeError);
+            return;
+        }
+
+        unsigned char type = (unsigned char) connection->header[4];
+        connection->readBuf.resize(length - 1);
+
+        if (length == 1)
+        {
+            handleFrame(connection, type);
+            return;
+        }
+
+        boost::asio::async_read(connection->socket, boost::asio::buffer(&connection->readBuf[0], length - 1),
+                                [this, connection, type](const boost::system::error_code& error, size_t)
+        {
+            if (! error)
+                handleFrame(connection, type);
+        });
+    });
+}
+
+void PatternStreamServer::handleFrame(PatternStreamConnectionPtr connection, unsigned char type)
+{
+    if (type == PATTERN_FRAME_HELLO)
+    {
+        // a second HELLO would grant the worker its credits again
+        if (connection->greeted)
+        {
+            cout << "Warning: PatternStreamServer: HELLO received twice from worker " << connection->clientUID
+                 << ", connection closed." << std::endl;
+            boost::system::error_code closeError;
+            connection->socket.close(closeError);
+            return;
+        }
+
+        connection->greeted = true;
+        connection->clientUID = connection->readBuf;
+        connection->pendingCredits += credits;
+        writeCredits(connection);
+    }
+    else if (type == PATTERN_FRAME_PATTERNS)
+    {
+        if (! connection->greeted)
+        {
+            cout << "Warning: PatternStreamServer: Patterns received before HELLO, connection closed." << std::endl;
+            boost::system::error_code closeError;
+            connection->socket.close(closeError);
+            return;
+        }
+
+        PatternFrame frame;
+        frame.connection = connection;
+        frame.payload.swap(connection->readBuf);
+
+        std::lock_guard<std::mutex> lock(frameQueueLock);
+        frameQueue.push_back(std::move(frame));
+        frameQueueCond.notify_one();
+    }
+
+    startRead(connection);
+}
+
+bool PatternStreamServer::popFrame(PatternFrame& frame, unsigned int timeoutMs)
+{
+    std::unique_lock<std::mutex> lock(frameQueueLock);
+    if (! frameQueueCond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return ! frameQueue.empty(); }))
+        return false;
+
+    frame = std::move(frameQueue.front());
+    frameQueue.pop_front();
+    return true;
+}
+
+void PatternStreamServer::frameDone(const PatternFrame& frame)
+{
+    grantCredits(frame.connection, 1);
+}
+
+void PatternStreamServer::grantCredits(PatternStreamConnectionPtr connection, unsigned int num)
+{
+    // the sockets are only used by the io thread
+    ioService.post([this, connection, num]
+    {
+        connection->pendingCredits += num;
+        writeCredits(connection);
+    });
+}
+
+void PatternStreamServer::writeCredits(PatternStreamConnectionPtr connection)
+{
+    if (connection->writing || (connection->pendingCredits == 0))
+        return;
+
+    string payload;
+    writeVarint(payload, connection->pendingCredits);
+    connection->pendingCredits = 0;
+    connection->writeBuf = makeFrame(PATTERN_FRAME_CREDIT, payload);
+    connection->writing = true;
+
+    boost::asio::async_write(connection->socket, boost::asio::buffer(connection->writeBuf),
+                             [this, connection](const boost::system::error_code& error, size_t)
+    {
+        connection->writing = false;
+        if (! error)
+            writeCredits(connection);
+    });
+}
+
+// ---------------- PatternStreamClient ----------------
+
+PatternStreamClient::PatternStreamClient() :
+    socket(ioService),
+    credits(0),
+    grantedCredits(0),
+    connected(false),
+    connectionNum(0)
+{
+}
+
+PatternStreamClient::~PatternStreamClient()
+{
+    close();
+}
+
+bool PatternStreamClient::connect(const string& ip, const string& port, const string& clientUID)
+{
+    serverIP = ip;
+    serverPort = port;
+    workerUID = clientUID;
+
+    unsigned int num_credits = 0;
+    try
+    {
+        tcp::resolver resolver(ioService);
+        boost::asio::connect(socket, resolver.resolve(tcp::resolver::query(ip, port)));
+        socket.set_option(tcp::no_delay(true));
+
+        boost::asio::write(socket, boost::asio::buffer(makeFrame(PATTERN_FRAME_HELLO, clientUID)));
+
+        // the server answers with the credits of this worker
+        unsigned char type = 0;
+        string payload;
+        uint64_t num = 0;
+        if (readFrame(type, payload) && (type == PATTERN_FRAME_CREDIT))
+        {
+            const char* p = payload.data();
+            if (! readVarint(p, payload.data() + payload.size(), num))
+                num = 0;
+        }
+
+        if (num == 0)
+        {
+            cout << "PatternStreamClient: The central server did not grant any credit." << std::endl;
+            boost::system::error_code closeError;
+            socket.close(closeError);
+            return false;
+        }
+
+        num_credits = (unsigned int) num;
+    }
+    catch (boost::system::system_error& e)
+    {
+        cout << "PatternStreamClient: Cannot connect to " << ip << ":" << port << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(creditLock);
+        credits = grantedCredits = num_credits;
+        connected = true;
+        connectionNum ++;
+        creditCond.notify_all();
+    }
+
+    readThread = std::thread([this] { readCredits(); });
+    return true;
+}
+
+bool PatternStreamClient::readFrame(unsigned char& type, string& payload)
+{
+    char header[5];
+    boost::system::error_code error;
+
+    boost::asio::read(socket, boost::asio::buffer(header, sizeof(header)), error);
+    if (error)
+        return false;
+
+    uint32_t length = readFrameLength(header);
+    if ((length == 0) || (length > PATTERN_FRAME_MAX_SIZE))
+        return false;
+
+    type = (unsigned char) header[4];
+    payload.resize(length - 1);
+    if (length > 1)
+    {
+        boost::asio::read(socket, boost::asio::buffer(&payload[0], length - 1), error);
+        if (error)
+            return false;
+    }
+
+    return true;
+}
+
+void PatternStreamClient::readCredits()
+{
+    unsigned char type;
+    string payload;
+
+    while (readFrame(type, payload))
+    {
+        if (type != PATTERN_FRAME_CREDIT)
+            continue;
+
+        const char* p = payload.data();
+        uint64_t num;
+        if (! readVarint(p, payload.data() + payload.size(), num))
+            continue;
+
+        std::lock_guard<std::mutex> lock(creditLock);
+        credits += (unsigned int) num;
+        creditCond.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(creditLock);
+    connected = false;
+    creditCond.notify_all();
+}
+
+bool PatternStreamClient::send(const string& frame)
+{
+    for (unsigned int tryTimes = 0; ; tryTimes ++)
+    {
+        unsigned int sendConnection;
+        bool hasCredit;
+        {
+            std::unique_lock<std::mutex> lock(creditLock);
+            creditCond.wait(lock, [this] { return (credits > 0) || (! connected); });
+            sendConnection = connectionNum;
+            hasCredit = connected;
+            if (hasCredit)
+                credits --;
+        }
+
+        if (hasCredit)
+        {
+            std::lock_guard<std::mutex> lock(sendLock);
+
+            // the connection may have been replaced while this thread
+            // waited for the lock, the credit was for the old one
+            if (sendConnection == connectionNum)
+            {
+                boost::system::error_code error;
+                boost::asio::write(socket, boost::asio::buffer(frame), error);
+                if (! error)
+                    return true;
+            }
+        }
+
+        if (tryTimes >= PATTERN_STREAM_MAX_RECONNECTS)
+            return false;
+
+        // the server drops a frame cut by a lost connection, so the whole
+        // frame is sent again on the new one
+        reconnect(sendConnection);
+    }
+}
+
+void PatternStreamClient::reconnect(unsigned int lostConnection)
+{
+    std::lock_guard<std::mutex> connectGuard(connectLock);
+
+    // another mining thread has already replaced the lost connection
+    if (connectionNum != lostConnection)
+        return;
+
+    std::lock_guard<std::mutex> sendGuard(sendLock);
+    close();
+
+    logger().warn("PatternStreamClient: The pattern stream to %s:%s is lost, reconnecting in %d seconds.",
+                  serverIP.c_str(), serverPort.c_str(), PATTERN_STREAM_RECONNECT_DELAY);
+    std::this_thread::sleep_for(std::chrono::seconds(PATTERN_STREAM_RECONNECT_DELAY));
+
+    if (connect(serverIP, serverPort, workerUID))
+        logger().info("PatternStreamClient: Reconnected to %s:%s.", serverIP.c_str(), serverPort.c_str());
+}
+
+void PatternStreamClient::flush()
+{
+    std::unique_lock<std::mutex> lock(creditLock);
+    creditCond.wait(lock, [this] { return (credits >= grantedCredits) || (! connected); });
+}
+
+void PatternStreamClient::close()
+{
+    boost::system::error_code error;
+
+    // the read thread stops at the end of the stream
+    socket.shutdown(tcp::socket::shutdown_both, error);
+    if (readThread.joinable())
+        readThread.join();
+
+    socket.close(error);
+
+    std::lock_guard<std::mutex> lock(creditLock);
+    connected = false;
+}
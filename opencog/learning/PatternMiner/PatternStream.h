@@ -0,0 +1,283 @@
+/*
+ * opencog/learning/PatternMiner/PatternStream.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_PATTERNMINER_PATTERNSTREAM_H
+#define _OPENCOG_PATTERNMINER_PATTERNSTREAM_H
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#define DEPRECATED_ATOMSPACE_CALLS
+#include <opencog/atomspace/AtomSpace.h>
+
+#include "PatternTable.h"
+
+using namespace std;
+
+namespace opencog
+{
+ namespace PatternMining
+{
+
+ // The binary stream from the distributed workers to the central server.
+ // Every message is a frame: the length of the rest of the frame as 4 bytes
+ // little endian, the frame type as 1 byte, then the payload.
+ //
+ //   HELLO    worker -> server: the client UID
+ //   CREDIT   server -> worker: varint number of PATTERNS frames the worker
+ //                              may send more
+ //   PATTERNS worker -> server: a batch of patterns, see PatternFrameWriter
+ //
+ // The server grants a number of credits when a worker connects, and gives
+ // one back each time it has parsed a PATTERNS frame, so a worker never has
+ // more frames in flight than the server is ready to take, and once it has
+ // all its credits back, all its patterns are in the server pattern table.
+ enum PatternFrameType
+ {
+     PATTERN_FRAME_HELLO = 1,
+     PATTERN_FRAME_CREDIT = 2,
+     PATTERN_FRAME_PATTERNS = 3
+ };
+
+ // The varints are little endian base 128, the keys 16 bytes little endian.
+ // The read functions return false if the buffer ends first.
+ void writeVarint(string& buf, uint64_t value);
+ bool readVarint(const char*& p, const char* end, uint64_t& value);
+ void writeKey(string& buf, const PatternKey& key);
+ bool readKey(const char*& p, const char* end, PatternKey& key);
+
+ // Builds a PATTERNS frame. Its payload is:
+ //   varint number of facts processed by the worker so far
+ //   varint number of strings, then each string as varint length and bytes
+ //   varint number of patterns, then for each pattern:
+ //     its key and the key of its parent, 16 bytes each, the parent key is
+ //     all zero for a pattern without parent
+ //     varint index of its extended link, varint gram
+ //     varint length of its encoding, then its encoding: each link depth
+ //     first, as the varint string id of its type name, then the string id
+ //     of its name for a node, or its arity then its outgoings for a link
+ //     varint length of its extra bytes, then the extra bytes: none in a
+ //     stream, the count and super patterns of the pattern in a checkpoint.
+ // The type and node names are sent once per frame through the string table.
+ // A frame does not refer to any other, so the server can parse frames in
+ // any order, on any number of threads.
+ class PatternFrameWriter
+ {
+ public:
+     PatternFrameWriter();
+
+     void addPattern(const HandleSeq& pattern, const PatternKey& key, const PatternKey& parentKey,
+                     unsigned int extendedLinkIndex, const AtomSpace* atomspace, const string& extra = "");
+
+     unsigned int size() const
+     {
+         return patternNum;
+     }
+
+     // Returns the whole frame, and empties the writer for the next one
+     string finish(unsigned int processedFactsNum);
+
+ private:
+     unordered_map<string, unsigned int> stringIds;
+     string strings;
+     string patterns;
+     string encoding; // of the pattern being added
+     unsigned int patternNum;
+
+     unsigned int stringId(const string& str);
+     void encodeAtom(const Handle& h, const AtomSpace* atomspace);
+ };
+
+ // Reads the next frame of a buffer of frames, such as a checkpoint file.
+ // Returns false at the end of the buffer, or if the next frame is truncated.
+ bool nextPatternFrame(const char*& cur, const char* end, unsigned char& type,
+                       const char*& payload, size_t& payloadSize);
+
+ // A pattern of a PATTERNS frame. Its links are only added to an AtomSpace
+ // by PatternFrameReader::loadPattern, when the pattern is new to the server.
+ struct PatternRecord
+ {
+     PatternKey key;
+     PatternKey parentKey;
+     unsigned int extendedLinkIndex;
+     unsigned int gram;
+     const char* encoding;
+     size_t encodingSize;
+     const char* extra;
+     size_t extraSize;
+ };
+
+ class PatternFrameReader
+ {
+ public:
+     // payload is a PATTERNS frame without its length and type, it must
+     // outlive the reader and the records read from it
+     PatternFrameReader(const string& payload);
+     PatternFrameReader(const char* payload, size_t size);
+
+     // false if the payload is truncated or malformed. next() checks each
+     // pattern encoding, so once a loop over next() has ended with the
+     // reader still valid, all the patterns of the frame can be loaded.
+     bool isValid() const
+     {
+         return valid;
+     }
+
+     unsigned int getProcessedFactsNum() const
+     {
+         return processedFactsNum;
+     }
+
+     bool next(PatternRecord& record);
+
+     // Adds the links of a pattern into atomspace. Returns an empty HandleSeq
+     // if the encoding is invalid.
+     HandleSeq loadPattern(const PatternRecord& record, AtomSpace* atomspace) const;
+
+ private:
+     const char* cur;
+     const char* end;
+     bool valid;
+     unsigned int processedFactsNum;
+     unsigned int remainingPatternNum;
+     vector<string> strings;
+
+     void readHeader();
+     // Only checks the encoding if atomspace is null
+     bool loadAtom(const char*& p, const char* pEnd, AtomSpace* atomspace, Handle& h,
+                   unsigned int depth) const;
+ };
+
+ // The central server end of the connection of a worker
+ struct PatternStreamConnection
+ {
+     PatternStreamConnection(boost::asio::io_service& io_service) :
+         socket(io_service), greeted(false), writing(false), pendingCredits(0) {}
+
+     boost::asio::ip::tcp::socket socket;
+     string clientUID;
+     bool greeted; // its HELLO has been received, it is only accepted once
+
+     // only used by the io thread of the server
+     char header[5];
+     string readBuf;
+     string writeBuf;
+     bool writing;
+     unsigned int pendingCredits;
+ };
+
+ typedef std::shared_ptr<PatternStreamConnection> PatternStreamConnectionPtr;
+
+ struct PatternFrame
+ {
+     PatternStreamConnectionPtr connection;
+     string payload;
+ };
+
+ // Accepts the connections of the workers, and queues the PATTERNS frames
+ // they send. The sockets are all served by one io thread, the frames are
+ // parsed by the threads calling popFrame().
+ class PatternStreamServer
+ {
+ public:
+     PatternStreamServer(const string& ip, const string& port, unsigned int credits);
+     ~PatternStreamServer();
+
+     void stop();
+
+     // Waits at most timeoutMs for a frame
+     bool popFrame(PatternFrame& frame, unsigned int timeoutMs);
+
+     // Gives back to the worker the credit of a frame it has parsed
+     void frameDone(const PatternFrame& frame);
+
+ private:
+     boost::asio::io_service ioService;
+     boost::asio::ip::tcp::acceptor acceptor;
+     std::thread ioThread;
+     unsigned int credits;
+
+     std::mutex frameQueueLock;
+     std::condition_variable frameQueueCond;
+     list<PatternFrame> frameQueue;
+
+     void startAccept();
+     void startRead(PatternStreamConnectionPtr connection);
+     void handleFrame(PatternStreamConnectionPtr connection, unsigned char type);
+     void grantCredits(PatternStreamConnectionPtr connection, unsigned int num);
+     void writeCredits(PatternStreamConnectionPtr connection);
+ };
+
+ // The worker end of the stream. send() can be called by all the mining
+ // threads at once.
+ class PatternStreamClient
+ {
+ public:
+     PatternStreamClient();
+     ~PatternStreamClient();
+
+     bool connect(const string& ip, const string& port, const string& clientUID);
+
+     // Sends a frame from PatternFrameWriter::finish, after waiting for a
+     // credit. A lost connection is reopened and the frame sent again;
+     // returns false if the server stays unreachable.
+     bool send(const string& frame);
+
+     // Waits until the server has parsed all the frames sent
+     void flush();
+
+     void close();
+
+ private:
+     boost::asio::io_service ioService;
+     boost::asio::ip::tcp::socket socket;
+     std::thread readThread;
+
+     std::mutex sendLock;
+     std::mutex creditLock;
+     std::condition_variable creditCond;
+     unsigned int credits;
+     unsigned int grantedCredits;
+     bool connected;
+
+     // reconnect() replaces the connection numbered lostConnection once,
+     // however many mining threads saw it fail
+     std::mutex connectLock;
+     unsigned int connectionNum;
+     string serverIP;
+     string serverPort;
+     string workerUID;
+
+     bool readFrame(unsigned char& type, string& payload);
+     void readCredits();
+     void reconnect(unsigned int lostConnection);
+ };
+
+}
+}
+
+#endif //_OPENCOG_PATTERNMINER_PATTERNSTREAM_H
@@ -0,0 +1,178 @@
+/*
+ * opencog/learning/PatternMiner/PatternTable.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "HTree.h"
+#include "PatternTable.h"
+
+using namespace opencog::PatternMining;
+using namespace opencog;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// MurmurHash3 x64 128 bit, by Austin Appleby (public domain)
+static void murmur3_128(const void* key, size_t len, uint64_t seed, uint64_t& h1, uint64_t& h2)
+{
+    const uint8_t* data = (const uint8_t*) key;
+    const size_t nblocks = len / 16;
+    const uint64_t c1 = 0x87c37b91114253d5ULL;
+    const uint64_t c2 = 0x4cf5ad432745937fULL;
+
+    h1 = seed;
+    h2 = seed;
+
+    for (size_t i = 0; i < nblocks; ++ i)
+    {
+        uint64_t k1, k2;
+        memcpy(&k1, data + i * 16, 8);
+        memcpy(&k2, data + i * 16 + 8, 8);
+
+        k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    const uint8_t* tail = data + nblocks * 16;
+    uint64_t k1 = 0;
+    uint64_t k2 = 0;
+
+    switch (len & 15)
+    {
+    case 15: k2 ^= ((uint64_t) tail[14]) << 48;
+    case 14: k2 ^= ((uint64_t) tail[13]) << 40;
+    case 13: k2 ^= ((uint64_t) tail[12]) << 32;
+    case 12: k2 ^= ((uint64_t) tail[11]) << 24;
+    case 11: k2 ^= ((uint64_t) tail[10]) << 16;
+    case 10: k2 ^= ((uint64_t) tail[9]) << 8;
+    case  9: k2 ^= ((uint64_t) tail[8]);
+             k2 *= c2; k2 = rotl64(k2, 33); k2 *= c1; h2 ^= k2;
+
+    case  8: k1 ^= ((uint64_t) tail[7]) << 56;
+    case  7: k1 ^= ((uint64_t) tail[6]) << 48;
+    case  6: k1 ^= ((uint64_t) tail[5]) << 40;
+    case  5: k1 ^= ((uint64_t) tail[4]) << 32;
+    case  4: k1 ^= ((uint64_t) tail[3]) << 24;
+    case  3: k1 ^= ((uint64_t) tail[2]) << 16;
+    case  2: k1 ^= ((uint64_t) tail[1]) << 8;
+    case  1: k1 ^= ((uint64_t) tail[0]);
+             k1 *= c1; k1 = rotl64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= len;
+    h2 ^= len;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+
+    h1 += h2;
+    h2 += h1;
+}
+
+PatternKey PatternKey::fromBytes(const string& bytes)
+{
+    PatternKey key;
+    murmur3_128(bytes.data(), bytes.size(), 0, key.hi, key.lo);
+    return key;
+}
+
+string PatternKey::toString() const
+{
+    char buf[33];
+    snprintf(buf, sizeof(buf), "%016llx%016llx",
+             (unsigned long long) hi, (unsigned long long) lo);
+    return string(buf);
+}
+
+PatternKey PatternKey::fromString(const string& hexStr)
+{
+    PatternKey key;
+    if (hexStr.size() == 32)
+    {
+        key.hi = strtoull(hexStr.substr(0, 16).c_str(), 0, 16);
+        key.lo = strtoull(hexStr.substr(16).c_str(), 0, 16);
+    }
+    return key;
+}
+
+uint64_t opencog::PatternMining::instanceUid(const OrderedHandleSet& instanceLinks)
+{
+    string bytes;
+    bytes.reserve(instanceLinks.size() * sizeof(uint64_t));
+    for (const Handle& h : instanceLinks)
+    {
+        uint64_t uuid = h.value();
+        bytes.append((const char*) &uuid, sizeof(uuid));
+    }
+
+    uint64_t h1, h2;
+    murmur3_128(bytes.data(), bytes.size(), 0, h1, h2);
+    return h1;
+}
+
+HTreeNode* PatternTable::find(const PatternKey& key)
+{
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard.lock);
+
+    auto it = shard.nodes.find(key);
+    if (it == shard.nodes.end())
+        return 0;
+    return it->second;
+}
+
+size_t PatternTable::size()
+{
+    size_t total = 0;
+    for (Shard& shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.lock);
+        total += shard.nodes.size();
+    }
+    return total;
+}
+
+void PatternTable::clear()
+{
+    for (Shard& shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.lock);
+        shard.nodes.clear();
+    }
+}
@@ -0,0 +1,146 @@
+/*
+ * opencog/learning/PatternMiner/PatternTable.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_PATTERNMINER_PATTERNTABLE_H
+#define _OPENCOG_PATTERNMINER_PATTERNTABLE_H
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#define DEPRECATED_ATOMSPACE_CALLS
+#include <opencog/atomspace/AtomSpace.h>
+
+using namespace std;
+
+namespace opencog
+{
+ namespace PatternMining
+{
+
+ class HTreeNode;
+
+ // The key of a pattern: a 128 bit hash of the canonical binary encoding of
+ // its unified links, that is, for every atom in depth first order, its type,
+ // then the name of a node or the arity of a link.
+ // Two patterns with the same key string have the same key, and different
+ // patterns have different keys with high probability: among 2^32 patterns
+ // two share a key with a probability of about 2^-65. Such a collision is
+ // not detected, the two patterns would be counted as one.
+ struct PatternKey
+ {
+     uint64_t hi;
+     uint64_t lo;
+
+     PatternKey() : hi(0), lo(0) {}
+
+     bool operator ==(const PatternKey& other) const
+     {
+         return (hi == other.hi) && (lo == other.lo);
+     }
+
+     bool operator !=(const PatternKey& other) const
+     {
+         return ! (*this == other);
+     }
+
+     // hash a canonical encoding
+     static PatternKey fromBytes(const string& bytes);
+
+     // 32 hex digits, to send a key to the central server
+     string toString() const;
+     static PatternKey fromString(const string& hexStr);
+ };
+
+ struct PatternKeyHash
+ {
+     size_t operator()(const PatternKey& key) const
+     {
+         return (size_t) key.lo;
+     }
+ };
+
+ // The uid of an instance, from the uuids of its fact links. An instance is
+ // counted once per pattern, whichever thread extracts it.
+ uint64_t instanceUid(const OrderedHandleSet& instanceLinks);
+
+ // The table of all the patterns found, shared by all the mining threads.
+ // It is split into shards with a lock each, so that threads finding
+ // different patterns seldom wait for each other.
+ class PatternTable
+ {
+ public:
+
+     HTreeNode* find(const PatternKey& key);
+
+     // Returns the node of the pattern with this key, after adding the one
+     // returned by create() if there was none. Then calls visit(node, added)
+     // under the lock of the shard, so that the counts of the node can be
+     // updated atomically with the lookup.
+     template<typename Create, typename Visit>
+     HTreeNode* findOrInsert(const PatternKey& key, Create create, Visit visit)
+     {
+         Shard& shard = shardOf(key);
+         std::lock_guard<std::mutex> lock(shard.lock);
+
+         bool added = false;
+         HTreeNode*& node = shard.nodes[key];
+         if (node == 0)
+         {
+             node = create();
+             added = true;
+         }
+         visit(node, added);
+         return node;
+     }
+
+     // Returns the node of the pattern with this key, after adding newNode
+     // as this node if there was none
+     HTreeNode* findOrInsert(const PatternKey& key, HTreeNode* newNode)
+     {
+         return findOrInsert(key, [newNode]() { return newNode; }, [](HTreeNode*, bool) {});
+     }
+
+     size_t size();
+
+     void clear();
+
+ private:
+
+     static const unsigned int SHARD_NUM = 64;
+
+     struct Shard
+     {
+         std::mutex lock;
+         unordered_map<PatternKey, HTreeNode*, PatternKeyHash> nodes;
+     };
+
+     Shard shards[SHARD_NUM];
+
+     Shard& shardOf(const PatternKey& key)
+     {
+         // the low bits select the bucket within a shard
+         return shards[key.hi % SHARD_NUM];
+     }
+ };
+
+}
+}
+
+#endif //_OPENCOG_PATTERNMINER_PATTERNTABLE_H
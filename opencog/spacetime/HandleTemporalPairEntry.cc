@@ -31,7 +31,7 @@
 
 using namespace opencog;
 
-int HandleTemporalPairEntry::existingObjects = 0;
+std::atomic<int> HandleTemporalPairEntry::existingObjects(0);
 
 HandleTemporalPairEntry::HandleTemporalPairEntry(const HandleTemporalPair& htp) : handleTemporalPair(htp)
 {
@@ -25,6 +25,7 @@
 #ifndef _OPENCOG_HANDLE_TEMPORAL_PAIR_ENTRY_H
 #define _OPENCOG_HANDLE_TEMPORAL_PAIR_ENTRY_H
 
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -64,7 +65,8 @@ private:
 
 public:
 
-    static int existingObjects;
+    // the TimeServer creates entries from many threads at once
+    static std::atomic<int> existingObjects;
 
     /**
      * Cell dat
@@ -0,0 +1,519 @@
+/*
+ * opencog/spacetime/SceneSnapshot.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+
+#include <opencog/atoms/base/ClassServer.h>
+#include <opencog/atoms/base/Node.h>
+#include <opencog/atomspace/AtomSpace.h>
+
+#include "SceneSnapshot.h"
+
+using namespace opencog;
+using namespace opencog::spatial;
+
+namespace
+{
+    const char MAGIC[8] = {'O', 'C', 'S', 'C', 'E', 'N', 'E', '\0'};
+
+    enum {ENTITY_REMOVED_FLAG = 1, ENTITY_AVATAR_FLAG = 2};
+    enum {OP_SELF_FLAG = 1, OP_AVATAR_FLAG = 2};
+
+    void writeU8(std::ostream& out, uint8_t value)
+    {
+        out.put((char) value);
+    }
+
+    void writeU32(std::ostream& out, uint32_t value)
+    {
+        char bytes[4];
+        for (unsigned i = 0; i < 4; i++) {
+            bytes[i] = (char) (value >> (8 * i));
+        }
+        out.write(bytes, 4);
+    }
+
+    void writeU64(std::ostream& out, uint64_t value)
+    {
+        char bytes[8];
+        for (unsigned i = 0; i < 8; i++) {
+            bytes[i] = (char) (value >> (8 * i));
+        }
+        out.write(bytes, 8);
+    }
+
+    void writeF32(std::ostream& out, float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        writeU32(out, bits);
+    }
+
+    void writeF64(std::ostream& out, double value)
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        writeU64(out, bits);
+    }
+
+    void writeString(std::ostream& out, const std::string& value)
+    {
+        writeU32(out, value.size());
+        out.write(value.data(), value.size());
+    }
+
+    void writeVector(std::ostream& out, const BlockVector& pos)
+    {
+        writeF64(out, pos.x);
+        writeF64(out, pos.y);
+        writeF64(out, pos.z);
+    }
+
+    void checkStream(std::istream& in)
+    {
+        if (!in) {
+            throw RuntimeException(TRACE_INFO,
+                "SceneSnapshot - The snapshot is truncated.");
+        }
+    }
+
+    uint8_t readU8(std::istream& in)
+    {
+        char byte;
+        in.get(byte);
+        checkStream(in);
+        return (uint8_t) byte;
+    }
+
+    uint32_t readU32(std::istream& in)
+    {
+        unsigned char bytes[4];
+        in.read((char*) bytes, 4);
+        checkStream(in);
+        uint32_t value = 0;
+        for (unsigned i = 0; i < 4; i++) {
+            value |= (uint32_t) bytes[i] << (8 * i);
+        }
+        return value;
+    }
+
+    uint64_t readU64(std::istream& in)
+    {
+        unsigned char bytes[8];
+        in.read((char*) bytes, 8);
+        checkStream(in);
+        uint64_t value = 0;
+        for (unsigned i = 0; i < 8; i++) {
+            value |= (uint64_t) bytes[i] << (8 * i);
+        }
+        return value;
+    }
+
+    float readF32(std::istream& in)
+    {
+        uint32_t bits = readU32(in);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    double readF64(std::istream& in)
+    {
+        uint64_t bits = readU64(in);
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    std::string readBytes(std::istream& in, uint64_t size)
+    {
+        std::string value;
+        // read in chunks, so that a corrupted size fails on the end of
+        // the stream rather than on allocating it
+        char chunk[4096];
+        while (size > 0) {
+            std::streamsize count = (std::streamsize) std::min<uint64_t>(size, sizeof(chunk));
+            in.read(chunk, count);
+            checkStream(in);
+            value.append(chunk, count);
+            size -= count;
+        }
+        return value;
+    }
+
+    std::string readString(std::istream& in)
+    {
+        return readBytes(in, readU32(in));
+    }
+
+    BlockVector readVector(std::istream& in)
+    {
+        double x = readF64(in);
+        double y = readF64(in);
+        double z = readF64(in);
+        return BlockVector(x, y, z);
+    }
+
+    // The atoms referred to by a snapshot, numbered in order of appearance
+    class AtomTableWriter
+    {
+    public:
+        uint32_t indexOf(const Handle& h)
+        {
+            if (h == Handle::UNDEFINED) {
+                return SceneSnapshot::NO_ATOM;
+            }
+            auto it = mIndexes.find(h);
+            if (it != mIndexes.end()) {
+                return it->second;
+            }
+            NodePtr node(NodeCast(h));
+            if (node == NULL) {
+                throw RuntimeException(TRACE_INFO,
+                    "SceneSnapshot - Only nodes can be saved in a scene, not a '%s'.",
+                    classserver().getTypeName(h->getType()).c_str());
+            }
+            uint32_t index = mAtoms.size();
+            mAtoms.push_back(node);
+            mIndexes[h] = index;
+            return index;
+        }
+
+        void write(std::ostream& out) const
+        {
+            writeU32(out, mAtoms.size());
+            for (auto it = mAtoms.begin(); it != mAtoms.end(); ++it) {
+                writeString(out, classserver().getTypeName((*it)->getType()));
+                writeString(out, (*it)->getName());
+            }
+        }
+
+    private:
+        std::vector<NodePtr> mAtoms;
+        std::map<Handle, uint32_t> mIndexes;
+    };
+
+    HandleSeq readAtomTable(std::istream& in, AtomSpace& atomSpace)
+    {
+        HandleSeq atoms;
+        uint32_t count = readU32(in);
+        for (uint32_t i = 0; i < count; i++) {
+            std::string typeName = readString(in);
+            std::string name = readString(in);
+            Type type = classserver().getType(typeName);
+            if (type == NOTYPE || !classserver().isA(type, NODE)) {
+                throw RuntimeException(TRACE_INFO,
+                    "SceneSnapshot - Unknown node type '%s' in the snapshot.",
+                    typeName.c_str());
+            }
+            atoms.push_back(atomSpace.add_node(type, name));
+        }
+        return atoms;
+    }
+
+    Handle readAtom(std::istream& in, const HandleSeq& atoms)
+    {
+        uint32_t index = readU32(in);
+        if (index == SceneSnapshot::NO_ATOM) {
+            return Handle::UNDEFINED;
+        }
+        if (index >= atoms.size()) {
+            throw RuntimeException(TRACE_INFO,
+                "SceneSnapshot - Atom %u out of the table of the snapshot.", index);
+        }
+        return atoms[index];
+    }
+
+    void writeSnapshot(std::ostream& out, SceneSnapshot::Kind kind, uint64_t chain,
+                       uint32_t sequence, uint32_t baseSequence,
+                       const OctomapOcTree& spaceMap,
+                       const AtomTableWriter& atoms, const std::string& body)
+    {
+        out.write(MAGIC, sizeof(MAGIC));
+        writeU8(out, SceneSnapshot::VERSION);
+        writeU8(out, kind);
+        writeU64(out, chain);
+        writeU32(out, sequence);
+        writeU32(out, baseSequence);
+        writeString(out, spaceMap.getMapName());
+        writeF64(out, spaceMap.getResolution());
+        writeF32(out, spaceMap.getAgentHeight());
+        atoms.write(out);
+        out.write(body.data(), body.size());
+        if (!out) {
+            throw RuntimeException(TRACE_INFO,
+                "SceneSnapshot - Failed to write the snapshot of '%s'.",
+                spaceMap.getMapName().c_str());
+        }
+    }
+}
+
+void SceneJournal::restart(uint64_t _chain, uint32_t _sequence, bool record)
+{
+    chain = _chain;
+    sequence = _sequence;
+    recording = record && sequence != 0;
+    changed = false;
+    overflowed = false;
+    // gives the memory of a long journal back
+    std::vector<Op>().swap(ops);
+}
+
+void SceneJournal::markChanged()
+{
+    if (sequence != 0) {
+        changed = true;
+    }
+}
+
+void SceneJournal::record(const Op& op)
+{
+    markChanged();
+    if (!recording) {
+        return;
+    }
+    if (ops.size() >= maxOps) {
+        recording = false;
+        overflowed = true;
+        std::vector<Op>().swap(ops);
+        return;
+    }
+    ops.push_back(op);
+}
+
+void SceneJournal::recordBlock(const Handle& block, const BlockVector& pos,
+                               float logOddsOccupancy)
+{
+    Op op = {BLOCK, block, pos, logOddsOccupancy, false, false, 0};
+    record(op);
+}
+
+void SceneJournal::recordEntity(const Handle& entity, const BlockVector& pos,
+                                bool isSelfObject, bool isAvatarEntity, uint64_t timestamp)
+{
+    Op op = {ENTITY, entity, pos, 0, isSelfObject, isAvatarEntity, timestamp};
+    record(op);
+}
+
+void SceneJournal::recordEntityRemoved(const Handle& entity)
+{
+    Op op = {ENTITY_REMOVED, entity, BlockVector::ZERO, 0, false, false, 0};
+    record(op);
+}
+
+uint64_t SceneSnapshot::newChain()
+{
+    // from the system, since the seed of the usual generators may be the
+    // same in every run
+    static std::mutex lock;
+    static std::random_device device;
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t chain = 0;
+    while (chain == 0) {
+        chain = ((uint64_t) device() << 32) | device();
+    }
+    return chain;
+}
+
+void SceneSnapshot::writeFull(std::ostream& out,
+                              const OctomapOcTree& spaceMap,
+                              const EntityRecorder& entityRecorder,
+                              uint64_t chain, uint32_t sequence)
+{
+    AtomTableWriter atoms;
+    std::ostringstream body;
+
+    std::ostringstream tree;
+    spaceMap.writeData(tree);
+    const std::string treeData = tree.str();
+    writeU64(body, treeData.size());
+    body.write(treeData.data(), treeData.size());
+
+    const std::map<Handle, BlockVector>& blocks = spaceMap.getAllUnitBlocks();
+    writeU32(body, blocks.size());
+    for (auto it = blocks.begin(); it != blocks.end(); ++it) {
+        writeU32(body, atoms.indexOf(it->first));
+        writeVector(body, it->second);
+    }
+
+    writeU32(body, atoms.indexOf(entityRecorder.getSelfAgentEntity()));
+    HandleSeq entities;
+    entityRecorder.findAllRecordedEntities(back_inserter(entities));
+    writeU32(body, entities.size());
+    for (auto it = entities.begin(); it != entities.end(); ++it) {
+        writeU32(body, atoms.indexOf(*it));
+        uint8_t flags = 0;
+        if (!entityRecorder.containsEntity(*it)) {
+            flags |= ENTITY_REMOVED_FLAG;
+        }
+        if (entityRecorder.isAvatarEntity(*it)) {
+            flags |= ENTITY_AVATAR_FLAG;
+        }
+        writeU8(body, flags);
+        const std::vector< std::pair<unsigned long, BlockVector> >& history =
+            entityRecorder.getLocationHistory(*it);
+        writeU32(body, history.size());
+        for (auto hit = history.begin(); hit != history.end(); ++hit) {
+            writeU64(body, hit->first);
+            writeVector(body, hit->second);
+        }
+    }
+
+    writeSnapshot(out, FULL, chain, sequence, 0, spaceMap, atoms, body.str());
+}
+
+void SceneSnapshot::writeDelta(std::ostream& out,
+                               const OctomapOcTree& spaceMap,
+                               const SceneJournal& journal,
+                               uint32_t sequence)
+{
+    AtomTableWriter atoms;
+    std::ostringstream body;
+
+    writeU32(body, journal.ops.size());
+    for (auto it = journal.ops.begin(); it != journal.ops.end(); ++it) {
+        writeU8(body, it->type);
+        writeU32(body, atoms.indexOf(it->handle));
+        writeVector(body, it->pos);
+        writeF32(body, it->logOddsOccupancy);
+        writeU8(body, (it->isSelfObject ? OP_SELF_FLAG : 0) |
+                      (it->isAvatarEntity ? OP_AVATAR_FLAG : 0));
+        writeU64(body, it->timestamp);
+    }
+
+    writeSnapshot(out, DELTA, journal.chain, sequence, journal.sequence,
+                  spaceMap, atoms, body.str());
+}
+
+SceneSnapshot::Header SceneSnapshot::readHeader(std::istream& in)
+{
+    char magic[sizeof(MAGIC)];
+    in.read(magic, sizeof(magic));
+    if (!in || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        throw RuntimeException(TRACE_INFO,
+            "SceneSnapshot - Not a scene snapshot.");
+    }
+    uint8_t version = readU8(in);
+    if (version != VERSION) {
+        throw RuntimeException(TRACE_INFO,
+            "SceneSnapshot - Unsupported snapshot version %u.", (unsigned) version);
+    }
+    uint8_t kind = readU8(in);
+    if (kind != FULL && kind != DELTA) {
+        throw RuntimeException(TRACE_INFO,
+            "SceneSnapshot - Unknown snapshot kind %u.", (unsigned) kind);
+    }
+
+    Header header;
+    header.kind = (Kind) kind;
+    header.chain = readU64(in);
+    header.sequence = readU32(in);
+    header.baseSequence = readU32(in);
+    header.mapName = readString(in);
+    header.resolution = readF64(in);
+    header.agentHeight = readF32(in);
+    return header;
+}
+
+void SceneSnapshot::readFull(std::istream& in, AtomSpace& atomSpace,
+                             OctomapOcTree& spaceMap,
+                             EntityRecorder& entityRecorder)
+{
+    HandleSeq atoms = readAtomTable(in, atomSpace);
+
+    // the tree gives the occupancy of every node, the blocks are put
+    // back in their nodes afterwards
+    if (spaceMap.size() != 0 || spaceMap.getTotalUnitBlockNum() != 0) {
+        throw RuntimeException(TRACE_INFO,
+            "SceneSnapshot - Restoring a snapshot into the non-empty map '%s'.",
+            spaceMap.getMapName().c_str());
+    }
+    std::istringstream tree(readBytes(in, readU64(in)));
+    spaceMap.readData(tree);
+    if (!tree) {
+        throw RuntimeException(TRACE_INFO,
+            "SceneSnapshot - The octree of the snapshot is corrupted.");
+    }
+
+    uint32_t blockCount = readU32(in);
+    for (uint32_t i = 0; i < blockCount; i++) {
+        Handle block = readAtom(in, atoms);
+        BlockVector pos = readVector(in);
+        spaceMap.setNodeBlock(pos.x, pos.y, pos.z, block);
+    }
+
+    Handle selfEntity = readAtom(in, atoms);
+    uint32_t entityCount = readU32(in);
+    std::vector< std::pair<unsigned long, BlockVector> > history;
+    for (uint32_t i = 0; i < entityCount; i++) {
+        Handle entity = readAtom(in, atoms);
+        uint8_t flags = readU8(in);
+        uint32_t historyCount = readU32(in);
+        history.clear();
+        for (uint32_t j = 0; j < historyCount; j++) {
+            unsigned long timestamp = readU64(in);
+            BlockVector pos = readVector(in);
+            history.push_back(std::make_pair(timestamp, pos));
+        }
+        entityRecorder.restoreEntity(entity, history,
+                                     flags & ENTITY_REMOVED_FLAG,
+                                     entity == selfEntity,
+                                     flags & ENTITY_AVATAR_FLAG);
+    }
+}
+
+void SceneSnapshot::readDelta(std::istream& in, AtomSpace& atomSpace,
+                              OctomapOcTree& spaceMap,
+                              EntityRecorder& entityRecorder)
+{
+    HandleSeq atoms = readAtomTable(in, atomSpace);
+
+    uint32_t opCount = readU32(in);
+    for (uint32_t i = 0; i < opCount; i++) {
+        uint8_t type = readU8(in);
+        Handle handle = readAtom(in, atoms);
+        BlockVector pos = readVector(in);
+        float logOddsOccupancy = readF32(in);
+        uint8_t flags = readU8(in);
+        uint64_t timestamp = readU64(in);
+
+        switch (type) {
+        case SceneJournal::BLOCK:
+            spaceMap.restoreUnitBlock(handle, pos, logOddsOccupancy);
+            break;
+        case SceneJournal::ENTITY:
+            entityRecorder.addNoneBlockEntity(handle, pos,
+                                              flags & OP_SELF_FLAG,
+                                              flags & OP_AVATAR_FLAG,
+                                              timestamp);
+            break;
+        case SceneJournal::ENTITY_REMOVED:
+            entityRecorder.removeNoneBlockEntity(handle);
+            break;
+        default:
+            throw RuntimeException(TRACE_INFO,
+                "SceneSnapshot - Unknown operation %u in the snapshot.", (unsigned) type);
+        }
+    }
+}
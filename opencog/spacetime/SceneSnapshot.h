@@ -0,0 +1,217 @@
+/*
+ * opencog/spacetime/SceneSnapshot.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+#ifndef _OPENCOG_SCENE_SNAPSHOT_H
+#define _OPENCOG_SCENE_SNAPSHOT_H
+
+#include <stdint.h>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <opencog/util/exceptions.h>
+
+#include <opencog/atoms/base/Handle.h>
+
+#include <opencog/spatial/3DSpaceMap/Block3DMapUtil.h>
+#include <opencog/spatial/3DSpaceMap/OctomapOcTree.h>
+#include <opencog/spatial/3DSpaceMap/EntityRecorder.h>
+
+// default limit of the changes a scene journal keeps, about 6MB of them
+#define SCENE_JOURNAL_MAX_OPS 100000
+
+namespace opencog
+{
+    /** \addtogroup grp_spacetime
+     *  @{
+     */
+
+    class AtomSpace;
+
+    /**
+     * The changes made to a scene since its last snapshot, in the order
+     * they were made, so that a delta snapshot can replay them.
+     *
+     * Only a snapshot that asks for it starts recording them, and at
+     * most maxOps of them are kept: past that the journal drops them and
+     * the next snapshot has to be a full one. Without recording, the
+     * journal only remembers whether the scene changed, which is enough
+     * to check that a delta may still be applied on it.
+     */
+    class SceneJournal
+    {
+    public:
+        enum OpType {BLOCK = 0, ENTITY = 1, ENTITY_REMOVED = 2};
+
+        struct Op
+        {
+            OpType type;
+            Handle handle;
+            spatial::BlockVector pos;
+            // BLOCK: the occupancy of the node after the change
+            float logOddsOccupancy;
+            // ENTITY: the arguments of EntityRecorder::addNoneBlockEntity()
+            bool isSelfObject;
+            bool isAvatarEntity;
+            uint64_t timestamp;
+        };
+
+        SceneJournal(): chain(0), sequence(0), recording(false), changed(false),
+                        overflowed(false), maxOps(SCENE_JOURNAL_MAX_OPS) {}
+
+        inline bool isRecording() const {return recording;}
+
+        // starts over from the snapshot with the given chain and sequence
+        // number, 0 if the scene has none, recording the changes if record
+        // is true
+        void restart(uint64_t _chain, uint32_t _sequence, bool record);
+
+        // a change that is not worth recording but still has to be known,
+        // i.e. made while not recording
+        void markChanged();
+
+        void recordBlock(const Handle& block, const spatial::BlockVector& pos,
+                         float logOddsOccupancy);
+        void recordEntity(const Handle& entity, const spatial::BlockVector& pos,
+                          bool isSelfObject, bool isAvatarEntity, uint64_t timestamp);
+        void recordEntityRemoved(const Handle& entity);
+
+        // the chain of snapshots the last snapshot of the scene belongs to,
+        // and its sequence number in it, 0 if none
+        uint64_t chain;
+        uint32_t sequence;
+        // ops holds the changes since that snapshot
+        bool recording;
+        // the scene changed since that snapshot
+        bool changed;
+        // there were more than maxOps changes, which were dropped
+        bool overflowed;
+        size_t maxOps;
+        std::vector<Op> ops;
+
+    private:
+        void record(const Op& op);
+    };
+
+    /**
+     * Binary snapshots of a scene: the block octree with the occupancy of
+     * every node, the blocks in it and the entities with their location
+     * history.
+     *
+     * A full snapshot holds the whole scene, a delta snapshot the journal
+     * of the changes since the previous snapshot of the scene, and is
+     * only applied on the scene restored from that one, which is checked
+     * by their sequence numbers. Every full snapshot starts a chain with
+     * a random id, which the deltas following it carry, so that a delta
+     * of another scene of the same name, e.g. from another run, is not
+     * taken for one of its own.
+     *
+     * Layout, all integers and floating point numbers little-endian:
+     *   header    magic "OCSCENE", version u8, kind u8 (0 full, 1 delta),
+     *             chain u64, sequence u32, base sequence u32 (0 for a full
+     *             snapshot),
+     *             map name, resolution f64, agent height f32
+     *   atoms     count u32, then type name and node name of each atom;
+     *             the atoms are referred to by their index in this table
+     *             (NO_ATOM for none) and found again by type and name when
+     *             restoring, since the handles don't outlive the process
+     *   full      octree size u64 and the octree in octomap's own format,
+     *             blocks count u32, then atom u32, x y z f64 of each,
+     *             self agent atom u32, entities count u32, then atom u32,
+     *             flags u8 (1 removed, 2 avatar), history count u32 and
+     *             timestamp u64, x y z f64 of each location
+     *   delta     ops count u32, then type u8, atom u32, x y z f64,
+     *             log odds f32, flags u8 (1 self, 2 avatar), timestamp u64
+     *             of each
+     * Strings are a u32 length followed by the bytes. Nothing is
+     * aligned, and the octree and the location histories have variable
+     * lengths, so a snapshot is read in order.
+     */
+    class SceneSnapshot
+    {
+    public:
+        enum Kind {FULL = 0, DELTA = 1};
+
+        static const uint8_t VERSION = 2;
+        static const uint32_t NO_ATOM = 0xffffffff;
+
+        struct Header
+        {
+            Kind kind;
+            uint64_t chain;
+            uint32_t sequence;
+            uint32_t baseSequence;
+            std::string mapName;
+            double resolution;
+            float agentHeight;
+        };
+
+        /**
+         * A new random chain id, never 0.
+         */
+        static uint64_t newChain();
+
+        /**
+         * Writes a full snapshot of the scene.
+         * @throws RuntimeException if a block or an entity is not a node
+         */
+        static void writeFull(std::ostream& out,
+                              const spatial::OctomapOcTree& spaceMap,
+                              const spatial::EntityRecorder& entityRecorder,
+                              uint64_t chain, uint32_t sequence);
+
+        /**
+         * Writes the changes of the journal, to apply on the snapshot of
+         * sequence journal.sequence in the chain journal.chain.
+         * @throws RuntimeException if a block or an entity is not a node
+         */
+        static void writeDelta(std::ostream& out,
+                               const spatial::OctomapOcTree& spaceMap,
+                               const SceneJournal& journal,
+                               uint32_t sequence);
+
+        /**
+         * Reads the header of a snapshot, to be followed by readFull() or
+         * readDelta() according to its kind.
+         * @throws RuntimeException if it is not a snapshot or is truncated
+         */
+        static Header readHeader(std::istream& in);
+
+        /**
+         * Restores a full snapshot into an empty scene, adding the atoms
+         * of the snapshot to the AtomSpace if they are not there.
+         * @throws RuntimeException if the snapshot is corrupted
+         */
+        static void readFull(std::istream& in, AtomSpace& atomSpace,
+                             spatial::OctomapOcTree& spaceMap,
+                             spatial::EntityRecorder& entityRecorder);
+
+        /**
+         * Applies a delta snapshot on the scene it was taken from.
+         * @throws RuntimeException if the snapshot is corrupted
+         */
+        static void readDelta(std::istream& in, AtomSpace& atomSpace,
+                              spatial::OctomapOcTree& spaceMap,
+                              spatial::EntityRecorder& entityRecorder);
+    };
+
+    /** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_SCENE_SNAPSHOT_H
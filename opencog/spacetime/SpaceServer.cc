@@ -21,6 +21,7 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 #include <string>
+#include <sstream>
 #include <vector>
 #include <cstdlib>
 
@@ -49,12 +50,28 @@
 using namespace opencog;
 using namespace opencog::spatial;
 
+// record the block and the occupancy of the node in pos, as they are
+// after changing it
+static void recordBlockChange(SceneJournal& journal, const OctomapOcTree& spaceMap,
+                              const BlockVector& pos)
+{
+    if (!journal.isRecording()) {
+        journal.markChanged();
+        return;
+    }
+    const OctomapOcTreeNode* node = spaceMap.search(pos.x, pos.y, pos.z);
+    if (node != NULL) {
+        journal.recordBlock(node->getBlock(), pos, node->getLogOdds());
+    }
+}
+
 SpaceServer::SpaceServer(AtomSpace &_atomspace) :
     atomspace(&_atomspace)
 {
     // Default values (should only be used for test purposes)
     agentRadius = 0.25;
     agentHeight = 0;
+    sceneJournalMaxOps = SCENE_JOURNAL_MAX_OPS;
 
     curSpaceMapHandle = Handle::UNDEFINED;
     curMap = NULL;
@@ -80,14 +97,15 @@ void SpaceServer::setTimeServer(TimeServer* ts)
     timeser = ts;
 }
 
-//TODO
 void SpaceServer::atomAdded(Handle h)
 {
-
+    materialChanged(h);
 }
 
 void SpaceServer::atomRemoved(AtomPtr atom)
 {
+    materialChanged(atom->getHandle());
+
     Type type = atom->getType();
     if (classserver().isA(type, OBJECT_NODE)) {
         std::vector<std::string> timeDomains = timeser->getTimeDomains();
@@ -97,6 +115,36 @@ void SpaceServer::atomRemoved(AtomPtr atom)
     }
 }
 
+void SpaceServer::materialChanged(const Handle& h)
+{
+    if (h->getType() != EVALUATION_LINK) {
+        return;
+    }
+    LinkPtr evalLink = LinkCast(h);
+    if (evalLink->getArity() != 2) {
+        return;
+    }
+    Handle predicate = evalLink->getOutgoingAtom(0);
+    Handle arguments = evalLink->getOutgoingAtom(1);
+    if (predicate->getType() != PREDICATE_NODE ||
+        NodeCast(predicate)->getName() != "material" ||
+        arguments->getType() != LIST_LINK) {
+        return;
+    }
+    LinkPtr argumentList = LinkCast(arguments);
+    // the material queries add their pattern, with a variable as value
+    if (argumentList->getArity() != 2 ||
+        argumentList->getOutgoingAtom(1)->getType() == VARIABLE_NODE) {
+        return;
+    }
+
+    Handle block = argumentList->getOutgoingAtom(0);
+    std::lock_guard<std::mutex> lock(scenesLock);
+    for (auto& scenePair : scenes) {
+        scenePair.second->spaceMap.invalidateBlockMaterial(block);
+    }
+}
+
 void SpaceServer::setAgentRadius(unsigned int _radius)
 {
     if (agentRadius != _radius) {
@@ -113,7 +161,7 @@ void SpaceServer::setAgentHeight(unsigned int _height, Handle spaceMapHandle)
         return;
     }
 
-    SpaceMap& theMap = (scenePairItr->second).spaceMap;
+    SpaceMap& theMap = scenePairItr->second->spaceMap;
 
     if (agentHeight != _height) {
         agentHeight = _height;
@@ -139,7 +187,7 @@ const SpaceServer::SpaceMap& SpaceServer::getMap(Handle spaceMapHandle) const
                 ATOM_AS_STRING(spaceMapHandle));
     }
 
-    return (itr->second).spaceMap;
+    return itr->second->spaceMap;
 }
 
 const EntityRecorder& SpaceServer::getEntityRecorder(Handle spaceMapHandle) const
@@ -158,7 +206,7 @@ const EntityRecorder& SpaceServer::getEntityRecorder(Handle spaceMapHandle) cons
                 ATOM_AS_STRING(spaceMapHandle));
     }
 
-    return (itr->second).entityRecorder;
+    return itr->second->entityRecorder;
 }
 
 
@@ -190,6 +238,7 @@ Handle SpaceServer::getLatestMapHandle() const
 
 void SpaceServer::removeMap(Handle spaceMapHandle)
 {
+    std::lock_guard<std::mutex> lock(scenesLock);
     auto itr = scenes.find(spaceMapHandle);
     if (itr != scenes.end()) {
         scenes.erase(itr);
@@ -203,6 +252,7 @@ unsigned int SpaceServer::getSpaceMapsSize() const
 
 void SpaceServer::clear()
 {
+    std::lock_guard<std::mutex> lock(scenesLock);
     scenes.clear();
 }
 
@@ -215,7 +265,7 @@ SpaceServer::SpaceMap* SpaceServer::cloneSpaceMap(Handle spaceMapHandle) const
 {
     auto itr = scenes.find(spaceMapHandle);
     return (itr == scenes.end())
-        ? (itr->second).spaceMap.clone()
+        ? itr->second->spaceMap.clone()
         : nullptr;
 }
 
@@ -239,13 +289,16 @@ bool SpaceServer::addSpaceInfo(Handle objectNode, Handle spaceMapHandle, bool is
 
     opencog::spatial::BlockVector pos(objX, objY, objZ);
 
+    SceneJournal& journal = scenePairItr->second->journal;
     if (objectNode->getType() == STRUCTURE_NODE) {
         // it's a block
-        SpaceMap& theSpaceMap = (scenePairItr->second).spaceMap;
+        SpaceMap& theSpaceMap = scenePairItr->second->spaceMap;
         theSpaceMap.addSolidUnitBlock(objectNode, pos);
+        recordBlockChange(journal, theSpaceMap, pos);
     } else {
-        EntityRecorder& entityRecorder = (scenePairItr->second).entityRecorder;
+        EntityRecorder& entityRecorder = scenePairItr->second->entityRecorder;
         entityRecorder.addNoneBlockEntity(objectNode, pos, isSelfObject, isAvatarEntity, timestamp);
+        journal.recordEntity(objectNode, pos, isSelfObject, isAvatarEntity, timestamp);
     }
     return true;
 }
@@ -259,8 +312,8 @@ Handle SpaceServer::addOrGetSpaceMap(octime_t timestamp, std::string _mapName, d
         spaceMapHandle = atomspace->add_node(SPACE_MAP_NODE,_mapName);
         spaceMapHandle->setLTI(1);
         timeser->addTimeInfo(spaceMapHandle, timestamp, timeDomain);
-        scenes.emplace(std::piecewise_construct, std::make_tuple(spaceMapHandle),
-                       std::make_tuple(_mapName, _resolution));
+        std::lock_guard<std::mutex> lock(scenesLock);
+        scenes[spaceMapHandle].reset(new Scene(_mapName, _resolution));
     }
 
     curSpaceMapHandle = spaceMapHandle;
@@ -284,12 +337,21 @@ void SpaceServer::removeSpaceInfo(Handle objectNode, Handle spaceMapHandle, octi
         timeser->addTimeInfo(spaceMapHandle, timestamp, timeDomain);
     }
 
+    SceneJournal& journal = scenePairItr->second->journal;
     if (objectNode->getType() == STRUCTURE_NODE) {
-        SpaceMap& theSpaceMap = (scenePairItr->second).spaceMap;
+        SpaceMap& theSpaceMap = scenePairItr->second->spaceMap;
+        const std::map<Handle, BlockVector>& blocks = theSpaceMap.getAllUnitBlocks();
+        auto blockItr = blocks.find(objectNode);
+        bool inMap = (blockItr != blocks.end());
+        BlockVector pos = inMap ? blockItr->second : BlockVector::ZERO;
         theSpaceMap.removeSolidUnitBlock(objectNode);
+        if (inMap) {
+            recordBlockChange(journal, theSpaceMap, pos);
+        }
     } else {
-        EntityRecorder& entityRecorder = (scenePairItr->second).entityRecorder;
+        EntityRecorder& entityRecorder = scenePairItr->second->entityRecorder;
         entityRecorder.removeNoneBlockEntity(objectNode);
+        journal.recordEntityRemoved(objectNode);
     }
 
     logger().debug("%s(%s)\n", __FUNCTION__, atomspace->get_name(objectNode).c_str());
@@ -318,22 +380,124 @@ std::string SpaceServer::getMapIdString(Handle mapHandle) const
     return atomspace->get_name(mapHandle);
 }
 
-// TODO
+void SpaceServer::setSceneJournalMaxOps(size_t maxOps)
+{
+    sceneJournalMaxOps = maxOps;
+}
+
+void SpaceServer::saveScene(Handle spaceMapHandle, std::ostream& out, bool recordChanges) const
+{
+    auto scenePairItr = scenes.find(spaceMapHandle);
+    if (scenePairItr == scenes.end()) {
+        throw opencog::RuntimeException(TRACE_INFO,
+                "SpaceServer::saveScene - Found no scene associate with handle: '%s'.",
+                ATOM_AS_STRING(spaceMapHandle));
+    }
+
+    const Scene& scene = *scenePairItr->second;
+    uint64_t chain = SceneSnapshot::newChain();
+    uint32_t sequence = scene.journal.sequence + 1;
+    SceneSnapshot::writeFull(out, scene.spaceMap, scene.entityRecorder, chain, sequence);
+    scene.journal.maxOps = sceneJournalMaxOps;
+    scene.journal.restart(chain, sequence, recordChanges);
+}
+
+void SpaceServer::saveSceneDelta(Handle spaceMapHandle, std::ostream& out) const
+{
+    auto scenePairItr = scenes.find(spaceMapHandle);
+    if (scenePairItr == scenes.end()) {
+        throw opencog::RuntimeException(TRACE_INFO,
+                "SpaceServer::saveSceneDelta - Found no scene associate with handle: '%s'.",
+                ATOM_AS_STRING(spaceMapHandle));
+    }
+
+    const Scene& scene = *scenePairItr->second;
+    if (!scene.journal.isRecording() && !scene.journal.overflowed) {
+        throw opencog::RuntimeException(TRACE_INFO,
+                "SpaceServer::saveSceneDelta - The changes of the scene '%s' are not recorded since its last snapshot.",
+                ATOM_AS_STRING(spaceMapHandle));
+    }
+    uint64_t chain = scene.journal.chain;
+    uint32_t sequence = scene.journal.sequence + 1;
+    if (scene.journal.overflowed) {
+        logger().info("SpaceServer::saveSceneDelta - The journal of the scene '%s' is full, "
+                      "saving a full snapshot instead.", ATOM_AS_STRING(spaceMapHandle));
+        chain = SceneSnapshot::newChain();
+        SceneSnapshot::writeFull(out, scene.spaceMap, scene.entityRecorder, chain, sequence);
+    } else {
+        SceneSnapshot::writeDelta(out, scene.spaceMap, scene.journal, sequence);
+    }
+    scene.journal.maxOps = sceneJournalMaxOps;
+    scene.journal.restart(chain, sequence, true);
+}
+
+Handle SpaceServer::loadScene(std::istream& in)
+{
+    SceneSnapshot::Header header = SceneSnapshot::readHeader(in);
+    Handle spaceMapHandle = atomspace->add_node(SPACE_MAP_NODE, header.mapName);
+
+    if (header.kind == SceneSnapshot::FULL) {
+        // restored aside, so that the scene of the same name is left as
+        // it was if the snapshot turns out to be corrupted
+        std::unique_ptr<Scene> scene(new Scene(header.mapName, header.resolution));
+        scene->spaceMap.setAgentHeight(header.agentHeight);
+        SceneSnapshot::readFull(in, *atomspace, scene->spaceMap, scene->entityRecorder);
+        scene->journal.restart(header.chain, header.sequence, false);
+        spaceMapHandle->setLTI(1);
+        {
+            std::lock_guard<std::mutex> lock(scenesLock);
+            scenes[spaceMapHandle] = std::move(scene);
+        }
+        curSpaceMapHandle = spaceMapHandle;
+    } else {
+        auto scenePairItr = scenes.find(spaceMapHandle);
+        if (scenePairItr == scenes.end() ||
+            scenePairItr->second->journal.chain != header.chain ||
+            scenePairItr->second->journal.sequence != header.baseSequence ||
+            scenePairItr->second->journal.changed) {
+            throw opencog::RuntimeException(TRACE_INFO,
+                    "SpaceServer::loadScene - The delta %u of the scene '%s' doesn't follow its last snapshot.",
+                    header.sequence, header.mapName.c_str());
+        }
+        Scene& scene = *scenePairItr->second;
+        try {
+            SceneSnapshot::readDelta(in, *atomspace, scene.spaceMap, scene.entityRecorder);
+        } catch (const opencog::RuntimeException&) {
+            // the delta is partly applied, no later one can follow
+            scene.journal.restart(0, 0, false);
+            throw;
+        }
+        scene.journal.restart(header.chain, header.sequence, false);
+    }
+
+    return spaceMapHandle;
+}
+
 std::string SpaceServer::mapToString(Handle mapHandle) const
 {
+    auto scenePairItr = scenes.find(mapHandle);
+    if (scenePairItr == scenes.end()) {
+        throw opencog::RuntimeException(TRACE_INFO,
+                "SpaceServer::mapToString - Found no scene associate with handle: '%s'.",
+                ATOM_AS_STRING(mapHandle));
+    }
 
+    // Leaves the journal alone, so as not to break a chain of snapshots.
+    // The scene is written as its last snapshot if it didn't change since,
+    // and as a snapshot of no chain otherwise, on which no delta applies.
+    const Scene& scene = *scenePairItr->second;
+    bool inChain = !scene.journal.changed;
     std::stringstream stringMap;
-    stringMap.precision(25);
-    stringMap << getMapIdString(mapHandle);
-    // see localspacemap toString
-
-    return stringMap.str( );
+    SceneSnapshot::writeFull(stringMap, scene.spaceMap, scene.entityRecorder,
+                             inChain ? scene.journal.chain : 0,
+                             inChain ? scene.journal.sequence : 0);
+    return stringMap.str();
 }
 
-// TODO
 Handle SpaceServer::mapFromString(const std::string& stringMap)
 {
-    return Handle::UNDEFINED;
+    std::istringstream in(stringMap);
+    return loadScene(in);
 }
 
 Handle SpaceServer::addPropertyPredicate(
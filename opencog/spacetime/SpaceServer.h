@@ -45,8 +45,12 @@
  * @author Welter Luigi
  */
 #include <exception>
+#include <istream>
+#include <ostream>
 #include <string>
 #include <map>
+#include <memory>
+#include <mutex>
 
 #include <boost/signals2.hpp>
 
@@ -59,6 +63,7 @@
 #include <opencog/spatial/3DSpaceMap/OctomapOcTree.h>
 #include <opencog/spatial/3DSpaceMap/EntityRecorder.h>
 
+#include "SceneSnapshot.h"
 #include "SpaceServerContainer.h"
 #include "Temporal.h"
 
@@ -97,9 +102,14 @@ namespace opencog
             spaceMap(mapName, resolution), entityRecorder(){}
             spatial::OctomapOcTree spaceMap;
             spatial::EntityRecorder entityRecorder;
+            // the changes since the last snapshot, kept by the const
+            // saving methods
+            mutable SceneJournal journal;
         };
 
-        typedef std::map<Handle, Scene> HandleToScenes;
+        // held by pointer, so that a scene can be restored aside and put
+        // in place of another
+        typedef std::map<Handle, std::unique_ptr<Scene> > HandleToScenes;
 
     public:
 
@@ -217,14 +227,58 @@ namespace opencog
 
         void clear();
 
+        /**
+         * Writes a full binary snapshot of the scene (see SceneSnapshot).
+         * If recordChanges is true, the changes of the scene are recorded
+         * from now on for saveSceneDelta(); otherwise they are not, and
+         * any recording of them stops.
+         * @throws RuntimeException if there is no such scene
+         */
+        void saveScene(Handle spaceMapHandle, std::ostream& out,
+                       bool recordChanges = false) const;
+
+        /**
+         * Writes the changes of the scene since its last snapshot, full or
+         * delta, which is much smaller than a full snapshot of a large map,
+         * and keeps recording them. If there were more changes than the
+         * journal keeps (see setSceneJournalMaxOps()), a full snapshot is
+         * written instead; loadScene() takes either.
+         * @throws RuntimeException if there is no such scene or its
+         *         changes are not recorded, see saveScene()
+         */
+        void saveSceneDelta(Handle spaceMapHandle, std::ostream& out) const;
+
+        /**
+         * Restores a snapshot written by saveScene() or saveSceneDelta().
+         * A full snapshot replaces the scene of the same name, if any, and
+         * the restored scene becomes the latest map; a delta is applied on
+         * the scene restored from the snapshot before it, in the same
+         * chain. A full snapshot that fails to load leaves the scene as it
+         * was; a delta that fails may be partly applied, and the scene then
+         * takes no delta until a full snapshot is loaded.
+         * The time info of the scene is not part of the snapshot.
+         * @return the SpaceMap handle of the scene
+         * @throws RuntimeException if the snapshot is corrupted or a delta
+         *         doesn't follow the last snapshot of the scene
+         */
+        Handle loadScene(std::istream& in);
+
+        /**
+         * Sets how many changes of a scene are recorded for a delta
+         * snapshot before falling back to a full one, from the next
+         * snapshot of the scene on.
+         */
+        void setSceneJournalMaxOps(size_t maxOps);
+
         /**
          * Converts the map identified by the given Handle into a string
-         * representation of it.
+         * representation of it, a full snapshot as saveScene(), without
+         * taking part in the chain of snapshots of the scene.
          */
         std::string mapToString(Handle mapHandle) const;
 
         /**
-         * TODO
+         * Restores a map from its string representation, as loadScene().
          */
         Handle mapFromString(const std::string& stringMap);
 
@@ -248,6 +302,11 @@ namespace opencog
 
         void atomRemoved(AtomPtr);
         void atomAdded(Handle);
+        // forgets the cached material of the block, in every map, if h is
+        // a material predicate of it:
+        // (EvaluationLink (PredicateNode "material") (ListLink block value))
+        // Called from the AtomSpace signals, on any thread.
+        void materialChanged(const Handle& h);
 
         Handle addPropertyPredicate(std::string predicateName,
                                     Handle,
@@ -260,6 +319,10 @@ namespace opencog
          * specific zone map.
          */
         HandleToScenes scenes;
+        // guards the adding, replacing and removing of scenes against
+        // materialChanged(); it must not be held while atoms are added or
+        // removed, their signals take it
+        std::mutex scenesLock;
 
         /**
          * comment@20150520 by YiShan
@@ -282,6 +345,11 @@ namespace opencog
          */
         unsigned int agentHeight;
 
+        /**
+         * The limit of the scene journals, see setSceneJournalMaxOps()
+         */
+        size_t sceneJournalMaxOps;
+
     };
 
 } // namespace opencog
@@ -0,0 +1,264 @@
+/*
+ * opencog/spacetime/TemporalIndex.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include "TemporalIndex.h"
+
+using namespace opencog;
+
+// A block is merged with a neighbour when it gets smaller than this
+#define MIN_BLOCK_FILL (BLOCK_SIZE / 4)
+
+const size_t TemporalIndex::BLOCK_SIZE;
+
+TemporalIndex::TemporalIndex() : leafNum(0), count(0)
+{
+}
+
+void TemporalIndex::clear()
+{
+    blocks.clear();
+    blockBounds.clear();
+    tree.clear();
+    leafNum = 0;
+    count = 0;
+}
+
+size_t TemporalIndex::findBlock(const Entry& entry) const
+{
+    // last block whose first entry is not greater than the given one
+    size_t low = 0;
+    size_t up = blocks.size();
+    while (low < up) {
+        size_t pos = (low + up) / 2;
+        if (less(entry, blocks[pos].front())) {
+            up = pos;
+        } else {
+            low = pos + 1;
+        }
+    }
+    return (low == 0) ? 0 : low - 1;
+}
+
+size_t TemporalIndex::lastBlockStartingBelow(octime_t lower) const
+{
+    size_t low = 0;
+    size_t up = blocks.size();
+    while (low < up) {
+        size_t pos = (low + up) / 2;
+        if (blocks[pos].front().lower < lower) {
+            low = pos + 1;
+        } else {
+            up = pos;
+        }
+    }
+    return (low == 0) ? blocks.size() : low - 1;
+}
+
+size_t TemporalIndex::lastBlockStartingAtOrBelow(octime_t lower) const
+{
+    size_t low = 0;
+    size_t up = blocks.size();
+    while (low < up) {
+        size_t pos = (low + up) / 2;
+        if (blocks[pos].front().lower <= lower) {
+            low = pos + 1;
+        } else {
+            up = pos;
+        }
+    }
+    return (low == 0) ? blocks.size() : low - 1;
+}
+
+TemporalIndex::Bounds TemporalIndex::boundsOf(const std::vector<Entry>& entries)
+{
+    Bounds bounds;
+    bounds.minUpper = OCTIME_MAX;
+    bounds.maxUpper = 0;
+    for (const Entry& entry : entries) {
+        if (entry.upper < bounds.minUpper) bounds.minUpper = entry.upper;
+        if (entry.upper > bounds.maxUpper) bounds.maxUpper = entry.upper;
+    }
+    return bounds;
+}
+
+void TemporalIndex::updateBlockBounds(size_t block)
+{
+    blockBounds[block] = boundsOf(blocks[block]);
+    size_t node = leafNum + block;
+    tree[node] = blockBounds[block];
+    for (node /= 2; node >= 1; node /= 2) {
+        const Bounds& left = tree[2 * node];
+        const Bounds& right = tree[2 * node + 1];
+        tree[node].minUpper = std::min(left.minUpper, right.minUpper);
+        tree[node].maxUpper = std::max(left.maxUpper, right.maxUpper);
+    }
+}
+
+void TemporalIndex::rebuildTree()
+{
+    leafNum = 1;
+    while (leafNum < blocks.size()) leafNum *= 2;
+
+    Bounds empty;
+    empty.minUpper = OCTIME_MAX;
+    empty.maxUpper = 0;
+    tree.assign(2 * leafNum, empty);
+
+    // the entries are not scanned again, only the cached bounds of the blocks
+    std::copy(blockBounds.begin(), blockBounds.end(), tree.begin() + leafNum);
+    for (size_t node = leafNum - 1; node >= 1; node--) {
+        tree[node].minUpper = std::min(tree[2 * node].minUpper, tree[2 * node + 1].minUpper);
+        tree[node].maxUpper = std::max(tree[2 * node].maxUpper, tree[2 * node + 1].maxUpper);
+    }
+}
+
+void TemporalIndex::splitBlock(size_t block)
+{
+    std::vector<Entry>& entries = blocks[block];
+    std::vector<Entry> secondHalf(entries.begin() + entries.size() / 2, entries.end());
+    entries.resize(entries.size() / 2);
+    blocks.insert(blocks.begin() + block + 1, std::vector<Entry>());
+    blocks[block + 1].swap(secondHalf);
+    blocks[block + 1].reserve(BLOCK_SIZE);
+    blockBounds[block] = boundsOf(blocks[block]);
+    blockBounds.insert(blockBounds.begin() + block + 1, boundsOf(blocks[block + 1]));
+    rebuildTree();
+}
+
+void TemporalIndex::removeBlock(size_t block)
+{
+    blocks.erase(blocks.begin() + block);
+    blockBounds.erase(blockBounds.begin() + block);
+    rebuildTree();
+}
+
+void TemporalIndex::insert(const Entry& entry)
+{
+    count++;
+    if (blocks.empty()) {
+        blocks.push_back(std::vector<Entry>());
+        blocks.back().reserve(BLOCK_SIZE);
+        blocks.back().push_back(entry);
+        blockBounds.push_back(boundsOf(blocks.back()));
+        rebuildTree();
+        return;
+    }
+
+    size_t block = findBlock(entry);
+    std::vector<Entry>& entries = blocks[block];
+
+    if (entries.size() >= BLOCK_SIZE && block == blocks.size() - 1 && less(entries.back(), entry)) {
+        // appending in chronological order: leaves the last block full and starts a new one
+        blocks.push_back(std::vector<Entry>());
+        blocks.back().reserve(BLOCK_SIZE);
+        blocks.back().push_back(entry);
+        blockBounds.push_back(boundsOf(blocks.back()));
+        if (blocks.size() > leafNum) {
+            rebuildTree();
+        } else {
+            updateBlockBounds(blocks.size() - 1);
+        }
+        return;
+    }
+
+    entries.insert(std::upper_bound(entries.begin(), entries.end(), entry, less), entry);
+    if (entries.size() > BLOCK_SIZE) {
+        splitBlock(block);
+    } else {
+        updateBlockBounds(block);
+    }
+}
+
+void TemporalIndex::bulkInsert(std::vector<Entry>& newEntries)
+{
+    if (newEntries.empty()) return;
+    std::sort(newEntries.begin(), newEntries.end(), less);
+
+    std::vector<Entry> all;
+    all.reserve(count + newEntries.size());
+    for (const std::vector<Entry>& entries : blocks) {
+        all.insert(all.end(), entries.begin(), entries.end());
+    }
+    size_t oldCount = all.size();
+    all.insert(all.end(), newEntries.begin(), newEntries.end());
+    std::inplace_merge(all.begin(), all.begin() + oldCount, all.end(), less);
+
+    // full blocks, as chronological insertion would leave them
+    blocks.clear();
+    blockBounds.clear();
+    for (size_t pos = 0; pos < all.size(); pos += BLOCK_SIZE) {
+        size_t end = std::min(pos + BLOCK_SIZE, all.size());
+        blocks.push_back(std::vector<Entry>(all.begin() + pos, all.begin() + end));
+        blockBounds.push_back(boundsOf(blocks.back()));
+    }
+    count = all.size();
+    rebuildTree();
+}
+
+bool TemporalIndex::remove(const Entry& entry)
+{
+    if (blocks.empty()) return false;
+
+    size_t block = findBlock(entry);
+    std::vector<Entry>& entries = blocks[block];
+    std::vector<Entry>::iterator it = std::lower_bound(entries.begin(), entries.end(), entry, less);
+    if (it == entries.end() || less(entry, *it)) return false;
+
+    entries.erase(it);
+    count--;
+
+    if (entries.empty()) {
+        removeBlock(block);
+    } else if (entries.size() < MIN_BLOCK_FILL && block + 1 < blocks.size() &&
+               entries.size() + blocks[block + 1].size() <= BLOCK_SIZE) {
+        entries.insert(entries.end(), blocks[block + 1].begin(), blocks[block + 1].end());
+        blockBounds[block] = boundsOf(entries);
+        removeBlock(block + 1);
+    } else {
+        updateBlockBounds(block);
+    }
+    return true;
+}
+
+const TemporalIndex::Entry* TemporalIndex::firstLowerAbove(octime_t lower) const
+{
+    if (lower == OCTIME_MAX) return NULL;
+    // the first entry with a lower bound >= lower + 1 is in the last block starting
+    // below lower + 1, or in the next one
+    size_t block = lastBlockStartingBelow(lower + 1);
+    if (block == blocks.size()) block = 0;
+    for (; block < blocks.size(); block++) {
+        const std::vector<Entry>& entries = blocks[block];
+        std::vector<Entry>::const_iterator it =
+            std::lower_bound(entries.begin(), entries.end(), lower + 1, lowerBoundLess);
+        if (it != entries.end()) return &(*it);
+    }
+    return NULL;
+}
+
+const TemporalIndex::Entry* TemporalIndex::lastLowerBelow(octime_t lower) const
+{
+    size_t block = lastBlockStartingBelow(lower);
+    if (block == blocks.size()) return NULL;
+    const std::vector<Entry>& entries = blocks[block];
+    std::vector<Entry>::const_iterator it =
+        std::lower_bound(entries.begin(), entries.end(), lower, lowerBoundLess);
+    // the block starts below lower, so it is not the first entry
+    return &(*(it - 1));
+}
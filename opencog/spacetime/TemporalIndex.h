@@ -0,0 +1,204 @@
+/*
+ * opencog/spacetime/TemporalIndex.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _OPENCOG_TEMPORAL_INDEX_H
+#define _OPENCOG_TEMPORAL_INDEX_H
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include <opencog/spacetime/Temporal.h>
+
+namespace opencog
+{
+/** \addtogroup grp_spacetime
+ *  @{
+ */
+
+/**
+ * Identifies a distinct Temporal object inside a TemporalTable.
+ */
+typedef uint32_t TemporalId;
+
+/**
+ * An interval index of Temporal objects, sorted in the order of Temporal::compareTo,
+ * i.e., by lower bound, then upper bound, then normal before uniform distribution.
+ *
+ * The entries are kept in contiguous blocks of at most BLOCK_SIZE entries, like the
+ * leaves of a B+tree. A segment tree over the blocks keeps the minimum and the maximum
+ * upper bound of each block, so that a lookup on both bounds only visits the blocks
+ * that may have a matching entry:
+ *   - a lookup on the lower bound only is a range of blocks found by binary search,
+ *     i.e., O(log n + k);
+ *   - a lookup that also restricts the upper bound descends the segment tree in the
+ *     range of blocks, and scans only the blocks whose upper bounds reach the range.
+ *
+ * Appending entries in chronological order, the usual case, fills the blocks up and
+ * never moves the previous ones.
+ *
+ * Limits:
+ *   - the upper bounds are only pruned by the minimum and the maximum of each block.
+ *     When the durations of the entries are alike, the upper bounds of a block, sorted
+ *     by lower bound, are close together and few blocks are scanned. When they vary a
+ *     lot, one long entry widens the bounds of its block, and a lookup on the upper
+ *     bound (ENDS_*, OVERLAPS, INCLUDES) may scan every block of its lower bound range,
+ *     i.e., up to O(n);
+ *   - inserting a block (splitting a full one) or removing one rebuilds the segment
+ *     tree from the cached bounds of the blocks, in O(n / BLOCK_SIZE). A split only
+ *     happens every BLOCK_SIZE / 2 insertions in the middle of the index at most.
+ */
+class TemporalIndex
+{
+
+public:
+
+    struct Entry {
+        octime_t lower;
+        octime_t upper;
+        bool normal;
+        TemporalId id;
+
+        Entry() {}
+        Entry(const Temporal& t, TemporalId _id) :
+            lower(t.getLowerBound()), upper(t.getUpperBound()), normal(t.isNormal()), id(_id) {}
+    };
+
+    /**
+     * The order of Temporal::compareTo.
+     */
+    static bool less(const Entry& e1, const Entry& e2) {
+        if (e1.lower != e2.lower) return e1.lower < e2.lower;
+        if (e1.upper != e2.upper) return e1.upper < e2.upper;
+        return e1.normal && !e2.normal;
+    }
+
+    TemporalIndex();
+
+    /**
+     * Adds an entry. There must be no entry with the same bounds and distribution yet.
+     */
+    void insert(const Entry&);
+
+    /**
+     * Adds many entries at once, in any order, sorting and merging them with the
+     * existing ones in O((n + m) + m log m) instead of m insertions.
+     */
+    void bulkInsert(std::vector<Entry>&);
+
+    /**
+     * Removes the entry with the same bounds and distribution of the given one.
+     * @return True if it was found.
+     */
+    bool remove(const Entry&);
+
+    void clear();
+
+    size_t size() const {
+        return count;
+    }
+
+    /**
+     * @return The first entry whose lower bound is greater than the given one, or NULL.
+     */
+    const Entry* firstLowerAbove(octime_t lower) const;
+
+    /**
+     * @return The last entry whose lower bound is smaller than the given one, or NULL.
+     */
+    const Entry* lastLowerBelow(octime_t lower) const;
+
+    /**
+     * Calls visitor(const Entry&), in order, for every entry whose bounds are such that
+     * lowerMin <= lower <= lowerMax and upperMin <= upper <= upperMax.
+     */
+    template<typename Visitor>
+    void visit(octime_t lowerMin, octime_t lowerMax, octime_t upperMin, octime_t upperMax, Visitor visitor) const {
+        if (blocks.empty() || lowerMin > lowerMax || upperMin > upperMax) return;
+        size_t firstBlock = lastBlockStartingBelow(lowerMin);
+        size_t lastBlock = lastBlockStartingAtOrBelow(lowerMax);
+        if (lastBlock == blocks.size()) return;
+        if (firstBlock == blocks.size()) firstBlock = 0;
+        visitNode(1, 0, leafNum, firstBlock, lastBlock, lowerMin, lowerMax, upperMin, upperMax, visitor);
+    }
+
+private:
+
+    static const size_t BLOCK_SIZE = 256;
+
+    struct Bounds {
+        octime_t minUpper;
+        octime_t maxUpper;
+    };
+
+    static bool lowerBoundLess(const Entry& entry, octime_t lower) {
+        return entry.lower < lower;
+    }
+
+    std::vector<std::vector<Entry> > blocks;
+    // the upper bounds of each block, the leaves of the segment tree
+    std::vector<Bounds> blockBounds;
+    // segment tree of the upper bounds of the blocks, node i has children 2i and 2i+1,
+    // the leaves start at leafNum
+    std::vector<Bounds> tree;
+    size_t leafNum;
+    size_t count;
+
+    // index of the block that has or would have the given entry
+    size_t findBlock(const Entry&) const;
+    // last block whose first lower bound is < lower (or <= lower), blocks.size() if none
+    size_t lastBlockStartingBelow(octime_t lower) const;
+    size_t lastBlockStartingAtOrBelow(octime_t lower) const;
+
+    static Bounds boundsOf(const std::vector<Entry>&);
+    void updateBlockBounds(size_t block);
+    void rebuildTree();
+    void splitBlock(size_t block);
+    void removeBlock(size_t block);
+
+    template<typename Visitor>
+    void visitNode(size_t node, size_t nodeFirst, size_t nodeEnd, size_t firstBlock, size_t lastBlock,
+                   octime_t lowerMin, octime_t lowerMax, octime_t upperMin, octime_t upperMax,
+                   Visitor& visitor) const {
+        if (nodeEnd <= firstBlock || nodeFirst > lastBlock) return;
+        const Bounds& bounds = tree[node];
+        if (bounds.maxUpper < upperMin || bounds.minUpper > upperMax) return;
+        if (nodeEnd - nodeFirst == 1) {
+            const std::vector<Entry>& entries = blocks[nodeFirst];
+            std::vector<Entry>::const_iterator it = entries.begin();
+            if (it->lower < lowerMin) {
+                it = std::lower_bound(entries.begin(), entries.end(), lowerMin, lowerBoundLess);
+            }
+            for (; it != entries.end() && it->lower <= lowerMax; ++it) {
+                if (it->upper >= upperMin && it->upper <= upperMax) {
+                    visitor(*it);
+                }
+            }
+            return;
+        }
+        size_t middle = (nodeFirst + nodeEnd) / 2;
+        visitNode(2 * node, nodeFirst, middle, firstBlock, lastBlock, lowerMin, lowerMax, upperMin, upperMax, visitor);
+        visitNode(2 * node + 1, middle, nodeEnd, firstBlock, lastBlock, lowerMin, lowerMax, upperMin, upperMax, visitor);
+    }
+};
+
+/** @}*/
+} // namespace opencog
+
+#endif // _OPENCOG_TEMPORAL_INDEX_H
@@ -22,878 +22,409 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
-#include <set>
-#include <opencog/util/Logger.h>
-
-#include "TemporalTable.h"
+#include <algorithm>
 
+#include <opencog/util/exceptions.h>
 
-//#define DPRINTF printf
-#define DPRINTF(...)
+#include "TemporalTable.h"
 
-// Minimal rate (number of entries / pending updates) so that an index table must be re-built
-#define PENDING_UPDATE_RATE_THRESHOLD 8
-#define INITIAL_INDEX_TABLE_SIZE 1
+// When adding more entries at once than this fraction of the table, the index is rebuilt
+// with all of them instead of inserting them one by one
+#define BULK_INSERT_RATE 8
 
 using namespace opencog;
 
 TemporalTable::TemporalTable()
 {
-    handleMap = new HandleToTemporalEntryMap();
-    tailHandleMap = new HandleToTemporalEntryMap();
-    temporalMap = new TemporalToHandleSetMap();
-    sortedTemporalList = NULL;
-    temporalIndexTable = new TemporalEntry*[INITIAL_INDEX_TABLE_SIZE];
-    indexTableSize = INITIAL_INDEX_TABLE_SIZE;
-    indexTableCount = 0;
-    pendingUpdateCount = 0;
 }
 
 TemporalTable::~TemporalTable()
 {
-    //delete(tailHandleMap);
-    ThreadSafeHandleMapIterator<TemporalEntry *> *keys = tailHandleMap->keys();
-    while (keys->has_next()) {
-        Handle nextKey = keys->next();
-        tailHandleMap->remove(nextKey);
-    }
-    delete(keys);
-    
-    delete(tailHandleMap);
-
-    delete(handleMap);
-
-    // get all Temporal* keys to be deleted later
-    std::set<Temporal*> toBeDeleted;
-    TemporalMapIterator* itr = temporalMap->keys();
-    while (itr->hasNext()) {
-        toBeDeleted.insert(itr->next());
-    }
-    delete itr;
-    delete(temporalMap);
-    delete(sortedTemporalList);
-    delete[](temporalIndexTable);
-    // delete all Temporal* keys
-    for (std::set<Temporal*>::iterator it = toBeDeleted.begin();
-            it != toBeDeleted.end(); ++it) {
-        delete *it;
-    }
 }
 
-void TemporalTable::add(Handle h, const Temporal& t)
+TemporalId TemporalTable::addTemporal(const Temporal& t, bool& added)
 {
-    DPRINTF("TemporalTable::add(%ld, %s)\n", h.value(), t.toString().c_str());
-    Temporal* internal_t = temporalMap->getKey(t);
-    if (!internal_t) {
-        internal_t = t.clone();
-    }
-    int oldNumTemporalEntries = temporalMap->getCount();
-    DPRINTF("oldNumTemporalEntries = %d\n", oldNumTemporalEntries);
-    DPRINTF("old sortedTemporalList = %s\n", sortedTemporalList->toString().c_str());
-    TemporalEntry* previousEntry = NULL;
-    if (indexTableCount > 0) {
-        previousEntry = getPreviousTemporalEntry(t);
-        if (previousEntry == NULL) {
-            DPRINTF("previous entry is NULL => inserting directly in sortedTemporalList\n");
-            sortedTemporalList = TemporalEntry::add(sortedTemporalList, internal_t);
-            previousEntry = sortedTemporalList;
-        } else {
-            DPRINTF("Previous entry's head is %s => inserting in this entry list\n", previousEntry->time->toString().c_str());
-            TemporalEntry::add(previousEntry, internal_t);
-        }
+    std::unordered_map<Temporal, TemporalId, TemporalHash>::const_iterator it = temporalIds.find(t);
+    if (it != temporalIds.end()) {
+        added = false;
+        return it->second;
+    }
+    TemporalId id;
+    if (freeSlots.empty()) {
+        id = slots.size();
+        slots.push_back(TemporalSlot(t));
     } else {
-        DPRINTF("Insertion not using index table\n");
-        sortedTemporalList = TemporalEntry::add (sortedTemporalList, internal_t);
-    }
-    DPRINTF("sortedTemporalList = %s\n", sortedTemporalList->toString().c_str());
-    addToMaps(h, internal_t);
-    int numTemporalEntries = temporalMap->getCount();
-    DPRINTF("numTemporalEntries = %d\n", numTemporalEntries);
-    if (numTemporalEntries != oldNumTemporalEntries) {
-        if ((previousEntry != NULL) &&
-                (indexTableCount > 0) &&
-                (indexTableCount < indexTableSize) &&
-                (TemporalEntry::compare(&t, temporalIndexTable[indexTableCount-1]->time) > 0)) {
-            // just update IndexTable by putting the new TemporalEntry in the last position
-            TemporalEntry* newEntry = previousEntry;
-            while (newEntry != NULL && TemporalEntry::compare(newEntry->time, &t) != 0) {
-                newEntry = newEntry->next;
-            }
-            if (newEntry == NULL) {
-                // Should never enter here
-                throw RuntimeException(TRACE_INFO,
-                                       "TemporalTable - Error inserting in TemporalTable (newEntry NULL).");
-            }
-            temporalIndexTable[indexTableCount++] = newEntry;
-            DPRINTF("indexTableCount++ => %d\n", indexTableCount);
-        } else {
-            pendingUpdateCount++;
-            int pendingRate = (numTemporalEntries / pendingUpdateCount);
-            if (pendingRate < PENDING_UPDATE_RATE_THRESHOLD) {
-                updateIndexTable(numTemporalEntries);
-            }
-        }
+        id = freeSlots.back();
+        freeSlots.pop_back();
+        slots[id].time = t;
     }
-    DPRINTF("Affer adding => sortedTemporalList = %s\n", sortedTemporalList->toString().c_str());
+    temporalIds[t] = id;
+    added = true;
+    return id;
 }
 
-HandleTemporalPairEntry* TemporalTable::get(Handle h, const Temporal& t, TemporalRelationship criterion) const
+void TemporalTable::removeTemporal(TemporalId id)
 {
-    DPRINTF("TemporalTable::getHandle(h, t = %s, criterion = %s\n", t.toString().c_str(), getTemporalRelationshipStr(criterion));
+    TemporalSlot& slot = slots[id];
+    index.remove(TemporalIndex::Entry(slot.time, id));
+    temporalIds.erase(slot.time);
+    std::vector<Handle>().swap(slot.handles);
+    freeSlots.push_back(id);
+}
 
-    if (h == Handle::UNDEFINED) {
-        return get(t, criterion);
+void TemporalTable::removeHandleTemporal(Handle h, TemporalId id)
+{
+    std::vector<Handle>& handles = slots[id].handles;
+    std::vector<Handle>::iterator it = std::find(handles.begin(), handles.end(), h);
+    if (it != handles.end()) {
+        *it = handles.back();
+        handles.pop_back();
     }
-    TemporalEntry* te = handleMap->get(h);
-    HandleTemporalPairEntry* result = NULL;
-    HandleTemporalPairEntry* tail = NULL;
-    DPRINTF("te = %s\n", te->toString().c_str());
-    bool searchFinished = false;
-    while (te != NULL && !searchFinished) {
-        // Check if Temporal matches
-        bool matches = false;
-        if (t == UNDEFINED_TEMPORAL) {
-            matches = true;
-            DPRINTF("t == null => matched\n");
-        } else {
-            matches = matchesTimeCriterion(*(te->time), t, criterion, searchFinished);
-            DPRINTF("Called matchesTimeCriterion(T' = %s, T = %s, criterion = %s) => matches = %d, searchFinished = %d\n", te->time->toString().c_str(), t.toString().c_str(), getTemporalRelationshipStr(criterion), matches, searchFinished);
-        }
-        if (matches) {
-            DPRINTF("Matched!\n");
-            HandleTemporalPairEntry* hte = new HandleTemporalPairEntry(HandleTemporalPair(h, te->time));
-            if (t != UNDEFINED_TEMPORAL && (criterion == PREVIOUS_BEFORE_START_OF || criterion == PREVIOUS_BEFORE_END_OF)) {
-                if (result) delete result; // discard previous result
-                result = hte; // get the new matching result.
-            } else {
-                if (result == NULL) {
-                    result = hte;
-                } else {
-                    tail->next = hte;
-                }
-                DPRINTF("result = %s\n", result->toString().c_str());
-                tail = hte;
-            }
-        } else {
-            DPRINTF("Not matched!\n");
-        }
-        te = te->next;
+    if (handles.empty()) {
+        removeTemporal(id);
     }
-
-    DPRINTF("TemporalTable::getHandle - end.\n");
-    return result;
 }
 
-HandleTemporalPairEntry* TemporalTable::get(const Temporal& t, TemporalRelationship criterion) const
+void TemporalTable::add(Handle h, const Temporal& t)
 {
-    DPRINTF("TemporalTable::get(%s, %d)\n", t.toString().c_str(), criterion);
-
-    HandleTemporalPairEntry* result = NULL;
-    if (t == UNDEFINED_TEMPORAL) {
-        // get all entries
-        HandleTemporalPairEntry* tail = NULL;
-        TemporalEntry* te = sortedTemporalList;
-        while (te != NULL) {
-            Temporal* time = te->time;
-            UnorderedHandleSet* hs = temporalMap->get(time);
-            UnorderedHandleSet::iterator itr = hs->begin();
-            while (itr != hs->end()) {
-                Handle h = *itr;
-                ++itr;
-                HandleTemporalPairEntry* hte = new HandleTemporalPairEntry(HandleTemporalPair(h, time));
-                if (result == NULL) {
-                    result = hte;
-                } else {
-                    tail->next = hte;
-                }
-                tail = hte;
-            }
-            te = te->next;
-        }
-    } else {
-        switch (criterion) {
-        case EXACT: {
-            DPRINTF("ExactMatch! temporalMap = %p\n", temporalMap);
-            UnorderedHandleSet* hs = temporalMap->get((Temporal*) & t);
-            DPRINTF("Got hs = %p\n", hs);
-            if (hs != NULL) {
-                Temporal* time = NULL; // internal Temporal object (Temporal argument cannot be used in the result)
-                // Build the HandleTemporalPairEntry
-                UnorderedHandleSet::iterator itr = hs->begin();
-                DPRINTF("Got hs iterator = %ld\n", itr->value());
-                while (itr != hs->end()) {
-                    DPRINTF("hs iterator has next\n");
-                    Handle handle = *itr;
-                    ++itr;
-                    DPRINTF("Got handle = %ld\n", handle.value());
-                    if (time == NULL) {
-                        DPRINTF("time is NULL. Creating Temporal object\n");
-                        // Find the internal Temporal object to put in the result list
-                        TemporalEntry* te = handleMap->get(handle);
-                        DPRINTF("Got TemporalEntry\n");
-                        while (te != NULL) {
-                            DPRINTF("Checking next Temporal entry\n");
-                            if (TemporalEntry::compare(&t, te->time) == 0) {
-                                time = te->time;
-                                break;
-                            }
-                            te = te->next;
-                        }
-                    }
-                    if (time == NULL) {
-                        throw RuntimeException(TRACE_INFO,
-                                               "TemporalTable - Could not find internal Temporal to insert into HandleTemporalPairEntry result.");
-                    }
-                    DPRINTF("About to concatenate handle\n");
-                    HandleTemporalPairEntry* newEntry = new HandleTemporalPairEntry(handle, time);
-                    DPRINTF("new Entry = %p\n", newEntry);
-                    result = HandleTemporalPairEntry::concatenation(newEntry, result);
-                    DPRINTF("Handle concatenated result = %p\n", result);
-                    DPRINTF("result's head = (%s)\n", result->toString().c_str());
-                }
-                DPRINTF("hs iteration finished\n");
-            }
-            break;
-        } // EXACT
-        case OVERLAPS: {
-            if (sortedTemporalList != NULL) {
-                // Get all Temporal entries that insersects with the given time interval of t
-                // => all Temporal time where (time->lowerBound <= t.upperBound) && (time->upperBound >= t.lowerBound)
-
-                // Eliminates the linear lower bound tests in the beggining of the list
-                // by using binary search to find the upper limit in the list.
-                TemporalEntry* upperLimitEntry = getPreviousTemporalEntry(t);
-                if (upperLimitEntry == NULL) {
-                    upperLimitEntry = sortedTemporalList;
-                }
-                // Now iterates on the list until finds the upper limit
-                while (upperLimitEntry != NULL) {
-                    DPRINTF("Checking lowerBound of %s ...", upperLimitEntry->time->toString().c_str());
-                    DPRINTF(" (upperBound of t = %ld) ", t.getUpperBound());
-                    if (upperLimitEntry->time->getLowerBound() > t.getUpperBound()) {
-                        DPRINTF("failed\n");
-                        break;
-                    }
-                    DPRINTF("ok\n");
-                    upperLimitEntry = upperLimitEntry->next;
-                }
-                // Here, we know that all entries from the beggining to the upperLimitEntry satisfy (time->lowerBound <= t.upperBound).
-                // Now, check (time->upperBound >= t.lowerBound) for each one of such entries
-                TemporalEntry* currentEntry = sortedTemporalList;
-                HandleTemporalPairEntry* resultTail = NULL;
-                while (currentEntry != upperLimitEntry) {
-                    // Check if current entry matches the interval by checking the upperBound of each entry.
-                    if (currentEntry->time->getUpperBound() >= t.getLowerBound()) {
-                        // Matched! Add associated handles to the result.
-                        UnorderedHandleSet* hs = temporalMap->get(currentEntry->time);
-                        // Build the HandleTemporalPairEntry
-                        UnorderedHandleSet::iterator itr = hs->begin();
-                        DPRINTF("Handles for time %s:\n", currentEntry->time->toString().c_str());
-                        DPRINTF("=> (not printed\n");
-                        // DPRINTF("=> %s:\n", hs->toString().c_str());
-                        while (itr != hs->end()) {
-                            HandleTemporalPairEntry* newEntry = new HandleTemporalPairEntry(*itr, currentEntry->time);
-                            ++itr;
-                            if (result) {
-                                resultTail->next = newEntry;
-                            } else {
-                                result = newEntry;
-                            }
-                            resultTail = newEntry;
-                        }
-                    }
-                    currentEntry = currentEntry->next;
-                }
-            }
-            break;
-        } // OVERLAPS
-        default: {
-            HandleTemporalPairEntry* tail = NULL;
-            bool searchFinished = false;
-            TemporalEntry* te = sortedTemporalList;
-            Temporal* previousTime = NULL;
-            while (te != NULL && !searchFinished) {
-                // Check if Temporal matches
-                bool matches = false;
-                if (t == UNDEFINED_TEMPORAL) {
-                    matches = true;
-                    DPRINTF("t == null => matched\n");
-                } else {
-                    matches = matchesTimeCriterion(*(te->time), t, criterion, searchFinished);
-                    DPRINTF("Called matchesTimeCriterion(T' = %s, T = %s, criterion = %s) => matches = %d, searchFinished = %d\n", te->time->toString().c_str(), t.toString().c_str(), getTemporalRelationshipStr(criterion), matches, searchFinished);
-                }
-                if (matches) {
-                    DPRINTF("Matched!\n");
-                    if (t != UNDEFINED_TEMPORAL && (criterion == PREVIOUS_BEFORE_START_OF || criterion == PREVIOUS_BEFORE_END_OF)) {
-                        // discard previous result and get the new matching result.
-                        previousTime = te->time;
-                    } else {
-                        Temporal* time = te->time;
-                        UnorderedHandleSet* hs = temporalMap->get(time);
-                        UnorderedHandleSet::iterator itr = hs->begin();
-                        while (itr != hs->end()) {
-                            Handle h = *itr;
-                            ++itr;
-                            HandleTemporalPairEntry* hte = new HandleTemporalPairEntry(HandleTemporalPair(h, time));
-                            if (result == NULL) {
-                                result = hte;
-                            } else {
-                                tail->next = hte;
-                            }
-                            tail = hte;
-                        }
-                    }
-                }
-                te = te->next;
-            }
-            if (previousTime) {
-                // get all entries with the previous time
-                UnorderedHandleSet* hs = temporalMap->get(previousTime);
-                UnorderedHandleSet::iterator itr = hs->begin();
-                while (itr != hs->end()) {
-                    Handle h = *itr;
-                    ++itr;
-                    HandleTemporalPairEntry* hte = new HandleTemporalPairEntry(HandleTemporalPair(h, previousTime));
-                    if (result == NULL) {
-                        result = hte;
-                    } else {
-                        tail->next = hte;
-                    }
-                    tail = hte;
-                }
-            }
-            break;
-        }
-        }
+    std::vector<TemporalId>& temporals = handleTemporals[h];
+    std::vector<TemporalId>::iterator it = std::lower_bound(temporals.begin(), temporals.end(), t,
+        [this](TemporalId id, const Temporal& time) { return slots[id].time.compareTo(&time) < 0; });
+    if (it != temporals.end() && slots[*it].time == t) {
+        // already there
+        return;
     }
 
-    DPRINTF("TemporalTable::get() returning...\n");fflush(stdout);
-    return result;
+    bool added;
+    TemporalId id = addTemporal(t, added);
+    if (added) {
+        index.insert(TemporalIndex::Entry(slots[id].time, id));
+    }
+    temporals.insert(it, id);
+    slots[id].handles.push_back(h);
 }
 
-bool TemporalTable::remove(Handle h, const Temporal& t, TemporalRelationship criterion)
+void TemporalTable::add(const std::vector<HandleTemporalPair>& pairs)
 {
-    DPRINTF("TemporalTable::remove(Handle h, const Temporal& t, TemporalRelationship criterion)\n");
-
-    if (h == Handle::UNDEFINED) {
-        return remove(t, criterion);
-    }
-    std::set<Temporal*> toBeDeleted;
-    DPRINTF("TemporalTable::remove(handle)\n");
-    TemporalEntry* te = handleMap->get(h);
-    TemporalEntry* tailTe = tailHandleMap->get(h);
-
-    TemporalEntry* currentTe = te;
-    DPRINTF("te = %s\n", te->toString().c_str());
-    bool searchFinished = false;
-    bool result = false;
-    TemporalEntry* previousTe = NULL;
-    while (currentTe != NULL && !searchFinished) {
-        // Check if Temporal matches
-        bool matches = false;
-        if (t == UNDEFINED_TEMPORAL) {
-            matches = true;
-            DPRINTF("t == null => matched\n");
-        } else {
-            matches = matchesTimeCriterion(*(currentTe->time), t, criterion, searchFinished);
+    // the Temporal objects of each handle, before sorting
+    std::unordered_map<Handle, size_t, handle_hash> oldSizes;
+    std::vector<TemporalIndex::Entry> newEntries;
+
+    for (const HandleTemporalPair& pair : pairs) {
+        Handle h = pair.getHandle();
+        std::vector<TemporalId>& temporals = handleTemporals[h];
+        if (oldSizes.find(h) == oldSizes.end()) {
+            oldSizes[h] = temporals.size();
         }
-        if (matches) {
-            result = true;
-            DPRINTF("Matched!\n");
-            if (t != UNDEFINED_TEMPORAL && (criterion == PREVIOUS_BEFORE_START_OF || criterion == PREVIOUS_BEFORE_END_OF)) {
-                // discard previous result and get the new matching result.
-                previousTe = currentTe;
-                currentTe = currentTe->next;
-            } else {
-                UnorderedHandleSet* hs = temporalMap->get(currentTe->time);
-                hs->erase(h);
-                DPRINTF("H removed from handle set!\n");
-                if (hs->empty()) {
-                    DPRINTF("Handle set became empty!\n");
-                    temporalMap->remove(currentTe->time);
-                    delete hs;
-                    DPRINTF("Removed from temporalMap!\n");
-                    removeFromSortedEntries(*(currentTe->time));
-                    DPRINTF("Removed from sorted entries!\n");
-                    toBeDeleted.insert(currentTe->time);
-                }
-                TemporalEntry* tmpTe = currentTe;
-                currentTe = currentTe->next;
-
-                //remove from tailHandleMap
-                if (tailTe != NULL && tailTe == tmpTe) {
-                    tailHandleMap->remove(h);
-                }
-
-                te = TemporalEntry::remove(te, tmpTe->time);
-
-                DPRINTF("Removed from handleMap entries!\n");
-            }
-        } else {
-            DPRINTF("Not matched!\n");
-            currentTe = currentTe->next;
+        bool added;
+        TemporalId id = addTemporal(*(pair.getTemporal()), added);
+        if (added) {
+            newEntries.push_back(TemporalIndex::Entry(slots[id].time, id));
         }
+        temporals.push_back(id);
     }
-    if (previousTe) {
-        Temporal* previousTime = previousTe->time;
-        UnorderedHandleSet* hs = temporalMap->get(previousTime);
-        hs->erase(h);
-        DPRINTF("H removed from handle set!\n");
-        if (hs->empty()) {
-            DPRINTF("Handle set became empty!\n");
-            temporalMap->remove(previousTime);
-            delete hs;
-            DPRINTF("Removed from temporalMap!\n");
-            removeFromSortedEntries(*(previousTime));
-            DPRINTF("Removed from sorted entries!\n");
-            toBeDeleted.insert(previousTime);
+
+    if (newEntries.size() * BULK_INSERT_RATE > index.size()) {
+        index.bulkInsert(newEntries);
+    } else {
+        for (const TemporalIndex::Entry& entry : newEntries) {
+            index.insert(entry);
         }
-        te = TemporalEntry::remove(te, previousTime);
-        DPRINTF("Removed from handleMap entries! te=%p\n", te);
-    }
-    handleMap->remove(h);
-    DPRINTF("ThreadSafeHandleMap entries removed!\n");
-    if (te != NULL) {
-        DPRINTF("te not null -- ThreadSafeHandleMap entries will be reinserted!\n");
-        // Replace te in the handleMap
-        handleMap->add(h, te);
-        DPRINTF("ThreadSafeHandleMap entries reinserted!\n");
-    }
-    // If empty temporal list => already removed from handleMap
-    for (std::set<Temporal*>::iterator it = toBeDeleted.begin();
-            it != toBeDeleted.end(); ++it) {
-        delete *it;
     }
 
-    DPRINTF("TemporalTable::remove(Handle, Temporal) - end.\n");
+    auto less = [this](TemporalId id1, TemporalId id2) { return slots[id1].time.compareTo(&(slots[id2].time)) < 0; };
+    for (const std::pair<Handle, size_t>& oldSize : oldSizes) {
+        std::vector<TemporalId>& temporals = handleTemporals[oldSize.first];
+        std::vector<TemporalId>::iterator oldEnd = temporals.begin() + oldSize.second;
+        std::sort(oldEnd, temporals.end(), less);
+        // drop the duplicates, and the Temporal objects the handle already had
+        std::vector<TemporalId>::iterator newEnd = oldEnd;
+        for (std::vector<TemporalId>::iterator it = oldEnd; it != temporals.end(); ++it) {
+            if ((newEnd != oldEnd && *(newEnd - 1) == *it) ||
+                    std::binary_search(temporals.begin(), oldEnd, *it, less)) {
+                continue;
+            }
+            slots[*it].handles.push_back(oldSize.first);
+            *(newEnd++) = *it;
+        }
+        temporals.erase(newEnd, temporals.end());
+        std::inplace_merge(temporals.begin(), oldEnd, temporals.end(), less);
+    }
+}
 
-    return result;
+bool TemporalTable::getCriterionBounds(const Temporal& t, TemporalRelationship criterion,
+                                       octime_t& lowerMin, octime_t& lowerMax, octime_t& upperMin, octime_t& upperMax)
+{
+    octime_t l = t.getLowerBound();
+    octime_t u = t.getUpperBound();
+    lowerMin = upperMin = 0;
+    lowerMax = upperMax = OCTIME_MAX;
+    switch (criterion) {
+    case STARTS_BEFORE:
+        if (l == 0) return false;
+        lowerMax = l - 1;
+        break;
+    case STARTS_WITHIN:
+        lowerMin = l;
+        lowerMax = u;
+        break;
+    case STARTS_AFTER:
+        if (u == OCTIME_MAX) return false;
+        lowerMin = u + 1;
+        break;
+    case ENDS_BEFORE:
+        if (l == 0) return false;
+        // and so does its lower bound
+        lowerMax = upperMax = l - 1;
+        break;
+    case ENDS_WITHIN:
+        lowerMax = u;
+        upperMin = l;
+        upperMax = u;
+        break;
+    case ENDS_AFTER:
+        if (u == OCTIME_MAX) return false;
+        upperMin = u + 1;
+        break;
+    case OVERLAPS:
+        lowerMax = u;
+        upperMin = l;
+        break;
+    case INCLUDES:
+        lowerMax = l;
+        upperMin = u;
+        break;
+    default:
+        throw RuntimeException(TRACE_INFO,
+                               "Operation is not implemented yet: '%s'.", getTemporalRelationshipStr(criterion));
+    }
+    return true;
 }
 
-bool TemporalTable::remove(const Temporal& t, TemporalRelationship criterion)
+void TemporalTable::getTemporals(const Temporal& t, TemporalRelationship criterion, std::vector<TemporalId>& result) const
 {
-    bool result = false;
-    DPRINTF("TemporalTable::remove(%s, %d)\n", t.toString().c_str(), criterion);
-    if (t == UNDEFINED_TEMPORAL) {
-        // remove all entries
-        TemporalEntry* te = sortedTemporalList;
-        result = (te != NULL);
-        while (te != NULL) {
-            Temporal* time = te->time;
-            te = te->next;
-            remove(*time); // TODO: Make this removal better, if performance is an issue.
+    const TemporalIndex::Entry* entry = NULL;
+    switch (criterion) {
+    case EXACT: {
+        std::unordered_map<Temporal, TemporalId, TemporalHash>::const_iterator it = temporalIds.find(t);
+        if (it != temporalIds.end()) {
+            result.push_back(it->second);
         }
-    } else {
-        switch (criterion) {
-        case EXACT: {
-            DPRINTF("ExactMatch!\n");
-            Temporal* internal_t = temporalMap->getKey(t);
-            if (internal_t) {
-                result = true;
-                UnorderedHandleSet* hs = temporalMap->remove(internal_t);
-                DPRINTF("Got hs = %p\n", hs);
-                UnorderedHandleSet::iterator itr = hs->begin();
-                DPRINTF("Got hs iterator = %ld\n", itr->value());
-                while (itr != hs->end()) {
-                    DPRINTF("hs iterator has next\n");
-                    Handle handle = *itr;
-                    ++itr;
-                    DPRINTF("Got handle = %ld\n", handle.value());
-                    TemporalEntry* te = handleMap->remove(handle);
-                    TemporalEntry* tailTe = tailHandleMap->get(handle);
-                    //remove from tailHandleMap
-                    if (tailTe != NULL && tailTe == te) {
-                        tailHandleMap->remove(handle);
-                    }
-
-                    te = TemporalEntry::remove(te, internal_t);
-                    if (te != NULL) {
-                        handleMap->add(handle, te);
-                    }
-                }
-                DPRINTF("hs iteration finished\n");
-                delete hs;
-                removeFromSortedEntries(t);
-                delete internal_t;
-            }
-            break;
-        } // EXACT
-        case OVERLAPS: {
-            if (sortedTemporalList != NULL) {
-                DPRINTF("Non ExactMatch!\n");
-                // Get all Temporal entries that overlaps the given time interval of t
-                // => all Temporal time where (time->lowerBound <= t.upperBound) && (time->upperBound >= t.lowerBound)
-
-                // Eliminates the linear lower bound tests in the beggining of the list
-                // by using binary search to find the upper limit in the list.
-                TemporalEntry* upperLimitEntry = getPreviousTemporalEntry(t);
-                if (upperLimitEntry == NULL) {
-                    upperLimitEntry = sortedTemporalList;
-                }
-                // Now iterates on the list until finds the upper limit
-                while (upperLimitEntry != NULL) {
-                    DPRINTF("Checking lowerBound of %s ...", upperLimitEntry->time->toString().c_str());
-                    DPRINTF(" (upperBound of t = %ld) ", t.getUpperBound());
-                    if (upperLimitEntry->time->getLowerBound() > t.getUpperBound()) {
-                        DPRINTF("failed\n");
-                        break;
-                    }
-                    DPRINTF("ok\n");
-                    upperLimitEntry = upperLimitEntry->next;
-                }
-                // Here, we know that all entries from the beggining to the upperLimitEntry satisfy (time->lowerBound <= t.upperBound).
-                // Now, check (time->upperBound >= t.lowerBound) for each one of such entries
-                TemporalEntry* currentEntry = sortedTemporalList;
-                while (currentEntry != upperLimitEntry) {
-                    // Check if current entry matches the interval by checking the upperBound of each entry.
-                    if (currentEntry->time->getUpperBound() >= t.getLowerBound()) {
-                        result = true;
-                        // Matched! Gets the time to be removed.
-                        Temporal* time = currentEntry->time;
-                        // Gets the next time entry to check before removing the current one
-                        currentEntry = currentEntry->next;
-                        // Removes the matched time using this same method, but with exact match
-                        remove(*time); // TODO: Make this removal better, if performance is an issue.
-                    } else {
-                        currentEntry = currentEntry->next;
-                    }
-                }
-            }
-            break;
-        } // OVERLAPS
-        case INCLUDES:
-        default: {
-            TemporalEntry* te = sortedTemporalList;
-            DPRINTF("Default: te = %s\n", te->toString().c_str());
-            bool searchFinished = false;
-            Temporal* previousTime = NULL;
-            while (te != NULL && !searchFinished) {
-                // Check if Temporal matches
-                Temporal* time = te->time;
-                te = te->next;
-                bool matches = matchesTimeCriterion(*time, t, criterion, searchFinished);
-                if (matches) {
-                    result = true;
-                    if (criterion == PREVIOUS_BEFORE_START_OF || criterion == PREVIOUS_BEFORE_END_OF) {
-                        previousTime = time;
-                    } else {
-                        remove(*time); // TODO: Make this removal better, if performance is an issue.
-                        DPRINTF("After removal: te = %s\n", te->toString().c_str());
-                    }
-                }
-            }
-            if (previousTime) {
-                remove(*previousTime); // TODO: Make this removal better, if performance is an issue.
-            }
-            break;
+        return;
+    }
+    case NEXT_AFTER_START_OF:
+        entry = index.firstLowerAbove(t.getLowerBound());
+        break;
+    case NEXT_AFTER_END_OF:
+        entry = index.firstLowerAbove(t.getUpperBound());
+        break;
+    case PREVIOUS_BEFORE_START_OF:
+        entry = index.lastLowerBelow(t.getLowerBound());
+        break;
+    case PREVIOUS_BEFORE_END_OF:
+        entry = index.lastLowerBelow(t.getUpperBound());
+        break;
+    default: {
+        octime_t lowerMin, lowerMax, upperMin, upperMax;
+        if (getCriterionBounds(t, criterion, lowerMin, lowerMax, upperMin, upperMax)) {
+            index.visit(lowerMin, lowerMax, upperMin, upperMax,
+                        [&result](const TemporalIndex::Entry& e) { result.push_back(e.id); });
         }
-        } // switch (criterion)
+        return;
+    }
+    }
+    if (entry) {
+        result.push_back(entry->id);
     }
-    
-    DPRINTF("TemporalTable::remove(Temporal) - end.\n");
-
-    return result;
 }
 
-void TemporalTable::removeFromSortedEntries(const Temporal& t)
+void TemporalTable::getTemporals(const std::vector<TemporalId>& temporals, const Temporal& t,
+                                 TemporalRelationship criterion, std::vector<TemporalId>& result) const
 {
-    DPRINTF("TemporalTable::removeFromSortedEntries(%s)\n", t.toString().c_str());
-    // First check if corresponding te is in the index table
-    int pos = getTemporalIndexTablePos(t);
-    DPRINTF("Index table pos = %d!\n", pos);
-    if (pos >= 0 && TemporalEntry::compare(temporalIndexTable[pos]->time, &t) == 0) {
-        TemporalEntry* entry = temporalIndexTable[pos];
-        DPRINTF("Temporal t found in index!\n");
-        if (entry->next != NULL) {
-            // TODO: THIS IS VERY BAD WHEN REMOVING TEMPORAL OBJECTS IN CRONOLOGICAL ASCENDENT ORDER: EACH REMOVAL ONE MORE REPLACEMENT IS NEEDED.
-            DPRINTF("TemporalEntry has next => replace all its ocurrences by the its next in index table!\n");
-            pos = replaceIndexTablePosition(pos, entry->next);
-        } else {
-            DPRINTF("TemporalEntry has no next => So, just remove all positions with this entry from the index!\n");
-            // Look backward for this entry
-            pos--;
-            while (pos >= 0 && temporalIndexTable[pos] == entry) {
-                pos--;
-            }
-            indexTableCount = pos + 1;
-            DPRINTF("indexTableCount = pos+1 => %d\n", indexTableCount);
+    auto lowerLess = [this](TemporalId id, octime_t lower) { return slots[id].time.getLowerBound() < lower; };
+    std::vector<TemporalId>::const_iterator it;
+    switch (criterion) {
+    case EXACT:
+        it = std::lower_bound(temporals.begin(), temporals.end(), t,
+            [this](TemporalId id, const Temporal& time) { return slots[id].time.compareTo(&time) < 0; });
+        if (it != temporals.end() && slots[*it].time == t) {
+            result.push_back(*it);
+        }
+        return;
+    case NEXT_AFTER_START_OF:
+    case NEXT_AFTER_END_OF: {
+        octime_t bound = (criterion == NEXT_AFTER_START_OF) ? t.getLowerBound() : t.getUpperBound();
+        if (bound == OCTIME_MAX) return;
+        it = std::lower_bound(temporals.begin(), temporals.end(), bound + 1, lowerLess);
+        if (it != temporals.end()) {
+            result.push_back(*it);
         }
+        return;
     }
-    DPRINTF("Previous pos = %d!\n", pos);
-    // Now removes the entry from the linked list
-    TemporalEntry* previousTe;
-    TemporalEntry* currentTe;
-    if (pos < 0) {
-        previousTe = NULL;
-        currentTe = sortedTemporalList;
-    } else {
-        previousTe = temporalIndexTable[pos];
-        currentTe = previousTe->next;
-    }
-    DPRINTF("Looking for TemporalEntry to be removed in %s!\n", currentTe->toString().c_str());
-    while (currentTe != NULL) {
-        int compare = TemporalEntry::compare(currentTe->time, &t);
-        if (compare == 0) {
-            DPRINTF("Found TemporalEntry to be removed!\n");
-            // Found the point to remove
-            if (previousTe != NULL) {
-                DPRINTF("Has previous entry. Just update its next!\n");
-                previousTe->next = currentTe->next;
-            } else {
-                DPRINTF("Has no previous entry. Update sorted list!\n");
-                sortedTemporalList = currentTe->next;
-            }
-            currentTe->next = NULL;
-            DPRINTF("TemporalEntry removed!\n");
-            break;
-        } else if (compare > 0) {
-            DPRINTF("TemporalEntry not found!\n");
-            // Not found
-            return;
+    case PREVIOUS_BEFORE_START_OF:
+    case PREVIOUS_BEFORE_END_OF: {
+        octime_t bound = (criterion == PREVIOUS_BEFORE_START_OF) ? t.getLowerBound() : t.getUpperBound();
+        it = std::lower_bound(temporals.begin(), temporals.end(), bound, lowerLess);
+        if (it != temporals.begin()) {
+            result.push_back(*(it - 1));
         }
-        previousTe = currentTe;
-        currentTe = currentTe->next;
-    }
-    // Check if it was really removed.
-    if (currentTe != NULL) {
-        if ((indexTableCount > 0) && (currentTe == temporalIndexTable[indexTableCount-1])) {
-            indexTableCount--;
-            DPRINTF("indexTableCount-- => %d\n", indexTableCount);
-        } else {
-            pendingUpdateCount++;
-            int numTemporalEntries = temporalMap->getCount();
-            int pendingRate = (numTemporalEntries / pendingUpdateCount);
-            if (pendingRate < PENDING_UPDATE_RATE_THRESHOLD) {
-                updateIndexTable(numTemporalEntries);
+        return;
+    }
+    default: {
+        octime_t lowerMin, lowerMax, upperMin, upperMax;
+        if (!getCriterionBounds(t, criterion, lowerMin, lowerMax, upperMin, upperMax)) return;
+        for (it = std::lower_bound(temporals.begin(), temporals.end(), lowerMin, lowerLess);
+                it != temporals.end() && slots[*it].time.getLowerBound() <= lowerMax; ++it) {
+            octime_t upper = slots[*it].time.getUpperBound();
+            if (upper >= upperMin && upper <= upperMax) {
+                result.push_back(*it);
             }
         }
-        delete currentTe;
+        return;
+    }
     }
-    DPRINTF("TemporalTable::removeFromSortedEntries - end.\n");
 }
 
-int TemporalTable::replaceIndexTablePosition(int pos, TemporalEntry* newEntry)
+HandleTemporalPairEntry* TemporalTable::get(Handle h, const Temporal& t, TemporalRelationship criterion) const
 {
-    DPRINTF("TemporalTable::replaceIndexTablePosition - init.\n");
-
-    TemporalEntry* oldEntry = temporalIndexTable[pos];
-    temporalIndexTable[pos] = newEntry;
-    // Propagates replacement forward
-    int fPos = pos + 1;
-    while (fPos < indexTableCount && TemporalEntry::compare(oldEntry->time, temporalIndexTable[fPos]->time) == 0) {
-        temporalIndexTable[fPos] = newEntry;
-        fPos++;
+    if (h == Handle::UNDEFINED) {
+        return get(t, criterion);
     }
-    // Propagates replacement backward
-    int bPos = pos - 1;
-    while (bPos >= 0 && TemporalEntry::compare(oldEntry->time, temporalIndexTable[bPos]->time) == 0) {
-        temporalIndexTable[bPos] = newEntry;
-        bPos--;
+    std::unordered_map<Handle, std::vector<TemporalId>, handle_hash>::const_iterator it = handleTemporals.find(h);
+    if (it == handleTemporals.end()) {
+        return NULL;
     }
 
-    DPRINTF("TemporalTable::replaceIndexTablePosition - end.\n");
-    return bPos;
-}
-
-void TemporalTable::addToMaps(Handle h, Temporal* t)
-{
-    DPRINTF("TemporalTable::addToMaps - init.\n");
-
-    // Add to handleMap
-    TemporalEntry* timeEntry;
-    if (handleMap->contains(h)) {
-        timeEntry = handleMap->remove(h);
+    std::vector<TemporalId> matched;
+    const std::vector<TemporalId>* temporals = &matched;
+    if (t == UNDEFINED_TEMPORAL) {
+        temporals = &(it->second);
     } else {
-        timeEntry = NULL;
-    }
-    //search in tail handle map
-    TemporalEntry* tailTimeEntry = NULL;
-    if (tailHandleMap->contains(h)) {
-        tailTimeEntry = tailHandleMap->remove(h);
-        if (TemporalEntry::compare(t, tailTimeEntry->time) > 0) {
-            DPRINTF("TemporalTable::addToMaps - using tail.\n");
-            TemporalEntry::add(tailTimeEntry, t);
-            tailTimeEntry = tailTimeEntry->last();
+        getTemporals(it->second, t, criterion, matched);
+    }
+
+    HandleTemporalPairEntry* result = NULL;
+    HandleTemporalPairEntry* tail = NULL;
+    for (TemporalId id : *temporals) {
+        // the result points to the internal Temporal object (Temporal argument cannot be used in the result)
+        HandleTemporalPairEntry* hte = new HandleTemporalPairEntry(h, const_cast<Temporal*>(&(slots[id].time)));
+        if (result == NULL) {
+            result = hte;
         } else {
-            timeEntry = TemporalEntry::add(timeEntry, t);
+            tail->next = hte;
         }
-    } else {
-        DPRINTF("TemporalTable::addToMaps - set tail.\n");
-        timeEntry = TemporalEntry::add(timeEntry, t);
-        tailTimeEntry = timeEntry->last();
+        tail = hte;
     }
+    return result;
+}
 
-    handleMap->add(h, timeEntry);
-    tailHandleMap->add(h, tailTimeEntry);
-
+HandleTemporalPairEntry* TemporalTable::get(const Temporal& t, TemporalRelationship criterion) const
+{
+    HandleTemporalPairEntry* result = NULL;
+    HandleTemporalPairEntry* tail = NULL;
+    auto addSlot = [this, &result, &tail](TemporalId id) {
+        const TemporalSlot& slot = slots[id];
+        for (const Handle& h : slot.handles) {
+            HandleTemporalPairEntry* hte = new HandleTemporalPairEntry(h, const_cast<Temporal*>(&(slot.time)));
+            if (result == NULL) {
+                result = hte;
+            } else {
+                tail->next = hte;
+            }
+            tail = hte;
+        }
+    };
 
-    // Add to temporalMap
-    UnorderedHandleSet* handleSet;
-    if (temporalMap->contains(t)) {
-        handleSet = temporalMap->remove(t);
+    if (t == UNDEFINED_TEMPORAL) {
+        // get all entries
+        index.visit(0, OCTIME_MAX, 0, OCTIME_MAX, [&addSlot](const TemporalIndex::Entry& e) { addSlot(e.id); });
     } else {
-        handleSet = new UnorderedHandleSet();
+        std::vector<TemporalId> matched;
+        getTemporals(t, criterion, matched);
+        for (TemporalId id : matched) {
+            addSlot(id);
+        }
     }
-    handleSet->insert(h);
-    temporalMap->add(t, handleSet);
-
-    DPRINTF("TemporalTable::addToMaps - end.\n");
+    return result;
 }
 
-void TemporalTable::updateIndexTable(int numEntries)
+bool TemporalTable::remove(Handle h, const Temporal& t, TemporalRelationship criterion)
 {
-    DPRINTF("TemporalTable::updateIndexTable(%d)\n", numEntries);
-    if ((numEntries > indexTableSize) || (numEntries < indexTableSize / 4)) {
-        // needs to allocate more memory or free unecessary memory
-        delete[](temporalIndexTable);
-        indexTableSize = numEntries * 2;
-        DPRINTF("indexTableSize => %d\n", indexTableSize);
-        temporalIndexTable = new TemporalEntry*[indexTableSize];
-    }
-    TemporalEntry* current = sortedTemporalList;
-    int i = 0;
-    while (current != NULL && i < numEntries) {
-        temporalIndexTable[i++] = current;
-        current = current->next;
-    }
-    indexTableCount = i;
-    DPRINTF("indexTableCount = i => %d\n", indexTableCount);
-    if (i != numEntries) {
-        logger().warn("WARN: Inconsistent sizes (sortedTemporalList => %d, numEntries => %d)\n", i, numEntries);
-    }
-    pendingUpdateCount = 0;
-    DPRINTF("TemporalTable::updateIndexTable - end.\n");
-}
+    if (h == Handle::UNDEFINED) {
+        return remove(t, criterion);
+    }
+    std::unordered_map<Handle, std::vector<TemporalId>, handle_hash>::iterator it = handleTemporals.find(h);
+    if (it == handleTemporals.end()) {
+        return false;
+    }
+    std::vector<TemporalId>& temporals = it->second;
 
+    if (t == UNDEFINED_TEMPORAL) {
+        for (TemporalId id : temporals) {
+            removeHandleTemporal(h, id);
+        }
+        handleTemporals.erase(it);
+        return true;
+    }
 
-int TemporalTable::getTemporalIndexTablePos(const Temporal& t) const
-{
-    DPRINTF("TemporalTable::getTemporalIndexTablePos - init.\n");
-
-    // Look up at index table, using binary search
-    int low = 0;
-    int up = indexTableCount - 1;
-    do {
-        int pos = (up + low) / 2;
-        DPRINTF("getTemporalIndexTablePos(): low = %d, up = %d, pos = %d\n", low, up, pos);
-        int compare = TemporalEntry::compare(temporalIndexTable[pos]->time, &t);
-        if (compare > 0) {
-            up = pos - 1;
-        } else if (compare < 0) {
-            low = pos + 1;
+    std::vector<TemporalId> matched;
+    getTemporals(temporals, t, criterion, matched);
+    if (matched.empty()) {
+        return false;
+    }
+    // matched is a subsequence of temporals
+    std::vector<TemporalId>::iterator kept = temporals.begin();
+    std::vector<TemporalId>::const_iterator next = matched.begin();
+    for (std::vector<TemporalId>::iterator tit = temporals.begin(); tit != temporals.end(); ++tit) {
+        if (next != matched.end() && *tit == *next) {
+            ++next;
         } else {
-            DPRINTF("getTemporalIndexTablePos(): key found!\n");
-            return pos;
+            *(kept++) = *tit;
         }
-    } while (low <= up);
-    DPRINTF("getTemporalIndexTablePos(): key not found!\n");
-    return up;
-}
-
-TemporalEntry* TemporalTable::getPreviousTemporalEntry(const Temporal& t) const
-{
-    DPRINTF("TemporalTable::getPreviousTemporalEntry init\n");
-
-    int pos = getTemporalIndexTablePos(t);
-    DPRINTF("Got pos = %d for Temporal %s\n", pos, t.toString().c_str());
-    if (pos >= 0 && TemporalEntry::compare(temporalIndexTable[pos]->time, &t) == 0) {
-        // key found. Get previous pos
-        pos--;
     }
-
-    DPRINTF("TemporalTable::getPreviousTemporalEntry end\n");
-    if (pos < 0) {
-        return NULL;
-    } else {
-        return temporalIndexTable[pos];
+    temporals.erase(kept, temporals.end());
+    if (temporals.empty()) {
+        handleTemporals.erase(it);
+    }
+    for (TemporalId id : matched) {
+        removeHandleTemporal(h, id);
     }
+    return true;
 }
 
-bool TemporalTable::matchesTimeCriterion(const Temporal& time, const Temporal& t, TemporalRelationship criterion, bool& searchFinished) const
+bool TemporalTable::remove(const Temporal& t, TemporalRelationship criterion)
 {
-    bool matches = false;
-    switch (criterion) {
-    case EXACT:
-        matches = (t == time);
-        if (matches) {
-            searchFinished = true;
-        }
-        break;
-    case OVERLAPS:
-        matches = (t.getLowerBound() <= time.getUpperBound()) && (t.getUpperBound() >= time.getLowerBound());
-        if (!matches && (time.getLowerBound() > t.getUpperBound())) {
-            searchFinished = true;
-        }
-        break;
-    case INCLUDES:
-        matches = (time.getLowerBound() <= t.getLowerBound()) && (time.getUpperBound() >= t.getUpperBound());
-        if (!matches && (time.getLowerBound() > t.getLowerBound())) {
-            searchFinished = true;
-        }
-        break;
-    case STARTS_BEFORE:
-        matches = (time.getLowerBound() < t.getLowerBound());
-        if (!matches && (time.getLowerBound() >= t.getLowerBound())) {
-            searchFinished = true;
-        }
-        break;
-    case STARTS_WITHIN:
-        matches = (time.getLowerBound() >= t.getLowerBound()) && (time.getLowerBound() <= t.getUpperBound());
-        if (!matches && (time.getLowerBound() > t.getUpperBound())) {
-            searchFinished = true;
-        }
-        break;
-    case STARTS_AFTER:
-        matches = (time.getLowerBound() > t.getUpperBound());
-        break;
-    case ENDS_BEFORE:
-        matches = (time.getUpperBound() < t.getLowerBound());
-        if (!matches && (time.getLowerBound() >= t.getLowerBound())) {
-            searchFinished = true;
-        }
-        break;
-    case ENDS_WITHIN:
-        matches = (time.getUpperBound() >= t.getLowerBound()) && (time.getUpperBound() <= t.getUpperBound());
-        if (!matches && (time.getLowerBound() > t.getUpperBound())) {
-            searchFinished = true;
-        }
-        break;
-    case ENDS_AFTER:
-        matches = (time.getUpperBound() > t.getUpperBound());
-        break;
-    case NEXT_AFTER_START_OF:
-        matches =  (time.getLowerBound() > t.getLowerBound());
-        if (matches) {
-            searchFinished = true; // gets only the next
-        }
-        break;
-    case NEXT_AFTER_END_OF:
-        matches =  (time.getLowerBound() > t.getUpperBound());
-        if (matches) {
-            searchFinished = true; // gets only the next
-        }
-        break;
-    case PREVIOUS_BEFORE_START_OF:
-        matches =  (time.getLowerBound() < t.getLowerBound());
-        if (!matches) {
-            searchFinished = true; // gets only the previous
-        }
-        break;
-    case PREVIOUS_BEFORE_END_OF:
-        matches =  (time.getLowerBound() < t.getUpperBound());
-        if (!matches) {
-            searchFinished = true; // gets only the previous
+    if (t == UNDEFINED_TEMPORAL) {
+        // remove all entries
+        bool result = (index.size() > 0);
+        slots.clear();
+        freeSlots.clear();
+        temporalIds.clear();
+        handleTemporals.clear();
+        index.clear();
+        return result;
+    }
+
+    std::vector<TemporalId> matched;
+    getTemporals(t, criterion, matched);
+    auto less = [this](TemporalId id, const Temporal& time) { return slots[id].time.compareTo(&time) < 0; };
+    for (TemporalId id : matched) {
+        TemporalSlot& slot = slots[id];
+        for (const Handle& h : slot.handles) {
+            std::unordered_map<Handle, std::vector<TemporalId>, handle_hash>::iterator it = handleTemporals.find(h);
+            std::vector<TemporalId>& temporals = it->second;
+            temporals.erase(std::lower_bound(temporals.begin(), temporals.end(), slot.time, less));
+            if (temporals.empty()) {
+                handleTemporals.erase(it);
+            }
         }
-        break;
-    default:
-        throw RuntimeException(TRACE_INFO,
-                               "Operation is not implemented yet: '%s'.", getTemporalRelationshipStr(criterion));
-        break;
+        removeTemporal(id);
     }
-    return matches;
+    return !matched.empty();
 }
 
 
+
 const char* TemporalTable::getTemporalRelationshipStr(TemporalRelationship criterion)
 {
     switch (criterion) {
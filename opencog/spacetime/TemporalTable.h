@@ -26,9 +26,14 @@
 #ifndef _OPENCOG_TEMPORAL_TABLE_H
 #define _OPENCOG_TEMPORAL_TABLE_H
 
-#include <opencog/spacetime/HandleToTemporalEntryMap.h>
-#include <opencog/spacetime/TemporalToHandleSetMap.h>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include <opencog/atoms/base/Handle.h>
 #include <opencog/spacetime/HandleTemporalPairEntry.h>
+#include <opencog/spacetime/TemporalEntry.h>
+#include <opencog/spacetime/TemporalIndex.h>
 
 namespace opencog
 {
@@ -36,14 +41,13 @@ namespace opencog
  *  @{
  */
 
-class TemporalTableFile;
-
-// TODO: Depending on the use cases, this class would have a better performance
-// if we use a sortedTemporalList in inverse cronological order.
-// Or, if saving space is not required, we can even have 2 sortedTemporalLists.
+/**
+ * Each distinct Temporal object is stored once, with the handles associated to it,
+ * and indexed by a TemporalIndex for the lookups over all handles. Each handle has
+ * a vector of its Temporal objects, in the same order, for the lookups by handle.
+ */
 class TemporalTable
 {
-    friend class TemporalTableFile;
 
 public:
 
@@ -94,6 +98,13 @@ public:
      */
     void add(Handle, const Temporal&);
 
+    /**
+     * Adds into this TemporalTable all the given entries at once. This is much faster than
+     * adding them one by one when they are many compared to the entries already in the table,
+     * e.g., when loading a saved table.
+     */
+    void add(const std::vector<HandleTemporalPair>&);
+
     /**
      * Gets a list of HandleTemporalPair objects given an Atom Handle.
      * If the passed Handle object is Handle::UNDEFINED, it matches any Handle.
@@ -145,25 +156,40 @@ public:
 
 private:
 
-    HandleToTemporalEntryMap* handleMap;
-    HandleToTemporalEntryMap* tailHandleMap;
-    TemporalToHandleSetMap* temporalMap;
-
-    TemporalEntry* sortedTemporalList;
-    TemporalEntry** temporalIndexTable;
-    int indexTableSize;
-    int indexTableCount;
-    int pendingUpdateCount;
-
-    void addToMaps(Handle h, Temporal* t);
-    void updateIndexTable(int numEntries);
-    int getTemporalIndexTablePos(const Temporal&) const;
-    int replaceIndexTablePosition(int pos, TemporalEntry* newEntry);
-    TemporalEntry* getPreviousTemporalEntry(const Temporal&) const;
-    void removeFromSortedEntries(const Temporal& t);
+    struct TemporalSlot {
+        Temporal time;
+        std::vector<Handle> handles;
+
+        TemporalSlot(const Temporal& t) : time(t) {}
+    };
+
+    struct TemporalHash {
+        size_t operator()(const Temporal& t) const {
+            size_t seed = boost::hash<octime_t>()(t.getA());
+            boost::hash_combine(seed, t.getB());
+            return seed;
+        }
+    };
+
+    // the distinct Temporal objects, at stable addresses since the results point to them
+    std::deque<TemporalSlot> slots;
+    std::vector<TemporalId> freeSlots;
+    std::unordered_map<Temporal, TemporalId, TemporalHash> temporalIds;
+
+    // the Temporal objects of each handle, sorted as in the index
+    std::unordered_map<Handle, std::vector<TemporalId>, handle_hash> handleTemporals;
+
+    TemporalIndex index;
+
+    TemporalId addTemporal(const Temporal&, bool& added);
+    void removeTemporal(TemporalId);
+    void removeHandleTemporal(Handle, TemporalId);
+    void getTemporals(const Temporal&, TemporalRelationship, std::vector<TemporalId>&) const;
+    void getTemporals(const std::vector<TemporalId>&, const Temporal&, TemporalRelationship, std::vector<TemporalId>&) const;
+    static bool getCriterionBounds(const Temporal&, TemporalRelationship,
+                                   octime_t& lowerMin, octime_t& lowerMax, octime_t& upperMin, octime_t& upperMax);
     HandleTemporalPairEntry* get(const Temporal& t, TemporalRelationship criterion = EXACT) const;
     bool remove(const Temporal& t, TemporalRelationship criterion = EXACT);
-    bool matchesTimeCriterion(const Temporal& time, const Temporal& t, TemporalRelationship criterion, bool& searchFinished) const;
 
 };
 
@@ -74,6 +74,39 @@ TimeServer::~TimeServer()
     removedAtomConnection.disconnect();
 }
 
+TimeServer::TimeDomainShardPtr TimeServer::getShard(const TimeDomain& timeDomain) const
+{
+    boost::shared_lock<boost::shared_mutex> lock(domains_mutex);
+    auto temporalTableIter = temporalTableMap.find(timeDomain);
+    if (temporalTableIter == temporalTableMap.end()) {
+        return TimeDomainShardPtr();
+    }
+    return temporalTableIter->second;
+}
+
+TimeServer::TimeDomainShardPtr TimeServer::getOrCreateShard(const TimeDomain& timeDomain)
+{
+    TimeDomainShardPtr shard = getShard(timeDomain);
+    if (shard) {
+        return shard;
+    }
+
+    boost::unique_lock<boost::shared_mutex> lock(domains_mutex);
+    TimeDomainShardPtr& newShard = temporalTableMap[timeDomain];
+    if (!newShard) {
+        newShard = std::make_shared<TimeDomainShard>();
+    }
+    return newShard;
+}
+
+void TimeServer::updateLatestTimestamp(octime_t timestamp)
+{
+    octime_t latest = latestTimestamp.load();
+    while (timestamp > latest &&
+           !latestTimestamp.compare_exchange_weak(latest, timestamp)) {
+    }
+}
+
 void TimeServer::add(Handle h, const Temporal& t, const TimeDomain& timeDomain)
 {
     // USED TO SEEK MEMORY LEAK
@@ -84,32 +117,52 @@ void TimeServer::add(Handle h, const Temporal& t, const TimeDomain& timeDomain)
     //   temporalSet.insert(t);
     //   cout << "Total unique entrys: " << temporalSet.size() << endl;
     //
-    std::unique_lock<std::mutex> lock(ts_mutex);
+    TimeDomainShardPtr shard = getOrCreateShard(timeDomain);
+    {
+        boost::unique_lock<boost::shared_mutex> lock(shard->lock);
+        shard->table.add(h, t);
+    }
 
-    temporalTableMap[timeDomain].add(h,t);
+    updateLatestTimestamp(t.getUpperBound());
+}
 
-    if (t.getUpperBound() > latestTimestamp) {
-        latestTimestamp = t.getUpperBound();
+void TimeServer::add(const std::vector<HandleTemporalPair>& pairs, const TimeDomain& timeDomain)
+{
+    if (pairs.empty()) {
+        return;
     }
 
+    octime_t latest = 0;
+    for (const HandleTemporalPair& pair : pairs) {
+        if (pair.getTemporal()->getUpperBound() > latest) {
+            latest = pair.getTemporal()->getUpperBound();
+        }
+    }
+
+    TimeDomainShardPtr shard = getOrCreateShard(timeDomain);
+    {
+        boost::unique_lock<boost::shared_mutex> lock(shard->lock);
+        shard->table.add(pairs);
+    }
+
+    updateLatestTimestamp(latest);
 }
 
 bool TimeServer::remove(Handle h, const Temporal& t, TemporalTable::TemporalRelationship criterion, const TimeDomain& timeDomain)
 {
-    auto temporalTableIter = temporalTableMap.find(timeDomain);
-    if (temporalTableIter == temporalTableMap.end()) {
+    TimeDomainShardPtr shard = getShard(timeDomain);
+    if (!shard) {
         logger().error("TimeServer::remove: timedomain %s not found\n", timeDomain.c_str());
         return false;
     }
-	
-    std::unique_lock<std::mutex> lock(ts_mutex);
-    return (temporalTableIter->second).remove(h, t, criterion);
+
+    boost::unique_lock<boost::shared_mutex> lock(shard->lock);
+    return shard->table.remove(h, t, criterion);
 }
 
 octime_t TimeServer::getLatestTimestamp() const
 {
-    std::unique_lock<std::mutex> lock(ts_mutex);
-    return latestTimestamp;
+    return latestTimestamp.load();
 }
 
 TimeServer& TimeServer::operator=(const TimeServer& other)
@@ -126,7 +179,7 @@ TimeServer::TimeServer(const TimeServer& other)
 
 void TimeServer::clear()
 {
-    std::unique_lock<std::mutex> lock(ts_mutex);
+    boost::unique_lock<boost::shared_mutex> lock(domains_mutex);
     temporalTableMap.clear();
     init();
 }
@@ -283,7 +336,8 @@ TimeDomain TimeServer::getTimeDomain() const
 vector<TimeDomain> TimeServer::getTimeDomains() const
 {
     vector<TimeDomain> result;
-    for (auto timeDomainTablePair : temporalTableMap) {
+    boost::shared_lock<boost::shared_mutex> lock(domains_mutex);
+    for (const auto& timeDomainTablePair : temporalTableMap) {
         result.push_back(timeDomainTablePair.first);
     }
     return result;
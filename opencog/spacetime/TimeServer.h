@@ -25,11 +25,14 @@
 #ifndef _OPENCOG_TIME_SERVER_H
 #define _OPENCOG_TIME_SERVER_H
 
-#include <mutex>
+#include <atomic>
+#include <memory>
 #include <set>
 #include <map>
 #include <string>
+#include <vector>
 #include <boost/signals2.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 #include <opencog/atomspace/AtomSpace.h>
 #include <opencog/spacetime/SpaceServer.h>
@@ -95,8 +98,27 @@ class TimeServer
     AtomSpace* atomspace;
     SpaceServer* spaceServer;
 
-    // TS-wide mutex, since add/remove atom signals are called from AtomSpace event-loop
-    mutable std::mutex ts_mutex;
+    /**
+     * The TemporalTable of a time domain, with its own lock. Lookups take it
+     * shared, so they never block each other, and only wait for the
+     * insertions and removals in the same time domain.
+     */
+    struct TimeDomainShard {
+        mutable boost::shared_mutex lock;
+        TemporalTable table;
+    };
+    typedef std::shared_ptr<TimeDomainShard> TimeDomainShardPtr;
+
+    // Guards temporalTableMap itself, not the tables. It is only taken
+    // exclusively when a time domain is added and by clear(); a reader keeps
+    // the shard it found alive after that.
+    mutable boost::shared_mutex domains_mutex;
+
+    /**
+     * @return the shard of the given time domain, or NULL if there is none.
+     */
+    TimeDomainShardPtr getShard(const TimeDomain& timeDomain) const;
+    TimeDomainShardPtr getOrCreateShard(const TimeDomain& timeDomain);
 
 public:
 
@@ -120,6 +142,13 @@ public:
      */
     void add(Handle h, const Temporal& t, const TimeDomain& timeDomain = DEFAULT_TIMEDOMAIN);
 
+    /**
+     * Adds many entries into the given time domain at once, e.g. all the
+     * timestamps of a perception frame, taking the lock of the time domain
+     * only once. The Temporal objects are copied.
+     */
+    void add(const std::vector<HandleTemporalPair>& pairs, const TimeDomain& timeDomain = DEFAULT_TIMEDOMAIN);
+
     /**
      * Gets a list of HandleTemporalPair objects given an Atom Handle and a time domain.
      * If the passed Handle object is Handle::UNDEFINED, it matches any Handle.
@@ -131,6 +160,9 @@ public:
      *
      * NOTE: The matched entries are appended to a container 
      * whose OutputIterator is passed as the first argument.
+     * The Temporal objects of the pairs belong to the TimeServer, and are only valid
+     * until their entries are removed from the time domain. When other threads may
+     * remove them, copy them (*pair.getTemporal()) rather than keeping the pointers.
      * Example of call to this method, which return all entries associated to time domain in TimeServer:
      *         std::list<HandleTemporalPair> ret;
      *         timeServer->get(back_inserter(ret), Handle::UNDEFINED, "game world");
@@ -141,20 +173,22 @@ public:
             TemporalTable::TemporalRelationship criterion = TemporalTable::EXACT,
             const TimeDomain& timeDomain = DEFAULT_TIMEDOMAIN) const {
 
-        auto temporalTableIter = temporalTableMap.find(timeDomain);        
-        if (temporalTableIter == temporalTableMap.end()) {
-            return outIt;            
+        TimeDomainShardPtr shard = getShard(timeDomain);
+        if (!shard) {
+            return outIt;
         }
 
-        std::unique_lock<std::mutex> lock(ts_mutex);
-        HandleTemporalPairEntry* hte = (temporalTableIter->second).get(h, t, criterion);
-        HandleTemporalPairEntry* toRemove = hte;
-
-        while (hte) {
-            *(outIt++) = hte->handleTemporalPair;
-            hte = hte->next;
+        HandleTemporalPairEntry* result;
+        {
+            // the entries point into the table, they are copied out before a writer
+            // can remove them
+            boost::shared_lock<boost::shared_mutex> lock(shard->lock);
+            result = shard->table.get(h, t, criterion);
+            for (HandleTemporalPairEntry* hte = result; hte; hte = hte->next) {
+                *(outIt++) = hte->handleTemporalPair;
+            }
         }
-        if (toRemove) delete toRemove;
+        if (result) delete result;
 
         return outIt;
     }
@@ -410,7 +444,7 @@ public:
     vector<TimeDomain> getTimeDomains() const;
     bool existTimeDomain(const TimeDomain timeDomain) const
     {
-        return temporalTableMap.find(timeDomain) != temporalTableMap.end();
+        return getShard(timeDomain) != nullptr;
     }
 
 private:
@@ -425,14 +459,16 @@ private:
     void atomRemoved(AtomPtr);
 
     /**
-     * The temporal table used by this TimeServer
+     * The temporal tables used by this TimeServer, one per time domain
      */
-    map<TimeDomain, TemporalTable> temporalTableMap;
+    map<TimeDomain, TimeDomainShardPtr> temporalTableMap;
 
     /**
      * The timestamp of the most recent upper bound of Temporal object already inserted into TimeServer.
      */
-    octime_t latestTimestamp;
+    std::atomic<octime_t> latestTimestamp;
+
+    void updateLatestTimestamp(octime_t timestamp);
 
     /**
      * Overrides and declares copy constructor and equals operator as private
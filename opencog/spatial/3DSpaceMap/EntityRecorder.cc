@@ -126,6 +126,36 @@ BlockVector EntityRecorder::getLastAppearedLocation(const Handle& entityHandle)
     }
 }
 
+const vector< pair<unsigned long, BlockVector> >&
+EntityRecorder::getLocationHistory(const Handle& entityHandle) const
+{
+    static const vector< pair<unsigned long, BlockVector> > noHistory;
+    auto it = mNoneBlockEntitieshistoryLocations.find(entityHandle);
+    return (it == mNoneBlockEntitieshistoryLocations.end()) ? noHistory : it->second;
+}
+
+void EntityRecorder::restoreEntity(const Handle& entityNode,
+                                   const vector< pair<unsigned long, BlockVector> >& history,
+                                   bool isRemoved, bool isSelfObject, bool isAvatarEntity)
+{
+    if (containsEntity(entityNode)) {
+        removeNoneBlockEntity(entityNode);
+    }
+    mNoneBlockEntitieshistoryLocations[entityNode] = history;
+    if (isSelfObject) {
+        mSelfAgentEntity = entityNode;
+    }
+    if (isAvatarEntity) {
+        mAllAvatarList.insert(entityNode);
+    } else {
+        mAllAvatarList.erase(entityNode);
+    }
+    if (!isRemoved && !history.empty()) {
+        mAllNoneBlockEntities.insert(entityNode);
+        mPosToNoneBlockEntityMap.insert(pair<BlockVector, Handle>(history.back().second, entityNode));
+    }
+}
+
 Handle EntityRecorder::getEntity(const BlockVector& pos) const
 {
     auto it = mPosToNoneBlockEntityMap.find(pos);
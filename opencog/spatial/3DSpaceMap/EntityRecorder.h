@@ -63,6 +63,27 @@ namespace opencog
                 return findAllEntities(out);
             }
 
+            // the entities with a location history, including the removed ones
+            template<typename Out>
+                Out findAllRecordedEntities(Out out) const
+            {
+                for (auto it = mNoneBlockEntitieshistoryLocations.begin();
+                     it != mNoneBlockEntitieshistoryLocations.end(); ++it) {
+                    *out++ = it->first;
+                }
+                return out;
+            }
+
+            // the (timestamp, location) history of the entity, empty if it
+            // has never been recorded
+            const vector< pair<unsigned long, BlockVector> >&
+                getLocationHistory(const Handle& entityHandle) const;
+            // put back an entity with its history, as it was recorded,
+            // e.g. when loading a snapshot of the scene
+            void restoreEntity(const Handle& entityNode,
+                               const vector< pair<unsigned long, BlockVector> >& history,
+                               bool isRemoved, bool isSelfObject, bool isAvatarEntity);
+
         private:
 
             Handle mSelfAgentEntity;
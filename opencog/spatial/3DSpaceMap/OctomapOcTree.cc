@@ -20,6 +20,60 @@ BlockVector point3dToBlockVector(point3d pos)
     return BlockVector(pos.x(), pos.y(), pos.z());
 }
 
+unsigned char VoxelLayer::get(const OcTreeKey& key, Property property) const
+{
+    auto it = mBricks.find(brickIndex(key));
+    if (it == mBricks.end()) {
+        return VALUE_UNKNOWN;
+    }
+    return (it->second[cellIndex(key)] >> property) & 3;
+}
+
+void VoxelLayer::set(const OcTreeKey& key, Property property, unsigned char value)
+{
+    auto it = mBricks.find(brickIndex(key));
+    if (it == mBricks.end()) {
+        if (value == VALUE_UNKNOWN) {
+            return;
+        }
+        it = mBricks.insert(make_pair(brickIndex(key),
+                                      vector<unsigned char>(1 << (3 * BRICK_BITS), 0))).first;
+    }
+    unsigned char& cell = it->second[cellIndex(key)];
+    cell = (cell & ~(3 << property)) | ((value & 3) << property);
+}
+
+void VoxelLayer::reset(const OcTreeKey& key)
+{
+    auto it = mBricks.find(brickIndex(key));
+    if (it != mBricks.end()) {
+        it->second[cellIndex(key)] = 0;
+    }
+}
+
+void VoxelLayer::resetAll(Property property)
+{
+    for (auto& brick : mBricks) {
+        for (unsigned char& cell : brick.second) {
+            cell &= ~(3 << property);
+        }
+    }
+}
+
+uint64_t VoxelLayer::brickIndex(const OcTreeKey& key)
+{
+    return ((uint64_t) (key[0] >> BRICK_BITS)) |
+           ((uint64_t) (key[1] >> BRICK_BITS) << 16) |
+           ((uint64_t) (key[2] >> BRICK_BITS) << 32);
+}
+
+unsigned VoxelLayer::cellIndex(const OcTreeKey& key)
+{
+    return (key[0] & BRICK_MASK) |
+           ((key[1] & BRICK_MASK) << BRICK_BITS) |
+           ((key[2] & BRICK_MASK) << (2 * BRICK_BITS));
+}
+
 void OctomapOcTreeNode::cloneNodeRecur(const OctomapOcTreeNode& rhs)
 {
     mblockHandle = rhs.mblockHandle;
@@ -61,6 +115,7 @@ OctomapOcTreeNode* OctomapOcTree::setNodeBlock(const point3d& pos, const Handle&
     if (n != NULL) {
         // add/remove record in atom->position map
         Handle oldBlock = n->getBlock();
+        std::lock_guard<std::mutex> lock(mBlocksMapLock);
         if (oldBlock == Handle::UNDEFINED && block != Handle::UNDEFINED) {
             mTotalUnitBlockNum++;
             mAllUnitAtomsToBlocksMap.insert(pair<Handle, BlockVector>(block, point3dToBlockVector(pos)));
@@ -71,6 +126,7 @@ OctomapOcTreeNode* OctomapOcTree::setNodeBlock(const point3d& pos, const Handle&
 
         n->setBlock(block);
     }
+    invalidateVoxel(point3dToBlockVector(pos));
 
     return n;
 }
@@ -91,6 +147,114 @@ Handle OctomapOcTree::getBlock(const BlockVector& pos, const float logOddsOccupa
     }
 }
 
+bool OctomapOcTree::isOccupied(const BlockVector& pos) const
+{
+    OcTreeKey key;
+    if (!coordToKeyChecked(pos.x, pos.y, pos.z, key)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mVoxelLayerLock);
+    VoxelLayer& layer = voxelLayer();
+    unsigned char occupied = layer.get(key, VoxelLayer::OCCUPIED);
+    if (occupied == VoxelLayer::VALUE_UNKNOWN) {
+        OctomapOcTreeNode* blocknode = this->search(key);
+        bool hasBlock = (blocknode != NULL &&
+                         blocknode->getLogOdds() >= occ_prob_thres_log &&
+                         blocknode->getBlock() != Handle::UNDEFINED);
+        occupied = hasBlock ? VoxelLayer::VALUE_TRUE : VoxelLayer::VALUE_FALSE;
+        layer.set(key, VoxelLayer::OCCUPIED, occupied);
+    }
+    return occupied == VoxelLayer::VALUE_TRUE;
+}
+
+bool OctomapOcTree::getCachedStandable(const BlockVector& pos, bool& standable) const
+{
+    OcTreeKey key;
+    if (!coordToKeyChecked(pos.x, pos.y, pos.z, key)) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mVoxelLayerLock);
+    unsigned char value = voxelLayer().get(key, VoxelLayer::STANDABLE);
+    if (value == VoxelLayer::VALUE_UNKNOWN) {
+        return false;
+    }
+    standable = (value == VoxelLayer::VALUE_TRUE);
+    return true;
+}
+
+void OctomapOcTree::setCachedStandable(const BlockVector& pos, bool standable) const
+{
+    OcTreeKey key;
+    if (coordToKeyChecked(pos.x, pos.y, pos.z, key)) {
+        std::lock_guard<std::mutex> lock(mVoxelLayerLock);
+        voxelLayer().set(key, VoxelLayer::STANDABLE,
+                         standable ? VoxelLayer::VALUE_TRUE : VoxelLayer::VALUE_FALSE);
+    }
+}
+
+OctomapOcTree::MaterialClass OctomapOcTree::getCachedMaterial(const BlockVector& pos) const
+{
+    OcTreeKey key;
+    if (!coordToKeyChecked(pos.x, pos.y, pos.z, key)) {
+        return MATERIAL_UNKNOWN;
+    }
+    std::lock_guard<std::mutex> lock(mVoxelLayerLock);
+    return MaterialClass(voxelLayer().get(key, VoxelLayer::MATERIAL));
+}
+
+void OctomapOcTree::setCachedMaterial(const BlockVector& pos, MaterialClass material) const
+{
+    OcTreeKey key;
+    if (coordToKeyChecked(pos.x, pos.y, pos.z, key)) {
+        std::lock_guard<std::mutex> lock(mVoxelLayerLock);
+        voxelLayer().set(key, VoxelLayer::MATERIAL, material);
+    }
+}
+
+void OctomapOcTree::invalidateBlockMaterial(const Handle& block)
+{
+    BlockVector pos;
+    {
+        std::lock_guard<std::mutex> lock(mBlocksMapLock);
+        auto it = mAllUnitAtomsToBlocksMap.find(block);
+        if (it == mAllUnitAtomsToBlocksMap.end()) {
+            return;
+        }
+        pos = it->second;
+    }
+    invalidateVoxel(pos);
+}
+
+VoxelLayer& OctomapOcTree::voxelLayer() const
+{
+    // everything cached was worked out with the old threshold
+    if (mVoxelLayerThresLog != occ_prob_thres_log) {
+        mVoxelLayer.clear();
+        mVoxelLayerThresLog = occ_prob_thres_log;
+    }
+    return mVoxelLayer;
+}
+
+void OctomapOcTree::invalidateVoxel(const BlockVector& pos)
+{
+    std::lock_guard<std::mutex> lock(mVoxelLayerLock);
+    OcTreeKey key;
+    if (coordToKeyChecked(pos.x, pos.y, pos.z, key)) {
+        mVoxelLayer.reset(key);
+    }
+    // the pos above stands on this block
+    if (coordToKeyChecked(pos.x, pos.y, pos.z + 1, key)) {
+        mVoxelLayer.set(key, VoxelLayer::STANDABLE, VoxelLayer::VALUE_UNKNOWN);
+    }
+    // and the pos below in the agent height need its room
+    for (int height = 1; height < mAgentHeight; height++) {
+        if (coordToKeyChecked(pos.x, pos.y, pos.z - height, key)) {
+            mVoxelLayer.set(key, VoxelLayer::STANDABLE, VoxelLayer::VALUE_UNKNOWN);
+        }
+    }
+}
 
 bool OctomapOcTree::checkIsOutOfRange(const BlockVector& pos) const
 {
@@ -120,7 +284,9 @@ bool OctomapOcTree::checkBlockInPos(const Handle& block,
 
 OctomapOcTree::OctomapOcTree(const std::string& mapName,const double resolution):
     OccupancyOcTreeBase<OctomapOcTreeNode>(resolution),
-    mMapName(mapName)
+    mMapName(mapName),
+    mTotalUnitBlockNum(0),
+    mVoxelLayerThresLog(occ_prob_thres_log)
 {
     //set default agent height as 1
     mAgentHeight = 1;
@@ -173,6 +339,12 @@ void OctomapOcTree::setUnitBlock(const Handle& block, BlockVector pos, float upd
     this->setNodeBlock(pos.x, pos.y, pos.z, block);
 }
 
+void OctomapOcTree::restoreUnitBlock(const Handle& block, BlockVector pos, float logOddsOccupancy)
+{
+    this->setNodeValue(pos.x, pos.y, pos.z, logOddsOccupancy);
+    this->setNodeBlock(pos.x, pos.y, pos.z, block);
+}
+
 BlockVector OctomapOcTree::getBlockLocation(const Handle& block) const
 {
     return getBlockLocation(block, this->getOccupancyThresLog());
@@ -200,7 +372,10 @@ OctomapOcTree::OctomapOcTree(const OctomapOcTree& rhs):
     OccupancyOcTreeBase <OctomapOcTreeNode>(rhs),
     mMapName(rhs.mMapName),
     mAgentHeight(rhs.mAgentHeight),
+    mTotalUnitBlockNum(rhs.mTotalUnitBlockNum),
     mAllUnitAtomsToBlocksMap(rhs.mAllUnitAtomsToBlocksMap)
 {
-
+    std::lock_guard<std::mutex> lock(rhs.mVoxelLayerLock);
+    mVoxelLayer = rhs.mVoxelLayer;
+    mVoxelLayerThresLog = rhs.mVoxelLayerThresLog;
 }
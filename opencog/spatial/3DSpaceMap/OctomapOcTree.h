@@ -45,7 +45,10 @@
 // If the occupancy log odds of node < thres, we regard it as freespace
 // else, It's a block in the space.
 
+#include <stdint.h>
 #include <map>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 #include <octomap/OcTreeNode.h>
 #include <octomap/OccupancyOcTreeBase.h>
@@ -101,7 +104,43 @@ namespace opencog
             Handle mblockHandle;
         };
 
+        // Cached properties of the voxels of a tree, two bits per property
+        // packed in one byte per key. The keys are grouped in bricks of
+        // 16x16x16 voxels allocated on first write, so that a region
+        // searched by the pathfinder takes a few contiguous pages.
+        // A property which has never been set (or has been reset) is 0.
+        class VoxelLayer
+        {
+        public:
+            // the shift of each property in the byte of a voxel
+            enum Property {OCCUPIED = 0, MATERIAL = 2, STANDABLE = 4};
+            enum {VALUE_UNKNOWN = 0, VALUE_TRUE = 1, VALUE_FALSE = 2};
+
+            unsigned char get(const OcTreeKey& key, Property property) const;
+            void set(const OcTreeKey& key, Property property, unsigned char value);
+            // forget all the properties of the voxel
+            void reset(const OcTreeKey& key);
+            // forget the given property of every voxel
+            void resetAll(Property property);
+            void clear() {mBricks.clear();}
+
+        private:
+            static const unsigned BRICK_BITS = 4;
+            static const unsigned BRICK_MASK = (1 << BRICK_BITS) - 1;
+
+            static uint64_t brickIndex(const OcTreeKey& key);
+            static unsigned cellIndex(const OcTreeKey& key);
+
+            std::unordered_map<uint64_t, vector<unsigned char> > mBricks;
+        };
+
         // tree definition
+        // The tree is not thread safe: the calls changing it (adding or
+        // removing blocks, setAgentHeight) must not run at the same time as
+        // any other call. The const queries may run at the same time as
+        // each other; the voxel layer they fill is guarded by its own lock.
+        // invalidateBlockMaterial may be called from any thread, as the
+        // AtomSpace signals do.
         class OctomapOcTree : public OccupancyOcTreeBase <OctomapOcTreeNode> {
 
         public:
@@ -119,9 +158,17 @@ namespace opencog
 
             inline string getMapName() const {return mMapName;}
             inline float getAgentHeight() const {return mAgentHeight;}
-            void setAgentHeight(float _height){ mAgentHeight = _height;}
+            // the standability of every pos depends on the agent height
+            void setAgentHeight(float _height)
+            {
+                mAgentHeight = _height;
+                std::lock_guard<std::mutex> lock(mVoxelLayerLock);
+                mVoxelLayer.resetAll(VoxelLayer::STANDABLE);
+            }
 
             inline int getTotalUnitBlockNum() const {return mTotalUnitBlockNum;}
+            // every block in the map with its position
+            inline const map<Handle, BlockVector>& getAllUnitBlocks() const {return mAllUnitAtomsToBlocksMap;}
 
             //binary add/remove operation
             void addSolidUnitBlock(const Handle& block, BlockVector pos);
@@ -131,6 +178,9 @@ namespace opencog
             //the updateLogOddsOccupancy will be added on the log odds occupancy of block to in/decrease the occupancy
             //probabilistic set occupancy, e.g. new occupied log
             void setUnitBlock(const Handle& block, BlockVector pos, float updateLogOddsOccupancy);
+            //set the block and the occupancy log odds in pos as they were recorded,
+            //e.g. when loading a snapshot of the map
+            void restoreUnitBlock(const Handle& block, BlockVector pos, float logOddsOccupancy);
 
             // binary
             BlockVector getBlockLocation(const Handle& block) const;
@@ -161,6 +211,28 @@ namespace opencog
             bool checkBlockInPos(const Handle& block, const BlockVector& pos, const float logOddsOccupancyThreshold) const;
 
 
+            // Material of a block as far as standing on it goes
+            enum MaterialClass {MATERIAL_UNKNOWN = 0, MATERIAL_SOLID, MATERIAL_LIQUID};
+
+            //  cached getBlock(pos) != Handle::UNDEFINED,
+            //  using occ_prob_thres_log as threshold; false out of range
+            bool isOccupied(const BlockVector& pos) const;
+
+            //  Cache of checkStandable, only valid for occ_prob_thres_log.
+            //  Adding or removing a block at, under or in the agent height
+            //  above a pos forgets its standability, so does setAgentHeight.
+            //  getCachedStandable returns false if pos is not cached yet.
+            bool getCachedStandable(const BlockVector& pos, bool& standable) const;
+            void setCachedStandable(const BlockVector& pos, bool standable) const;
+            //  Cache of the material class of the block in pos, forgotten
+            //  when the block is changed.
+            MaterialClass getCachedMaterial(const BlockVector& pos) const;
+            void setCachedMaterial(const BlockVector& pos, MaterialClass material) const;
+            //  The material predicates live in the AtomSpace, so the tree is
+            //  not told when they change: the SpaceServer calls this when a
+            //  material predicate of a block is added or removed.
+            void invalidateBlockMaterial(const Handle& block);
+
             // functions for save/load map in persist/, but haven't implemented yet. Keep it to make code compiled.
             void save(FILE* fp ){};
             void load(FILE* fp ){};
@@ -174,7 +246,7 @@ namespace opencog
              * ends up in the classIDMapping only once
              */
 
-        OctomapOcTree(double resolution): OccupancyOcTreeBase<OctomapOcTreeNode>(resolution){}
+        OctomapOcTree(double resolution): OccupancyOcTreeBase<OctomapOcTreeNode>(resolution), mTotalUnitBlockNum(0), mVoxelLayerThresLog(occ_prob_thres_log){}
             class StaticMemberInitializer{
             public:
                 StaticMemberInitializer() {
@@ -193,6 +265,23 @@ namespace opencog
             // Memory consuming: 50k blocks take about 10M RAM for one map
             // Time consuming: 2e-5 sec for 10k blocks; if using bindlink to get position cost 2e-3 sec
             map<Handle, BlockVector> mAllUnitAtomsToBlocksMap;
+            // guards the changes of mAllUnitAtomsToBlocksMap against
+            // invalidateBlockMaterial, the other readers never race them
+            std::mutex mBlocksMapLock;
+
+            // occupancy, material and standability of the voxels, filled
+            // lazily by the const queries
+            mutable VoxelLayer mVoxelLayer;
+            // the threshold the occupancy in mVoxelLayer was cached for
+            mutable float mVoxelLayerThresLog;
+            // guards mVoxelLayer and mVoxelLayerThresLog
+            mutable std::mutex mVoxelLayerLock;
+
+            // the voxel layer for the current threshold, with
+            // mVoxelLayerLock held
+            VoxelLayer& voxelLayer() const;
+            // forget the cached properties depending on the block in pos
+            void invalidateVoxel(const BlockVector& pos);
 
             // this constructor is only used for clone
             OctomapOcTree(const OctomapOcTree&);
@@ -22,8 +22,11 @@
  */
 
 
-#include <set>
-#include <map>
+#include <stdint.h>
+#include <chrono>
+#include <cmath>
+#include <queue>
+#include <unordered_map>
 #include <iterator>
 #include <algorithm>
 #include "SpaceMapUtil.h"
@@ -31,12 +34,58 @@
 using namespace opencog;
 using namespace opencog::spatial;
 
+// The positions are on the block grid, each coordinate in 21 bits
+#define GRID_KEY_OFFSET (1 << 20)
+
+static inline uint64_t gridKey(const BlockVector& pos)
+{
+    return ((uint64_t)(lround(pos.x) + GRID_KEY_OFFSET) << 42) |
+           ((uint64_t)(lround(pos.y) + GRID_KEY_OFFSET) << 21) |
+           (uint64_t)(lround(pos.z) + GRID_KEY_OFFSET);
+}
+
+struct AStar3DNode
+{
+    BlockVector pos;
+    double costFromBegin;
+    int parent;
+    bool closed;
+
+    AStar3DNode(const BlockVector& _pos, double _costFromBegin, int _parent) :
+        pos(_pos), costFromBegin(_costFromBegin), parent(_parent), closed(false) {}
+};
+
+struct AStar3DOpenEntry
+{
+    double estimatedCost;
+    double costFromBegin;
+    int node;
+
+    AStar3DOpenEntry(double _estimatedCost, double _costFromBegin, int _node) :
+        estimatedCost(_estimatedCost), costFromBegin(_costFromBegin), node(_node) {}
+
+    // the top of the heap is the lowest estimated cost, then the furthest from the begin
+    bool operator < (const AStar3DOpenEntry& other) const
+    {
+        if (estimatedCost != other.estimatedCost)
+            return estimatedCost > other.estimatedCost;
+        return costFromBegin < other.costFromBegin;
+    }
+};
+
+static void buildPath(const vector<AStar3DNode>& nodes, int node, vector<BlockVector>& path)
+{
+    path.clear();
+    for (; node != -1; node = nodes[node].parent)
+        path.push_back(nodes[node].pos);
+    std::reverse(path.begin(), path.end());
+}
+
 bool Pathfinder3D::AStar3DPathFinder(AtomSpace* atomSpace, OctomapOcTree *mapManager,  const BlockVector& begin, const BlockVector& target, vector<BlockVector>& path,
-                                     BlockVector& nearestPos, BlockVector& bestPos, bool getNearestPos, bool getBestPos, bool tryOptimal)
+                                     BlockVector& nearestPos, BlockVector& bestPos, bool getNearestPos, bool getBestPos,
+                                     unsigned int maxMilliseconds)
 {
     BlockVector end = target;
-    map<BlockVector,double> costMap;
-    map<BlockVector,double>::const_iterator itercost;
 
     float nearestDis = begin - target;
     float bestHeuristic = nearestDis * 1.41421356f;
@@ -44,38 +93,58 @@ bool Pathfinder3D::AStar3DPathFinder(AtomSpace* atomSpace, OctomapOcTree *mapMan
     bestPos = begin;
     bool nostandable = false;
 
-    // check if the begin and target pos standable first
-    if ((! checkStandable(*atomSpace, *mapManager, begin)) || (! checkStandable(*atomSpace, *mapManager, target)))
+    // check if the begin and target pos standable first; the standability
+    // of each pos is cached in the map, so it is only worked out from the
+    // blocks and their material once
+    if ((! checkStandable(*atomSpace, *mapManager, begin)) ||
+        (! checkStandable(*atomSpace, *mapManager, target)))
     {
         nostandable = true;
         if ((! getNearestPos) && (! getBestPos))
             return false;
     }
 
+    path.clear();
 
-    set<BlockVector> searchedList;
-    set<BlockVector>::const_iterator iter;
-    BlockVector curPos;
+    // all the pos reached so far, the open ones are in a binary heap, with lazy removal of the outdated entries
+    vector<AStar3DNode> nodes;
+    unordered_map<uint64_t, int> nodeIndex;
+    priority_queue<AStar3DOpenEntry> openList;
 
-    path.push_back(begin);
-    searchedList.insert(begin);
-    int pathfindingSteps = 0;
+    nodes.push_back(AStar3DNode(begin, 0.0, -1));
+    nodeIndex.insert(std::make_pair(gridKey(begin), 0));
+    openList.push(AStar3DOpenEntry(begin - end, 0.0, 0));
+    int nearestNode = 0;
 
-    bool is_found = false;
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    unsigned int expandedNum = 0;
+    bool timeout = false;
+    int foundNode = -1;
 
-    while(path.size() != 0)
+    while (! openList.empty())
     {
+        AStar3DOpenEntry entry = openList.top();
+        openList.pop();
+
+        if (nodes[entry.node].closed || (entry.costFromBegin > nodes[entry.node].costFromBegin))
+            continue;
+        nodes[entry.node].closed = true;
+
+        BlockVector lastPos = nodes[entry.node].pos;
+
         // successfully achieve the target
-        if (path.back() == end)
+        if (lastPos == end)
         {
-            is_found = true;
+            foundNode = entry.node;
             break;
         }
 
-        // Calculate 24 neighbour cost and then pick the lowest one.
-        double lowestCost = 999999.99;
-        BlockVector lowestCostPos;
-        double curCost;
+        if ((maxMilliseconds != 0) && ((++ expandedNum) % 64 == 0) &&
+            (std::chrono::steady_clock::now() - startTime > std::chrono::milliseconds(maxMilliseconds)))
+        {
+            timeout = true;
+            break;
+        }
 
         for (int i = -1; i < 2; i ++)
         {
@@ -87,100 +156,72 @@ bool Pathfinder3D::AStar3DPathFinder(AtomSpace* atomSpace, OctomapOcTree *mapMan
                     if ( (i == 0) && (j == 0))
                         continue;
 
-                    curPos.x = path.back().x + i;
-                    curPos.y = path.back().y + j;
-                    curPos.z = path.back().z + k;
+                    BlockVector curPos(lastPos.x + i, lastPos.y + j, lastPos.z + k);
+                    uint64_t key = gridKey(curPos);
 
-                    iter = searchedList.find(curPos);
-                    if (iter != searchedList.end())
-                    {
-                        // already searched!
+                    unordered_map<uint64_t, int>::const_iterator iter = nodeIndex.find(key);
+                    if ((iter != nodeIndex.end()) && nodes[iter->second].closed)
                         continue;
-                    }
 
-                    // check if standable
                     if (! checkStandable(*atomSpace, *mapManager, curPos))
-                    {
-                        searchedList.insert(curPos);
                         continue;
-                    }
-
 
-                    if ( ! checkNeighbourAccessable(mapManager,path.back() , i, j, k))
+                    if ( ! checkNeighbourAccessable(mapManager, lastPos, i, j, k))
                         continue;
 
-                    double costFromLastStep = 0.0;
-                    if (k == 1) // this pos is higher than last pos, have to cost more to jump up
-                        costFromLastStep = 0.2;
-                    else if (k == -1) // this pos is lower than last pos, have to cost more to jump down
-                        costFromLastStep = 0.1;
+                    double costFromBegin = entry.costFromBegin + calculateStepCost(i, j, k);
 
-                    itercost = costMap.find(curPos);
-                    if (itercost != costMap.end())
+                    int node;
+                    if (iter == nodeIndex.end())
                     {
-                        if ((double)(itercost->second) + costFromLastStep < lowestCost)
-                        {
-                            lowestCost = (double)(itercost->second) + costFromLastStep;
-                            lowestCostPos = curPos;
-                        }
+                        node = nodes.size();
+                        nodes.push_back(AStar3DNode(curPos, costFromBegin, entry.node));
+                        nodeIndex.insert(std::make_pair(key, node));
+
+                        float lastNearestDis = nearestDis;
+                        calculateCostByDistance(begin, end, curPos, nearestDis, nearestPos, bestHeuristic, bestPos);
+                        if (nearestDis < lastNearestDis)
+                            nearestNode = node;
                     }
-
-                    // calculate the cost of this pos
-                    curCost = calculateCostByDistance(begin, end, curPos,nearestDis,nearestPos,bestHeuristic,bestPos);
-
-                    pathfindingSteps++;
-                    costMap.insert(pair<BlockVector, int>(curPos,curCost));
-                    if (curCost + costFromLastStep < lowestCost)
+                    else
                     {
-                        lowestCost = curCost +costFromLastStep;
-                        lowestCostPos = curPos;
+                        node = iter->second;
+                        if (costFromBegin >= nodes[node].costFromBegin)
+                            continue;
+                        nodes[node].costFromBegin = costFromBegin;
+                        nodes[node].parent = entry.node;
                     }
+
+                    openList.push(AStar3DOpenEntry(costFromBegin + (curPos - end), costFromBegin, node));
                 }
             }
         }
-
-        // if the lowestCost still == 99999.99, it shows that all the neighbours have been searched and failed,
-        // so we should return to last step
-        if (lowestCost > 999999.0)
-        {
-            path.pop_back();
-        }
-        else
-        {
-            // add the lowestcost neighbour pos to the path
-            path.push_back(lowestCostPos);
-            searchedList.insert(lowestCostPos);
-
-        }
-
     }
 
-    if (! is_found)
+    if (foundNode == -1)
+    {
+        // the best partial path when running out of time
+        if (timeout)
+            buildPath(nodes, nearestNode, path);
         return false;
+    }
 
     if (nostandable)
         return false;
-    else if (tryOptimal)
-    {
-        // switch the start and end point
-        vector<BlockVector> inversePath;
-        BlockVector inearestPos,ibestPos;
-        AStar3DPathFinder(atomSpace, mapManager, target, begin, inversePath, inearestPos,ibestPos);
-        if (inversePath.size() < path.size())
-        {
-            path = inversePath;
-            std::reverse(path.begin(), path.end());
-
-        }
-
-    }
 
+    buildPath(nodes, foundNode, path);
     return true;
-
-
-
 }
 
+double Pathfinder3D::calculateStepCost(int i, int j, int k)
+{
+    double cost = sqrt((double)(i * i + j * j + k * k));
+    if (k == 1) // this pos is higher than last pos, have to cost more to jump up
+        cost += 0.2;
+    else if (k == -1) // this pos is lower than last pos, have to cost more to jump down
+        cost += 0.1;
+    return cost;
+}
 
 double Pathfinder3D::calculateCostByDistance(const BlockVector& begin, const BlockVector& target,  const BlockVector& pos,
                                              float& nearestDis,BlockVector& nearestPos, float& bestHeuristic, BlockVector& bestPos)
@@ -214,24 +255,21 @@ bool Pathfinder3D::checkNeighbourAccessable(OctomapOcTree *mapManager, BlockVect
             if (i != 0)
             {
                 BlockVector neighbour1(lastPos.x + i,lastPos.y,lastPos.z + h);
-                Handle neighbourblock1 = mapManager->getBlock(neighbour1);
-                if ( neighbourblock1 != Handle::UNDEFINED)
+                if (mapManager->isOccupied(neighbour1))
                     return false;
             }
 
             if (j != 0)
             {
                 BlockVector neighbour2(lastPos.x,lastPos.y + j,lastPos.z + h);
-                Handle neighbourblock2 = mapManager->getBlock(neighbour2);
-                if ( neighbourblock2 != Handle::UNDEFINED)
+                if (mapManager->isOccupied(neighbour2))
                     return false;
             }
 
             if ( (i != 0) && (j != 0))
             {
                 BlockVector neighbour3(lastPos.x + i,lastPos.y + j,lastPos.z + h);
-                Handle neighbourblock3 = mapManager->getBlock(neighbour3);
-                if ( neighbourblock3 != Handle::UNDEFINED)
+                if (mapManager->isOccupied(neighbour3))
                     return false;
             }
         }
@@ -248,8 +286,7 @@ bool Pathfinder3D::checkNeighbourAccessable(OctomapOcTree *mapManager, BlockVect
     //    FBG
     if (k == 1) // if  want to access higer position
     {
-        Handle block = mapManager->getBlock(BlockVector(lastPos.x,lastPos.y,lastPos.z + 1));
-        if ( block != Handle::UNDEFINED)
+        if (mapManager->isOccupied(BlockVector(lastPos.x,lastPos.y,lastPos.z + 1)))
             return false;
     }
 
@@ -259,13 +296,11 @@ bool Pathfinder3D::checkNeighbourAccessable(OctomapOcTree *mapManager, BlockVect
         for (int h = 0; h < mapManager->getAgentHeight(); h++)
         {
             BlockVector neighbour1(lastPos.x + i,lastPos.y,lastPos.z + h + k );
-            Handle neighbourblock1 = mapManager->getBlock(neighbour1);
-            if ( neighbourblock1 != Handle::UNDEFINED)
+            if (mapManager->isOccupied(neighbour1))
                 return false;
 
             BlockVector neighbour2(lastPos.x,lastPos.y + j,lastPos.z + h + k );
-            Handle neighbourblock2 = mapManager->getBlock(neighbour2);
-            if ( neighbourblock2 != Handle::UNDEFINED)
+            if (mapManager->isOccupied(neighbour2))
                 return false;
         }
 
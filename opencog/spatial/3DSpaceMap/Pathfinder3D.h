@@ -44,12 +44,20 @@ namespace opencog
         class Pathfinder3D
         {
         public:
+            // A* search over the standable positions of the map, moving to any of the 24 neighbours not just above or
+            // below. A step costs its length, plus 0.2 to jump up or 0.1 to jump down, and the heuristic is the
+            // straight distance to the target, so the path found is the cheapest one.
             // When getNearestPos is true,return the nearestPos as well, which would possibably useful when it cannot find a path,at least it find the nearest location to the target;
             // The bestPos is calculated by the A* heuristics which consider the cost of moving and the distance to the target, heuristic = (target - pos)*1.41421356f + (begin - pos)
+            // When maxMilliseconds is not 0, the search stops after that time, returning false with the path to the
+            // nearestPos found so far.
 static bool AStar3DPathFinder(AtomSpace* atomSpace, OctomapOcTree* mapManager, const BlockVector& begin, const BlockVector& target,
-                                          vector<BlockVector>& path, BlockVector& nearestPos,BlockVector& bestPos, bool getNearestPos = false, bool getBestPos = false, bool tryOptimal = false);
+                                          vector<BlockVector>& path, BlockVector& nearestPos,BlockVector& bestPos, bool getNearestPos = false, bool getBestPos = false,
+                                          unsigned int maxMilliseconds = 0);
             static double calculateCostByDistance(const BlockVector& begin,const BlockVector& target,const BlockVector& pos,float &nearestDis,BlockVector& nearestPos,float& bestHeuristic, BlockVector& bestPos);
             static bool checkNeighbourAccessable(OctomapOcTree *mapManager, BlockVector& lastPos, int i, int j, int k);
+            // the cost of moving from a pos to its neighbour at offset (i, j, k)
+            static double calculateStepCost(int i, int j, int k);
         };
     }
 /** @}*/
@@ -79,9 +79,26 @@ namespace opencog
                        pos.x,pos.y,pos.z);
                 return false;
             }
+            // the map only caches what it sees with its own threshold
+            bool useCache = (logOddsOccupancy == spaceMap.getOccupancyThresLog());
+            bool standable;
+            if (useCache && spaceMap.getCachedStandable(pos, standable)) {
+                return standable;
+            }
+            auto isOccupied = [&](const BlockVector& blockPos)
+            {
+                if (useCache) {
+                    return spaceMap.isOccupied(blockPos);
+                }
+                return spaceMap.getBlock(blockPos, logOddsOccupancy) != Handle::UNDEFINED;
+            };
+
+            standable = false;
             // check if there is any non-block obstacle in this pos
-            Handle blockHandle = spaceMap.getBlock(pos,logOddsOccupancy);
-            if (blockHandle != Handle::UNDEFINED) {
+            if (isOccupied(pos)) {
+                if (useCache) {
+                    spaceMap.setCachedStandable(pos, false);
+                }
                 return false;
             }
             // because the agent has a height,
@@ -90,33 +107,49 @@ namespace opencog
             if (agentHeight > 1) {
                 for (int height = 1; height < agentHeight; height ++) {
                     BlockVector blockAbove(pos.x, pos.y, pos.z + height);
-                    if (spaceMap.getBlock(blockAbove, logOddsOccupancy) != Handle::UNDEFINED) {
+                    if (isOccupied(blockAbove)) {
+                        if (useCache) {
+                            spaceMap.setCachedStandable(pos, false);
+                        }
                         return false;
                     }
                 }
             }
 
             BlockVector under(pos.x, pos.y, pos.z - 1);
-            Handle underBlock = spaceMap.getBlock(under, logOddsOccupancy);
-            if (underBlock != Handle::UNDEFINED) {
+            if (isOccupied(under)) {
                 //TODO:Judge if this block is standable
                 //if agent can't stand on it (ex.water/lava)return false
-                HandleSeq blocks;
-                blocks.push_back(underBlock);
-                vector<string> materialPredicates = getPredicate(atomSpace, "material", blocks, 1);
-                if (materialPredicates.empty()) {
-                    logger().error("checkStandable - underBlock is not undefined but no material predicate!");
-                    return false;
+                OctomapOcTree::MaterialClass material = OctomapOcTree::MATERIAL_UNKNOWN;
+                if (useCache) {
+                    material = spaceMap.getCachedMaterial(under);
                 }
-                string materialOfUnderBlock = materialPredicates[0];
+                if (material == OctomapOcTree::MATERIAL_UNKNOWN) {
+                    HandleSeq blocks;
+                    blocks.push_back(spaceMap.getBlock(under, logOddsOccupancy));
+                    vector<string> materialPredicates = getPredicate(atomSpace, "material", blocks, 1);
+                    if (materialPredicates.empty()) {
+                        // not cached, the predicate may be added later
+                        logger().error("checkStandable - underBlock is not undefined but no material predicate!");
+                        return false;
+                    }
+                    string materialOfUnderBlock = materialPredicates[0];
 
-                if (materialOfUnderBlock == "water") {
-                    return false;
-                } else {
-                    return true;
+                    if (materialOfUnderBlock == "water") {
+                        material = OctomapOcTree::MATERIAL_LIQUID;
+                    } else {
+                        material = OctomapOcTree::MATERIAL_SOLID;
+                    }
+                    if (useCache) {
+                        spaceMap.setCachedMaterial(under, material);
+                    }
                 }
+                standable = (material == OctomapOcTree::MATERIAL_SOLID);
             }
-            return false;
+            if (useCache) {
+                spaceMap.setCachedStandable(pos, standable);
+            }
+            return standable;
         }
 
 
@@ -295,16 +328,47 @@ namespace opencog
                 return spatialRelations;
             }
 
-            if (boundingboxA.isFaceTouching(boundingboxB)) {
-                spatialRelations.insert(TOUCHING);
+            unsigned int relations = computeSpatialRelationMask(boundingboxA, boundingboxB);
+            for (int relation = 0; relation != TOTAL_RELATIONS; relation++) {
+                if (relations & (1 << relation)) {
+                    spatialRelations.insert(SPATIAL_RELATION(relation));
+                }
+            }
+            return spatialRelations;
+        }
+
+        // isFaceTouching() needs the faces to be less than 1 unit apart,
+        // so the boxes can't be further apart than that along any axis
+        static bool mayBeFaceTouching(const AxisAlignedBox& boundingboxA,
+                                      const AxisAlignedBox& boundingboxB)
+        {
+            const double margin = 2.0;
+            const BlockVector& a = boundingboxA.nearLeftBottomConer;
+            const BlockVector& b = boundingboxB.nearLeftBottomConer;
+            return (b.x - (a.x + boundingboxA.size_x) <= margin &&
+                    a.x - (b.x + boundingboxB.size_x) <= margin &&
+                    b.y - (a.y + boundingboxA.size_y) <= margin &&
+                    a.y - (b.y + boundingboxB.size_y) <= margin &&
+                    b.z - (a.z + boundingboxA.size_z) <= margin &&
+                    a.z - (b.z + boundingboxB.size_z) <= margin);
+        }
+
+        unsigned int computeSpatialRelationMask(const AxisAlignedBox& boundingboxA,
+                                                const AxisAlignedBox& boundingboxB)
+        {
+            unsigned int relations = 0;
+
+            if (mayBeFaceTouching(boundingboxA, boundingboxB) &&
+                boundingboxA.isFaceTouching(boundingboxB)) {
+                relations |= 1 << TOUCHING;
             }
 
             if (boundingboxA.nearLeftBottomConer.z >= boundingboxB.nearLeftBottomConer.z + boundingboxB.size_z) {
-                spatialRelations.insert(ABOVE);
+                relations |= 1 << ABOVE;
             }
 
             if (boundingboxB.nearLeftBottomConer.z >= boundingboxA.nearLeftBottomConer.z + boundingboxA.size_z) {
-                spatialRelations.insert(BELOW);
+                relations |= 1 << BELOW;
             }
             // if A is near/far to B
             double dis = boundingboxB.getCenterPoint() - boundingboxA.getCenterPoint();
@@ -312,11 +376,11 @@ namespace opencog
             double BR = boundingboxB.getRadius();
             double nearDis = (AR + BR) * 2.0;
             if (dis <= nearDis) {
-                spatialRelations.insert(NEAR);
+                relations |= 1 << NEAR;
             } else if (dis > nearDis*10.0 ) {
-                spatialRelations.insert(FAR_);
+                relations |= 1 << FAR_;
             }
-            return spatialRelations;
+            return relations;
         }
 
         string spatialRelationToString(SPATIAL_RELATION relation ) {
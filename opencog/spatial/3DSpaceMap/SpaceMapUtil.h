@@ -191,6 +191,15 @@ namespace opencog
                                                       const AxisAlignedBox& boundingboxC = AxisAlignedBox::ZERO,
                                                       const Handle& observer = Handle::UNDEFINED);
 
+        /**
+         * The binary spatial relations of A to B as a bit set, with the bit
+         * (1 << relation) set for each relation computeSpatialRelations()
+         * would return for the two boxes, without building a set for the
+         * callers going through many pairs.
+         */
+        unsigned int computeSpatialRelationMask(const AxisAlignedBox& boundingboxA,
+                                                const AxisAlignedBox& boundingboxB);
+
         /**
          * Helper functions to transform SPATIAL_RELATION enum to string
          * @param relation Enumeartion to record spatial relation state
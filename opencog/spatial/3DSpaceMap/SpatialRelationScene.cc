@@ -0,0 +1,500 @@
+/*
+ * opencog/spatial/3DSpaceMap/SpatialRelationScene.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+#include <boost/bind.hpp>
+
+#include <opencog/atoms/base/Link.h>
+#include <opencog/atoms/base/Node.h>
+#include <opencog/util/Logger.h>
+#include "SpatialRelationScene.h"
+
+using namespace opencog;
+using namespace opencog::spatial;
+
+// see mayBeFaceTouching() in SpaceMapUtil.cc
+static const double TOUCHING_MARGIN = 2.0;
+
+static inline double coordinate(const BlockVector& pos, int axis)
+{
+    return (axis == 0) ? pos.x : ((axis == 1) ? pos.y : pos.z);
+}
+
+static inline double boxSize(const AxisAlignedBox& box, int axis)
+{
+    return (axis == 0) ? box.size_x : ((axis == 1) ? box.size_y : box.size_z);
+}
+
+static set<SPATIAL_RELATION> relationSet(unsigned int relations)
+{
+    set<SPATIAL_RELATION> result;
+    for (int relation = 0; relation != TOTAL_RELATIONS; relation++) {
+        if (relations & (1 << relation)) {
+            result.insert(SPATIAL_RELATION(relation));
+        }
+    }
+    return result;
+}
+
+SpatialRelationScene::SpatialRelationScene(double cullingDistance, unsigned int threads):
+    mCullingDistance(cullingDistance), mThreads(threads), mAtomSpace(NULL)
+{
+}
+
+SpatialRelationScene::~SpatialRelationScene()
+{
+    mAddedAtomConnection.disconnect();
+    mRemovedAtomConnection.disconnect();
+}
+
+void SpatialRelationScene::atomAdded(Handle h)
+{
+    sizeChanged(h);
+}
+
+void SpatialRelationScene::atomRemoved(AtomPtr atom)
+{
+    sizeChanged(atom->getHandle());
+}
+
+void SpatialRelationScene::sizeChanged(const Handle& h)
+{
+    if (h->getType() != EVALUATION_LINK) {
+        return;
+    }
+    LinkPtr evalLink = LinkCast(h);
+    if (evalLink->getArity() != 2) {
+        return;
+    }
+    Handle predicate = evalLink->getOutgoingAtom(0);
+    Handle arguments = evalLink->getOutgoingAtom(1);
+    if (predicate->getType() != PREDICATE_NODE ||
+        NodeCast(predicate)->getName() != "size" ||
+        arguments->getType() != LIST_LINK) {
+        return;
+    }
+    LinkPtr argumentList = LinkCast(arguments);
+    if (argumentList->getArity() != 4) {
+        return;
+    }
+    // getPredicate() adds its pattern, with variables as values
+    for (unsigned int i = 1; i != 4; i++) {
+        if (argumentList->getOutgoingAtom(i)->getType() == VARIABLE_NODE) {
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mSizeChangedLock);
+    mSizeChanged.push_back(argumentList->getOutgoingAtom(0));
+}
+
+void SpatialRelationScene::update(AtomSpace& atomSpace,
+                                  const EntityRecorder& entityRecorder,
+                                  vector<SpatialRelationChange>& changes)
+{
+    if (mAtomSpace != &atomSpace) {
+        mAddedAtomConnection.disconnect();
+        mRemovedAtomConnection.disconnect();
+        mAddedAtomConnection = atomSpace.addAtomSignal(
+            boost::bind(&SpatialRelationScene::atomAdded, this, _1));
+        mRemovedAtomConnection = atomSpace.removeAtomSignal(
+            boost::bind(&SpatialRelationScene::atomRemoved, this, _1));
+        // the sizes read from another atomspace are stale
+        if (mAtomSpace != NULL) {
+            for (Entity& e : mEntities) {
+                e.sized = false;
+            }
+            mUnsized.clear();
+        }
+        mAtomSpace = &atomSpace;
+    }
+
+    HandleSeq resized;
+    {
+        std::lock_guard<std::mutex> lock(mSizeChangedLock);
+        resized.swap(mSizeChanged);
+    }
+    for (const Handle& entity : resized) {
+        invalidateSize(entity);
+        mUnsized.erase(entity);
+    }
+
+    // the entities gone from the recorder
+    HandleSeq removed;
+    for (auto it = mIndexes.begin(); it != mIndexes.end(); ++it) {
+        if (!entityRecorder.containsEntity(it->first)) {
+            removed.push_back(it->first);
+        }
+    }
+    for (const Handle& entity : removed) {
+        removeEntity(entity);
+    }
+    for (auto it = mUnsized.begin(); it != mUnsized.end(); ) {
+        if (entityRecorder.containsEntity(*it)) {
+            ++it;
+        } else {
+            it = mUnsized.erase(it);
+        }
+    }
+
+    HandleSeq entities;
+    entityRecorder.findAllEntities(back_inserter(entities));
+    for (const Handle& entity : entities) {
+        BlockVector location = entityRecorder.getLastAppearedLocation(entity);
+        auto it = mIndexes.find(entity);
+        if (it != mIndexes.end() && mEntities[it->second].sized) {
+            const AxisAlignedBox& box = mEntities[it->second].box;
+            setEntityBox(entity, AxisAlignedBox(location, box.size_x, box.size_y, box.size_z));
+            continue;
+        }
+        if (mUnsized.count(entity) != 0) {
+            continue;
+        }
+
+        vector<string> sizeStrings = getPredicate(atomSpace, "size", HandleSeq({entity}), 3);
+        if (sizeStrings.size() < 3) {
+            logger().warn("SpatialRelationScene - entity %s has no size predicate!",
+                          entity->toShortString().c_str());
+            mUnsized.insert(entity);
+            removeEntity(entity);
+            continue;
+        }
+        double length = std::stof(sizeStrings[0]);
+        double width = std::stof(sizeStrings[1]);
+        double height = std::stof(sizeStrings[2]);
+        setEntityBox(entity, AxisAlignedBox(location, length, width, height));
+    }
+
+    computeChanges(changes);
+}
+
+void SpatialRelationScene::setEntityBox(const Handle& entity, const AxisAlignedBox& box)
+{
+    auto it = mIndexes.find(entity);
+    unsigned int index;
+    if (it == mIndexes.end()) {
+        if (mFreeIndexes.empty()) {
+            index = mEntities.size();
+            mEntities.push_back(Entity());
+        } else {
+            index = mFreeIndexes.back();
+            mFreeIndexes.pop_back();
+        }
+        mIndexes[entity] = index;
+        Entity& newEntity = mEntities[index];
+        newEntity.handle = entity;
+        newEntity.alive = true;
+        newEntity.dirty = false;
+    } else {
+        index = it->second;
+        if (mEntities[index].box == box) {
+            mEntities[index].sized = true;
+            return;
+        }
+    }
+
+    Entity& e = mEntities[index];
+    e.box = box;
+    e.center = box.getCenterPoint();
+    e.radius = box.getRadius();
+    e.sized = true;
+    markDirty(index);
+}
+
+void SpatialRelationScene::removeEntity(const Handle& entity)
+{
+    auto it = mIndexes.find(entity);
+    if (it == mIndexes.end()) {
+        return;
+    }
+    // the index is freed once the relations of the entity are removed
+    mEntities[it->second].alive = false;
+    mRemoved.push_back(it->second);
+    mIndexes.erase(it);
+}
+
+void SpatialRelationScene::invalidateSize(const Handle& entity)
+{
+    auto it = mIndexes.find(entity);
+    if (it != mIndexes.end()) {
+        mEntities[it->second].sized = false;
+    }
+}
+
+bool SpatialRelationScene::containsEntity(const Handle& entity) const
+{
+    return mIndexes.find(entity) != mIndexes.end();
+}
+
+set<SPATIAL_RELATION> SpatialRelationScene::getRelations(const Handle& entityA,
+                                                        const Handle& entityB) const
+{
+    auto itA = mIndexes.find(entityA);
+    auto itB = mIndexes.find(entityB);
+    if (itA == mIndexes.end() || itB == mIndexes.end()) {
+        return set<SPATIAL_RELATION>();
+    }
+    const unordered_map<unsigned int, unsigned int>& relations = mEntities[itA->second].relations;
+    auto it = relations.find(itB->second);
+    return relationSet(it == relations.end() ? 0 : it->second);
+}
+
+void SpatialRelationScene::markDirty(unsigned int index)
+{
+    if (!mEntities[index].dirty) {
+        mEntities[index].dirty = true;
+        mDirty.push_back(index);
+    }
+}
+
+void SpatialRelationScene::computeChanges(vector<SpatialRelationChange>& changes)
+{
+    for (unsigned int index : mRemoved) {
+        Entity& e = mEntities[index];
+        vector<unsigned int> partners;
+        for (auto it = e.relations.begin(); it != e.relations.end(); ++it) {
+            partners.push_back(it->first);
+        }
+        for (unsigned int partner : partners) {
+            setRelations(index, partner, 0, changes);
+            setRelations(partner, index, 0, changes);
+        }
+        e.handle = Handle::UNDEFINED;
+        e.dirty = false;
+        mFreeIndexes.push_back(index);
+    }
+    mRemoved.clear();
+
+    // a removed entity may have been changed before
+    mDirty.erase(remove_if(mDirty.begin(), mDirty.end(),
+                           [this](unsigned int index) {return !mEntities[index].alive;}),
+                 mDirty.end());
+    if (mDirty.empty()) {
+        return;
+    }
+
+    buildHierarchy();
+
+    // The pairs of the changed entities are found in parallel, only
+    // reading the entities and the hierarchy
+    vector<vector<PairRelations> > pairs(mDirty.size());
+    if (mThreads != 1 && mDirty.size() > ENTITIES_PER_TASK) {
+        if (!mPool) {
+            mPool.reset(new WorkStealingPool(mThreads));
+        }
+        for (size_t first = 0; first < mDirty.size(); first += ENTITIES_PER_TASK) {
+            size_t last = min(first + ENTITIES_PER_TASK, mDirty.size());
+            mPool->submit([this, &pairs, first, last] {
+                for (size_t i = first; i != last; i++) {
+                    findPairs(mDirty[i], pairs[i]);
+                }
+            });
+        }
+        mPool->wait();
+    } else {
+        for (size_t i = 0; i != mDirty.size(); i++) {
+            findPairs(mDirty[i], pairs[i]);
+        }
+    }
+
+    // A pair of changed entities is set twice with the same relations,
+    // the second time changes nothing
+    for (size_t i = 0; i != mDirty.size(); i++) {
+        unsigned int index = mDirty[i];
+        unordered_map<unsigned int, unsigned int> found;
+        for (const PairRelations& pair : pairs[i]) {
+            found[pair.other] = 1;
+        }
+
+        vector<unsigned int> lost;
+        const unordered_map<unsigned int, unsigned int>& relations = mEntities[index].relations;
+        for (auto it = relations.begin(); it != relations.end(); ++it) {
+            if (found.find(it->first) == found.end()) {
+                lost.push_back(it->first);
+            }
+        }
+        for (unsigned int partner : lost) {
+            setRelations(index, partner, 0, changes);
+            setRelations(partner, index, 0, changes);
+        }
+
+        for (const PairRelations& pair : pairs[i]) {
+            setRelations(index, pair.other, pair.relations, changes);
+            setRelations(pair.other, index, pair.inverse, changes);
+        }
+        mEntities[index].dirty = false;
+    }
+    mDirty.clear();
+}
+
+void SpatialRelationScene::setRelations(unsigned int a, unsigned int b, unsigned int relations,
+                                        vector<SpatialRelationChange>& changes)
+{
+    unordered_map<unsigned int, unsigned int>& aRelations = mEntities[a].relations;
+    auto it = aRelations.find(b);
+    unsigned int previous = (it == aRelations.end()) ? 0 : it->second;
+    if (previous == relations) {
+        return;
+    }
+    if (relations == 0) {
+        aRelations.erase(it);
+    } else {
+        aRelations[b] = relations;
+    }
+
+    SpatialRelationChange change;
+    change.entityA = mEntities[a].handle;
+    change.entityB = mEntities[b].handle;
+    change.added = relationSet(relations & ~previous);
+    change.removed = relationSet(previous & ~relations);
+    changes.push_back(change);
+}
+
+void SpatialRelationScene::buildHierarchy()
+{
+    mOrder.clear();
+    for (unsigned int index = 0; index != mEntities.size(); index++) {
+        if (mEntities[index].alive) {
+            mOrder.push_back(index);
+        }
+    }
+
+    mNodes.clear();
+    if (mOrder.empty()) {
+        return;
+    }
+    // a binary tree with leaves of at least one entity, so that the
+    // nodes never move while the tree is built
+    mNodes.reserve(2 * mOrder.size());
+    mNodes.push_back(BVHNode());
+    buildNode(0, 0, mOrder.size());
+}
+
+void SpatialRelationScene::buildNode(unsigned int node, unsigned int first, unsigned int count)
+{
+    BVHNode& n = mNodes[node];
+    n.first = first;
+    n.count = count;
+    n.left = 0;
+    n.maxRadius = 0;
+    for (int axis = 0; axis != 3; axis++) {
+        n.centerMin[axis] = n.boxMin[axis] = numeric_limits<double>::infinity();
+        n.centerMax[axis] = n.boxMax[axis] = -numeric_limits<double>::infinity();
+    }
+    for (unsigned int i = first; i != first + count; i++) {
+        const Entity& e = mEntities[mOrder[i]];
+        for (int axis = 0; axis != 3; axis++) {
+            double center = coordinate(e.center, axis);
+            double low = coordinate(e.box.nearLeftBottomConer, axis);
+            n.centerMin[axis] = min(n.centerMin[axis], center);
+            n.centerMax[axis] = max(n.centerMax[axis], center);
+            n.boxMin[axis] = min(n.boxMin[axis], low);
+            n.boxMax[axis] = max(n.boxMax[axis], low + boxSize(e.box, axis));
+        }
+        n.maxRadius = max(n.maxRadius, e.radius);
+    }
+    if (count <= LEAF_SIZE) {
+        return;
+    }
+
+    // split at the median center along the longest axis
+    int splitAxis = 0;
+    for (int axis = 1; axis != 3; axis++) {
+        if (n.centerMax[axis] - n.centerMin[axis] >
+            n.centerMax[splitAxis] - n.centerMin[splitAxis]) {
+            splitAxis = axis;
+        }
+    }
+    unsigned int middle = first + count / 2;
+    nth_element(mOrder.begin() + first, mOrder.begin() + middle, mOrder.begin() + first + count,
+                [this, splitAxis](unsigned int a, unsigned int b) {
+                    return coordinate(mEntities[a].center, splitAxis) <
+                           coordinate(mEntities[b].center, splitAxis);
+                });
+
+    unsigned int left = mNodes.size();
+    n.left = left;
+    mNodes.push_back(BVHNode());
+    mNodes.push_back(BVHNode());
+    buildNode(left, first, middle - first);
+    buildNode(left + 1, middle, first + count - middle);
+}
+
+void SpatialRelationScene::findPairs(unsigned int index, vector<PairRelations>& pairs) const
+{
+    const Entity& a = mEntities[index];
+    double boxMin[3], boxMax[3];
+    for (int axis = 0; axis != 3; axis++) {
+        boxMin[axis] = coordinate(a.box.nearLeftBottomConer, axis);
+        boxMax[axis] = boxMin[axis] + boxSize(a.box, axis);
+    }
+
+    vector<unsigned int> stack(1, 0);
+    while (!stack.empty()) {
+        const BVHNode& n = mNodes[stack.back()];
+        stack.pop_back();
+
+        // skip the nodes whose entities are all too far to be within the
+        // culling distance, near or touching
+        double squaredDistance = 0;
+        bool mayTouch = true;
+        for (int axis = 0; axis != 3; axis++) {
+            double center = coordinate(a.center, axis);
+            double outside = max(0.0, max(n.centerMin[axis] - center, center - n.centerMax[axis]));
+            squaredDistance += outside * outside;
+            if (n.boxMin[axis] - boxMax[axis] > TOUCHING_MARGIN ||
+                boxMin[axis] - n.boxMax[axis] > TOUCHING_MARGIN) {
+                mayTouch = false;
+            }
+        }
+        double distance = sqrt(squaredDistance);
+        if (distance > mCullingDistance &&
+            distance > 2.0 * (a.radius + n.maxRadius) && !mayTouch) {
+            continue;
+        }
+
+        if (n.left != 0) {
+            stack.push_back(n.left);
+            stack.push_back(n.left + 1);
+            continue;
+        }
+
+        for (unsigned int i = n.first; i != n.first + n.count; i++) {
+            unsigned int other = mOrder[i];
+            if (other == index) {
+                continue;
+            }
+            const Entity& b = mEntities[other];
+            PairRelations pair;
+            pair.other = other;
+            pair.relations = computeSpatialRelationMask(a.box, b.box);
+            pair.inverse = computeSpatialRelationMask(b.box, a.box);
+            if ((b.center - a.center) > mCullingDistance) {
+                pair.relations &= ~GLOBAL_RELATIONS;
+                pair.inverse &= ~GLOBAL_RELATIONS;
+            }
+            if (pair.relations != 0 || pair.inverse != 0) {
+                pairs.push_back(pair);
+            }
+        }
+    }
+}
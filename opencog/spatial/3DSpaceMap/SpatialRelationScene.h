@@ -0,0 +1,195 @@
+/*
+ * opencog/spatial/3DSpaceMap/SpatialRelationScene.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _SPATIAL_SPATIALRELATIONSCENE_H
+#define _SPATIAL_SPATIALRELATIONSCENE_H
+
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/signals2.hpp>
+
+#include <opencog/atomspace/AtomSpace.h>
+#include <opencog/atoms/base/Handle.h>
+#include <opencog/concurrency/WorkStealingPool.h>
+#include "Block3DMapUtil.h"
+#include "EntityRecorder.h"
+#include "SpaceMapUtil.h"
+
+using namespace std;
+
+namespace opencog
+{
+/** \addtogroup grp_spatial
+ *  @{
+ */
+
+    namespace spatial
+    {
+        // The relations of entityA to entityB which appeared and
+        // disappeared since the previous frame
+        struct SpatialRelationChange
+        {
+            Handle entityA;
+            Handle entityB;
+            set<SPATIAL_RELATION> added;
+            set<SPATIAL_RELATION> removed;
+        };
+
+        // The binary spatial relations (see computeSpatialRelations())
+        // between all the entities of a scene, kept from frame to frame.
+        //
+        // The bounding box of each entity is cached: its size predicate is
+        // only read when the entity appears or after invalidateSize(), and
+        // the box follows the location recorded in the EntityRecorder.
+        // update() connects the scene to the atomspace, so that adding or
+        // removing a size predicate invalidates the size on its own.
+        // Each frame only the pairs with an entity whose box changed are
+        // computed again, found through a bounding volume hierarchy over
+        // the boxes, and only the relations which changed are returned.
+        //
+        // TOUCHING and NEAR are always computed. ABOVE, BELOW and FAR_ can
+        // hold between entities at any distance, so they are only kept for
+        // the entities whose centers are within the culling distance; the
+        // default infinite distance keeps them for every pair.
+        class SpatialRelationScene
+        {
+        public:
+            // threads is the number of threads computing the pairs,
+            // 0 for one per core, 1 computes them in the caller's thread.
+            SpatialRelationScene(double cullingDistance = numeric_limits<double>::infinity(),
+                                 unsigned int threads = 1);
+            ~SpatialRelationScene();
+
+            inline double getCullingDistance() const {return mCullingDistance;}
+
+            // Read the boxes of the entities in the recorder, adding the
+            // new ones and removing those which are gone, then compute the
+            // relations which changed since the previous frame. An entity
+            // without size predicate is left out until one is added.
+            void update(AtomSpace& atomSpace, const EntityRecorder& entityRecorder,
+                        vector<SpatialRelationChange>& changes);
+
+            // Add an entity or move it with its box, an entity without size
+            // predicate can be given this way. The change is computed on
+            // the next update() or computeChanges().
+            void setEntityBox(const Handle& entity, const AxisAlignedBox& box);
+            void removeEntity(const Handle& entity);
+            // The size predicate of the entity changed, read it again on
+            // the next update()
+            void invalidateSize(const Handle& entity);
+
+            // compute the relations which changed since the previous frame
+            void computeChanges(vector<SpatialRelationChange>& changes);
+
+            bool containsEntity(const Handle& entity) const;
+            set<SPATIAL_RELATION> getRelations(const Handle& entityA, const Handle& entityB) const;
+
+        private:
+            // the relations which hold at any distance
+            static const unsigned int GLOBAL_RELATIONS =
+                (1 << ABOVE) | (1 << BELOW) | (1 << FAR_);
+            static const unsigned int LEAF_SIZE = 4;
+            static const unsigned int ENTITIES_PER_TASK = 32;
+
+            struct Entity
+            {
+                Handle handle;
+                AxisAlignedBox box;
+                BlockVector center;
+                double radius;
+                bool alive;
+                bool dirty;
+                // false until the size predicate has been read
+                bool sized;
+                // the relations of this entity to each other one, by index
+                unordered_map<unsigned int, unsigned int> relations;
+            };
+
+            // a node of the hierarchy, over the entities
+            // mOrder[first, first + count)
+            struct BVHNode
+            {
+                double centerMin[3];
+                double centerMax[3];
+                double boxMin[3];
+                double boxMax[3];
+                double maxRadius;
+                unsigned int first;
+                unsigned int count;
+                // children at left and left + 1, 0 for a leaf
+                unsigned int left;
+            };
+
+            // the relations of a changed entity to another one and back
+            struct PairRelations
+            {
+                unsigned int other;
+                unsigned int relations;
+                unsigned int inverse;
+            };
+
+            double mCullingDistance;
+            unsigned int mThreads;
+            unique_ptr<WorkStealingPool> mPool;
+
+            vector<Entity> mEntities;
+            map<Handle, unsigned int> mIndexes;
+            vector<unsigned int> mFreeIndexes;
+            vector<unsigned int> mDirty;
+            vector<unsigned int> mRemoved;
+
+            vector<BVHNode> mNodes;
+            vector<unsigned int> mOrder;
+
+            // The atomspace signals can come from any thread, the entities
+            // whose size predicate changed are queued for the next update()
+            AtomSpace* mAtomSpace;
+            boost::signals2::connection mAddedAtomConnection;
+            boost::signals2::connection mRemovedAtomConnection;
+            std::mutex mSizeChangedLock;
+            HandleSeq mSizeChanged;
+            // the entities of the recorder without size predicate, already
+            // warned about
+            set<Handle> mUnsized;
+
+            void atomAdded(Handle h);
+            void atomRemoved(AtomPtr atom);
+            // queues the entity if h is its size predicate:
+            // (EvaluationLink (PredicateNode "size")
+            //                 (ListLink entity length width height))
+            void sizeChanged(const Handle& h);
+
+            void markDirty(unsigned int index);
+            void buildHierarchy();
+            void buildNode(unsigned int node, unsigned int first, unsigned int count);
+            void findPairs(unsigned int index, vector<PairRelations>& pairs) const;
+            void setRelations(unsigned int a, unsigned int b, unsigned int relations,
+                              vector<SpatialRelationChange>& changes);
+        };
+    }
+/** @}*/
+}
+
+#endif // _SPATIAL_SPATIALRELATIONSCENE_H
@@ -48,13 +48,11 @@ void AStar3DController::setStartAndGoalStates(MapSearchNode &nodeStart, MapSearc
 }
 
 /**
- * Create new astarsearch with same start and goal nodes, for testing and comparing different heuristics
+ * Restart astarsearch with new start and goal nodes, for testing and comparing different heuristics
  */
 void AStar3DController::resetSearch(MapSearchNode &startNode, MapSearchNode &goalNode)
 {
-    delete astarsearch;
-
-    astarsearch = new AStarSearch<MapSearchNode>(MAX_3D_SEARCH_NODES);
+    // the same search, and its node pool, is reused
     astarsearch->SetStartAndGoalStates(startNode, goalNode);
 }
 
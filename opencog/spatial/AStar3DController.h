@@ -82,7 +82,7 @@ namespace opencog
             void setMap(Map *map);
             void setStartAndGoalStates(MapSearchNode &startNode, MapSearchNode &goalNode);
 
-            //Create new astarsearch with same start and goal nodes, for testing and comparing different heuristics
+            //Restart astarsearch with new start and goal nodes, for testing and comparing different heuristics
             void resetSearch(MapSearchNode &startNode, MapSearchNode &goalNode);
 
             /**
@@ -0,0 +1,147 @@
+/*
+ * opencog/spatial/AStarBenchmark.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Compares the hashed open/closed lists of AStarSearch with the original
+// linear ones, running the same random searches with both on random
+// LocalSpaceMap2D grids of growing sizes.
+//
+// Usage: astarbench [searches per map] [seed]
+
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+
+#include <opencog/util/mt19937ar.h>
+
+#include <opencog/spatial/LSMap2DSearchNode.h>
+#include <opencog/spatial/LocalSpaceMap2DUtil.h>
+
+using namespace std;
+
+using namespace opencog;
+using namespace opencog::spatial;
+
+typedef LocalSpaceMap2D Map;
+typedef LSMap2DSearchNode MapSearchNode;
+typedef AStarSearch<MapSearchNode> Search;
+
+const unsigned int MAP_SIZES[] = {50, 100, 200, 400};
+const unsigned int DEFAULT_SEARCHES = 20;
+
+struct SearchStats {
+    double seconds;
+    unsigned int steps;
+    unsigned int succeeded;
+    double pathCost;
+
+    SearchStats() : seconds(0), steps(0), succeeded(0), pathCost(0) {}
+};
+
+//generate a random legal (non-obstacle) node
+MapSearchNode getRandomNode(Map *map)
+{
+    RandGen &rng = randGen();
+    MapSearchNode node;
+    do {
+        node.x = rng.randint(map->xDim());
+        node.y = rng.randint(map->yDim());
+    } while (!node.isLegal());
+    return node;
+}
+
+void runSearch(Search &search, MapSearchNode &nodeStart, MapSearchNode &nodeEnd, SearchStats &stats)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    search.SetStartAndGoalStates(nodeStart, nodeEnd);
+    unsigned int searchState;
+    do {
+        searchState = search.SearchStep();
+    } while (searchState == Search::SEARCH_STATE_SEARCHING);
+
+    stats.seconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    stats.steps += search.GetStepCount();
+
+    if (searchState != Search::SEARCH_STATE_SUCCEEDED) {
+        return;
+    }
+
+    stats.succeeded++;
+    MapSearchNode *node = search.GetSolutionStart();
+    MapSearchNode previous = *node;
+    while ((node = search.GetSolutionNext())) {
+        stats.pathCost += previous.GetCost(*node);
+        previous = *node;
+    }
+    search.FreeSolutionNodes();
+}
+
+void printStats(const char *name, const SearchStats &stats, unsigned int searches)
+{
+    cout << "  " << setw(8) << name
+         << setw(12) << fixed << setprecision(2) << stats.seconds * 1000.0 / searches << " ms/search"
+         << setw(10) << stats.steps / searches << " steps/search"
+         << setw(6) << stats.succeeded << " found"
+         << setw(12) << setprecision(1) << stats.pathCost << " total path cost" << endl;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned int searches = (argc > 1) ? atoi(argv[1]) : DEFAULT_SEARCHES;
+    randGen().seed((argc > 2) ? atoi(argv[2]) : time(0));
+
+    // the diagonal distance is consistent with the costs of the moves, so
+    // both versions find paths of the same cost
+    MapSearchNode::setHeuristic(MapSearchNode::DIAGONAL);
+
+    for (unsigned int size : MAP_SIZES) {
+        Map map(0, size, size, 0, size, size, 2);
+        populateRandom(map, size / 5, spatial::GridPoint(size / 2, size / 2), size / 3);
+        MapSearchNode::setMap(&map);
+
+        // each state is on open or closed at most once, plus the successors
+        // of the node being expanded and the goal
+        int maxNodes = size * size + 16;
+        Search hashed(maxNodes, true);
+        Search linear(maxNodes, false);
+        SearchStats hashedStats, linearStats;
+
+        for (unsigned int i = 0; i < searches; i++) {
+            MapSearchNode nodeStart = getRandomNode(&map);
+            MapSearchNode nodeEnd = getRandomNode(&map);
+            runSearch(hashed, nodeStart, nodeEnd, hashedStats);
+            runSearch(linear, nodeStart, nodeEnd, linearStats);
+        }
+
+        cout << size << "x" << size << " map, " << searches << " searches" << endl;
+        printStats("hashed", hashedStats, searches);
+        printStats("linear", linearStats, searches);
+        if (hashedStats.succeeded != linearStats.succeeded ||
+                fabs(hashedStats.pathCost - linearStats.pathCost) > 0.01 * searches) {
+            cout << "  the two versions found different paths!" << endl;
+            return 1;
+        }
+        cout << "  speedup " << setprecision(1)
+             << linearStats.seconds / max(hashedStats.seconds, 1e-9) << "x" << endl;
+    }
+
+    return 0;
+}
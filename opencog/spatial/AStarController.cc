@@ -48,13 +48,11 @@ void AStarController::setStartAndGoalStates(MapSearchNode &nodeStart, MapSearchN
 
 
 /**
- * Create new astarsearch with same start and goal nodes, for testing and comparing different heuristics
+ * Restart astarsearch with new start and goal nodes, for testing and comparing different heuristics
  */
 void AStarController::resetSearch(MapSearchNode &startNode, MapSearchNode &goalNode)
 {
-    delete astarsearch;
-
-    astarsearch = new AStarSearch<MapSearchNode>(MAX_SEARCH_NODES);
+    // the same search, and its node pool, is reused
     astarsearch->SetStartAndGoalStates(startNode, goalNode);
 }
 
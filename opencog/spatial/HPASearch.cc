@@ -23,6 +23,7 @@
 
 #include <opencog/spatial/HPASearch.h>
 #include <cmath>
+#include <limits>
 #include <map>
 #include <opencog/util/Logger.h>
 #include <opencog/spatial/QuadTree.h>
@@ -39,15 +40,66 @@ HPASearch::Level::Level( LocalSpaceMap2D* map, unsigned int level, unsigned int
     this->numberOfRows = maximumClusters * level;
     this->clusterDimension.width = ( this->map->xMax( ) - this->map->xMin( ) ) / numberOfCols;
     this->clusterDimension.height = ( this->map->yMax( ) - this->map->yMin( ) ) / numberOfRows;
-    this->abstractGraph = new Graph( this->map->xDim( ) * this->map->yDim( ) );
+    this->abstractGraph = new Graph( 0 );
+    this->clusters.resize( numberOfCols * numberOfRows );
+    this->boundaryEntrances.resize( numberOfCols * numberOfRows * 2 );
+    this->numberOfClusterBuilds = 0;
     this->needsUpdate = true;
+    this->listening = true;
+    this->map->addListener( this );
 }
 
 HPASearch::Level::~Level( void )
 {
+    if ( this->listening ) {
+        this->map->removeListener( this );
+    } // if
     delete abstractGraph;
 }
 
+void HPASearch::Level::obstaclesChanged( const GridPoint& low, const GridPoint& high )
+{
+    if ( this->needsUpdate ) {
+        // all the clusters will be built anyway
+        return;
+    } // if
+
+    unsigned int clusterCols = std::max( 1u,
+        static_cast<unsigned int>( clusterDimension.width / this->map->xGridWidth( ) ) );
+    unsigned int clusterRows = std::max( 1u,
+        static_cast<unsigned int>( clusterDimension.height / this->map->yGridWidth( ) ) );
+
+    // take a cell more on each side, as the entrances of a border are
+    // found on the cells of both its clusters
+    unsigned int firstCol = std::min( ( low.first > 0 ? low.first - 1 : 0 ) / clusterCols, numberOfCols - 1 );
+    unsigned int lastCol = std::min( ( high.first + 1 ) / clusterCols, numberOfCols - 1 );
+    unsigned int firstRow = std::min( ( low.second > 0 ? low.second - 1 : 0 ) / clusterRows, numberOfRows - 1 );
+    unsigned int lastRow = std::min( ( high.second + 1 ) / clusterRows, numberOfRows - 1 );
+
+    unsigned int row;
+    unsigned int col;
+    for ( row = firstRow; row <= lastRow; ++row ) {
+        for ( col = firstCol; col <= lastCol; ++col ) {
+            this->dirtyClusters.insert( row * numberOfCols + col );
+        } // for
+    } // for
+}
+
+void HPASearch::Level::mapDestroyed( void )
+{
+    this->listening = false;
+}
+
+unsigned int HPASearch::Level::getNumberOfClusterBuilds( void ) const
+{
+    return this->numberOfClusterBuilds;
+}
+
+unsigned int HPASearch::Level::getBoundaryId( unsigned int row, unsigned int col, bool horizontal ) const
+{
+    return ( row * numberOfCols + col ) * 2 + ( horizontal ? 0 : 1 );
+}
+
 const HPASearch::Graph& HPASearch::Level::getAbstractGraph( void )
 {
     return *this->abstractGraph;
@@ -83,138 +135,190 @@ void HPASearch::Level::buildClusters( void )
     unsigned int clusterRows =
         static_cast<unsigned int>( clusterDimension.height / this->map->yGridWidth( ) );
 
+    unsigned int i;
+    if ( this->needsUpdate ) {
+        for ( i = 0; i < this->clusters.size( ); ++i ) {
+            this->dirtyClusters.insert( i );
+        } // for
+    } // if
+
+    // the clusters whose entrances may have changed: the dirty ones and
+    // the ones on the other side of their borders
+    std::set< unsigned int > touchedClusters;
+
+    std::set< unsigned int >::const_iterator it;
+    for ( it = this->dirtyClusters.begin( ); it != this->dirtyClusters.end( ); ++it ) {
+        unsigned int row = *it / numberOfCols;
+        unsigned int col = *it % numberOfCols;
+
+        // build the entrances of all the cluster borders
+        buildEntrance( row, col, true );
+        buildEntrance( row, col, false );
+        touchedClusters.insert( *it );
+        if ( col > 0 ) {
+            buildEntrance( row, col - 1, true );
+            touchedClusters.insert( *it - 1 );
+        } // if
+        if ( row > 0 ) {
+            buildEntrance( row - 1, col, false );
+            touchedClusters.insert( *it - numberOfCols );
+        } // if
+        if ( col + 1 < numberOfCols ) {
+            touchedClusters.insert( *it + 1 );
+        } // if
+        if ( row + 1 < numberOfRows ) {
+            touchedClusters.insert( *it + numberOfCols );
+        } // if
+
+        ClusterGraph& cluster = this->clusters[ *it ];
+        cluster.vertices.clear( );
+        cluster.edges.clear( );
+        QuadTree( this->map, GridPoint( clusterCols * col, clusterRows * row ), clusterCols, &cluster ).connectEdges( );
+        ++this->numberOfClusterBuilds;
+    } // for
+    this->dirtyClusters.clear( );
+
+    collectEntrances( );
+
+    for ( it = touchedClusters.begin( ); it != touchedClusters.end( ); ++it ) {
+        connectEntrances( *it );
+    } // for
+
+    buildGraph( );
+}
+
+void HPASearch::Level::collectEntrances( void )
+{
+    this->entrances.clear( );
+    this->clusterEntrances.clear( );
+
     unsigned int row;
     unsigned int col;
-
-    // build all cluster entrances
     for ( row = 0; row < numberOfRows; ++row ) {
         for ( col = 0; col < numberOfCols; ++col ) {
-            buildEntrance( row, col, true );
-            buildEntrance( row, col, false );
+            unsigned int i;
+            for ( i = 0; i < 2; ++i ) {
+                const std::vector< Edge >& boundary =
+                    this->boundaryEntrances[ getBoundaryId( row, col, i == 0 ) ];
+
+                std::vector< Edge >::const_iterator it;
+                for ( it = boundary.begin( ); it != boundary.end( ); ++it ) {
+                    this->entrances.push_back( *it );
+                    this->clusterEntrances[ getClusterId( it->first ) ].push_back( it->first );
+                    this->clusterEntrances[ getClusterId( it->second ) ].push_back( it->second );
+                } // for
+            } // for
         } // for
     } // for
+}
 
-    // boost::property_map<Graph, HPASearch::VertexPosition>::type position =
-    boost::get( HPASearch::VertexPosition( ), *this->abstractGraph );
+void HPASearch::Level::connectEntrances( unsigned int clusterId )
+{
+    ClusterGraph& cluster = this->clusters[ clusterId ];
+    cluster.entranceEdges.clear( );
 
+    const std::vector< GridPoint >& nearestEntrances =
+        this->clusterEntrances[ clusterId ];
 
-    for ( row = 0; row < numberOfRows; ++row ) {
-        for ( col = 0; col < numberOfCols; ++col ) {
-            unsigned int rowClusterOffset = clusterRows * row;
-            unsigned int colClusterOffset = clusterCols * col;
+    unsigned int i;
+    unsigned int j;
+    if ( !cluster.vertices.empty( ) ) {
 
-            unsigned int beforeVertexCounter = this->vertexCounter;
-            QuadTree( this, GridPoint( colClusterOffset, rowClusterOffset ), clusterCols, this->abstractGraph ).connectEdges( );
-            unsigned int numberOfClusterVertices = this->vertexCounter - beforeVertexCounter;
+        std::vector<float> distances( nearestEntrances.size( ), std::numeric_limits<float>::max( ) );
+        std::vector<GridPoint> nearestVertex( nearestEntrances.size( ) );
 
-            unsigned int clusterId = getClusterId( GridPoint( colClusterOffset, rowClusterOffset ) );
-            clustersVertexRange[ clusterId ].first = beforeVertexCounter;
-            clustersVertexRange[ clusterId ].second = numberOfClusterVertices;
+        for ( j = 0; j < cluster.vertices.size( ); ++j ) {
+            Point position = map->unsnap( cluster.vertices[ j ] );
 
-            std::vector< GridPoint >& nearestEntrances =
-                clusterEntrances[ clusterId ];
+            for ( i = 0; i < nearestEntrances.size( ); ++i ) {
+                Point entrancePosition = map->unsnap( nearestEntrances[ i ] );
 
-            unsigned int i;
-            unsigned int j;
-            if ( numberOfClusterVertices > 0 ) {
+                float candidateDistance = ( math::Vector2( position.first, position.second ) -
+                                            math::Vector2( entrancePosition.first, entrancePosition.second ) ).length( );
 
-                std::vector<float> distances(nearestEntrances.size( ));
-                std::vector<unsigned int> nearestVertex(nearestEntrances.size( ));
-                std::fill_n( distances.begin( ), nearestEntrances.size( ),  ( map->xDim( ) * map->yDim( ) ) );
+                if ( candidateDistance < distances[ i ] ) {
+                    distances[ i ] = candidateDistance;
+                    nearestVertex[ i ] = cluster.vertices[ j ];
+                } // if
 
-                for ( j = 0; j < numberOfClusterVertices; ++j ) {
-                    unsigned int vertexId = beforeVertexCounter + j;
-                    math::Vector2 position = boost::get( HPASearch::VertexPosition( ), *this->abstractGraph, vertexId );
+            } // for
+        } // for
 
-                    for ( i = 0; i < nearestEntrances.size( ); ++i ) {
-                        math::Vector2 entrancePosition = boost::get( HPASearch::VertexPosition( ),
-                                                         *this->abstractGraph,
-                                                         this->graphVertices[ nearestEntrances[ i ] ] );
+        // connect all entrances to the inner graph
+        for ( i = 0; i < nearestEntrances.size( ); ++i ) {
+            cluster.entranceEdges.push_back( ClusterGraph::WeightedEdge(
+                Edge( nearestEntrances[ i ], nearestVertex[ i ] ), distances[ i ] ) );
+        } // for
 
-                        float candidateDistance = ( position - entrancePosition ).length( );
+    } else {
+        // there is no obstacle inside cluster, so
+        // inter-connect all entrances
+        for ( i = 0; i < nearestEntrances.size( ); ++i ) {
+            for ( j = i + 1; j < nearestEntrances.size( ); ++j ) {
+                Point position1 = map->unsnap( nearestEntrances[ i ] );
+                Point position2 = map->unsnap( nearestEntrances[ j ] );
+
+                float distance = ( math::Vector2( position1.first, position1.second ) -
+                                   math::Vector2( position2.first, position2.second ) ).length( );
+
+                cluster.entranceEdges.push_back( ClusterGraph::WeightedEdge(
+                    Edge( nearestEntrances[ i ], nearestEntrances[ j ] ), distance ) );
+            } // for
+        } // for
 
-                        if ( candidateDistance < distances[ i ] ) {
-                            distances[ i ] = candidateDistance;
-                            nearestVertex[ i ] = vertexId;
-                        } // if
+    } // else
+}
 
-                    } // for
-                } // for
+void HPASearch::Level::buildGraph( void )
+{
+    unsigned int numberOfVertices = this->entrances.size( ) * 2;
+    unsigned int clusterId;
+    for ( clusterId = 0; clusterId < this->clusters.size( ); ++clusterId ) {
+        numberOfVertices += this->clusters[ clusterId ].vertices.size( );
+    } // for
 
-                // connect all entrances to the inner graph
-                for ( i = 0; i < nearestEntrances.size( ); ++i ) {
-                    boost::add_edge( this->graphVertices[ nearestEntrances[ i ] ],
-                                     nearestVertex[ i ], distances[ i ], *this->abstractGraph );
-                } // for
+    delete this->abstractGraph;
+    this->abstractGraph = new Graph( numberOfVertices );
+    this->graphVertices.clear( );
+    this->clustersVertexRange.clear( );
+    this->vertexCounter = 0;
 
-            } else {
-                // there is no obstacle inside cluster, so
-                // inter-connect all entrances
-                for ( i = 0; i < nearestEntrances.size( ); ++i ) {
-                    for ( j = i + 1; j < nearestEntrances.size( ); ++j ) {
-
-                        unsigned int vertex1 = this->graphVertices[ nearestEntrances[ i ] ];
-                        unsigned int vertex2 = this->graphVertices[ nearestEntrances[ j ] ];
-                        math::Vector2 position1 = boost::get( HPASearch::VertexPosition( ),
-                                                              *this->abstractGraph,
-                                                              vertex1 );
-
-                        math::Vector2 position2 = boost::get( HPASearch::VertexPosition( ),
-                                                              *this->abstractGraph,
-                                                              vertex2 );
-
-                        boost::add_edge( vertex1, vertex2,
-                                         ( position1 - position2 ).length( ), *this->abstractGraph );
-                    } // for
-                } // for
+    // the entrances come first, then the vertices of each cluster
+    unsigned int i;
+    for ( i = 0; i < this->entrances.size( ); ++i ) {
+        setupVertex( this->entrances[ i ].first );
+        setupVertex( this->entrances[ i ].second );
+    } // for
 
-            } // else
+    for ( clusterId = 0; clusterId < this->clusters.size( ); ++clusterId ) {
+        const std::vector< GridPoint >& vertices = this->clusters[ clusterId ].vertices;
+        clustersVertexRange[ clusterId ].first = this->vertexCounter;
+        clustersVertexRange[ clusterId ].second = vertices.size( );
+
+        for ( i = 0; i < vertices.size( ); ++i ) {
+            setupVertex( vertices[ i ] );
+        } // for
+    } // for
 
+    for ( clusterId = 0; clusterId < this->clusters.size( ); ++clusterId ) {
+        const ClusterGraph& cluster = this->clusters[ clusterId ];
+        std::vector< ClusterGraph::WeightedEdge >::const_iterator it;
+        for ( it = cluster.edges.begin( ); it != cluster.edges.end( ); ++it ) {
+            boost::add_edge( this->graphVertices[ it->first.first ],
+                             this->graphVertices[ it->first.second ], it->second, *this->abstractGraph );
+        } // for
+        for ( it = cluster.entranceEdges.begin( ); it != cluster.entranceEdges.end( ); ++it ) {
+            boost::add_edge( this->graphVertices[ it->first.first ],
+                             this->graphVertices[ it->first.second ], it->second, *this->abstractGraph );
         } // for
     } // for
 
     // connect all intra cluster entrances
-    unsigned int i;
     for ( i = 0; i < this->entrances.size( ); ++i ) {
         unsigned int vertex1 = this->graphVertices[ this->entrances[ i ].first ];
         unsigned int vertex2 = this->graphVertices[ this->entrances[ i ].second ];
         boost::add_edge( vertex1, vertex2, clusterDimension.width, *this->abstractGraph );
     } // for
-
-    // make a reduced copy of the graph
-    if ( boost::num_vertices( *this->abstractGraph ) / 2 > this->vertexCounter ) {
-
-        Graph* oldGraph = this->abstractGraph;
-        this->abstractGraph = new Graph( this->vertexCounter );
-
-        boost::property_map<Graph, HPASearch::VertexPosition>::type position =
-            boost::get( HPASearch::VertexPosition( ), *this->abstractGraph );
-
-        // copy vertices
-        unsigned int i;
-        for ( i = 0; i < this->vertexCounter; ++i ) {
-            math::Vector2 realPosition =
-                boost::get( HPASearch::VertexPosition( ), *oldGraph, i );
-            boost::put( position, i, realPosition );
-        } // if
-
-        // copy edges
-        EdgeIterator it = boost::edges( *oldGraph );
-        while ( it.first != it.second ) {
-
-            VertexDescriptor v1 = boost::source( *it.first, *oldGraph );
-            VertexDescriptor v2 = boost::target( *it.first, *oldGraph );
-
-            boost::add_edge( v1, v2, 0, *this->abstractGraph );
-            ++it.first;
-        } // while
-
-        delete oldGraph;
-
-    } // if
-
-
-
 }
 
 void HPASearch::Level::setupVertex( const GridPoint& gridPoint )
@@ -234,6 +338,9 @@ void HPASearch::Level::buildEntrance( unsigned int row, unsigned int col, bool h
     float numberOfCols = clusterDimension.width / map->xGridWidth( );
     float numberOfRows = clusterDimension.height / map->yGridWidth( );
 
+    std::vector< Edge >& boundary = this->boundaryEntrances[ getBoundaryId( row, col, horizontal ) ];
+    boundary.clear( );
+
     if ( horizontal ) {
         unsigned int topLeftCluster1Col = static_cast<unsigned int>
                                           ( ( col * numberOfCols ) + numberOfCols - 1 );
@@ -253,27 +360,13 @@ void HPASearch::Level::buildEntrance( unsigned int row, unsigned int col, bool h
                 localEntrances.push_back( std::pair<GridPoint, GridPoint>( cell1, cell2 ) );
             } else if ( localEntrances.size( ) > 0 ) {
                 unsigned int selectedIndex = ( localEntrances.size( ) ) / 2;
-                std::pair<GridPoint, GridPoint>& entrance = localEntrances[ selectedIndex ];
-                this->entrances.push_back( entrance );
-
-                this->clusterEntrances[ getClusterId( entrance.first ) ].push_back( entrance.first );
-                this->clusterEntrances[ getClusterId( entrance.second ) ].push_back( entrance.second );
-
-                setupVertex( entrance.first );
-                setupVertex( entrance.second );
+                boundary.push_back( localEntrances[ selectedIndex ] );
             } // else
         } // for
 
         if ( localEntrances.size( ) > 0 ) {
             unsigned int selectedIndex = ( localEntrances.size( ) ) / 2;
-            std::pair<GridPoint, GridPoint>& entrance = localEntrances[ selectedIndex ];
-            this->entrances.push_back( entrance );
-
-            this->clusterEntrances[ getClusterId( entrance.first ) ].push_back( entrance.first );
-            this->clusterEntrances[ getClusterId( entrance.second ) ].push_back( entrance.second );
-
-            setupVertex( entrance.first );
-            setupVertex( entrance.second );
+            boundary.push_back( localEntrances[ selectedIndex ] );
         } // if
     } else {
         unsigned int bottomLeftCluster1Col = static_cast<unsigned int>( col * numberOfCols );
@@ -292,28 +385,14 @@ void HPASearch::Level::buildEntrance( unsigned int row, unsigned int col, bool h
                 localEntrances.push_back( std::pair<GridPoint, GridPoint>( cell1, cell2 ) );
             } else if ( localEntrances.size( ) > 0 ) {
                 unsigned int selectedIndex = ( localEntrances.size( ) ) / 2;
-                std::pair<GridPoint, GridPoint>& entrance = localEntrances[ selectedIndex ];
-                this->entrances.push_back( entrance );
-
-                this->clusterEntrances[ getClusterId( entrance.first ) ].push_back( entrance.first );
-                this->clusterEntrances[ getClusterId( entrance.second ) ].push_back( entrance.second );
-
-                setupVertex( entrance.first );
-                setupVertex( entrance.second );
+                boundary.push_back( localEntrances[ selectedIndex ] );
             } // else
 
         } // for
 
         if ( localEntrances.size( ) > 0 ) {
             unsigned int selectedIndex = ( localEntrances.size( ) ) / 2;
-            std::pair<GridPoint, GridPoint>& entrance = localEntrances[ selectedIndex ];
-            this->entrances.push_back( entrance );
-
-            this->clusterEntrances[ getClusterId( entrance.first ) ].push_back( entrance.first );
-            this->clusterEntrances[ getClusterId( entrance.second ) ].push_back( entrance.second );
-
-            setupVertex( entrance.first );
-            setupVertex( entrance.second );
+            boundary.push_back( localEntrances[ selectedIndex ] );
         } // if
 
     } // else
@@ -372,7 +451,7 @@ bool HPASearch::Level::processPath( const math::Vector2& startPoint, const math:
 
     this->processedPath.clear( );
 
-    if ( this->needsUpdate ) {
+    if ( this->needsUpdate || !this->dirtyClusters.empty( ) ) {
         buildClusters( );
         this->needsUpdate = false;
     } // if
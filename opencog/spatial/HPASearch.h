@@ -27,6 +27,7 @@
 #include <opencog/spatial/LocalSpaceMap2D.h>
 #include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/astar_search.hpp>
+#include <set>
 #include <string>
 #include <opencog/spatial/Prerequisites.h>
 #include <opencog/spatial/math/Dimension2.h>
@@ -74,6 +75,22 @@ namespace opencog
             typedef std::pair < boost::graph_traits < Graph >::edge_iterator,
                 boost::graph_traits < Graph >::edge_iterator > EdgeIterator;
 
+            /**
+             * struct ClusterGraph
+             * The part of the abstract graph inside a cluster: the vertices of
+             * its quad tree and the edges between them, plus the edges from its
+             * entrances to them, with their costs. The vertices are kept by grid
+             * cell, so the cached graph doesn't depend on the numbering of the
+             * whole abstract graph.
+             */
+            struct ClusterGraph {
+                typedef std::pair< Edge, float > WeightedEdge;
+
+                std::vector< GridPoint > vertices;
+                std::vector< WeightedEdge > edges;
+                std::vector< WeightedEdge > entranceEdges;
+            };
+
             /**
              * class FoundGoal
              * Exception throwed when a path was found
@@ -129,8 +146,12 @@ namespace opencog
              * class Level
              * HPA* can handle multiple levels in a hierarchical way,
              * Each level has n clusters. More clusters means that such level is more detailed
+             *
+             * A level listens to the changes of the obstacles of its map. Only the
+             * changed clusters, and the entrances on their borders, are built again
+             * before the next path is processed; the other clusters keep their graphs.
              */
-            class Level
+            class Level : public LocalSpaceMapListener
             {
             public:
 
@@ -138,6 +159,13 @@ namespace opencog
 
                 virtual ~Level( );
 
+                void obstaclesChanged( const GridPoint& low, const GridPoint& high );
+
+                void mapDestroyed( void );
+
+                // number of clusters that were built again since this level was created
+                unsigned int getNumberOfClusterBuilds( void ) const;
+
                 const Graph& getAbstractGraph( void );
 
                 bool processPath( const math::Vector2& startPoint, const math::Vector2& endPoint ) throw( opencog::RuntimeException );
@@ -154,9 +182,25 @@ namespace opencog
 
             protected:
 
+                // build the dirty clusters (all of them if needsUpdate is set)
+                // and assemble the abstract graph
                 void buildClusters( void );
 
+                // find the entrances between the cluster at row and col and the
+                // one at its right (horizontal) or below it
                 void buildEntrance( unsigned int row, unsigned int col, bool horizontal );
+
+                // rebuild entrances and clusterEntrances from boundaryEntrances
+                void collectEntrances( void );
+
+                // connect the entrances of a cluster to its inner vertices
+                void connectEntrances( unsigned int clusterId );
+
+                // build the abstract graph from the cached cluster graphs
+                void buildGraph( void );
+
+                unsigned int getBoundaryId( unsigned int row, unsigned int col, bool horizontal ) const;
+
                 GridPoint getNearestEntrance( unsigned int clusterId, const math::Vector2& position );
 
                 GridPoint getNearestVertex( unsigned int clusterId, const math::Vector2& position );
@@ -184,7 +228,16 @@ namespace opencog
                 unsigned int numberOfCols;
                 unsigned int numberOfRows;
 
+                // the entrances of each boundary between two clusters
+                std::vector< std::vector< Edge > > boundaryEntrances;
+                // the cached graphs of the clusters, by row * numberOfCols + col
+                std::vector< ClusterGraph > clusters;
+                std::set< unsigned int > dirtyClusters;
+                unsigned int numberOfClusterBuilds;
+
                 bool needsUpdate;
+                // false once the map is gone, so it can't be unregistered from
+                bool listening;
 
                 friend class Cluster;
                 friend class QuadTree;
@@ -0,0 +1,147 @@
+/*
+ * opencog/spatial/HPASearchBenchmark.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+// Replays a trace of object movements on a LocalSpaceMap2D, processing a
+// path after each one. The HPASearch kept along the trace only builds the
+// clusters the moves changed; it is compared with an HPASearch built from
+// scratch every frame, which must find the same paths.
+//
+// Usage: hpabench [frames] [seed]
+
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+#include <opencog/util/mt19937ar.h>
+
+#include <opencog/spatial/HPASearch.h>
+#include <opencog/spatial/LocalSpaceMap2D.h>
+
+using namespace std;
+
+using namespace opencog;
+using namespace opencog::spatial;
+
+const unsigned int DEFAULT_FRAMES = 100;
+const unsigned int NUMBER_OF_OBJECTS = 60;
+
+const float MAP_SIZE = 128.0;
+const unsigned int MAP_DIM = 512;
+const float AGENT_RADIUS = 0.354f;
+
+// one frame of the trace: an object moves and a path is processed
+struct Move {
+    string id;
+    ObjectMetaData metadata;
+    math::Vector2 start;
+    math::Vector2 end;
+};
+
+float randomCoordinate(float margin)
+{
+    return -MAP_SIZE / 2 + margin + randGen().randfloat() * (MAP_SIZE - 2 * margin);
+}
+
+ObjectMetaData randomObject(void)
+{
+    return ObjectMetaData(randomCoordinate(10), randomCoordinate(10), 0,
+                          1 + randGen().randfloat() * 6,
+                          1 + randGen().randfloat() * 6,
+                          2, 0);
+}
+
+// every frame one of the objects takes a small step
+vector<Move> buildTrace(const vector<ObjectMetaData>& objects, unsigned int frames)
+{
+    vector<ObjectMetaData> positions(objects);
+    vector<Move> trace;
+    for (unsigned int i = 0; i < frames; i++) {
+        Move move;
+        unsigned int object = randGen().randint(positions.size());
+        positions[object].centerX += randGen().randfloat() * 2 - 1;
+        positions[object].centerY += randGen().randfloat() * 2 - 1;
+
+        stringstream id;
+        id << "object" << object;
+        move.id = id.str();
+        move.metadata = positions[object];
+        move.start = math::Vector2(randomCoordinate(1), randomCoordinate(1));
+        move.end = math::Vector2(randomCoordinate(1), randomCoordinate(1));
+        trace.push_back(move);
+    }
+    return trace;
+}
+
+int main(int argc, char * argv[])
+{
+    unsigned int frames = (argc > 1) ? atoi(argv[1]) : DEFAULT_FRAMES;
+    randGen().seed((argc > 2) ? atoi(argv[2]) : time(0));
+
+    LocalSpaceMap2D map(-MAP_SIZE / 2, MAP_SIZE / 2, MAP_DIM,
+                        -MAP_SIZE / 2, MAP_SIZE / 2, MAP_DIM, AGENT_RADIUS);
+
+    vector<ObjectMetaData> objects;
+    for (unsigned int i = 0; i < NUMBER_OF_OBJECTS; i++) {
+        stringstream id;
+        id << "object" << i;
+        objects.push_back(randomObject());
+        map.addObject(id.str(), objects.back(), true);
+    }
+    vector<Move> trace = buildTrace(objects, frames);
+
+    HPASearch incremental(&map);
+    double incrementalSeconds = 0;
+    double fullSeconds = 0;
+    unsigned int found = 0;
+
+    for (vector<Move>::const_iterator it = trace.begin(); it != trace.end(); ++it) {
+        map.updateObject(it->id, it->metadata, true);
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        bool incrementalFound = incremental.processPath(it->start, it->end);
+        incrementalSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        start = chrono::steady_clock::now();
+        HPASearch full(&map);
+        bool fullFound = full.processPath(it->start, it->end);
+        fullSeconds += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        if (incrementalFound != fullFound ||
+                incremental.getProcessedPath(1) != full.getProcessedPath(1)) {
+            cout << "the incremental and full searches found different paths!" << endl;
+            return 1;
+        }
+        found += incrementalFound ? 1 : 0;
+    }
+
+    HPASearch::Level* level = incremental.getLevel(1);
+    cout << frames << " frames, " << NUMBER_OF_OBJECTS << " moving objects, "
+         << found << " paths found" << endl;
+    cout << "  " << setw(12) << "incremental"
+         << setw(12) << fixed << setprecision(2) << incrementalSeconds * 1000.0 / frames << " ms/frame"
+         << setw(8) << level->getNumberOfClusterBuilds() << " cluster builds" << endl;
+    cout << "  " << setw(12) << "full"
+         << setw(12) << fullSeconds * 1000.0 / frames << " ms/frame" << endl;
+    cout << "  speedup " << setprecision(1)
+         << fullSeconds / max(incrementalSeconds, 1e-9) << "x" << endl;
+
+    return 0;
+}
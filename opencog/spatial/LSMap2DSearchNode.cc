@@ -24,6 +24,8 @@
 #include <opencog/spatial/LSMap2DSearchNode.h>
 #include <opencog/util/exceptions.h>
 
+#include <boost/functional/hash.hpp>
+
 using namespace opencog;
 using namespace opencog::spatial;
 
@@ -68,6 +70,14 @@ bool LSMap2DSearchNode::IsSameState(const LSMap2DSearchNode &rhs)
     }
 }
 
+size_t LSMap2DSearchNode::Hash() const
+{
+    size_t seed = 0;
+    boost::hash_combine(seed, x);
+    boost::hash_combine(seed, y);
+    return seed;
+}
+
 void LSMap2DSearchNode::PrintNodeInfo()
 {
     char str[100];
@@ -66,6 +66,7 @@ namespace opencog
             bool GetSuccessors(AStarSearch<LSMap2DSearchNode> *astarsearch, LSMap2DSearchNode *parent_node );
             float GetCost(const LSMap2DSearchNode &successor);
             bool IsSameState(const LSMap2DSearchNode &rhs);
+            size_t Hash() const;
             bool isLegal(unsigned int x, unsigned int);
             bool isLegal();
             static void setHeuristic(int h);
@@ -24,6 +24,8 @@
 #include <opencog/spatial/LSMap3DSearchNode.h>
 #include <opencog/util/exceptions.h>
 
+#include <boost/functional/hash.hpp>
+
 using namespace opencog;
 using namespace opencog::spatial;
 
@@ -84,6 +86,15 @@ bool LSMap3DSearchNode::IsSameState(const LSMap3DSearchNode &rhs)
     }
 }
 
+size_t LSMap3DSearchNode::Hash() const
+{
+    // the heights of the same state only need to be close, so they are not hashed
+    size_t seed = 0;
+    boost::hash_combine(seed, x);
+    boost::hash_combine(seed, y);
+    return seed;
+}
+
 void LSMap3DSearchNode::PrintNodeInfo()
 {
     char str[100];
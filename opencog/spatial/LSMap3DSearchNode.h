@@ -75,6 +75,7 @@ namespace opencog
             bool GetSuccessors(AStarSearch<LSMap3DSearchNode> *astarsearch, LSMap3DSearchNode *parent_node );
             float GetCost(const LSMap3DSearchNode &successor);
             bool IsSameState(const LSMap3DSearchNode &rhs);
+            size_t Hash() const;
             bool isLegal();
             bool isLegal(unsigned int, unsigned int);
             double getDestHeight(const GridPoint& dest) const;
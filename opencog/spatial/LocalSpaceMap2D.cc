@@ -183,7 +183,9 @@ LocalSpaceMap2D::LocalSpaceMap2D(spatial::Distance xMin, spatial::Distance xMax,
                                  spatial::Distance floor):
         _xMin(xMin), _xMax(xMax), _xDim(xDim),
         _yMin(yMin), _yMax(yMax), _yDim(yDim),
-        _radius(radius)
+        _radius(radius),
+        _occupancy(xDim, yDim), _occupancy_nonObstacle(xDim, yDim),
+        _objectIndex(xDim, yDim)
 {
     _floorHeight = floor;
     _agentHeight = agentHeight;
@@ -194,6 +196,10 @@ LocalSpaceMap2D::LocalSpaceMap2D(spatial::Distance xMin, spatial::Distance xMax,
 
 LocalSpaceMap2D::~LocalSpaceMap2D()
 {
+    std::list<LocalSpaceMapListener*>::const_iterator it;
+    for ( it = listeners.begin( ); it != listeners.end( ); ++it ) {
+        (*it)->mapDestroyed( );
+    } // for
 }
 
 LocalSpaceMap2D* LocalSpaceMap2D::clone() const
@@ -214,6 +220,9 @@ LocalSpaceMap2D* LocalSpaceMap2D::clone() const
     clonedMap->gridPoints = this->gridPoints;
     clonedMap->_grid = _grid;
     clonedMap->_grid_nonObstacle = _grid_nonObstacle;
+    clonedMap->_occupancy = _occupancy;
+    clonedMap->_occupancy_nonObstacle = _occupancy_nonObstacle;
+    clonedMap->_objectIndex = _objectIndex;
 
     return clonedMap;
 }
@@ -642,8 +651,7 @@ bool LocalSpaceMap2D::gridIllegal(unsigned int i, unsigned int j) const
 
 bool LocalSpaceMap2D::gridOccupied(const spatial::GridPoint& gp) const
 {
-    spatial::GridMap::const_iterator itr = _grid.find(gp);
-    return (itr != _grid.end() && !(itr->second.empty()));
+    return _occupancy.test(gp);
 }
 
 bool LocalSpaceMap2D::gridOccupied(unsigned int i, unsigned int j) const
@@ -653,8 +661,7 @@ bool LocalSpaceMap2D::gridOccupied(unsigned int i, unsigned int j) const
 
 bool LocalSpaceMap2D::gridOccupied_nonObstacle(const spatial::GridPoint& gp) const
 {
-    spatial::GridMap::const_iterator itr = _grid_nonObstacle.find(gp);
-    return (itr != _grid_nonObstacle.end() && !(itr->second.empty()));
+    return _occupancy_nonObstacle.test(gp);
 }
 
 bool LocalSpaceMap2D::gridOccupied_nonObstacle(unsigned int i, unsigned int j) const
@@ -894,6 +901,7 @@ void LocalSpaceMap2D::removeObject(const spatial::ObjectID& id)
             }
             if ( _grid[ entityGridPoints[i] ].size( ) == 0 ) {
                 _grid.erase( entityGridPoints[i] );
+                _occupancy.set( entityGridPoints[i], false );
             } // if
         } else {
             ObjectInfoSet::iterator obj_info_it = _grid_nonObstacle[ entityGridPoints[i] ].find(info);
@@ -902,9 +910,14 @@ void LocalSpaceMap2D::removeObject(const spatial::ObjectID& id)
             }
             if ( _grid_nonObstacle[ entityGridPoints[i] ].size( ) == 0 ) {
                 _grid_nonObstacle.erase( entityGridPoints[i] );
+                _occupancy_nonObstacle.set( entityGridPoints[i], false );
             } // if
         } // else
     } // for
+    _objectIndex.remove( id );
+    if ( isObstacle ) {
+        notifyObstaclesChanged( entityGridPoints );
+    } // if
 
     this->gridPoints.erase( idHash );
     this->entities.erase( it );
@@ -1214,10 +1227,16 @@ void LocalSpaceMap2D::addObject( const spatial::ObjectID& id, const spatial::Obj
         ObjectInfo info(internalId, false);
         if ( isObstacle ) {
             _grid[ entityGridPoints[i] ].insert(info);
+            _occupancy.set( entityGridPoints[i], true );
         } else {
             _grid_nonObstacle[ entityGridPoints[i] ].insert(info);
+            _occupancy_nonObstacle.set( entityGridPoints[i], true );
         } // else
     } // for
+    _objectIndex.add( id, idHash, entityGridPoints );
+    if ( isObstacle ) {
+        notifyObstaclesChanged( entityGridPoints );
+    } // if
 
 }
 
@@ -1270,11 +1289,15 @@ void LocalSpaceMap2D::addBlock(const ObjectID& id, const ObjectMetaData& metadat
     for (i = 0; i < solidArea.size(); ++i) {
         ObjectInfo info(internalId, false);
         _grid[solidArea[i]].insert(info);
+        _occupancy.set(solidArea[i], true);
     } // for
     for (i = 0; i < expansionArea.size(); ++i) {
         ObjectInfo info(internalId, true);
         _grid[expansionArea[i]].insert(info);
+        _occupancy.set(expansionArea[i], true);
     } // for
+    _objectIndex.add(id, idHash, totalArea);
+    notifyObstaclesChanged(totalArea);
 }
 
 void LocalSpaceMap2D::updateObject( const spatial::ObjectID& id, const spatial::ObjectMetaData& metadata, bool isObstacle )
@@ -1303,6 +1326,38 @@ void LocalSpaceMap2D::updateObject( const spatial::ObjectID& id, const spatial::
     } // catch
 }
 
+void LocalSpaceMap2D::addListener( LocalSpaceMapListener* listener )
+{
+    listeners.push_back( listener );
+}
+
+void LocalSpaceMap2D::removeListener( LocalSpaceMapListener* listener )
+{
+    listeners.remove( listener );
+}
+
+void LocalSpaceMap2D::notifyObstaclesChanged( const std::vector<spatial::GridPoint>& points ) const
+{
+    if ( points.empty( ) || listeners.empty( ) ) {
+        return;
+    } // if
+
+    spatial::GridPoint low = points.front( );
+    spatial::GridPoint high = points.front( );
+    std::vector<spatial::GridPoint>::const_iterator it;
+    for ( it = points.begin( ); it != points.end( ); ++it ) {
+        low.first = std::min( low.first, it->first );
+        low.second = std::min( low.second, it->second );
+        high.first = std::max( high.first, it->first );
+        high.second = std::max( high.second, it->second );
+    } // for
+
+    std::list<LocalSpaceMapListener*>::const_iterator it2;
+    for ( it2 = listeners.begin( ); it2 != listeners.end( ); ++it2 ) {
+        (*it2)->obstaclesChanged( low, high );
+    } // for
+}
+
 const EntityPtr& LocalSpaceMap2D::getEntity( const std::string& id ) const throw (opencog::NotFoundException)
 {
     long idHash = boost::hash<std::string>()( id );
@@ -1357,9 +1412,11 @@ const SuperEntityPtr& LocalSpaceMap2D::getSuperEntityWhichContains( const spatia
  */
 rec_find::rec_find(const spatial::GridPoint& current,
                    const spatial::GridMap& grid,
+                   const spatial::OccupancyGrid& occupancy,
                    spatial::ObjectIDSet& out,
                    const spatial::LocalSpaceMap2D& parent) :
-        _current(current), _g(current), _grid(grid), _out(out), _parent(&parent)
+        _current(current), _g(current), _grid(grid), _occupancy(occupancy),
+        _out(out), _parent(&parent)
 {
 
     //initialize walk_arround parameters
@@ -1401,7 +1458,9 @@ void rec_find::move_down()
 void rec_find::check_grid()
 {
     // if there is something in this grid
-
+    if (!_occupancy.test(_current)) {
+        return;
+    }
 
     spatial::GridMap::const_iterator it = _grid.find(_current);
 
@@ -32,10 +32,12 @@
 #include <opencog/util/mt19937ar.h>
 
 #include <opencog/spatial/LocalSpaceMap2DUtil.h>
+#include <opencog/spatial/LocalSpaceMap2DIndex.h>
 
 #include <iostream>
 #include <exception>
 #include <boost/bind.hpp>
+#include <limits>
 #include <string>
 
 #include <opencog/spatial/SuperEntity.h>
@@ -69,6 +71,8 @@ namespace opencog
             const GridPoint& _g;
 
             const GridMap& _grid;
+            // the cells of _grid that have objects, to skip the empty ones
+            const OccupancyGrid& _occupancy;
 
             ObjectIDSet& _out;
 
@@ -92,6 +96,7 @@ namespace opencog
         public:
             rec_find(const GridPoint& current,
                      const GridMap& grid,
+                     const OccupancyGrid& occupancy,
                      ObjectIDSet& out,
                      const LocalSpaceMap2D& parent);
 
@@ -99,6 +104,24 @@ namespace opencog
 
         }; // struct rec_find
 
+        /**
+         * Interface of the objects that keep structures built over the grid
+         * of a LocalSpaceMap2D, so they can update them only where the
+         * obstacles have changed. See LocalSpaceMap2D::addListener
+         */
+        class LocalSpaceMapListener
+        {
+        public:
+            virtual ~LocalSpaceMapListener( ) { }
+
+            // an obstacle was added to or removed from the cells of the
+            // rectangle between low and high (inclusive)
+            virtual void obstaclesChanged( const GridPoint& low, const GridPoint& high ) = 0;
+
+            // the map is being destroyed and won't notify anything else
+            virtual void mapDestroyed( void ) = 0;
+        };
+
         class LocalSpaceMap2D
         {
 
@@ -107,6 +130,15 @@ namespace opencog
             GridMap _grid;
             GridMap _grid_nonObstacle;
 
+            // dense copies of the occupied cells of _grid and _grid_nonObstacle,
+            // for the occupancy tests of path planning
+            OccupancyGrid _occupancy;
+            OccupancyGrid _occupancy_nonObstacle;
+
+            // the objects by the buckets of grid cells they are in, for the
+            // nearest object and objects within distance queries
+            ObjectBucketIndex _objectIndex;
+
             //    ObjectHashMap objects;
 
             std::list<SuperEntityPtr> superEntities;
@@ -136,6 +168,10 @@ namespace opencog
             // used only for test
             const GridSet _empty_set;
 
+            std::list<LocalSpaceMapListener*> listeners;
+
+            void notifyObstaclesChanged( const std::vector<GridPoint>& points ) const;
+
             bool outsideMap( const std::vector<math::LineSegment>& segments );
 
             /**
@@ -297,8 +333,8 @@ namespace opencog
                 Out findEntities(const GridPoint& g, Distance d, Out out) const {
                 ObjectIDSet objs;
 
-                struct rec_find finder(g, _grid, objs, *this);
-                struct rec_find finderNonObstacle(g, _grid_nonObstacle, objs, *this);
+                struct rec_find finder(g, _grid, _occupancy, objs, *this);
+                struct rec_find finderNonObstacle(g, _grid_nonObstacle, _occupancy_nonObstacle, objs, *this);
 
                 finder.johnnie_walker(d);
                 finderNonObstacle.johnnie_walker(d);
@@ -306,56 +342,106 @@ namespace opencog
                 return std::copy(objs.begin(), objs.end(), out);
 
             }
+
+            //find the IDs of all objects with some point within (euclidean)
+            //distance d of a certain point, using the object index
+            template<typename Out>
+                Out findEntitiesWithinDistance(const Point& p, Distance d, Out out) const {
+                ObjectIDSet objs;
+
+                const ObjectIDTable& ids = _objectIndex.ids();
+                std::vector<bool> visited(ids.capacity(), false);
+
+                GridPoint low = snap(Point(p.first - d, p.second - d));
+                GridPoint high = snap(Point(p.first + d, p.second + d));
+                unsigned int bucketSize = ObjectBucketIndex::BUCKET_SIZE;
+
+                for (unsigned int by = low.second / bucketSize; by <= high.second / bucketSize; by++) {
+                    for (unsigned int bx = low.first / bucketSize; bx <= high.first / bucketSize; bx++) {
+                        const std::vector<InternedID>& bucket = _objectIndex.bucket(bx, by);
+                        for (std::vector<InternedID>::const_iterator it = bucket.begin(); it != bucket.end(); ++it) {
+                            if (visited[*it]) {
+                                continue;
+                            }
+                            visited[*it] = true;
+                            const ObjectID& id = ids.name(*it);
+                            if (minDist(id, p) <= d) {
+                                objs.insert(id.c_str());
+                            }
+                        }
+                    }
+                }
+
+                return std::copy(objs.begin(), objs.end(), out);
+            }
+
             //find the minimal distance between some point in an object and a reference
             //point
             Distance minDist(const ObjectID& id, const Point& p) const;
 
             //find the nearest entity to a given point satisfying some predicate
+            //
+            //the buckets of the object index are visited in square rings around
+            //the point, until a ring is farther than the nearest object found
             template<typename Pred>
                 ObjectID findNearestFiltered(const Point& p, Pred pred) const {
 
-                std::vector<ObjectID> tmp;
-                Distance d = 5;
+                const ObjectIDTable& ids = _objectIndex.ids();
+                std::vector<bool> visited(ids.capacity(), false);
 
-                //convert to greidPoint
                 GridPoint g = snap(p);
-
-                Distance x = fmax(xDim() - g.first - 1, g.first);
-                Distance y = fmax(yDim() - g.second - 1, g.second);
-                Distance maxD = sqrt((x * x) + (y * y));
-
-                ObjectIDSet objs;
-
-                struct rec_find finder(g, _grid, objs, *this);
-                struct rec_find finderNonObstacle(g, _grid_nonObstacle, objs, *this);
-
-                do {
-                    finder.johnnie_walker(d);
-                    finderNonObstacle.johnnie_walker(d);
-
-                    std::copy(objs.begin(), objs.end(), back_inserter(tmp));
-
-                    tmp.erase(std::partition(tmp.begin(), tmp.end(), pred), tmp.end());
-
-                    if (d >= maxD && tmp.empty()) {
-                        opencog::logger().debug("LocalSpaceMap - Found no object that verifies the predicate. Distance %.2f, Max distance %.2f.", d, maxD);
-                        //won't find anything
-                        return ObjectID();
+                unsigned int bucketSize = ObjectBucketIndex::BUCKET_SIZE;
+                unsigned int bx = g.first / bucketSize;
+                unsigned int by = g.second / bucketSize;
+                unsigned int lastBx = _objectIndex.xBuckets() - 1;
+                unsigned int lastBy = _objectIndex.yBuckets() - 1;
+                unsigned int maxRing = std::max(std::max(bx, lastBx - bx), std::max(by, lastBy - by));
+
+                // the points in the buckets of ring r are at least r - 1 buckets away
+                Distance bucketWidth = bucketSize * std::min(xGridWidth(), yGridWidth());
+
+                ObjectID nearest;
+                Distance nearestDist = std::numeric_limits<Distance>::max();
+
+                for (unsigned int ring = 0; ring <= maxRing; ring++) {
+                    if (ring > 0 && (ring - 1) * bucketWidth > nearestDist) {
+                        break;
                     }
-                    d *= 1.5; //maybe it shouldn't grow so fast?
-                    if (d > maxD ) {
-                        d = maxD;
+                    unsigned int x0 = (bx >= ring) ? bx - ring : 0;
+                    unsigned int y0 = (by >= ring) ? by - ring : 0;
+                    unsigned int x1 = std::min(bx + ring, lastBx);
+                    unsigned int y1 = std::min(by + ring, lastBy);
+
+                    for (unsigned int y = y0; y <= y1; y++) {
+                        for (unsigned int x = x0; x <= x1; x++) {
+                            // only the border of the ring
+                            if (x + ring != bx && x != bx + ring && y + ring != by && y != by + ring) {
+                                continue;
+                            }
+                            const std::vector<InternedID>& bucket = _objectIndex.bucket(x, y);
+                            for (std::vector<InternedID>::const_iterator it = bucket.begin(); it != bucket.end(); ++it) {
+                                if (visited[*it]) {
+                                    continue;
+                                }
+                                visited[*it] = true;
+                                const ObjectID& id = ids.name(*it);
+                                if (!pred(id)) {
+                                    continue;
+                                }
+                                Distance d = minDist(id, p);
+                                if (d < nearestDist) {
+                                    nearestDist = d;
+                                    nearest = id;
+                                }
+                            }
+                        }
                     }
+                }
 
-                } while (tmp.empty());
-
-                //now find the closest
-                std::vector<Distance> dists(tmp.size());
-                std::transform(tmp.begin(), tmp.end(), dists.begin(),
-                               boost::bind(&LocalSpaceMap2D::minDist, this,  ::_1, boost::cref(p)));
-
-                return *(tmp.begin() + distance(dists.begin(),
-                                                min_element(dists.begin(), dists.end())));
+                if (nearest.empty()) {
+                    opencog::logger().debug("LocalSpaceMap - Found no object that verifies the predicate.");
+                }
+                return nearest;
             }
 
             //find a random entity satisfying some predicate
@@ -535,6 +621,16 @@ namespace opencog
              */
             void updateObject( const ObjectID& id, const ObjectMetaData& metadata, bool isObstacle = false );
 
+            /**
+             * Register a listener to be notified of the changes on the
+             * obstacles of this map. Listeners are not copied by clone
+             *
+             * @param listener The listener, which must be removed before it is deleted
+             */
+            void addListener( LocalSpaceMapListener* listener );
+
+            void removeListener( LocalSpaceMapListener* listener );
+
             //const Object& getObject( const ObjectID& id ) const throw (opencog::NotFoundException);
 
             const EntityPtr& getEntity( const std::string& id ) const throw (opencog::NotFoundException);
@@ -0,0 +1,182 @@
+/*
+ * opencog/spatial/LocalSpaceMap2DIndex.cc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <opencog/spatial/LocalSpaceMap2DIndex.h>
+
+#include <algorithm>
+
+using namespace opencog;
+using namespace opencog::spatial;
+
+/** ---------------------------------------------------------------------------
+ * OccupancyGrid
+ * ----------------------------------------------------------------------------
+ */
+OccupancyGrid::OccupancyGrid(unsigned int xDim, unsigned int yDim) :
+    _xDim(xDim), _yDim(yDim)
+{
+    unsigned int words = (xDim + 63) / 64;
+    _wordsPerRow = (words + WORDS_PER_LINE - 1) / WORDS_PER_LINE * WORDS_PER_LINE;
+    _storage.assign((size_t) _wordsPerRow * yDim + WORDS_PER_LINE, 0);
+    alignWords();
+}
+
+OccupancyGrid::OccupancyGrid(const OccupancyGrid& other) :
+    _xDim(other._xDim), _yDim(other._yDim), _wordsPerRow(other._wordsPerRow),
+    _storage(other._storage.size(), 0)
+{
+    alignWords();
+    std::copy(other._words, other._words + (size_t) _wordsPerRow * _yDim, _words);
+}
+
+OccupancyGrid& OccupancyGrid::operator=(const OccupancyGrid& other)
+{
+    if (this != &other) {
+        _xDim = other._xDim;
+        _yDim = other._yDim;
+        _wordsPerRow = other._wordsPerRow;
+        _storage.assign(other._storage.size(), 0);
+        alignWords();
+        std::copy(other._words, other._words + (size_t) _wordsPerRow * _yDim, _words);
+    }
+    return *this;
+}
+
+void OccupancyGrid::alignWords()
+{
+    uintptr_t address = (uintptr_t) &_storage[0];
+    uintptr_t lineSize = WORDS_PER_LINE * sizeof(uint64_t);
+    _words = (uint64_t*) ((address + lineSize - 1) / lineSize * lineSize);
+}
+
+void OccupancyGrid::set(const GridPoint& gp, bool occupied)
+{
+    if (gp.first >= _xDim || gp.second >= _yDim) {
+        return;
+    }
+    uint64_t& word = _words[gp.second * _wordsPerRow + (gp.first >> 6)];
+    uint64_t bit = (uint64_t) 1 << (gp.first & 63);
+    if (occupied) {
+        word |= bit;
+    } else {
+        word &= ~bit;
+    }
+}
+
+void OccupancyGrid::clear()
+{
+    std::fill(_storage.begin(), _storage.end(), 0);
+}
+
+/** ---------------------------------------------------------------------------
+ * ObjectIDTable
+ * ----------------------------------------------------------------------------
+ */
+InternedID ObjectIDTable::intern(const ObjectID& id, long idHash)
+{
+    boost::unordered_map<ObjectID, InternedID>::const_iterator it = _ids.find(id);
+    if (it != _ids.end()) {
+        return it->second;
+    }
+
+    InternedID internedId;
+    if (_freeIds.empty()) {
+        internedId = _entries.size();
+        _entries.push_back(Entry());
+    } else {
+        internedId = _freeIds.back();
+        _freeIds.pop_back();
+    }
+    _entries[internedId].name = id;
+    _entries[internedId].idHash = idHash;
+    _ids[id] = internedId;
+    return internedId;
+}
+
+bool ObjectIDTable::find(const ObjectID& id, InternedID& internedId) const
+{
+    boost::unordered_map<ObjectID, InternedID>::const_iterator it = _ids.find(id);
+    if (it == _ids.end()) {
+        return false;
+    }
+    internedId = it->second;
+    return true;
+}
+
+void ObjectIDTable::release(InternedID internedId)
+{
+    _ids.erase(_entries[internedId].name);
+    _entries[internedId].name.clear();
+    _freeIds.push_back(internedId);
+}
+
+/** ---------------------------------------------------------------------------
+ * ObjectBucketIndex
+ * ----------------------------------------------------------------------------
+ */
+const unsigned int ObjectBucketIndex::BUCKET_SIZE;
+
+ObjectBucketIndex::ObjectBucketIndex(unsigned int xDim, unsigned int yDim) :
+    _xBuckets((xDim + BUCKET_SIZE - 1) / BUCKET_SIZE),
+    _yBuckets((yDim + BUCKET_SIZE - 1) / BUCKET_SIZE),
+    _buckets((size_t) _xBuckets * _yBuckets)
+{
+}
+
+void ObjectBucketIndex::add(const ObjectID& id, long idHash, const std::vector<GridPoint>& points)
+{
+    InternedID internedId;
+    if (_ids.find(id, internedId)) {
+        remove(id);
+    }
+    internedId = _ids.intern(id, idHash);
+    if (internedId >= _objectBuckets.size()) {
+        _objectBuckets.resize(internedId + 1);
+    }
+
+    std::vector<unsigned int>& objectBuckets = _objectBuckets[internedId];
+    for (std::vector<GridPoint>::const_iterator it = points.begin(); it != points.end(); ++it) {
+        unsigned int bx = std::min(it->first / BUCKET_SIZE, _xBuckets - 1);
+        unsigned int by = std::min(it->second / BUCKET_SIZE, _yBuckets - 1);
+        objectBuckets.push_back(by * _xBuckets + bx);
+    }
+    std::sort(objectBuckets.begin(), objectBuckets.end());
+    objectBuckets.erase(std::unique(objectBuckets.begin(), objectBuckets.end()), objectBuckets.end());
+
+    for (std::vector<unsigned int>::const_iterator it = objectBuckets.begin(); it != objectBuckets.end(); ++it) {
+        _buckets[*it].push_back(internedId);
+    }
+}
+
+void ObjectBucketIndex::remove(const ObjectID& id)
+{
+    InternedID internedId;
+    if (!_ids.find(id, internedId)) {
+        return;
+    }
+
+    std::vector<unsigned int>& objectBuckets = _objectBuckets[internedId];
+    for (std::vector<unsigned int>::const_iterator it = objectBuckets.begin(); it != objectBuckets.end(); ++it) {
+        std::vector<InternedID>& bucket = _buckets[*it];
+        bucket.erase(std::find(bucket.begin(), bucket.end(), internedId));
+    }
+    objectBuckets.clear();
+
+    _ids.release(internedId);
+}
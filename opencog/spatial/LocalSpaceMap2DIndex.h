@@ -0,0 +1,187 @@
+/*
+ * opencog/spatial/LocalSpaceMap2DIndex.h
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License v3 as
+ * published by the Free Software Foundation and including the exceptions
+ * at http://opencog.org/wiki/Licenses
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program; if not, write to:
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _SPATIAL_LOCAL_SPACE_MAP_2D_INDEX_H_
+#define _SPATIAL_LOCAL_SPACE_MAP_2D_INDEX_H_
+
+#include <stdint.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+#include <opencog/spatial/LocalSpaceMap2DUtil.h>
+
+namespace opencog
+{
+/** \addtogroup grp_spatial
+ *  @{
+ */
+    namespace spatial
+    {
+
+        /**
+         * A dense occupancy bitmap of a grid, one bit per cell.
+         *
+         * Each row is a whole number of 64 bytes cache lines and the first row
+         * starts on a cache line, so the cells around a given one are a few
+         * lines away whatever the size of the map.
+         */
+        class OccupancyGrid
+        {
+
+        public:
+
+            OccupancyGrid(unsigned int xDim, unsigned int yDim);
+            OccupancyGrid(const OccupancyGrid& other);
+            OccupancyGrid& operator=(const OccupancyGrid& other);
+
+            // Cells outside the grid are never occupied
+            inline bool test(unsigned int x, unsigned int y) const {
+                if (x >= _xDim || y >= _yDim) {
+                    return false;
+                }
+                return (_words[y * _wordsPerRow + (x >> 6)] >> (x & 63)) & 1;
+            }
+
+            inline bool test(const GridPoint& gp) const {
+                return test(gp.first, gp.second);
+            }
+
+            // Setting a cell outside the grid does nothing
+            void set(const GridPoint& gp, bool occupied);
+
+            void clear();
+
+        private:
+
+            enum {
+                WORDS_PER_LINE = 8
+            };
+
+            unsigned int _xDim;
+            unsigned int _yDim;
+            unsigned int _wordsPerRow;
+
+            // over-allocated by a cache line, _words is its first aligned word
+            std::vector<uint64_t> _storage;
+            uint64_t* _words;
+
+            void alignWords();
+
+        }; // class OccupancyGrid
+
+        typedef uint32_t InternedID;
+
+        /**
+         * Interns the ids of the objects of a map as small integers, which
+         * index a table with their names and id hashes. The id of a removed
+         * object is given to the next added one.
+         */
+        class ObjectIDTable
+        {
+
+        public:
+
+            InternedID intern(const ObjectID& id, long idHash);
+
+            // The interned id of the given object, false if there is none
+            bool find(const ObjectID& id, InternedID& internedId) const;
+
+            void release(InternedID internedId);
+
+            // The name stays at the same address while the object is interned
+            inline const ObjectID& name(InternedID internedId) const {
+                return _entries[internedId].name;
+            }
+
+            inline long idHash(InternedID internedId) const {
+                return _entries[internedId].idHash;
+            }
+
+            // One more than the greatest interned id
+            inline size_t capacity() const {
+                return _entries.size();
+            }
+
+        private:
+
+            struct Entry {
+                ObjectID name;
+                long idHash;
+            };
+
+            // a deque doesn't move its elements when it grows
+            std::deque<Entry> _entries;
+            boost::unordered_map<ObjectID, InternedID> _ids;
+            std::vector<InternedID> _freeIds;
+
+        }; // class ObjectIDTable
+
+        /**
+         * A uniform bucket index of the objects of a map: the grid is split in
+         * square buckets of BUCKET_SIZE cells, each one listing the objects
+         * that have a grid point in it.
+         */
+        class ObjectBucketIndex
+        {
+
+        public:
+
+            static const unsigned int BUCKET_SIZE = 16;
+
+            ObjectBucketIndex(unsigned int xDim, unsigned int yDim);
+
+            void add(const ObjectID& id, long idHash, const std::vector<GridPoint>& points);
+            void remove(const ObjectID& id);
+
+            inline const ObjectIDTable& ids() const {
+                return _ids;
+            }
+
+            inline unsigned int xBuckets() const {
+                return _xBuckets;
+            }
+
+            inline unsigned int yBuckets() const {
+                return _yBuckets;
+            }
+
+            inline const std::vector<InternedID>& bucket(unsigned int bx, unsigned int by) const {
+                return _buckets[by * _xBuckets + bx];
+            }
+
+        private:
+
+            unsigned int _xBuckets;
+            unsigned int _yBuckets;
+
+            ObjectIDTable _ids;
+            std::vector<std::vector<InternedID> > _buckets;
+            // the buckets of each object, by interned id, to remove it
+            std::vector<std::vector<unsigned int> > _objectBuckets;
+
+        }; // class ObjectBucketIndex
+
+    } // spatial
+/** @}*/
+} // opencog
+
+#endif // _SPATIAL_LOCAL_SPACE_MAP_2D_INDEX_H_
@@ -26,12 +26,12 @@
 using namespace opencog;
 using namespace opencog::spatial;
 
-QuadTree::QuadTree( HPASearch::Level* level, const GridPoint& cellPosition, unsigned int clusterSideSize, HPASearch::Graph* graph, QuadTree* parentQuad,  GridPoint* currentPosition )
+QuadTree::QuadTree( const LocalSpaceMap2D* map, const GridPoint& cellPosition, unsigned int clusterSideSize, HPASearch::ClusterGraph* cluster, QuadTree* parentQuad,  GridPoint* currentPosition )
 {
 
     this->hasFreeCenter = false;
-    this->graph = graph;
-    this->level = level;
+    this->map = map;
+    this->cluster = cluster;
     this->clusterSideSize = clusterSideSize;
     bool splitted = false;
     if ( clusterSideSize > 1 ) {
@@ -70,20 +70,20 @@ QuadTree::QuadTree( HPASearch::Level* level, const GridPoint& cellPosition, unsi
                                            cellPosition.second + row );
 
                 // split cluster if it has obstacles
-                if ( level->map->gridIllegal( currentPosition ) ) {
+                if ( map->gridIllegal( currentPosition ) ) {
                     // split on four quads
                     unsigned int nextNumberOfColumns = clusterSideSize / 2;
                     // quad 1
-                    QuadTree* quad1 = new QuadTree( level, cellPosition, nextNumberOfColumns, graph, this, &currentPosition );
+                    QuadTree* quad1 = new QuadTree( map, cellPosition, nextNumberOfColumns, cluster, this, &currentPosition );
 
                     // quad 2
-                    QuadTree* quad2 = new QuadTree( level, GridPoint( cellPosition.first + nextNumberOfColumns, cellPosition.second ), nextNumberOfColumns, graph, this, &currentPosition );
+                    QuadTree* quad2 = new QuadTree( map, GridPoint( cellPosition.first + nextNumberOfColumns, cellPosition.second ), nextNumberOfColumns, cluster, this, &currentPosition );
 
                     // quad 3
-                    QuadTree* quad3 = new QuadTree( level, GridPoint( cellPosition.first, cellPosition.second + nextNumberOfColumns ), nextNumberOfColumns, graph, this, &currentPosition );
+                    QuadTree* quad3 = new QuadTree( map, GridPoint( cellPosition.first, cellPosition.second + nextNumberOfColumns ), nextNumberOfColumns, cluster, this, &currentPosition );
 
                     // quad 4
-                    QuadTree* quad4 = new QuadTree( level, GridPoint( cellPosition.first + nextNumberOfColumns, cellPosition.second + nextNumberOfColumns ), nextNumberOfColumns, graph, this, &currentPosition );
+                    QuadTree* quad4 = new QuadTree( map, GridPoint( cellPosition.first + nextNumberOfColumns, cellPosition.second + nextNumberOfColumns ), nextNumberOfColumns, cluster, this, &currentPosition );
 
                     quads[ TOP_LEFT ].reset( quad1 );
                     quads[ TOP_RIGHT ].reset( quad2 );
@@ -105,34 +105,18 @@ QuadTree::QuadTree( HPASearch::Level* level, const GridPoint& cellPosition, unsi
             this->hasFreeCenter = true;
 
             if ( parentQuad ) {
-
-                boost::property_map<HPASearch::Graph, HPASearch::VertexPosition>::type position =
-                    boost::get( HPASearch::VertexPosition( ), *graph );
-
-                Point realPosition = level->map->unsnap( this->centerCellPosition );
-                boost::put( position, level->vertexCounter, math::Vector2( realPosition.first, realPosition.second ) );
-                this->vertexId = level->vertexCounter;
-                level->graphVertices[ this->centerCellPosition ] = this->vertexId;
-                ++level->vertexCounter;
-
+                cluster->vertices.push_back( this->centerCellPosition );
             } // if
 
         } // if
 
-    } else if ( !level->map->gridIllegal( cellPosition ) ) {
+    } else if ( !map->gridIllegal( cellPosition ) ) {
         // partitioning reaches the deeper level
         this->hasFreeCenter = true;
+        this->centerCellPosition = cellPosition;
 
         if ( parentQuad ) {
-            boost::property_map<HPASearch::Graph, HPASearch::VertexPosition>::type position =
-                boost::get( HPASearch::VertexPosition( ), *graph );
-
-            Point realPosition = level->map->unsnap( cellPosition );
-            boost::put( position, level->vertexCounter, math::Vector2( realPosition.first, realPosition.second ) );
-
-            this->vertexId = level->vertexCounter;
-            level->graphVertices[ cellPosition ] = this->vertexId;
-            ++level->vertexCounter;
+            cluster->vertices.push_back( cellPosition );
         } // if
     } // else
 
@@ -198,7 +182,7 @@ void QuadTree::connectQuads( QuadTree* quad1, QuadTree* quad2, bool vertical )
     } // else
 }
 
-void QuadTree::processVertices( const std::vector<unsigned int>& vertices1, const std::vector<unsigned int>& vertices2 )
+void QuadTree::processVertices( const std::vector<GridPoint>& vertices1, const std::vector<GridPoint>& vertices2 )
 {
     unsigned int i;
     unsigned int j;
@@ -207,24 +191,24 @@ void QuadTree::processVertices( const std::vector<unsigned int>& vertices1, cons
     {
         for ( j = 0; j < vertices2.size( ); ++j )
         {
-            // math::Vector2 position1 =
-            boost::get(HPASearch::VertexPosition(), *this->graph, vertices1[i]);
-
-            // math::Vector2 position2 =
-            boost::get(HPASearch::VertexPosition(), *this->graph, vertices2[j]);
+            Point position1 = map->unsnap( vertices1[i] );
+            Point position2 = map->unsnap( vertices2[j] );
+            float distance = ( math::Vector2( position1.first, position1.second ) -
+                               math::Vector2( position2.first, position2.second ) ).length( );
 
-            boost::add_edge(vertices1[i], vertices2[j], 1, *graph);
+            cluster->edges.push_back( HPASearch::ClusterGraph::WeightedEdge(
+                HPASearch::Edge( vertices1[i], vertices2[j] ), distance ) );
         }
     }
 }
 
-std::vector<unsigned int> QuadTree::getVerticesFrom( POSITION position )
+std::vector<GridPoint> QuadTree::getVerticesFrom( POSITION position )
 {
-    std::vector<unsigned int> response;
+    std::vector<GridPoint> response;
     if ( this->hasFreeCenter ) {
-        response.push_back( vertexId );
+        response.push_back( centerCellPosition );
     } else {
-        std::back_insert_iterator< std::vector<unsigned int> > ii( response );
+        std::back_insert_iterator< std::vector<GridPoint> > ii( response );
 
         std::map<POSITION, boost::shared_ptr<QuadTree> >::iterator it;
         for ( it = quads.begin( ); it != quads.end( ); ++it ) {
@@ -233,7 +217,7 @@ std::vector<unsigned int> QuadTree::getVerticesFrom( POSITION position )
                     ( position == LEFT && ( it->first == TOP_LEFT || it->first == BOTTOM_LEFT ) ) ||
                     ( position == TOP && ( it->first == TOP_LEFT || it->first == TOP_RIGHT ) ) ||
                     ( position == BOTTOM && ( it->first == BOTTOM_LEFT || it->first == BOTTOM_RIGHT ) ) ) {
-                std::vector<unsigned int> partialResponse =
+                std::vector<GridPoint> partialResponse =
                     it->second->getVerticesFrom( position );
 
                 std::copy( partialResponse.begin( ), partialResponse.end( ), ii );
@@ -36,8 +36,9 @@ namespace opencog
     {
         /**
          * class QuadTree
-         * Subdivides the grid on a quad tree and builds
-         * a graph that represents the free nodes of the tree
+         * Subdivides the grid of a cluster on a quad tree and builds
+         * a graph that represents the free nodes of the tree, appending
+         * its vertices and edges to the cluster graph
          */
         class QuadTree
         {
@@ -54,8 +55,8 @@ namespace opencog
                 BOTTOM
             };
 
-            QuadTree( HPASearch::Level* level, const GridPoint& cellPosition, 
-                unsigned int clusterSideSize, HPASearch::Graph* graph, 
+            QuadTree( const LocalSpaceMap2D* map, const GridPoint& cellPosition,
+                unsigned int clusterSideSize, HPASearch::ClusterGraph* cluster,
                     QuadTree* parentQuad = 0, GridPoint* currentPosition = 0 );
 
             virtual ~QuadTree( void ) { }
@@ -67,23 +68,22 @@ namespace opencog
             void connectQuads( QuadTree* quad1, QuadTree* quad2, bool vertical );
 
             // connect the two vertices lists with edges
-            void processVertices( const std::vector<unsigned int>& vertices1, const std::vector<unsigned int>& vertices2 );
+            void processVertices( const std::vector<GridPoint>& vertices1, const std::vector<GridPoint>& vertices2 );
 
             // return the vertices at POSITION
-            std::vector<unsigned int> getVerticesFrom( POSITION position );
+            std::vector<GridPoint> getVerticesFrom( POSITION position );
 
-            // if this quad has a free center position, vertexId will be defined
-            unsigned int vertexId;
             unsigned int clusterSideSize;
-            // cell positioned at the center of quad
+            // cell positioned at the center of quad, which is its vertex
+            // if it has a free center
             GridPoint centerCellPosition;
 
             bool hasFreeCenter;
 
             std::map<POSITION, boost::shared_ptr<QuadTree> > quads;
 
-            HPASearch::Graph* graph;
-            HPASearch::Level* level;
+            const LocalSpaceMap2D* map;
+            HPASearch::ClusterGraph* cluster;
         };
 
     } // spatial
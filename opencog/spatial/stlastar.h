@@ -35,6 +35,7 @@
 // stl includes
 #include <algorithm>
 #include <set>
+#include <unordered_set>
 #include <vector>
 
 // fast fixed size memory allocator, used for fast node memory management
@@ -59,6 +60,18 @@ namespace opencog
         using namespace std;
 
         // The AStar search class. UserState is the users state space type
+        //
+        // By default the open and closed lists are indexed by a hash set of the
+        // states, so UserState must also provide
+        //     size_t Hash() const;
+        // consistent with IsSameState. The open list is then an indexed heap, a
+        // node whose cost improves is moved up in place (decrease-key) instead of
+        // being replaced and the whole heap rebuilt. Passing HashedLists = false
+        // to the constructor selects the original linear lookups, to compare
+        // their performance (see AStarBenchmark.cc).
+        //
+        // The same instance may be used for many searches, its node pool and
+        // lists keep their memory from one search to the next.
         template <class UserState> class AStarSearch
             {
 
@@ -91,12 +104,19 @@ namespace opencog
                     float h; // heuristic estimate of distance to goal
                     float f; // sum of cumulative cost of predecessors and self and heuristic
 
+                    // positions in the open and closed lists, -1 if not in them
+                    // (only kept up to date with the hashed lists)
+                    int openIndex;
+                    int closedIndex;
+
                 Node() :
                     parent( 0 ),
                         child( 0 ),
                         g( 0.0f ),
                         h( 0.0f ),
-                        f( 0.0f ) {
+                        f( 0.0f ),
+                        openIndex( -1 ),
+                        closedIndex( -1 ) {
                     }
 
                     UserState m_UserState;
@@ -115,19 +135,43 @@ namespace opencog
                     }
                 };
 
+                // Hash and equality of the states of two nodes, for the hashed lists
+
+                class NodeStateHash
+                {
+                public:
+
+                    size_t operator() ( const Node *x ) const {
+                        return x->m_UserState.Hash();
+                    }
+                };
+
+                class NodeStateEqual
+                {
+                public:
+
+                    bool operator() ( Node *x, Node *y ) const {
+                        return x->m_UserState.IsSameState( y->m_UserState );
+                    }
+                };
+
 
             public: // methods
 
 
                 // constructor just initialises private data
-            AStarSearch( int MaxNodes = 1000 ) :
+            AStarSearch( int MaxNodes = 1000, bool HashedLists = true ) :
                 m_State( SEARCH_STATE_NOT_INITIALISED ),
+                    m_Start( NULL ),
+                    m_Goal( NULL ),
                     m_CurrentSolutionNode( NULL ),
 #if USE_FSA_MEMORY
                     m_FixedSizeAllocator( MaxNodes ),
 #endif
                     m_AllocateNodeCount(0),
-                    m_CancelRequest( false ) {
+                    m_CancelRequest( false ),
+                    m_HashedLists( HashedLists ),
+                    m_ApproxOptimalNode( NULL ) {
 
                 }
 
@@ -142,7 +186,13 @@ namespace opencog
 
                 // Set Start and goal states
                 void SetStartAndGoalStates( UserState &Start, UserState &Goal ) {
+                    // A search left unfinished gives its nodes back to the pool
+                    if ( m_State == SEARCH_STATE_SEARCHING ) {
+                        FreeAllNodes();
+                    }
+
                     m_CancelRequest = false;
+                    m_ApproxOptimalNode = NULL;
 
                     m_Start = AllocateNode();
                     m_Goal = AllocateNode();
@@ -164,10 +214,15 @@ namespace opencog
 
                     // Push the start node on the Open list
 
-                    m_OpenList.push_back( m_Start ); // heap now unsorted
+                    if ( m_HashedLists ) {
+                        m_NodeSet.insert( m_Start );
+                        PushOpen( m_Start );
+                    } else {
+                        m_OpenList.push_back( m_Start ); // heap now unsorted
 
-                    // Sort back element into heap
-                    push_heap( m_OpenList.begin(), m_OpenList.end(), HeapCompare_f() );
+                        // Sort back element into heap
+                        push_heap( m_OpenList.begin(), m_OpenList.end(), HeapCompare_f() );
+                    }
 
                     // Initialise counter for search steps
                     m_Steps = 0;
@@ -202,9 +257,14 @@ namespace opencog
                     m_Steps ++;
 
                     // Pop the best node (the one with the lowest f)
-                    Node *n = m_OpenList.front(); // get pointer to the node
-                    pop_heap( m_OpenList.begin(), m_OpenList.end(), HeapCompare_f() );
-                    m_OpenList.pop_back();
+                    Node *n;
+                    if ( m_HashedLists ) {
+                        n = PopOpen();
+                    } else {
+                        n = m_OpenList.front(); // get pointer to the node
+                        pop_heap( m_OpenList.begin(), m_OpenList.end(), HeapCompare_f() );
+                        m_OpenList.pop_back();
+                    }
 
                     m_ApproxOptimalNode = n;
 
@@ -275,6 +335,11 @@ namespace opencog
                             //  The g value for this successor ...
                             float newg = n->g + n->m_UserState.GetCost( (*successor)->m_UserState );
 
+                            if ( m_HashedLists ) {
+                                AddHashedSuccessor( n, *successor, newg );
+                                continue;
+                            }
+
                             // Now we need to find whether the node is on the open or closed lists
                             // If it is but the node that is already on them is better (lower g)
                             // then we can forget about this successor
@@ -324,50 +389,55 @@ namespace opencog
 
                             // This node is the best node so far with this particular state
                             // so lets keep it and set up its AStar specific data ...
+                            //
+                            // A node already on open or closed is updated in place rather
+                            // than replaced by the successor: a closed node is the parent of
+                            // other nodes, which would be left pointing at a freed one.
 
-                            (*successor)->parent = n;
-                            (*successor)->g = newg;
-                            (*successor)->h = (*successor)->m_UserState.GoalDistanceEstimate( m_Goal->m_UserState );
-                            (*successor)->f = (*successor)->g + (*successor)->h;
-
-                            // Remove successor from closed if it was on it
+                            Node *node = (*successor);
 
                             if ( closedlist_result != m_ClosedList.end() ) {
-                                // remove it from Closed
-                                FreeNode(  (*closedlist_result) );
+                                // remove it from Closed, it goes back on Open
+                                node = (*closedlist_result);
+                                FreeNode( (*successor) );
                                 m_ClosedList.erase( closedlist_result );
 
                                 // Fix thanks to ...
                                 // Greg Douglas <gregdouglasmail@gmail.com>
                                 // who noticed that this code path was incorrect
                                 // Here we have found a new state which is already CLOSED
-                                // anus 
 
+                            } else if ( openlist_result != m_OpenList.end() ) {
+                                node = (*openlist_result);
+                                FreeNode( (*successor) );
                             }
 
+                            node->parent = n;
+                            node->g = newg;
+                            node->h = node->m_UserState.GoalDistanceEstimate( m_Goal->m_UserState );
+                            node->f = node->g + node->h;
+
                             // Update old version of this node
                             if ( openlist_result != m_OpenList.end() ) {
 
-                                FreeNode( (*openlist_result) );
-                                m_OpenList.erase( openlist_result );
-
                                 // re-make the heap
                                 // make_heap rather than sort_heap is an essential bug fix
                                 // thanks to Mike Ryynanen for pointing this out and then explaining
                                 // it in detail. sort_heap called on an invalid heap does not work
                                 make_heap( m_OpenList.begin(), m_OpenList.end(), HeapCompare_f() );
-                                
-                            }
 
-                            // heap now unsorted
-                            m_OpenList.push_back( (*successor) );
+                            } else {
+                                // heap now unsorted
+                                m_OpenList.push_back( node );
 
-                            // sort back element into heap
-                            push_heap( m_OpenList.begin(), m_OpenList.end(), HeapCompare_f() );
+                                // sort back element into heap
+                                push_heap( m_OpenList.begin(), m_OpenList.end(), HeapCompare_f() );
+                            }
                         }
 
                         // push n onto Closed, as we have expanded it now
 
+                        n->closedIndex = m_ClosedList.size();
                         m_ClosedList.push_back( n );
 
                         
@@ -592,6 +662,115 @@ namespace opencog
 
             private: // methods
 
+                // Hashed lists: keeps the successor of n if its state has not been
+                // reached yet, or updates the node that has it if newg is cheaper
+                void AddHashedSuccessor( Node *n, Node *successor, float newg ) {
+                    typename NodeSet::iterator found = m_NodeSet.find( successor );
+
+                    if ( found == m_NodeSet.end() ) {
+                        successor->parent = n;
+                        successor->g = newg;
+                        successor->h = successor->m_UserState.GoalDistanceEstimate( m_Goal->m_UserState );
+                        successor->f = successor->g + successor->h;
+
+                        m_NodeSet.insert( successor );
+                        PushOpen( successor );
+                        return;
+                    }
+
+                    // the state is on open or closed already, the successor is not needed
+                    Node *node = *found;
+                    FreeNode( successor );
+
+                    if ( node->g <= newg ) {
+                        return;
+                    }
+
+                    // same state, same heuristic estimate
+                    node->parent = n;
+                    node->g = newg;
+                    node->f = node->g + node->h;
+
+                    if ( node->openIndex >= 0 ) {
+                        SiftUp( node->openIndex );
+                    } else {
+                        if ( node->closedIndex >= 0 ) {
+                            RemoveClosed( node );
+                        }
+                        PushOpen( node );
+                    }
+                }
+
+                // Indexed heap operations on the open list, for the hashed lists
+                void PushOpen( Node *node ) {
+                    m_OpenList.push_back( node );
+                    SiftUp( m_OpenList.size() - 1 );
+                }
+
+                Node *PopOpen() {
+                    Node *top = m_OpenList.front();
+                    Node *last = m_OpenList.back();
+                    m_OpenList.pop_back();
+
+                    if ( !m_OpenList.empty() ) {
+                        m_OpenList[0] = last;
+                        SiftDown( 0 );
+                    }
+
+                    top->openIndex = -1;
+                    return top;
+                }
+
+                void SiftUp( size_t index ) {
+                    Node *node = m_OpenList[index];
+
+                    while ( index > 0 ) {
+                        size_t parent = (index - 1) / 2;
+                        if ( m_OpenList[parent]->f <= node->f ) {
+                            break;
+                        }
+                        m_OpenList[index] = m_OpenList[parent];
+                        m_OpenList[index]->openIndex = index;
+                        index = parent;
+                    }
+
+                    m_OpenList[index] = node;
+                    node->openIndex = index;
+                }
+
+                void SiftDown( size_t index ) {
+                    Node *node = m_OpenList[index];
+                    size_t size = m_OpenList.size();
+
+                    while ( true ) {
+                        size_t child = 2 * index + 1;
+                        if ( child >= size ) {
+                            break;
+                        }
+                        if ( child + 1 < size && m_OpenList[child + 1]->f < m_OpenList[child]->f ) {
+                            child ++;
+                        }
+                        if ( node->f <= m_OpenList[child]->f ) {
+                            break;
+                        }
+                        m_OpenList[index] = m_OpenList[child];
+                        m_OpenList[index]->openIndex = index;
+                        index = child;
+                    }
+
+                    m_OpenList[index] = node;
+                    node->openIndex = index;
+                }
+
+                // Takes a node off the closed list by moving the last one in its place
+                void RemoveClosed( Node *node ) {
+                    Node *last = m_ClosedList.back();
+                    m_ClosedList[node->closedIndex] = last;
+                    last->closedIndex = node->closedIndex;
+                    m_ClosedList.pop_back();
+                    node->closedIndex = -1;
+                }
+
                 // This is called when a search fails or is cancelled to free all used
                 // memory
                 void FreeAllNodes() {
@@ -616,6 +795,7 @@ namespace opencog
                     }
 
                     m_ClosedList.clear();
+                    m_NodeSet.clear();
 
                     // delete the goal
 
@@ -657,6 +837,7 @@ namespace opencog
                     }
 
                     m_ClosedList.clear();
+                    m_NodeSet.clear();
 
                 }
 
@@ -699,6 +880,10 @@ namespace opencog
                 // Closed list is a vector.
                 vector< Node * > m_ClosedList;
 
+                // Nodes on the open and closed lists by state, with the hashed lists
+                typedef unordered_set< Node *, NodeStateHash, NodeStateEqual > NodeSet;
+                NodeSet m_NodeSet;
+
                 // Successors is a vector filled out by the user each type successors to a node
                 // are generated
                 vector< Node * > m_Successors;
@@ -730,6 +915,9 @@ namespace opencog
 
                 bool m_CancelRequest;
 
+                // whether the lists are indexed by hashed states
+                bool m_HashedLists;
+
                 Node *m_ApproxOptimalNode;
                 vector<UserState> m_ApproxSolution;
             };
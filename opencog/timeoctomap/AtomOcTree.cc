@@ -48,6 +48,25 @@ AtomOcTree::setNodeData(const OcTreeKey& key, const opencog::Handle& r)
     }
     return n;
 }
+
+void
+AtomOcTree::recycle()
+{
+    if (this->root != nullptr) recycleRecurs(this->root);
+}
+
+void
+AtomOcTree::recycleRecurs(AtomOcTreeNode* node)
+{
+    node->setData(UndefinedHandle);
+    //a log odds of 0 is an occupancy of 0.5, which is occupied, the
+    //recycled nodes are known to be free instead
+    node->setLogOdds(this->clamping_thres_min);
+    if (!node->hasChildren()) return;
+    for (unsigned int i = 0; i < 8; i++) {
+        if (node->childExists(i)) recycleRecurs(node->getChild(i));
+    }
+}
 /* This may not be required ..
   template <class T>
   void AtomOcTree<T>::updateInnerOccupancy() {
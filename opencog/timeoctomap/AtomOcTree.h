@@ -71,8 +71,21 @@ public:
     // update inner nodes, sets dat to average child dat
     void updateInnerOccupancy() {}
 
+    // resets the dat of all nodes and makes them free, but keeps them
+    // allocated, so that a tree of a mostly static scene can be refilled
+    // without allocating any node
+    void recycle();
+
+    // a node reset by recycle(), or cleared by misses, with no atom
+    bool isRecycled(const AtomOcTreeNode* node) const
+    {
+        return node->getData() == UndefinedHandle &&
+               node->getLogOdds() <= this->clamping_thres_min;
+    }
+
 
 protected:
+    void recycleRecurs(AtomOcTreeNode* node);
     ////void updateInnerOccupancyRecurs(AtomOcTreeNode<T>* node, unsigned int depth);
 
     /**
@@ -35,10 +35,14 @@
 //#include <assert.h>
 #include "opencog/util/oc_assert.h"
 
+//nodes an evicted tree may keep for the next time unit, some tens of MB
+#define DEFAULT_RECYCLED_TREE_LIMIT (1 << 20)
+
 TimeOctomap::TimeOctomap(unsigned int num_time_units,
                          double map_res_meters,
                          duration_c time_resolution):
-             auto_step(false),map_res(map_res_meters),time_res(time_resolution),created_once(false),time_circle(num_time_units)
+             auto_step(false),map_res(map_res_meters),time_res(time_resolution),created_once(false),time_circle(num_time_units),
+             carry_over(false),recycled_tree_limit(DEFAULT_RECYCLED_TREE_LIMIT)
 {
 
 }
@@ -93,10 +97,16 @@ TimeOctomap::step_time_unit()
          time_p=std::chrono::system_clock::now();
     }
 
-    TimeUnit temp(time_p, duration);
-    time_circle.push_back(temp);
-    int i = time_circle.capacity() - 1;
-    if (time_circle.size() < time_circle.capacity()) i = time_circle.size() - 1;
+    if (time_circle.full()) {
+        //the oldest time unit becomes the newest, without freeing its tree
+        unindex_time_unit(time_circle.front());
+        time_circle.front().recycle(time_p, duration, recycled_tree_limit);
+        if (time_circle.size() > 1) time_circle.rotate(time_circle.begin() + 1);
+    } else {
+        TimeUnit temp(time_p, duration);
+        time_circle.push_back(temp);
+    }
+    int i = time_circle.size() - 1;
     /*
     for_each( map_res.begin(), map_res.end(), [&](pair<int, double> handle) {
         time_circle[i].map_tree[handle.first].setResolution(handle.second);
@@ -104,6 +114,8 @@ TimeOctomap::step_time_unit()
     );
     */
     time_circle[i].map_tree.setResolution(map_res);
+    if (carry_over && i > 0)
+        carry_over_time_unit(time_circle[i - 1], time_circle[i]);
 
     curr_time = time_p;
     curr_duration = duration;
@@ -127,6 +139,41 @@ TimeOctomap::auto_step_time(bool astep)
     else g_thread.join();
 }
 
+bool
+TimeOctomap::is_carry_over_atoms_on()
+{
+    return carry_over;
+}
+
+void
+TimeOctomap::carry_over_atoms(bool carry)
+{
+    std::lock_guard<std::mutex> lgm(mtx);
+    carry_over = carry;
+}
+
+void
+TimeOctomap::set_recycled_tree_limit(size_t max_nodes)
+{
+    std::lock_guard<std::mutex> lgm(mtx);
+    recycled_tree_limit = max_nodes;
+}
+
+void
+TimeOctomap::carry_over_time_unit(TimeUnit& from, TimeUnit& to)
+{
+    //in a recycled tree, the nodes of a static scene are there already
+    for (auto& atom_keys : from.atom_keys) {
+        for (const OcTreeKey& key : atom_keys.second) {
+            AtomOcTreeNode* node = from.map_tree.search(key);
+            if (node == nullptr || node->getData() != atom_keys.first) continue;
+            to.map_tree.setNodeValue(key, node->getLogOdds(), true);
+            to.map_tree.setNodeData(key, atom_keys.first);
+            index_atom(to, atom_keys.first, key);
+        }
+    }
+}
+
 void
 TimeOctomap::auto_timer()
 {
@@ -142,17 +189,72 @@ TimeOctomap::auto_timer()
     });//.detach();
 }
 
+TimeUnit&
+TimeOctomap::current_time_unit()
+{
+    int i = time_circle.capacity() - 1;
+    if (time_circle.size() < time_circle.capacity()) i = time_circle.size() - 1;
+    return time_circle[i];
+}
+
+void
+TimeOctomap::index_atom(TimeUnit& tu, const opencog::Handle& ato,
+                        const OcTreeKey& key)
+{
+    KeySet& keys = tu.atom_keys[ato];
+    if (keys.empty()) atom_times[ato].insert(tu.t);
+    keys.insert(key);
+}
+
+void
+TimeOctomap::unindex_atom(TimeUnit& tu, const opencog::Handle& ato,
+                          const OcTreeKey& key)
+{
+    auto it = tu.atom_keys.find(ato);
+    if (it == tu.atom_keys.end()) return;
+    it->second.erase(key);
+    if (!it->second.empty()) return;
+    tu.atom_keys.erase(it);
+    auto itt = atom_times.find(ato);
+    if (itt == atom_times.end()) return;
+    itt->second.erase(tu.t);
+    if (itt->second.empty()) atom_times.erase(itt);
+}
+
+void
+TimeOctomap::unindex_time_unit(TimeUnit& tu)
+{
+    for (auto& atom_keys : tu.atom_keys) {
+        auto itt = atom_times.find(atom_keys.first);
+        if (itt == atom_times.end()) continue;
+        itt->second.erase(tu.t);
+        if (itt->second.empty()) atom_times.erase(itt);
+    }
+    tu.atom_keys.clear();
+}
+
 bool
 TimeOctomap::put_atom_at_current_time(const point3d location,
                                         const opencog::Handle& ato)
 {
     std::lock_guard<std::mutex> lgm(mtx);
     OC_ASSERT(created_once);
-    int i = time_circle.capacity() - 1;
-    if (time_circle.size() < time_circle.capacity()) i = time_circle.size() - 1;
+    TimeUnit& tu = current_time_unit();
     //if (!time_circle[i].has_map(handle)) return false;//may assert too
-    time_circle[i].map_tree.updateNode(location, true);
-    time_circle[i].map_tree.setNodeData(location, ato);
+    OcTreeKey key;
+    if (!tu.map_tree.coordToKeyChecked(location, key)) return false;
+    AtomOcTreeNode* node = tu.map_tree.search(key);
+    if (node != nullptr && node->getData() != UndefinedHandle &&
+        node->getData() != ato)
+        unindex_atom(tu, node->getData(), key);
+    //lazy update: pruning would drop the atoms of the merged nodes
+    //a recycled node gets the occupancy of a new node after one hit
+    if (node != nullptr && tu.map_tree.isRecycled(node))
+        tu.map_tree.setNodeValue(key, tu.map_tree.getProbHitLog(), true);
+    else
+        tu.map_tree.updateNode(key, true, true);
+    tu.map_tree.setNodeData(key, ato);
+    index_atom(tu, ato, key);
     return true;
 }
 
@@ -162,10 +264,9 @@ TimeOctomap::remove_atom_at_current_time_by_location(
 {
     OC_ASSERT(created_once);
     std::lock_guard<std::mutex> lgm(mtx);
-    int i = time_circle.capacity() - 1;
-    if (time_circle.size() < time_circle.capacity()) i = time_circle.size() - 1;
     //time_circle[i].map_tree[map_handle].setNodeData(location,UndefinedHandle);
-    time_circle[i].map_tree.updateNode(location, false);
+    //the atom is kept in the node, and in the indexes
+    current_time_unit().map_tree.updateNode(location, false, true);
     return true;
 }
 
@@ -182,7 +283,7 @@ TimeOctomap::remove_atom_at_time_by_location(time_pt tp,
     auto it = find (tp);
     if (it == nullptr) return false;
     //it->map_tree[map_handle].setNodeData(location,UndefinedHandle);
-    it->map_tree.updateNode(location, false);
+    it->map_tree.updateNode(location, false, true);
     return true;
 }
 
@@ -255,24 +356,10 @@ TimeOctomap::get_times_of_atom_occurence_in_map(const opencog::Handle& ato)
 {
     std::lock_guard<std::mutex> lgm(mtx);
     time_list tl;
-    for(auto tu = std::begin(time_circle), end = std::end(time_circle);
-        (tu != end);
-        tu++) {
-        bool found = false;
-        //go through all nodes and leafs of octomap to search atom
-        for(AtomOcTree::tree_iterator it =
-            tu->map_tree.begin_tree(),
-            end = tu->map_tree.end_tree();
-            it != end;
-            ++it) {
-            //
-            if (it->getData() == ato) {
-                found = true;
-                break;
-            }
-        }
-        if (found) tl.push_back(tu->t);
-    }
+    auto itt = atom_times.find(ato);
+    if (itt == atom_times.end()) return tl;
+    //already sorted by time
+    tl.assign(itt->second.begin(), itt->second.end());
     return tl;
 }//ok
 //get the first atom from the elapse from now
@@ -385,26 +472,28 @@ bool TimeOctomap::get_last_locations_of_atom_observed(const opencog::Handle& ato
   return true;
 }
 
+point3d_list
+TimeOctomap::get_locations_in_time_unit(TimeUnit& tu,
+                                        const opencog::Handle& ato)
+{
+    point3d_list pl;
+    auto it = tu.atom_keys.find(ato);
+    if (it == tu.atom_keys.end()) return pl;
+    for (const OcTreeKey& key : it->second) {
+        AtomOcTreeNode* node = tu.map_tree.search(key);
+        if (node != nullptr && node->getData() == ato)
+            pl.push_back(tu.map_tree.keyToCoord(key));
+    }
+    return pl;
+}
+
 point3d_list
 TimeOctomap::get_locations_of_atom_occurence_now(
                                               const opencog::Handle& ato)
 {
     OC_ASSERT(created_once);
     std::lock_guard<std::mutex> lgm(mtx);
-    point3d_list pl;
-    int i = time_circle.capacity() - 1;
-    if (time_circle.size() < time_circle.capacity())
-        i = time_circle.size() - 1;
-    for(AtomOcTree::tree_iterator it =
-        time_circle[i].map_tree.begin_tree(),
-        end = time_circle[i].map_tree.end_tree();
-        it != end;
-        ++it) {
-        //
-        if (it->getData() == ato)
-            pl.push_back(it.getCoordinate());
-    }
-    return pl;
+    return get_locations_in_time_unit(current_time_unit(), ato);
 }//ok
 
 TimeUnit *
@@ -425,7 +514,6 @@ TimeOctomap::get_locations_of_atom_occurence_at_time(const time_pt& time_p,
 {
     OC_ASSERT(created_once);
     std::lock_guard<std::mutex> lgm(mtx);
-    point3d_list pl;
     /*
     auto it = std::find(std::begin(time_circle),
                         std::end(time_circle),
@@ -434,51 +522,39 @@ TimeOctomap::get_locations_of_atom_occurence_at_time(const time_pt& time_p,
     */
     TimeUnit * it = find(time_p);
     if (it == nullptr) return point3d_list();
-    for(AtomOcTree::tree_iterator ita =
-        it->map_tree.begin_tree(),
-        end = it->map_tree.end_tree();
-        ita != end;
-        ++ita) {
-        //
-        if (ita->getData() == ato)
-            pl.push_back(ita.getCoordinate());
-    }
-    return pl;
+    return get_locations_in_time_unit(*it, ato);
 }//ok
 
+void
+TimeOctomap::remove_atom_from_time_unit(TimeUnit& tu, const opencog::Handle& ato)
+{
+    auto it = tu.atom_keys.find(ato);
+    if (it == tu.atom_keys.end()) return;
+    for (const OcTreeKey& key : it->second) {
+        AtomOcTreeNode* node = tu.map_tree.search(key);
+        if (node == nullptr || node->getData() != ato) continue;
+        node->setData(UndefinedHandle);
+        tu.map_tree.deleteNode(key);
+    }
+    tu.atom_keys.erase(it);
+
+    auto itt = atom_times.find(ato);
+    if (itt == atom_times.end()) return;
+    itt->second.erase(tu.t);
+    if (itt->second.empty()) atom_times.erase(itt);
+}
+
 void
 TimeOctomap::remove_atom_at_current_time(const opencog::Handle& ato)
 {
     std::lock_guard<std::mutex> lgm(mtx);
-    point3d_list pl;
-    int i = time_circle.capacity() - 1;
-    if (time_circle.size() < time_circle.capacity())
-        i = time_circle.size() - 1;
-    auto* tu=&time_circle[i];
-            for(AtomOcTree::tree_iterator it2 =
-                tu->map_tree.begin_tree(),
-                endit2 = tu->map_tree.end_tree();
-                it2 != endit2;
-                ++it2) {
-                if (it2->getData() == ato) {
-                    pl.push_back(it2.getCoordinate());
-                    it2->setData(UndefinedHandle);
-                }
-            }
-
-            //cout<<"remove size="<<pl.size()<<endl;
-            for(auto it3 = std::begin(pl), endit3 = std::end(pl);
-                it3 != endit3;
-                it3++) {
-                tu->map_tree.deleteNode(*it3);
-            }
+    remove_atom_from_time_unit(current_time_unit(), ato);
 }
 
 void
 TimeOctomap::remove_atom_at_time(const time_pt& time_p,const opencog::Handle& ato)
 {
     std::lock_guard<std::mutex> lgm(mtx);
-    point3d_list pl;
     /*
     auto tu = std::find(std::begin(time_circle),
                         std::end(time_circle),
@@ -487,56 +563,23 @@ TimeOctomap::remove_atom_at_time(const time_pt& time_p,const opencog::Handle& at
     */
     auto tu = find(time_p);
     if (tu == nullptr) return;
-            for(AtomOcTree::tree_iterator it2 =
-                tu->map_tree.begin_tree(),
-                endit2 = tu->map_tree.end_tree();
-                it2 != endit2;
-                ++it2) {
-                if (it2->getData() == ato) {
-                    pl.push_back(it2.getCoordinate());
-                    it2->setData(UndefinedHandle);
-                }
-            }
-
-            //cout<<"remove size="<<pl.size()<<endl;
-            for(auto it3 = std::begin(pl), endit3 = std::end(pl);
-                it3 != endit3;
-                it3++) {
-                tu->map_tree.deleteNode(*it3);
-            }
+    remove_atom_from_time_unit(*tu, ato);
 }
 
 void
 TimeOctomap::remove_atom(const opencog::Handle& ato)
 {
-  std::lock_guard<std::mutex> lgm(mtx);
+    std::lock_guard<std::mutex> lgm(mtx);
     //remove all occurences of atom in all maps at all times
-    point3d_list pl;
-    for(auto tu = std::begin(time_circle),
-        end = std::end(time_circle);
-        (tu != end);
-        tu++) {
-            pl.clear();
-            for(AtomOcTree::tree_iterator it2 =
-                tu->map_tree.begin_tree(),
-                endit2 = tu->map_tree.end_tree();
-                it2 != endit2;
-                ++it2) {
-                if (it2->getData() == ato) {
-                    pl.push_back(it2.getCoordinate());
-                    it2->setData(UndefinedHandle);
-                }
-            }
-
-            //cout<<"remove size="<<pl.size()<<endl;
-            for(auto it3 = std::begin(pl), endit3 = std::end(pl);
-                it3 != endit3;
-                it3++) {
-                tu->map_tree.deleteNode(*it3);
-            }
-
+    auto itt = atom_times.find(ato);
+    if (itt == atom_times.end()) return;
+    std::set<time_pt> times = itt->second;
+    for (const time_pt& t : times) {
+        TimeUnit* tu = find(t);
+        if (tu != nullptr) remove_atom_from_time_unit(*tu, ato);
     }
-}//hacked not perfect
+    atom_times.erase(ato);
+}
 
 //////spatial relations
 //later instead of get a location, use get nearest location or get furthest location
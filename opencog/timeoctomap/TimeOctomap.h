@@ -41,7 +41,9 @@
 #include <boost/circular_buffer.hpp>
 #include <list>
 #include <map>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <chrono>
 #include <algorithm>
 #include <cmath>
@@ -63,10 +65,14 @@ typedef list<time_pt> time_list;
 #define NEAR_ANGLE DEG2RAD(20.0)
 
 //data structures
+//the keys of the map_tree nodes holding each atom
+typedef std::unordered_map<opencog::Handle, KeySet, opencog::handle_hash> AtomKeysMap;
+
 struct TimeUnit
 {
     time_pt t; duration_c duration;
     AtomOcTree map_tree;
+    AtomKeysMap atom_keys;
     TimeUnit(time_pt tp, duration_c d): t(tp), duration(d)
     {}
     bool operator==(time_pt tp)
@@ -78,9 +84,20 @@ struct TimeUnit
     {
         t=tu.t; duration=tu.duration;
         map_tree.clear();
+        atom_keys.clear();
         return *this;
     }
 
+    //reuse for a new time range, the nodes of map_tree stay allocated
+    //unless there are more than max_nodes of them
+    void recycle(time_pt tp, duration_c d, size_t max_nodes)
+    {
+        t=tp; duration=d;
+        atom_keys.clear();
+        if (map_tree.size() > max_nodes) map_tree.clear();
+        else map_tree.recycle();
+    }
+
     //>,< not needed as only == search happens although created buffer should always be sorted, just simplifies a bit over search speed cost
 };
 
@@ -106,6 +123,13 @@ public:
     bool step_time_unit();//step_time_unit
     bool is_auto_step_time_on();
     void auto_step_time(bool astep);
+    //a new time unit starts with the atoms of the previous one,
+    //for mostly static scenes
+    bool is_carry_over_atoms_on();
+    void carry_over_atoms(bool carry);
+    //an evicted time unit keeps its tree nodes for the next one,
+    //unless it has more than max_nodes
+    void set_recycled_tree_limit(size_t max_nodes);
     //store an atom at coordinates in map
     bool put_atom_at_current_time(const point3d location,
                               const opencog::Handle& ato);
@@ -199,6 +223,19 @@ private:
     time_pt curr_time; duration_c curr_duration;
     bool created_once;
     void auto_timer();
+    //reverse indexes, kept up to date by the put and remove functions
+    //so that atom queries never walk the map trees:
+    //the time units each atom is in, by their start time point
+    std::unordered_map<opencog::Handle, std::set<time_pt>, opencog::handle_hash> atom_times;
+    bool carry_over;
+    size_t recycled_tree_limit;
+    TimeUnit& current_time_unit();
+    void carry_over_time_unit(TimeUnit& from, TimeUnit& to);
+    void index_atom(TimeUnit& tu, const opencog::Handle& ato, const OcTreeKey& key);
+    void unindex_atom(TimeUnit& tu, const opencog::Handle& ato, const OcTreeKey& key);
+    void unindex_time_unit(TimeUnit& tu);
+    void remove_atom_from_time_unit(TimeUnit& tu, const opencog::Handle& ato);
+    point3d_list get_locations_in_time_unit(TimeUnit& tu, const opencog::Handle& ato);
     bool auto_step;
     std::mutex mtx,mtx_auto;
     std::thread g_thread;